@@ -0,0 +1,491 @@
+/*
+ * Arrow IPC 文件输出，见 arrow.h
+ *
+ * 文件依次是 "ARROW1\0\0"、Schema 消息、各 RecordBatch 消息、结束标记、Footer、Footer 的长度和 "ARROW1"
+ * 每个消息是 0xFFFFFFFF、元数据长度、Message（flatbuffer，补到 8 字节对齐）和消息体，消息体中各缓冲区按 8 字节对齐
+ * 用到的 flatbuffers 表（Schema.fbs、Message.fbs、File.fbs），括号中是字段号：
+ *   Message     { version(0): short; header(1, 2): MessageHeader; bodyLength(3): long; }
+ *   Schema      { fields(1): [Field]; }
+ *   Field       { name(0): string; nullable(1): bool; type(2, 3): Type; children(5): [Field]; custom_metadata(6): [KeyValue]; }
+ *   KeyValue    { key(0): string; value(1): string; }
+ *   Int         { bitWidth(0): int; is_signed(1): bool; }
+ *   FloatingPoint { precision(0): short; }
+ *   FixedSizeList { listSize(0): int; }
+ *   RecordBatch { length(0): long; nodes(1): [FieldNode]; buffers(2): [Buffer]; }
+ *   Footer      { version(0): short; schema(1): Schema; dictionaries(2): [Block]; recordBatches(3): [Block]; }
+ * 没有空值，各列的有效位图都是长度为 0 的缓冲区
+ */
+
+#define _GNU_SOURCE  // asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+
+#include "arrow.h"
+#include "fb.h"
+#include "obuf.h"
+
+#define METADATA_V5 4
+
+// MessageHeader 联合的标签
+#define HEADER_SCHEMA 1
+#define HEADER_RECORD_BATCH 3
+
+// Type 联合的标签
+#define TYPE_NULL 1
+#define TYPE_INT 2
+#define TYPE_FLOATING_POINT 3
+#define TYPE_UTF8 5
+#define TYPE_LIST 12
+#define TYPE_FIXED_SIZE_LIST 16
+
+#define PRECISION_SINGLE 1
+#define PRECISION_DOUBLE 2
+
+#define GEOM_NODES 4  // 几何列的 FieldNode 数：多边形、环、点、坐标
+#define GEOM_BUFFERS 7
+
+static const char magic[8] = "ARROW1\0";
+
+/*
+ * Schema 中的一个字段
+ */
+struct field {
+    const char *name;
+    int type;  // TYPE_*
+    int param;  // Int 的位数，FloatingPoint 的精度，FixedSizeList 的长度
+    int nullable;
+    const struct field *child;  // List、FixedSizeList 的元素，其它为 NULL
+    const char *ext_meta;  // geoarrow.polygon 的扩展元数据，NULL 表示不是扩展类型
+};
+
+static const struct field xy_field = {"xy", TYPE_FLOATING_POINT, PRECISION_DOUBLE, 0, NULL, NULL};
+static const struct field vertices_field = {"vertices", TYPE_FIXED_SIZE_LIST, 2, 0, &xy_field, NULL};
+static const struct field rings_field = {"rings", TYPE_LIST, 0, 0, &vertices_field, NULL};
+
+/*
+ * 一个属性列当前批的值
+ */
+struct arrow_col {
+    int type;  // ARROW_*
+    struct sbuf offsets;  // ARROW_UTF8 各值在 data 中的开始位置，int32，比行数多一个
+    struct sbuf data;
+};
+
+/*
+ * RecordBatch 中的 FieldNode 和 Buffer，文件中的格式
+ */
+struct node {
+    int64_t length;
+    int64_t null_count;
+};
+
+struct buffer {
+    int64_t offset;
+    int64_t length;
+};
+
+/*
+ * Footer 中的 Block，文件中的格式
+ */
+struct block {
+    int64_t offset;
+    int32_t meta_len;  // 包括 0xFFFFFFFF 和长度
+    int32_t pad;
+    int64_t body_len;
+};
+
+struct arrow_writer {
+    struct obuf ob;
+    struct field *fields;  // 属性列和几何列
+    int num_cols;  // 属性列数
+    struct arrow_col *cols;
+    long rows;  // 当前批的行数
+    size_t bytes;  // 当前批各列的字节数
+    struct sbuf poly_offsets;  // 几何列：各多边形第一个环的序号，int32
+    struct sbuf ring_offsets;  // 各环第一点的序号，int32
+    struct sbuf coords;  // 交错存放的坐标
+    int32_t num_rings;  // 当前批的环数
+    int32_t num_points;  // 当前批的点数
+    struct node *nodes;  // 写 RecordBatch 用
+    struct buffer *buffers;
+    const void **bodies;  // 各缓冲区的内容
+    struct sbuf msg;  // 编码消息用
+    struct sbuf blocks;  // 各 RecordBatch 的 Block
+};
+
+static void enc_field(struct sbuf *sb, size_t b0, size_t ref, const struct field *f);
+
+static void
+enc_key_value(struct sbuf *sb, size_t b0, size_t ref, const char *key, const char *value) {
+    size_t vt, k, v;
+
+    vt = fb_vtable(sb, b0, (const uint16_t[]){4, 8}, 2, 12);
+    fb_table(sb, b0, 4, ref, vt);
+    k = fb_ref(sb);
+    v = fb_ref(sb);
+    fb_string(sb, b0, k, key, strlen(key));
+    fb_string(sb, b0, v, value, strlen(value));
+}
+
+static void
+enc_type(struct sbuf *sb, size_t b0, size_t ref, const struct field *f) {
+    size_t vt;
+
+    switch (f->type) {
+    case TYPE_INT:
+        vt = fb_vtable(sb, b0, (const uint16_t[]){4, 8}, 2, 12);
+        fb_table(sb, b0, 4, ref, vt);
+        fb_i32(sb, f->param);
+        fb_u32(sb, 1);  // is_signed
+        break;
+    case TYPE_FLOATING_POINT:
+        vt = fb_vtable(sb, b0, (const uint16_t[]){4}, 1, 8);
+        fb_table(sb, b0, 4, ref, vt);
+        fb_u16(sb, (uint16_t)f->param);
+        fb_u16(sb, 0);
+        break;
+    case TYPE_FIXED_SIZE_LIST:
+        vt = fb_vtable(sb, b0, (const uint16_t[]){4}, 1, 8);
+        fb_table(sb, b0, 4, ref, vt);
+        fb_i32(sb, f->param);
+        break;
+    default:  // 没有字段的表
+        vt = fb_vtable(sb, b0, NULL, 0, 4);
+        fb_table(sb, b0, 4, ref, vt);
+    }
+}
+
+static void
+enc_field(struct sbuf *sb, size_t b0, size_t ref, const struct field *f) {
+    size_t vt, name, type, children, metadata, child = 0;
+
+    vt = fb_vtable(sb, b0, (const uint16_t[]){4, 20, 21, 8, 0, 12, f->ext_meta ? 16 : 0}, 7, 24);
+    fb_table(sb, b0, 4, ref, vt);
+    name = fb_ref(sb);
+    type = fb_ref(sb);
+    children = fb_ref(sb);
+    metadata = fb_ref(sb);  // 不是扩展类型时不用
+    fb_u8(sb, (uint8_t)f->nullable);
+    fb_u8(sb, (uint8_t)f->type);
+    fb_u16(sb, 0);
+
+    fb_string(sb, b0, name, f->name, strlen(f->name));
+    enc_type(sb, b0, type, f);
+    fb_vector(sb, b0, children, 4, f->child ? 1 : 0);
+    if (f->child) {
+        child = fb_ref(sb);
+    }
+    if (f->ext_meta) {
+        size_t kv[2];
+
+        fb_vector(sb, b0, metadata, 4, 2);
+        kv[0] = fb_ref(sb);
+        kv[1] = fb_ref(sb);
+        enc_key_value(sb, b0, kv[0], "ARROW:extension:name", "geoarrow.polygon");
+        enc_key_value(sb, b0, kv[1], "ARROW:extension:metadata", f->ext_meta);
+    }
+    if (f->child) {
+        enc_field(sb, b0, child, f->child);
+    }
+}
+
+static void
+enc_schema(struct sbuf *sb, size_t b0, size_t ref, struct arrow_writer *w) {
+    int n = w->num_cols + 1;
+    size_t vt, fields;
+    size_t *refs = malloc(n * sizeof(*refs));
+
+    vt = fb_vtable(sb, b0, (const uint16_t[]){0, 4}, 2, 8);
+    fb_table(sb, b0, 4, ref, vt);
+    fields = fb_ref(sb);
+    fb_vector(sb, b0, fields, 4, (uint32_t)n);
+    for (int i = 0; i < n; i++) {
+        refs[i] = fb_ref(sb);
+    }
+    for (int i = 0; i < n; i++) {
+        enc_field(sb, b0, refs[i], w->fields + i);
+    }
+    free(refs);
+}
+
+static void
+enc_record_batch(struct sbuf *sb, size_t b0, size_t ref, struct arrow_writer *w, int num_nodes, int num_buffers) {
+    size_t vt, nodes, buffers;
+
+    vt = fb_vtable(sb, b0, (const uint16_t[]){8, 4, 16}, 3, 24);
+    fb_table(sb, b0, 8, ref, vt);
+    nodes = fb_ref(sb);
+    fb_u64(sb, (uint64_t)w->rows);
+    buffers = fb_ref(sb);
+    fb_u32(sb, 0);
+    fb_vector(sb, b0, nodes, 8, (uint32_t)num_nodes);
+    sbuf_add(sb, w->nodes, num_nodes * sizeof(*w->nodes));
+    fb_vector(sb, b0, buffers, 8, (uint32_t)num_buffers);
+    sbuf_add(sb, w->buffers, num_buffers * sizeof(*w->buffers));
+}
+
+/*
+ * 写出一个消息的元数据部分，返回它的字节数（包括 0xFFFFFFFF 和长度）
+ *   - header_type  HEADER_*，RecordBatch 的内容来自 w->nodes 和 w->buffers
+ */
+static size_t
+write_message(struct arrow_writer *w, int header_type, int64_t body_len, int num_nodes, int num_buffers) {
+    struct sbuf *sb = &w->msg;
+    size_t b0 = 8, root, header, vt;
+
+    sb->len = 0;
+    fb_u32(sb, 0xFFFFFFFF);
+    fb_u32(sb, 0);  // 长度，最后填上
+    root = fb_ref(sb);
+    vt = fb_vtable(sb, b0, (const uint16_t[]){16, 18, 4, 8}, 4, 24);
+    fb_table(sb, b0, 8, root, vt);
+    header = fb_ref(sb);
+    fb_u64(sb, (uint64_t)body_len);
+    fb_u16(sb, METADATA_V5);
+    fb_u8(sb, (uint8_t)header_type);
+    fb_u8(sb, 0);
+    fb_u32(sb, 0);
+    if (header_type == HEADER_SCHEMA) {
+        enc_schema(sb, b0, header, w);
+    } else {
+        enc_record_batch(sb, b0, header, w, num_nodes, num_buffers);
+    }
+    fb_pad(sb, b0, 8);
+
+    uint32_t len = (uint32_t)(sb->len - b0);
+
+    memcpy(sb->data + 4, &len, sizeof(len));
+    obuf_write(&w->ob, sb->data, sb->len);
+    return sb->len;
+}
+
+/*
+ * 让各列从空的一批开始，偏移量都先放一个 0
+ */
+static void
+batch_reset(struct arrow_writer *w) {
+    int32_t zero = 0;
+
+    for (int i = 0; i < w->num_cols; i++) {
+        w->cols[i].offsets.len = 0;
+        w->cols[i].data.len = 0;
+        if (w->cols[i].type == ARROW_UTF8) {
+            sbuf_add(&w->cols[i].offsets, &zero, sizeof(zero));
+        }
+    }
+    w->poly_offsets.len = 0;
+    w->ring_offsets.len = 0;
+    w->coords.len = 0;
+    sbuf_add(&w->poly_offsets, &zero, sizeof(zero));
+    sbuf_add(&w->ring_offsets, &zero, sizeof(zero));
+    w->rows = 0;
+    w->bytes = 0;
+    w->num_rings = 0;
+    w->num_points = 0;
+}
+
+/*
+ * 把当前批写成一个 RecordBatch
+ */
+static void
+flush_batch(struct arrow_writer *w) {
+    int nn = 0, nb = 0;
+    int64_t body_len = 0;
+    struct block blk;
+
+    for (int i = 0; i < w->num_cols; i++) {
+        struct arrow_col *c = w->cols + i;
+
+        w->nodes[nn++] = (struct node){w->rows, c->type == ARROW_NULL ? w->rows : 0};
+        if (c->type == ARROW_NULL) {  // 没有缓冲区
+            continue;
+        }
+        w->bodies[nb] = NULL;
+        w->buffers[nb++].length = 0;
+        if (c->type == ARROW_UTF8) {
+            w->bodies[nb] = c->offsets.data;
+            w->buffers[nb++].length = c->offsets.len;
+        }
+        w->bodies[nb] = c->data.data;
+        w->buffers[nb++].length = c->data.len;
+    }
+    w->nodes[nn++] = (struct node){w->rows, 0};
+    w->nodes[nn++] = (struct node){w->num_rings, 0};
+    w->nodes[nn++] = (struct node){w->num_points, 0};
+    w->nodes[nn++] = (struct node){2 * (int64_t)w->num_points, 0};
+    const void *geom[GEOM_BUFFERS] = {NULL, w->poly_offsets.data, NULL, w->ring_offsets.data, NULL, NULL, w->coords.data};
+    size_t geom_len[GEOM_BUFFERS] = {0, w->poly_offsets.len, 0, w->ring_offsets.len, 0, 0, w->coords.len};
+
+    for (int i = 0; i < GEOM_BUFFERS; i++, nb++) {
+        w->bodies[nb] = geom[i];
+        w->buffers[nb].length = geom_len[i];
+    }
+    for (int i = 0; i < nb; i++) {
+        w->buffers[i].offset = body_len;
+        body_len += (w->buffers[i].length + 7) & ~7;
+    }
+
+    blk.offset = obuf_size(&w->ob);
+    blk.meta_len = (int32_t)write_message(w, HEADER_RECORD_BATCH, body_len, nn, nb);
+    blk.pad = 0;
+    blk.body_len = body_len;
+    sbuf_add(&w->blocks, &blk, sizeof(blk));
+    for (int i = 0; i < nb; i++) {
+        static const char zeros[8];
+        size_t n = w->buffers[i].length;
+
+        if (n > 0) {
+            obuf_write(&w->ob, w->bodies[i], n);
+            obuf_write(&w->ob, zeros, -n & 7);
+        }
+    }
+    batch_reset(w);
+}
+
+struct arrow_writer *
+arrow_open(const char *path, const struct arrow_column *cols, int num_cols, int epsg) {
+    struct arrow_writer *w = calloc(1, sizeof(*w));
+    char *meta;
+
+    obuf_open(&w->ob, path, 0);
+    w->num_cols = num_cols;
+    w->cols = calloc(num_cols ? num_cols : 1, sizeof(*w->cols));
+    w->fields = calloc(num_cols + 1, sizeof(*w->fields));
+    for (int i = 0; i < num_cols; i++) {
+        struct field *f = w->fields + i;
+
+        f->name = strdup(cols[i].name);
+        f->nullable = 1;
+        switch (cols[i].type) {
+        case ARROW_INT32:
+            f->type = TYPE_INT;
+            f->param = 32;
+            break;
+        case ARROW_FLOAT32:
+        case ARROW_FLOAT64:
+            f->type = TYPE_FLOATING_POINT;
+            f->param = cols[i].type == ARROW_FLOAT32 ? PRECISION_SINGLE : PRECISION_DOUBLE;
+            break;
+        case ARROW_UTF8:
+            f->type = TYPE_UTF8;
+            break;
+        default:
+            f->type = TYPE_NULL;
+        }
+        w->cols[i].type = cols[i].type;
+    }
+    if (epsg) {
+        if (asprintf(&meta, "{\"crs\":\"EPSG:%d\",\"crs_type\":\"authority_code\"}", epsg) == -1) {
+            err(1, "asprintf");
+        }
+    } else {
+        meta = strdup("{}");
+    }
+    w->fields[num_cols] = (struct field){"geometry", TYPE_LIST, 0, 1, &rings_field, meta};
+    w->nodes = malloc((num_cols + GEOM_NODES) * sizeof(*w->nodes));
+    w->buffers = malloc((3 * num_cols + GEOM_BUFFERS) * sizeof(*w->buffers));
+    w->bodies = malloc((3 * num_cols + GEOM_BUFFERS) * sizeof(*w->bodies));
+    batch_reset(w);
+
+    obuf_write(&w->ob, magic, sizeof(magic));
+    write_message(w, HEADER_SCHEMA, 0, 0, 0);
+    return w;
+}
+
+void
+arrow_fixed(struct arrow_writer *w, int col, const void *p) {
+    struct arrow_col *c = w->cols + col;
+    size_t n = c->type == ARROW_FLOAT64 ? 8 : 4;
+
+    sbuf_add(&c->data, p, n);
+    w->bytes += n;
+}
+
+void
+arrow_utf8(struct arrow_writer *w, int col, const char *s, size_t n) {
+    struct arrow_col *c = w->cols + col;
+    int32_t end;
+
+    sbuf_add(&c->data, s, n);
+    end = (int32_t)c->data.len;
+    sbuf_add(&c->offsets, &end, sizeof(end));
+    w->bytes += n + sizeof(end);
+}
+
+void
+arrow_polygon(struct arrow_writer *w, const double *xy, const int *ring_end, int num_rings, int first) {
+    int last = num_rings > 0 ? ring_end[num_rings - 1] : first;
+
+    for (int r = 0; r < num_rings; r++) {
+        int32_t end = w->num_points + (ring_end[r] - first);
+
+        sbuf_add(&w->ring_offsets, &end, sizeof(end));
+    }
+    sbuf_add(&w->coords, xy + 2 * first, (size_t)(last - first) * 2 * sizeof(double));
+    w->num_rings += num_rings;
+    w->num_points += last - first;
+    sbuf_add(&w->poly_offsets, &w->num_rings, sizeof(w->num_rings));
+    w->bytes += (size_t)(last - first) * 2 * sizeof(double) + (num_rings + 1) * sizeof(int32_t);
+}
+
+void
+arrow_end_row(struct arrow_writer *w) {
+    w->rows++;
+    if (w->rows >= ARROW_BATCH_ROWS || w->bytes >= ARROW_BATCH_BYTES) {
+        flush_batch(w);
+    }
+}
+
+void
+arrow_close(struct arrow_writer *w) {
+    static const uint32_t eos[2] = {0xFFFFFFFF, 0};
+    struct sbuf *sb = &w->msg;
+    size_t vt, root, schema, dictionaries, batches;
+    uint32_t len;
+
+    if (w->rows > 0) {
+        flush_batch(w);
+    }
+    obuf_write(&w->ob, eos, sizeof(eos));
+
+    // Footer 前面没有长度，后面跟着长度和魔数
+    sb->len = 0;
+    root = fb_ref(sb);
+    vt = fb_vtable(sb, 0, (const uint16_t[]){16, 4, 8, 12}, 4, 20);
+    fb_table(sb, 0, 4, root, vt);
+    schema = fb_ref(sb);
+    dictionaries = fb_ref(sb);
+    batches = fb_ref(sb);
+    fb_u16(sb, METADATA_V5);
+    fb_u16(sb, 0);
+    enc_schema(sb, 0, schema, w);
+    fb_vector(sb, 0, dictionaries, 8, 0);
+    fb_vector(sb, 0, batches, 8, (uint32_t)(w->blocks.len / sizeof(struct block)));
+    sbuf_add(sb, w->blocks.data, w->blocks.len);
+    len = (uint32_t)sb->len;
+    fb_u32(sb, len);
+    sbuf_add(sb, magic, 6);
+    obuf_write(&w->ob, sb->data, sb->len);
+    obuf_close(&w->ob);
+
+    for (int i = 0; i < w->num_cols; i++) {
+        free((char *)w->fields[i].name);
+        sbuf_free(&w->cols[i].offsets);
+        sbuf_free(&w->cols[i].data);
+    }
+    free((char *)w->fields[w->num_cols].ext_meta);
+    free(w->fields);
+    free(w->cols);
+    free(w->nodes);
+    free(w->buffers);
+    free(w->bodies);
+    sbuf_free(&w->poly_offsets);
+    sbuf_free(&w->ring_offsets);
+    sbuf_free(&w->coords);
+    sbuf_free(&w->msg);
+    sbuf_free(&w->blocks);
+    free(w);
+}
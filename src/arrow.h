@@ -0,0 +1,70 @@
+/*
+ * Arrow IPC 文件（Feather V2）输出，几何是 GeoArrow 的 geoarrow.polygon，不依赖 Arrow 库
+ *
+ * 属性是有类型的列，几何是嵌套的坐标列表 List<rings: List<vertices: FixedSizeList<xy: double>[2]>>，
+ * 坐标交错存放，与组装好的多边形（poly_coords）一样，可以整段复制
+ * 行一行一行地追加到各列中，攒够一批就写成一个 RecordBatch，所以内存占用与要素总数无关；
+ * 文件尾的 Footer 中有各批的位置，关闭时写出
+ */
+#ifndef MAPGIS_ARROW_H
+#define MAPGIS_ARROW_H
+
+#include <stddef.h>
+
+#define ARROW_BATCH_ROWS 65536  // 每个 RecordBatch 最多的行数
+#define ARROW_BATCH_BYTES (64 << 20)  // 一批的各列加起来超过这么多字节时提前写出
+
+// 属性列的类型
+enum {
+    ARROW_NULL,  // 没有值，不占空间
+    ARROW_INT32,
+    ARROW_FLOAT32,
+    ARROW_FLOAT64,
+    ARROW_UTF8,
+};
+
+/*
+ * 一个属性列
+ */
+struct arrow_column {
+    const char *name;  // UTF-8
+    int type;  // ARROW_*
+};
+
+struct arrow_writer;
+
+/*
+ * 开始输出
+ *   - path  输出文件名，NULL 表示标准输出
+ *   - cols  属性列，几何列 geometry 在它们后面
+ *   - epsg  坐标系，写进 GeoArrow 的扩展元数据，0 表示不知道
+ * 出错时直接退出
+ */
+struct arrow_writer *arrow_open(const char *path, const struct arrow_column *cols, int num_cols, int epsg);
+
+/*
+ * 当前行第 col 列的值，每行的每列都要给一个值，ARROW_NULL 列除外
+ * arrow_fixed() 用于数值列，从 p 复制 4 或 8 个字节（不要求对齐）；arrow_utf8() 用于字符串列
+ */
+void arrow_fixed(struct arrow_writer *w, int col, const void *p);
+void arrow_utf8(struct arrow_writer *w, int col, const char *s, size_t n);
+
+/*
+ * 当前行的几何
+ *   - xy        交错存放的坐标
+ *   - ring_end  各环最后一点的下一个点在 xy 中的序号
+ *   - first     第一个环的第一点在 xy 中的序号
+ */
+void arrow_polygon(struct arrow_writer *w, const double *xy, const int *ring_end, int num_rings, int first);
+
+/*
+ * 当前行结束，攒够一批时写出
+ */
+void arrow_end_row(struct arrow_writer *w);
+
+/*
+ * 写出最后一批和文件尾，关闭输出
+ */
+void arrow_close(struct arrow_writer *w);
+
+#endif
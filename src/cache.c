@@ -0,0 +1,150 @@
+/*
+ * 本机缓存文件，见 cache.h
+ *
+ * 文件头是魔数、戳和区数，接着是各区的偏移量和长度，然后是各区，每个区前面补 0 对齐到 CACHE_ALIGN
+ */
+
+#define _GNU_SOURCE  // asprintf()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "MGCACHE1"  // 8 个字节，最后的数字是文件头的版本
+
+struct cache_header {
+    char magic[8];
+    uint64_t stamp[CACHE_STAMP_WORDS];
+    uint64_t num_sections;
+};
+
+/*
+ * 各区在文件中的位置
+ */
+struct cache_entry {
+    uint64_t off;
+    uint64_t len;
+};
+
+static size_t
+align_up(size_t n) {
+    return (n + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+/*
+ * 把 p 开始的 n 个字节全部写出，处理被信号打断和部分写出的情况，出错返回 0
+ */
+static int
+write_full(int fd, const void *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p = (const char *)p + r;
+        n -= r;
+    }
+    return 1;
+}
+
+int
+cache_write(const char *path, const uint64_t *stamp, const struct cache_section *secs, int n) {
+    static const char zeros[CACHE_ALIGN];
+    struct cache_header h;
+    struct cache_entry *ents = calloc(n ? n : 1, sizeof(*ents));
+    size_t off = align_up(sizeof(h) + n * sizeof(*ents));
+    char *tmp;
+    int fd, ok;
+
+    if (!ents || asprintf(&tmp, "%s.XXXXXX", path) == -1) {
+        err(1, "malloc");
+    }
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    memcpy(h.stamp, stamp, sizeof(h.stamp));
+    h.num_sections = n;
+    for (int k = 0; k < n; k++) {
+        ents[k].off = off;
+        ents[k].len = secs[k].len;
+        off = align_up(off + secs[k].len);
+    }
+
+    fd = mkstemp(tmp);
+    if (fd == -1) {
+        warn("创建缓存文件 %s 失败", tmp);
+        free(ents);
+        free(tmp);
+        return 0;
+    }
+    ok = write_full(fd, &h, sizeof(h)) && write_full(fd, ents, n * sizeof(*ents));
+    off = sizeof(h) + n * sizeof(*ents);
+    for (int k = 0; ok && k < n; k++) {
+        ok = write_full(fd, zeros, ents[k].off - off) && write_full(fd, secs[k].p, secs[k].len);
+        off = ents[k].off + ents[k].len;
+    }
+    // 权限与普通的输出文件一样，mkstemp() 建的是 0600
+    ok = ok && fchmod(fd, 0644) == 0;
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, path) != 0) {
+        warn("写缓存文件 %s 失败", path);
+        unlink(tmp);
+        ok = 0;
+    }
+    free(ents);
+    free(tmp);
+    return ok;
+}
+
+void *
+cache_map(const char *path, const uint64_t *stamp, struct cache_section *secs, int n, size_t *len) {
+    struct cache_header h;
+    struct cache_entry *ents;
+    struct stat st;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(h) + n * sizeof(*ents)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    memcpy(&h, map, sizeof(h));
+    if (memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 || memcmp(h.stamp, stamp, sizeof(h.stamp)) != 0 ||
+            h.num_sections != (uint64_t)n) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    ents = (struct cache_entry *)((char *)map + sizeof(h));
+    for (int k = 0; k < n; k++) {
+        if (ents[k].off % CACHE_ALIGN != 0 || ents[k].off > (uint64_t)st.st_size || ents[k].len > st.st_size - ents[k].off) {
+            warnx("缓存文件 %s 坏了", path);
+            munmap(map, st.st_size);
+            return NULL;
+        }
+        secs[k].p = (char *)map + ents[k].off;
+        secs[k].len = ents[k].len;
+    }
+    *len = st.st_size;
+    return map;
+}
@@ -0,0 +1,35 @@
+/*
+ * 本机缓存文件：若干个按 CACHE_ALIGN 对齐的区，整个映射到内存中直接用，不用再解码
+ *
+ * 文件头中有一个戳（如源文件的大小和修改时间），打开时与调用者给的戳比较，不一样就当作没有缓存。
+ * 区的内容是本机的字节序和对齐，只给同一台机器上的同一个程序用，不是交换格式
+ * 写的时候先写临时文件再改名，别的进程不会读到写了一半的缓存
+ */
+#ifndef MAPGIS_CACHE_H
+#define MAPGIS_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_ALIGN 64  // 各区的起点对齐到这么多字节
+#define CACHE_STAMP_WORDS 8  // 戳的长度，用不完的填 0
+
+/*
+ * 一个区：写的时候是要写的内容，映射时填上在映射中的位置
+ */
+struct cache_section {
+    const void *p;
+    size_t len;
+};
+
+/*
+ * 写缓存文件 path，出错时打印警告并返回 0，缓存只是加速用的，写不了也不影响转换
+ */
+int cache_write(const char *path, const uint64_t *stamp, const struct cache_section *secs, int n);
+
+/*
+ * 映射缓存文件 path，没有、戳不一样或区数不对时返回 NULL；否则填好 secs，返回映射的起点，用完 munmap(p, *len)
+ */
+void *cache_map(const char *path, const uint64_t *stamp, struct cache_section *secs, int n, size_t *len);
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * 转换结果缓存，见 convcache.h
+ *
+ * 打开时扫一遍缓存目录，记下各条目的大小和最近使用时间，之后在内存中维护；
+ * 超过上限时一次淘汰到上限的 CONVCACHE_LOW_WATER，免得每存一个条目都要排一次序
+ */
+
+#define _GNU_SOURCE  // asprintf(), copy_file_range()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "convcache.h"
+
+#define CONVCACHE_LOW_WATER 0.9  // 淘汰到上限的这么多
+#define COPY_BUF_SIZE (1 << 20)
+
+struct cc_entry {
+    char key[CONVCACHE_KEY_LEN + 1];
+    size_t bytes;
+    struct timespec used;  // 最近使用的时间
+};
+
+struct convcache {
+    pthread_mutex_t lock;
+    char *dir;
+    size_t max_bytes;
+    size_t bytes;
+    struct cc_entry *v;
+    int n;  // v 中的项数，包括已经淘汰的
+    int cap;
+    int num_sorted;  // v 的前这么多项（打开时扫到的）按键排好了序
+    int entries;
+    long hits, misses, evictions;
+};
+
+static int
+cmp_key(const void *a, const void *b) {
+    return strcmp(((const struct cc_entry *)a)->key, ((const struct cc_entry *)b)->key);
+}
+
+static int
+key_ok(const char *name) {
+    if (strlen(name) != CONVCACHE_KEY_LEN) {
+        return 0;
+    }
+    for (const char *p = name; *p; p++) {
+        if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * 删除一个条目目录及其中的文件，返回其中文件的字节数
+ */
+static size_t
+remove_dir(const char *path) {
+    DIR *d = opendir(path);
+    struct dirent *de;
+    size_t bytes = 0;
+
+    if (!d) {
+        return 0;
+    }
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        char *f;
+
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        if (asprintf(&f, "%s/%s", path, de->d_name) == -1) {
+            err(1, "asprintf");
+        }
+        if (stat(f, &st) == 0) {
+            bytes += st.st_size;
+        }
+        unlink(f);
+        free(f);
+    }
+    closedir(d);
+    rmdir(path);
+    return bytes;
+}
+
+/*
+ * 条目目录中各文件的字节数之和
+ */
+static size_t
+dir_bytes(const char *path) {
+    DIR *d = opendir(path);
+    struct dirent *de;
+    size_t bytes = 0;
+
+    if (!d) {
+        return 0;
+    }
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+
+        if (de->d_name[0] != '.' && fstatat(dirfd(d), de->d_name, &st, 0) == 0) {
+            bytes += st.st_size;
+        }
+    }
+    closedir(d);
+    return bytes;
+}
+
+static void evict(struct convcache *c, struct cc_entry *keep);
+
+static struct cc_entry *
+add_entry(struct convcache *c, const char *key, size_t bytes, struct timespec used) {
+    struct cc_entry *e;
+
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 256;
+        c->v = realloc(c->v, c->cap * sizeof(*c->v));
+        if (!c->v) {
+            err(1, "realloc");
+        }
+    }
+    e = c->v + c->n++;
+    memcpy(e->key, key, CONVCACHE_KEY_LEN + 1);
+    e->bytes = bytes;
+    e->used = used;
+    c->bytes += bytes;
+    c->entries++;
+    return e;
+}
+
+static struct cc_entry *
+find_entry(struct convcache *c, const char *key) {
+    struct cc_entry k, *e;
+
+    memcpy(k.key, key, CONVCACHE_KEY_LEN + 1);
+    e = bsearch(&k, c->v, c->num_sorted, sizeof(*c->v), cmp_key);
+    if (e) {
+        return e;
+    }
+    for (int i = c->num_sorted; i < c->n; i++) {  // 这次运行存进来的
+        if (strcmp(c->v[i].key, key) == 0) {
+            return c->v + i;
+        }
+    }
+    return NULL;
+}
+
+struct convcache *
+convcache_open(const char *dir, size_t max_bytes) {
+    struct convcache *c = calloc(1, sizeof(*c));
+    struct dirent *de;
+    DIR *d;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        err(1, "创建缓存目录 %s 失败", dir);
+    }
+    d = opendir(dir);
+    if (!d) {
+        err(1, "打开缓存目录 %s 失败", dir);
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->dir = strdup(dir);
+    c->max_bytes = max_bytes;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        char *path;
+
+        if (!key_ok(de->d_name) || fstatat(dirfd(d), de->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;  // 写了一半的临时目录等
+        }
+        if (asprintf(&path, "%s/%s", dir, de->d_name) == -1) {
+            err(1, "asprintf");
+        }
+        add_entry(c, de->d_name, dir_bytes(path), st.st_mtim);
+        free(path);
+    }
+    closedir(d);
+    qsort(c->v, c->n, sizeof(*c->v), cmp_key);
+    c->num_sorted = c->n;
+    evict(c, NULL);  // 上限可能比上次用的小
+    return c;
+}
+
+/*
+ * 复制文件，dst 已有的覆盖掉，出错返回 0
+ */
+static int
+copy_file(const char *src, const char *dst, size_t *bytes) {
+    int in = open(src, O_RDONLY), out;
+    ssize_t r;
+    char *buf = NULL;
+    int ok = 1;
+
+    if (in == -1) {
+        return 0;
+    }
+    out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out == -1) {
+        close(in);
+        return 0;
+    }
+    *bytes = 0;
+    // 同一个文件系统上由内核直接复制（有的文件系统只是共享数据块），不行时再自己读写
+    while ((r = copy_file_range(in, NULL, out, NULL, COPY_BUF_SIZE, 0)) > 0) {
+        *bytes += r;
+    }
+    if (r < 0 && *bytes == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+        buf = malloc(COPY_BUF_SIZE);
+        if (!buf) {
+            err(1, "malloc");
+        }
+        while ((r = read(in, buf, COPY_BUF_SIZE)) > 0) {
+            for (ssize_t done = 0; done < r;) {
+                ssize_t w = write(out, buf + done, r - done);
+
+                if (w < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (w <= 0) {
+                    ok = 0;
+                    break;
+                }
+                done += w;
+            }
+            if (!ok) {
+                break;
+            }
+            *bytes += r;
+        }
+        free(buf);
+    }
+    if (r < 0) {
+        ok = 0;
+    }
+    close(in);
+    if (close(out) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+int
+convcache_get(struct convcache *c, const char *key, char *const *paths, int n, long *count) {
+    char *entry, *f;
+    struct cc_entry *e;
+    FILE *fi;
+    int ok = 0, num_files = -1;
+
+    if (asprintf(&entry, "%s/%s", c->dir, key) == -1 || asprintf(&f, "%s/info", entry) == -1) {
+        err(1, "asprintf");
+    }
+    fi = fopen(f, "r");
+    if (fi) {
+        ok = fscanf(fi, "%d %ld", &num_files, count) == 2 && num_files == n;
+        fclose(fi);
+    }
+    free(f);
+    for (int i = 0; ok && i < n; i++) {
+        size_t bytes;
+
+        if (asprintf(&f, "%s/%d", entry, i) == -1) {
+            err(1, "asprintf");
+        }
+        ok = copy_file(f, paths[i], &bytes);
+        if (!ok) {
+            warn("从缓存复制 %s 失败", paths[i]);
+        }
+        free(f);
+    }
+    if (ok) {
+        utimensat(AT_FDCWD, entry, NULL, 0);  // 记下最近使用的时间，淘汰时按它排
+    }
+    free(entry);
+
+    pthread_mutex_lock(&c->lock);
+    if (ok) {
+        c->hits++;
+        e = find_entry(c, key);
+        if (e) {
+            clock_gettime(CLOCK_REALTIME, &e->used);
+        }
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return ok;
+}
+
+static int
+cmp_used(const void *a, const void *b) {
+    const struct cc_entry *x = *(struct cc_entry *const *)a, *y = *(struct cc_entry *const *)b;
+
+    if (x->used.tv_sec != y->used.tv_sec) {
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    }
+    return x->used.tv_nsec < y->used.tv_nsec ? -1 : x->used.tv_nsec > y->used.tv_nsec;
+}
+
+/*
+ * 淘汰最久没用的条目，直到总字节数不超过上限的 CONVCACHE_LOW_WATER，要先锁上
+ *   - keep 刚存进来的条目，不淘汰它
+ */
+static void
+evict(struct convcache *c, struct cc_entry *keep) {
+    struct cc_entry **order;
+    int m = 0;
+
+    if (c->bytes <= c->max_bytes) {
+        return;
+    }
+    order = malloc(c->n * sizeof(*order));
+    if (!order) {
+        err(1, "malloc");
+    }
+    for (int i = 0; i < c->n; i++) {
+        if (c->v + i != keep) {
+            order[m++] = c->v + i;
+        }
+    }
+    qsort(order, m, sizeof(*order), cmp_used);
+    for (int i = 0; i < m && c->bytes > c->max_bytes * CONVCACHE_LOW_WATER; i++) {
+        char *path;
+
+        if (asprintf(&path, "%s/%s", c->dir, order[i]->key) == -1) {
+            err(1, "asprintf");
+        }
+        remove_dir(path);
+        free(path);
+        c->bytes -= order[i]->bytes;
+        c->entries--;
+        c->evictions++;
+        order[i]->key[0] = 0;
+    }
+    free(order);
+
+    // 去掉淘汰了的项，保持原来的次序，排好序的部分还能二分查找
+    int n = 0, num_sorted = 0;
+
+    for (int i = 0; i < c->n; i++) {
+        if (c->v[i].key[0]) {
+            num_sorted += i < c->num_sorted;
+            c->v[n++] = c->v[i];
+        }
+    }
+    c->n = n;
+    c->num_sorted = num_sorted;
+}
+
+void
+convcache_put(struct convcache *c, const char *key, char *const *paths, int n, long count) {
+    char *tmp, *entry, *f;
+    size_t total = 0;
+    struct timespec now;
+    FILE *fi;
+    int ok = 1;
+
+    if (asprintf(&tmp, "%s/%s.tmp.XXXXXX", c->dir, key) == -1 || asprintf(&entry, "%s/%s", c->dir, key) == -1) {
+        err(1, "asprintf");
+    }
+    if (!mkdtemp(tmp)) {
+        warn("创建缓存目录 %s 失败", tmp);
+        free(tmp);
+        free(entry);
+        return;
+    }
+    for (int i = 0; ok && i < n; i++) {
+        size_t bytes;
+
+        if (asprintf(&f, "%s/%d", tmp, i) == -1) {
+            err(1, "asprintf");
+        }
+        ok = copy_file(paths[i], f, &bytes);
+        if (!ok) {
+            warn("把 %s 存入缓存失败", paths[i]);
+        }
+        total += bytes;
+        free(f);
+    }
+    if (ok) {  // info 最后写，有它的条目才是完整的
+        if (asprintf(&f, "%s/info", tmp) == -1) {
+            err(1, "asprintf");
+        }
+        fi = fopen(f, "w");
+        ok = fi && fprintf(fi, "%d %ld\n", n, count) > 0;
+        if (fi && fclose(fi) != 0) {
+            ok = 0;
+        }
+        free(f);
+        total = dir_bytes(tmp);  // 与 convcache_open() 一样算上 info，淘汰时减去的也是这个数
+    }
+    // 比整个缓存还大的不存；已经有了（别的进程刚存的）时改名失败，也不用再存
+    if (!ok || total > c->max_bytes || rename(tmp, entry) != 0) {
+        remove_dir(tmp);
+        free(tmp);
+        free(entry);
+        return;
+    }
+    free(tmp);
+    free(entry);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    pthread_mutex_lock(&c->lock);
+    evict(c, add_entry(c, key, total, now));
+    pthread_mutex_unlock(&c->lock);
+}
+
+void
+convcache_get_stats(struct convcache *c, struct convcache_stats *st) {
+    pthread_mutex_lock(&c->lock);
+    st->hits = c->hits;
+    st->misses = c->misses;
+    st->evictions = c->evictions;
+    st->bytes = c->bytes;
+    st->entries = c->entries;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void
+convcache_close(struct convcache *c) {
+    pthread_mutex_destroy(&c->lock);
+    free(c->v);
+    free(c->dir);
+    free(c);
+}
@@ -0,0 +1,48 @@
+/*
+ * 转换结果缓存：按输入内容等算出的键存放一次转换的所有输出文件，同样的转换再做时直接复制出来
+ *
+ * 每个条目是缓存目录下以键为名的子目录，其中是各输出文件的副本和一个 info 文件，
+ * 先写到临时目录再改名，所以看得到的条目都是完整的；多个进程共用一个缓存目录也没关系
+ * 缓存的总字节数有上限，超过时按最近使用的时间（目录的修改时间，命中时更新）淘汰最久没用的条目
+ * 多线程共用，内部加锁
+ */
+#ifndef MAPGIS_CONVCACHE_H
+#define MAPGIS_CONVCACHE_H
+
+#include <stddef.h>
+
+#define CONVCACHE_KEY_LEN 32  // 键是这么多个十六进制数字
+
+struct convcache;
+
+/*
+ * 打开缓存目录 dir，没有就创建，建不了时直接退出
+ *   - max_bytes  所有条目加起来的字节数上限
+ */
+struct convcache *convcache_open(const char *dir, size_t max_bytes);
+
+/*
+ * 找 key 的条目，有就把它的 n 个文件依次复制到 paths，*count 是存入时给的数，返回 1；
+ * 没有、文件个数不对或复制失败时返回 0
+ */
+int convcache_get(struct convcache *c, const char *key, char *const *paths, int n, long *count);
+
+/*
+ * 把 paths 中的 n 个文件存为 key 的条目，连同调用者的一个数 count（如要素数），超过上限时淘汰旧条目
+ * 出错时打印警告，不影响转换
+ */
+void convcache_put(struct convcache *c, const char *key, char *const *paths, int n, long count);
+
+struct convcache_stats {
+    long hits;
+    long misses;
+    long evictions;
+    size_t bytes;
+    int entries;
+};
+
+void convcache_get_stats(struct convcache *c, struct convcache_stats *st);
+
+void convcache_close(struct convcache *c);
+
+#endif
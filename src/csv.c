@@ -0,0 +1,103 @@
+/*
+ * CSV 输出，见 csv.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <math.h>
+
+#include "csv.h"
+#include "obuf.h"
+#include "numfmt.h"
+
+struct csv_writer {
+    struct obuf ob;
+};
+
+struct csv_writer *
+csv_open(const char *path, int gzip, const char *const *names, int num_names) {
+    struct csv_writer *w = calloc(1, sizeof(*w));
+    struct sbuf sb;
+
+    bzero(&sb, sizeof(sb));
+    sbuf_adds(&sb, CSV_GEOM_NAME);
+    for (int i = 0; i < num_names; i++) {
+        sbuf_addc(&sb, ',');
+        csv_add_string(&sb, names[i], strlen(names[i]));
+    }
+    sbuf_addc(&sb, '\n');
+    obuf_open(&w->ob, path, gzip);
+    obuf_write(&w->ob, sb.data, sb.len);
+    sbuf_free(&sb);
+    return w;
+}
+
+void
+csv_write(struct csv_writer *w, const void *rows, size_t len) {
+    obuf_write(&w->ob, rows, len);
+}
+
+void
+csv_close(struct csv_writer *w) {
+    obuf_close(&w->ob);
+    free(w);
+}
+
+void
+csv_add_string(struct sbuf *sb, const char *s, size_t n) {
+    if (!memchr(s, ',', n) && !memchr(s, '"', n) && !memchr(s, '\n', n) && !memchr(s, '\r', n)) {
+        sbuf_add(sb, s, n);
+        return;
+    }
+    sbuf_reserve(sb, 2 * n + 2);  // 最坏情况下都是双引号
+    char *o = sb->data + sb->len;
+
+    *o++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '"') {
+            *o++ = '"';
+        }
+        *o++ = s[i];
+    }
+    *o++ = '"';
+    sb->len = o - sb->data;
+}
+
+void
+csv_add_double(struct sbuf *sb, double d) {
+    if (isfinite(d)) {
+        sbuf_add_double(sb, d, -1);
+    }
+}
+
+void
+csv_wkt_polygon(struct sbuf *sb, const double *xy, const int *ring_end, int num_rings, int first) {
+    int k = first;
+
+    if (num_rings == 0) {
+        sbuf_adds(sb, "POLYGON EMPTY");
+        return;
+    }
+    sbuf_adds(sb, "\"POLYGON (");
+    for (int r = 0; r < num_rings; r++) {
+        int start = k;  // 本环的第一点
+
+        sbuf_adds(sb, r > 0 ? ", (" : "(");
+        for (; k < ring_end[r]; k++) {
+            sbuf_reserve(sb, 2 * NUMFMT_MAX + 3);
+            char *o = sb->data + sb->len;
+
+            if (k > start) {
+                *o++ = ',';
+                *o++ = ' ';
+            }
+            o += fmt_double(o, xy[2 * k], -1);
+            *o++ = ' ';
+            o += fmt_double(o, xy[2 * k + 1], -1);
+            sb->len = o - sb->data;
+        }
+        sbuf_addc(sb, ')');
+    }
+    sbuf_adds(sb, ")\"");
+}
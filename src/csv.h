@@ -0,0 +1,56 @@
+/*
+ * CSV 输出，几何是 WKT
+ *
+ * 第一行是列名，以后一行一个要素，第一列是 WKT（GDAL 等按列名认出几何列），后面是各属性
+ * 按 RFC 4180 转义：含逗号、双引号或换行的值用双引号括起来，其中的双引号写两次；行以 \n 结尾
+ * 行各自独立，可以并行编码，按顺序追加到输出中
+ */
+#ifndef MAPGIS_CSV_H
+#define MAPGIS_CSV_H
+
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#define CSV_GEOM_NAME "WKT"
+
+struct csv_writer;
+
+/*
+ * 开始输出，写出列名
+ *   - path   输出文件名，NULL 表示标准输出
+ *   - gzip   压缩输出
+ *   - names  属性列名（UTF-8），只在打开时用到
+ * 出错时直接退出
+ */
+struct csv_writer *csv_open(const char *path, int gzip, const char *const *names, int num_names);
+
+/*
+ * 写出编码好的若干行
+ */
+void csv_write(struct csv_writer *w, const void *rows, size_t len);
+
+/*
+ * 关闭输出
+ */
+void csv_close(struct csv_writer *w);
+
+/*
+ * 一个字符串值，需要时加上双引号
+ */
+void csv_add_string(struct sbuf *sb, const char *s, size_t n);
+
+/*
+ * 一个数值，不是有限数时为空
+ */
+void csv_add_double(struct sbuf *sb, double d);
+
+/*
+ * 多边形的 WKT，括在双引号中，没有环时是 POLYGON EMPTY
+ *   - xy        交错存放的坐标
+ *   - ring_end  各环最后一点的下一个点在 xy 中的序号
+ *   - first     第一个环的第一点在 xy 中的序号
+ */
+void csv_wkt_polygon(struct sbuf *sb, const double *xy, const int *ring_end, int num_rings, int first);
+
+#endif
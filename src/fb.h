@@ -0,0 +1,124 @@
+/*
+ * 从前往后写 flatbuffers 的几个小函数，FlatGeobuf 和 Arrow 输出用，不依赖 flatbuffers 库
+ *
+ * flatbuffers 通常从后往前建，这里要写的结构都是固定的，直接从前往后写：vtable 放在表的前面（soffset 为正），
+ * 表中指向字符串、向量、子表的 uoffset 先占位（fb_ref()），写到目标时再填上（fb_patch()），所以目标总在引用之后
+ * 对齐都相对于 b0，即 flatbuffer 的开头在 sb 中的位置
+ * 按小端写出，与读 .WP 文件时一样只考虑小端机器
+ */
+#ifndef MAPGIS_FB_H
+#define MAPGIS_FB_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sbuf.h"
+
+static inline void
+fb_u8(struct sbuf *sb, uint8_t v) {
+    sbuf_addc(sb, (char)v);
+}
+
+static inline void
+fb_u16(struct sbuf *sb, uint16_t v) {
+    sbuf_add(sb, &v, sizeof(v));
+}
+
+static inline void
+fb_u32(struct sbuf *sb, uint32_t v) {
+    sbuf_add(sb, &v, sizeof(v));
+}
+
+static inline void
+fb_i32(struct sbuf *sb, int32_t v) {
+    sbuf_add(sb, &v, sizeof(v));
+}
+
+static inline void
+fb_u64(struct sbuf *sb, uint64_t v) {
+    sbuf_add(sb, &v, sizeof(v));
+}
+
+/*
+ * 补 0 到相对于 b0 按 align 对齐，b0 是 flatbuffer 开头在 sb 中的位置
+ */
+static inline void
+fb_pad(struct sbuf *sb, size_t b0, int align) {
+    while ((sb->len - b0) % align) {
+        sbuf_addc(sb, 0);
+    }
+}
+
+/*
+ * 一个 uoffset 的占位，返回它的位置，目标写出前用 fb_patch() 填上
+ */
+static inline size_t
+fb_ref(struct sbuf *sb) {
+    size_t p = sb->len;
+
+    fb_u32(sb, 0);
+    return p;
+}
+
+/*
+ * 让 ref 处的 uoffset 指向当前位置
+ */
+static inline void
+fb_patch(struct sbuf *sb, size_t ref) {
+    uint32_t v = (uint32_t)(sb->len - ref);
+
+    memcpy(sb->data + ref, &v, sizeof(v));
+}
+
+/*
+ * 写出一个 vtable，返回它的位置
+ *   - offs      各字段在表中的偏移量，0 表示没有这个字段
+ *   - tbl_size  表的大小
+ */
+static inline size_t
+fb_vtable(struct sbuf *sb, size_t b0, const uint16_t *offs, int n, int tbl_size) {
+    size_t vt;
+
+    fb_pad(sb, b0, 2);
+    vt = sb->len;
+    fb_u16(sb, (uint16_t)(4 + 2 * n));
+    fb_u16(sb, (uint16_t)tbl_size);
+    for (int i = 0; i < n; i++) {
+        fb_u16(sb, offs[i]);
+    }
+    return vt;
+}
+
+/*
+ * 开始一个表：对齐，让 ref 指向它，写出指向 vtable 的 soffset
+ */
+static inline void
+fb_table(struct sbuf *sb, size_t b0, int align, size_t ref, size_t vt) {
+    fb_pad(sb, b0, align);
+    fb_patch(sb, ref);
+    fb_i32(sb, (int32_t)(sb->len - vt));
+}
+
+static inline void
+fb_string(struct sbuf *sb, size_t b0, size_t ref, const char *s, size_t n) {
+    fb_pad(sb, b0, 4);
+    fb_patch(sb, ref);
+    fb_u32(sb, (uint32_t)n);
+    sbuf_add(sb, s, n);
+    sbuf_addc(sb, 0);
+}
+
+/*
+ * 开始一个向量：长度之后的元素按 elem_align 对齐，让 ref 指向它，写出长度
+ */
+static inline void
+fb_vector(struct sbuf *sb, size_t b0, size_t ref, int elem_align, uint32_t n) {
+    fb_pad(sb, b0, 4);
+    while ((sb->len + 4 - b0) % elem_align) {
+        sbuf_addc(sb, 0);
+    }
+    fb_patch(sb, ref);
+    fb_u32(sb, n);
+}
+
+#endif
@@ -0,0 +1,479 @@
+/*
+ * FlatGeobuf 输出，见 fgb.h
+ *
+ * 用到的 flatbuffers 表（header.fbs、feature.fbs），括号中是字段号：
+ *   Header   { name(0): string; envelope(1): [double]; geometry_type(2): ubyte; columns(7): [Column];
+ *              features_count(8): ulong; index_node_size(9): ushort = 16; crs(10): Crs; }
+ *   Column   { name(0): string; type(1): ubyte; width(4): int; precision(5): int; scale(6): int; }
+ *   Crs      { org(0): string; code(1): int; }
+ *   Feature  { geometry(0): Geometry; properties(1): [ubyte]; }
+ *   Geometry { ends(0): [uint]; xy(1): [double]; type(6): ubyte; }
+ * 对齐都相对于 flatbuffer 的开头（长度前缀之后），见 fb.h
+ */
+
+#define _GNU_SOURCE  // asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <math.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fgb.h"
+#include "fb.h"
+#include "obuf.h"
+
+#define GEOM_POLYGON 3
+#define SPILL_FLUSH (4 << 20)  // 临时文件的写缓冲区攒到这么多就写出
+#define HILBERT_MAX ((1 << 16) - 1)
+
+static const unsigned char magic[8] = {0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62, 0x00};  // "fgb" 3 "fgb" 0
+
+/*
+ * 临时文件中的一个要素
+ */
+struct fgb_item {
+    double bbox[4];
+    uint64_t off;  // 在临时文件中的位置
+    uint32_t len;  // 带长度前缀的长度
+    uint32_t hilbert;  // 范围中心的 Hilbert 值
+};
+
+/*
+ * 索引节点，文件中的格式
+ */
+struct fgb_node {
+    double bbox[4];
+    uint64_t off;  // 叶子是要素在要素区中的偏移量，其它是第一个子节点的序号
+};
+
+struct fgb_writer {
+    struct obuf ob;
+    char *name;
+    int epsg;
+    struct fgb_column *cols;
+    int num_cols;
+    int spill;  // 临时文件，打开后就删掉了
+    struct sbuf spill_buf;
+    uint64_t spill_size;  // 已写进临时文件（包括还在缓冲区中）的字节数
+    struct fgb_item *items;
+    size_t num_items;
+    size_t cap_items;
+};
+
+void
+fgb_prop_int(struct sbuf *props, int col, int32_t v) {
+    fb_u16(props, (uint16_t)col);
+    fb_i32(props, v);
+}
+
+void
+fgb_prop_float(struct sbuf *props, int col, float v) {
+    fb_u16(props, (uint16_t)col);
+    sbuf_add(props, &v, sizeof(v));
+}
+
+void
+fgb_prop_double(struct sbuf *props, int col, double v) {
+    fb_u16(props, (uint16_t)col);
+    sbuf_add(props, &v, sizeof(v));
+}
+
+void
+fgb_prop_string(struct sbuf *props, int col, const char *s, size_t n) {
+    fb_u16(props, (uint16_t)col);
+    fb_u32(props, (uint32_t)n);
+    sbuf_add(props, s, n);
+}
+
+void
+fgb_polygon(struct sbuf *out, const double *xy, const int *ring_end, int num_rings, int first,
+        const void *props, size_t props_len, double *bbox) {
+    int last = num_rings > 0 ? ring_end[num_rings - 1] : first;
+    size_t prefix = out->len;
+    size_t b0 = prefix + 4;
+    size_t root, vt, geom, ends = 0, coords, properties = 0;
+
+    fb_u32(out, 0);  // 长度前缀，最后填上
+
+    // Feature
+    root = fb_ref(out);
+    vt = fb_vtable(out, b0, (const uint16_t[]){4, props_len ? 8 : 0}, 2, 12);
+    fb_table(out, b0, 4, root, vt);
+    geom = fb_ref(out);
+    if (props_len) {
+        properties = fb_ref(out);
+    } else {
+        fb_u32(out, 0);
+    }
+
+    // Geometry，只有一个环时不用 ends
+    vt = fb_vtable(out, b0, (const uint16_t[]){num_rings > 1 ? 4 : 0, 8, 0, 0, 0, 0, 12}, 7, 16);
+    fb_table(out, b0, 4, geom, vt);
+    if (num_rings > 1) {
+        ends = fb_ref(out);
+    } else {
+        fb_u32(out, 0);
+    }
+    coords = fb_ref(out);
+    fb_u8(out, GEOM_POLYGON);
+    fb_u8(out, 0);
+    fb_u16(out, 0);
+
+    if (num_rings > 1) {
+        fb_vector(out, b0, ends, 4, (uint32_t)num_rings);
+        for (int r = 0; r < num_rings; r++) {
+            fb_u32(out, (uint32_t)(ring_end[r] - first));
+        }
+    }
+    fb_vector(out, b0, coords, 8, (uint32_t)(2 * (last - first)));
+    sbuf_add(out, xy + 2 * first, (size_t)(last - first) * 2 * sizeof(double));
+    if (props_len) {
+        fb_vector(out, b0, properties, 1, (uint32_t)props_len);
+        sbuf_add(out, props, props_len);
+    }
+    fb_pad(out, b0, 4);
+
+    uint32_t len = (uint32_t)(out->len - b0);
+
+    memcpy(out->data + prefix, &len, sizeof(len));
+
+    // 范围
+    bbox[0] = bbox[1] = INFINITY;
+    bbox[2] = bbox[3] = -INFINITY;
+    for (int k = first; k < last; k++) {
+        bbox[0] = fmin(bbox[0], xy[2 * k]);
+        bbox[1] = fmin(bbox[1], xy[2 * k + 1]);
+        bbox[2] = fmax(bbox[2], xy[2 * k]);
+        bbox[3] = fmax(bbox[3], xy[2 * k + 1]);
+    }
+    if (last == first) {  // 化简掉了的多边形，不参与总范围，索引中也查不到
+        bbox[0] = bbox[1] = bbox[2] = bbox[3] = NAN;
+    }
+}
+
+/*
+ * 编码 Header（带长度前缀）
+ */
+static void
+enc_header(struct sbuf *sb, struct fgb_writer *w, const double *extent) {
+    size_t prefix = sb->len;
+    size_t b0 = prefix + 4;
+    size_t root, vt, name, envelope, columns, crs;
+    size_t *col_refs = malloc((w->num_cols ? w->num_cols : 1) * sizeof(*col_refs));
+
+    fb_u32(sb, 0);
+    root = fb_ref(sb);
+    vt = fb_vtable(sb, b0, (const uint16_t[]){4, 8, 34, 0, 0, 0, 0, 12, 24, 32, 16}, 11, 36);
+    fb_table(sb, b0, 8, root, vt);
+    name = fb_ref(sb);
+    envelope = fb_ref(sb);
+    columns = fb_ref(sb);
+    crs = fb_ref(sb);
+    fb_u32(sb, 0);
+    fb_u64(sb, w->num_items);
+    fb_u16(sb, w->num_items ? FGB_NODE_SIZE : 0);  // 没有要素时没有索引
+    fb_u8(sb, GEOM_POLYGON);
+    fb_u8(sb, 0);
+
+    fb_string(sb, b0, name, w->name, strlen(w->name));
+    fb_vector(sb, b0, envelope, 8, 4);
+    sbuf_add(sb, extent, 4 * sizeof(double));
+
+    fb_vector(sb, b0, columns, 4, (uint32_t)w->num_cols);
+    for (int i = 0; i < w->num_cols; i++) {
+        col_refs[i] = fb_ref(sb);
+    }
+    for (int i = 0; i < w->num_cols; i++) {
+        struct fgb_column *c = w->cols + i;
+        size_t cname;
+
+        vt = fb_vtable(sb, b0, (const uint16_t[]){4, 20, 0, 0, 8, 12, 16}, 7, 24);
+        fb_table(sb, b0, 4, col_refs[i], vt);
+        cname = fb_ref(sb);
+        fb_i32(sb, c->width);
+        fb_i32(sb, c->precision);
+        fb_i32(sb, c->scale);
+        fb_u8(sb, (uint8_t)c->type);
+        fb_u8(sb, 0);
+        fb_u16(sb, 0);
+        fb_string(sb, b0, cname, c->name, strlen(c->name));
+    }
+    free(col_refs);
+
+    size_t org;
+
+    vt = fb_vtable(sb, b0, (const uint16_t[]){4, 8}, 2, 12);
+    fb_table(sb, b0, 4, crs, vt);
+    org = fb_ref(sb);
+    fb_i32(sb, w->epsg);
+    fb_string(sb, b0, org, "EPSG", 4);
+    fb_pad(sb, b0, 8);
+
+    uint32_t len = (uint32_t)(sb->len - b0);
+
+    memcpy(sb->data + prefix, &len, sizeof(len));
+}
+
+/*
+ * (x, y) 的 Hilbert 值，x、y 都在 0 到 HILBERT_MAX 之间，算法与 FlatGeobuf 的参考实现相同
+ */
+static uint32_t
+hilbert(uint32_t x, uint32_t y) {
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+    uint32_t A = a | (b >> 1);
+    uint32_t B = (a >> 1) ^ a;
+    uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = (a & (a >> 2)) ^ (b & (b >> 2));
+    B = (a & (b >> 2)) ^ (b & ((a ^ b) >> 2));
+    C ^= (a & (c >> 2)) ^ (b & (d >> 2));
+    D ^= (b & (c >> 2)) ^ ((a ^ b) & (d >> 2));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = (a & (a >> 4)) ^ (b & (b >> 4));
+    B = (a & (b >> 4)) ^ (b & ((a ^ b) >> 4));
+    C ^= (a & (c >> 4)) ^ (b & (d >> 4));
+    D ^= (b & (c >> 4)) ^ ((a ^ b) & (d >> 4));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    C ^= (a & (c >> 8)) ^ (b & (d >> 8));
+    D ^= (b & (c >> 8)) ^ ((a ^ b) & (d >> 8));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    uint32_t i0 = x ^ y;
+    uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+    return (i1 << 1) | i0;
+}
+
+/*
+ * 与参考实现一样按 Hilbert 值从大到小排，相同时按到来的顺序
+ */
+static int
+cmp_item(const void *a, const void *b) {
+    const struct fgb_item *x = a, *y = b;
+
+    if (x->hilbert != y->hilbert) {
+        return x->hilbert < y->hilbert ? 1 : -1;
+    }
+    return x->off < y->off ? -1 : x->off > y->off;
+}
+
+static void
+write_all(int fd, const void *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+
+        if (r < 0) {
+            err(1, "写临时文件");
+        }
+        p = (const char *)p + r;
+        n -= r;
+    }
+}
+
+struct fgb_writer *
+fgb_open(const char *path, const char *name, int epsg, const struct fgb_column *cols, int num_cols) {
+    struct fgb_writer *w = calloc(1, sizeof(*w));
+    char *tmp;
+
+    // 临时文件放在输出文件旁边，免得 /tmp 是内存文件系统时占内存
+    if (asprintf(&tmp, "%s.XXXXXX", path ? path : "/tmp/mapgisf.fgb") == -1) {
+        err(1, "asprintf");
+    }
+    w->spill = mkstemp(tmp);
+    if (w->spill < 0) {
+        err(1, "%s", tmp);
+    }
+    unlink(tmp);
+    free(tmp);
+
+    obuf_open(&w->ob, path, 0);
+    w->name = strdup(name);
+    w->epsg = epsg;
+    w->num_cols = num_cols;
+    w->cols = malloc((num_cols ? num_cols : 1) * sizeof(*w->cols));
+    for (int i = 0; i < num_cols; i++) {
+        w->cols[i] = cols[i];
+        w->cols[i].name = strdup(cols[i].name);
+    }
+    return w;
+}
+
+void
+fgb_write_feature(struct fgb_writer *w, const void *feature, size_t len, const double *bbox) {
+    if (w->num_items == w->cap_items) {
+        w->cap_items = w->cap_items ? w->cap_items * 2 : 1024;
+        w->items = realloc(w->items, w->cap_items * sizeof(*w->items));
+        if (!w->items) {
+            err(1, "realloc");
+        }
+    }
+
+    struct fgb_item *it = w->items + w->num_items++;
+
+    memcpy(it->bbox, bbox, sizeof(it->bbox));
+    it->off = w->spill_size;
+    it->len = (uint32_t)len;
+    sbuf_add(&w->spill_buf, feature, len);
+    w->spill_size += len;
+    if (w->spill_buf.len >= SPILL_FLUSH) {
+        write_all(w->spill, w->spill_buf.data, w->spill_buf.len);
+        w->spill_buf.len = 0;
+    }
+}
+
+/*
+ * 建打包的 Hilbert R 树：叶子在最后，按排好的顺序，父节点一层层往前放，根是第 0 个
+ * 返回节点数，*out 用完 free()
+ */
+static size_t
+build_index(struct fgb_item *items, size_t n, struct fgb_node **out) {
+    size_t count[64], start[64], total = n, m = n, off;
+    int levels = 0;
+    struct fgb_node *nodes;
+
+    count[levels++] = n;
+    do {
+        m = (m + FGB_NODE_SIZE - 1) / FGB_NODE_SIZE;
+        total += m;
+        count[levels++] = m;
+    } while (m != 1);
+    off = total;
+    for (int i = 0; i < levels; i++) {
+        off -= count[i];
+        start[i] = off;
+    }
+
+    nodes = malloc(total * sizeof(*nodes));
+    if (!nodes) {
+        err(1, "malloc");
+    }
+    off = 0;
+    for (size_t k = 0; k < n; k++) {
+        struct fgb_node *nd = nodes + start[0] + k;
+
+        memcpy(nd->bbox, items[k].bbox, sizeof(nd->bbox));
+        nd->off = off;  // 要素按排好的顺序写出
+        off += items[k].len;
+    }
+    for (int i = 0; i < levels - 1; i++) {
+        size_t pos = start[i], end = start[i] + count[i], up = start[i + 1];
+
+        while (pos < end) {
+            struct fgb_node *nd = nodes + up++;
+
+            nd->bbox[0] = nd->bbox[1] = INFINITY;
+            nd->bbox[2] = nd->bbox[3] = -INFINITY;
+            nd->off = pos;
+            for (int j = 0; j < FGB_NODE_SIZE && pos < end; j++, pos++) {
+                nd->bbox[0] = fmin(nd->bbox[0], nodes[pos].bbox[0]);
+                nd->bbox[1] = fmin(nd->bbox[1], nodes[pos].bbox[1]);
+                nd->bbox[2] = fmax(nd->bbox[2], nodes[pos].bbox[2]);
+                nd->bbox[3] = fmax(nd->bbox[3], nodes[pos].bbox[3]);
+            }
+        }
+    }
+    *out = nodes;
+    return total;
+}
+
+void
+fgb_close(struct fgb_writer *w) {
+    double extent[4] = {0, 0, 0, 0};
+    struct sbuf header;
+    char *spill = NULL;
+
+    write_all(w->spill, w->spill_buf.data, w->spill_buf.len);
+    sbuf_free(&w->spill_buf);
+
+    if (w->num_items > 0) {
+        extent[0] = extent[1] = INFINITY;
+        extent[2] = extent[3] = -INFINITY;
+        for (size_t k = 0; k < w->num_items; k++) {  // fmin()、fmax() 不管 NAN
+            extent[0] = fmin(extent[0], w->items[k].bbox[0]);
+            extent[1] = fmin(extent[1], w->items[k].bbox[1]);
+            extent[2] = fmax(extent[2], w->items[k].bbox[2]);
+            extent[3] = fmax(extent[3], w->items[k].bbox[3]);
+        }
+        if (!(extent[0] <= extent[2])) {  // 全是空的
+            extent[0] = extent[1] = extent[2] = extent[3] = 0;
+        }
+
+        double width = extent[2] - extent[0], height = extent[3] - extent[1];
+
+        for (size_t k = 0; k < w->num_items; k++) {
+            struct fgb_item *it = w->items + k;
+            uint32_t x = 0, y = 0;
+
+            if (width > 0 && !isnan(it->bbox[0])) {
+                x = (uint32_t)floor(HILBERT_MAX * ((it->bbox[0] + it->bbox[2]) / 2 - extent[0]) / width);
+            }
+            if (height > 0 && !isnan(it->bbox[1])) {
+                y = (uint32_t)floor(HILBERT_MAX * ((it->bbox[1] + it->bbox[3]) / 2 - extent[1]) / height);
+            }
+
+            it->hilbert = hilbert(x, y);
+        }
+        qsort(w->items, w->num_items, sizeof(*w->items), cmp_item);
+        spill = mmap(NULL, w->spill_size, PROT_READ, MAP_SHARED, w->spill, 0);
+        if (spill == MAP_FAILED) {
+            err(1, "mmap 临时文件");
+        }
+        madvise(spill, w->spill_size, MADV_RANDOM);
+    }
+
+    bzero(&header, sizeof(header));
+    sbuf_add(&header, magic, sizeof(magic));
+    enc_header(&header, w, extent);
+    obuf_write(&w->ob, header.data, header.len);
+    sbuf_free(&header);
+
+    if (w->num_items > 0) {
+        struct fgb_node *nodes;
+        size_t num_nodes = build_index(w->items, w->num_items, &nodes);
+
+        obuf_write(&w->ob, nodes, num_nodes * sizeof(*nodes));
+        free(nodes);
+        for (size_t k = 0; k < w->num_items; k++) {
+            obuf_write(&w->ob, spill + w->items[k].off, w->items[k].len);
+        }
+        munmap(spill, w->spill_size);
+    }
+    obuf_close(&w->ob);
+    close(w->spill);
+    for (int i = 0; i < w->num_cols; i++) {
+        free((char *)w->cols[i].name);
+    }
+    free(w->cols);
+    free(w->items);
+    free(w->name);
+    free(w);
+}
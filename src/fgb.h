@@ -0,0 +1,77 @@
+/*
+ * FlatGeobuf（3.x）输出，不依赖 flatbuffers 库
+ *
+ * 文件依次是魔数、Header、打包的 Hilbert R 树索引和各要素。索引在要素前面，又要等所有要素的范围都知道了才能建，
+ * 所以要素先按到来的顺序写进临时文件，内存中只留各要素的范围和在临时文件中的位置（每个 48 字节），
+ * 关闭时按范围中心的 Hilbert 值排序、建索引，再按排好的顺序把要素从临时文件复制到输出中
+ */
+#ifndef MAPGIS_FGB_H
+#define MAPGIS_FGB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#define FGB_NODE_SIZE 16  // 索引每个节点的子节点数，与 GDAL 等的默认值相同
+
+// 用到的属性类型（ColumnType）
+#define FGB_INT 5
+#define FGB_FLOAT 9
+#define FGB_DOUBLE 10
+#define FGB_STRING 11
+
+/*
+ * 一个属性列
+ */
+struct fgb_column {
+    const char *name;  // UTF-8
+    int type;  // FGB_*
+    int width;  // 最大宽度，-1 表示不知道，下同
+    int precision;  // 有效数字位数
+    int scale;  // 小数位数
+};
+
+struct fgb_writer;
+
+/*
+ * 开始输出
+ *   - path  输出文件名，NULL 表示标准输出
+ *   - name  数据集名，UTF-8
+ *   - epsg  坐标系
+ *   - cols  属性列，只在打开时用到
+ * 出错时直接退出
+ */
+struct fgb_writer *fgb_open(const char *path, const char *name, int epsg, const struct fgb_column *cols, int num_cols);
+
+/*
+ * 写出一个 fgb_polygon() 编码好的要素（带长度前缀），bbox 为它的范围 minx, miny, maxx, maxy
+ */
+void fgb_write_feature(struct fgb_writer *w, const void *feature, size_t len, const double *bbox);
+
+/*
+ * 建索引，写出 Header、索引和所有要素，关闭输出
+ */
+void fgb_close(struct fgb_writer *w);
+
+/*
+ * 要素的属性值，一个接一个追加到 props 中
+ *   - col  属性列的序号
+ */
+void fgb_prop_int(struct sbuf *props, int col, int32_t v);
+void fgb_prop_float(struct sbuf *props, int col, float v);
+void fgb_prop_double(struct sbuf *props, int col, double v);
+void fgb_prop_string(struct sbuf *props, int col, const char *s, size_t n);
+
+/*
+ * 编码一个多边形要素（带长度前缀），追加到 out 中，并算出它的范围
+ *   - xy        交错存放的坐标
+ *   - ring_end  各环最后一点的下一个点在 xy 中的序号
+ *   - first     第一个环的第一点在 xy 中的序号
+ *   - props     fgb_prop_*() 编码好的属性值
+ *   - bbox      输出，minx, miny, maxx, maxy，没有点时为 0
+ */
+void fgb_polygon(struct sbuf *out, const double *xy, const int *ring_end, int num_rings, int first,
+        const void *props, size_t props_len, double *bbox);
+
+#endif
@@ -0,0 +1,609 @@
+/*
+ * --where 属性过滤表达式的编译和求值
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // strncasecmp()
+#include <err.h>  // errx()
+#include <iconv.h>
+
+#include "filter.h"
+
+// 结点类型
+enum {
+    F_OR,
+    F_AND,
+    F_NOT,
+    F_CMP,  // 属性与一个值比较
+    F_IN,  // 属性值在一个列表中
+};
+
+// 比较符
+enum {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+};
+
+/*
+ * 常量值，字符串已转成 GB18030，与属性值行中的原始字节直接比较
+ */
+struct fvalue {
+    double num;
+    float fnum;  // 单精度属性按单精度比较，常量先舍入成 float，否则 1.04 这样的数与属性值永远不相等
+    char *str;
+    size_t len;
+};
+
+struct filter {
+    int kind;
+    struct filter *l, *r;  // F_OR、F_AND、F_NOT 的子结点，F_NOT 只用 l
+    // 以下用于 F_CMP 和 F_IN
+    int op;
+    char type;  // 属性类型 ATTR_STR 等
+    int attr_off;  // 属性在行中的偏移量
+    short size;  // 属性占用空间
+    int nvals;
+    struct fvalue *vals;
+};
+
+// 词法单元类型
+enum {
+    T_END,
+    T_NAME,
+    T_NUM,
+    T_STR,
+    T_OP,
+    T_LP,
+    T_RP,
+    T_COMMA,
+    T_AND,
+    T_OR,
+    T_NOT,
+    T_IN,
+};
+
+/*
+ * 编译时的状态
+ */
+struct fparser {
+    const char *expr;  // 整个表达式，用于报错
+    const char *p;  // 当前位置
+    int tok;  // 当前词法单元
+    char text[256];  // 当前词法单元文本（名字或字符串）
+    double num;
+    int op;
+    struct obj_attr_define_utf8 *defu;
+    int ndef;
+    iconv_t icv;  // UTF-8 到 GB18030
+};
+
+static void
+parse_error(struct fparser *ps, const char *msg) {
+    errx(1, "--where: %s，位置 %ld: %s", msg, (long)(ps->p - ps->expr), ps->expr);
+}
+
+static int
+is_name_char(unsigned char c) {
+    return c >= 0x80 || c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/*
+ * 读取引号括起来的文本到 ps->text
+ */
+static void
+lex_quoted(struct fparser *ps, char q) {
+    size_t n = 0;
+
+    ps->p++;
+    while (*ps->p && *ps->p != q) {
+        if (n + 1 >= sizeof(ps->text)) {
+            parse_error(ps, "字符串太长");
+        }
+        ps->text[n++] = *ps->p++;
+    }
+    if (*ps->p != q) {
+        parse_error(ps, "引号不匹配");
+    }
+    ps->p++;
+    ps->text[n] = 0;
+}
+
+/*
+ * 取下一个词法单元
+ */
+static void
+lex(struct fparser *ps) {
+    const char *p;
+
+    while (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n') {
+        ps->p++;
+    }
+    p = ps->p;
+    switch (*p) {
+    case 0:
+        ps->tok = T_END;
+        return;
+    case '(':
+        ps->tok = T_LP;
+        ps->p++;
+        return;
+    case ')':
+        ps->tok = T_RP;
+        ps->p++;
+        return;
+    case ',':
+        ps->tok = T_COMMA;
+        ps->p++;
+        return;
+    case '\'':
+        lex_quoted(ps, '\'');
+        ps->tok = T_STR;
+        return;
+    case '"':
+        lex_quoted(ps, '"');
+        ps->tok = T_NAME;
+        return;
+    case '=':
+        ps->tok = T_OP;
+        ps->op = OP_EQ;
+        ps->p += p[1] == '=' ? 2 : 1;
+        return;
+    case '!':
+        if (p[1] != '=') {
+            parse_error(ps, "不认识的符号");
+        }
+        ps->tok = T_OP;
+        ps->op = OP_NE;
+        ps->p += 2;
+        return;
+    case '<':
+        ps->tok = T_OP;
+        if (p[1] == '=') {
+            ps->op = OP_LE;
+            ps->p += 2;
+        } else if (p[1] == '>') {
+            ps->op = OP_NE;
+            ps->p += 2;
+        } else {
+            ps->op = OP_LT;
+            ps->p++;
+        }
+        return;
+    case '>':
+        ps->tok = T_OP;
+        if (p[1] == '=') {
+            ps->op = OP_GE;
+            ps->p += 2;
+        } else {
+            ps->op = OP_GT;
+            ps->p++;
+        }
+        return;
+    }
+    if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.') {
+        const char *q = p;
+        char *end;
+
+        ps->num = strtod(p, &end);
+        if (end == p) {
+            parse_error(ps, "数字格式不对");
+        }
+        while (is_name_char(*q)) {
+            q++;
+        }
+        if (q <= end) {  // 2级代号 这样数字开头、后面还有名字字符的是属性名，下面按名字读
+            ps->tok = T_NUM;
+            ps->p = end;
+            return;
+        }
+    }
+    if (!is_name_char(*p)) {
+        parse_error(ps, "不认识的符号");
+    }
+    while (is_name_char(*ps->p)) {
+        ps->p++;
+    }
+    if ((size_t)(ps->p - p) >= sizeof(ps->text)) {
+        parse_error(ps, "名字太长");
+    }
+    memcpy(ps->text, p, ps->p - p);
+    ps->text[ps->p - p] = 0;
+    if (strcasecmp(ps->text, "AND") == 0) {
+        ps->tok = T_AND;
+    } else if (strcasecmp(ps->text, "OR") == 0) {
+        ps->tok = T_OR;
+    } else if (strcasecmp(ps->text, "NOT") == 0) {
+        ps->tok = T_NOT;
+    } else if (strcasecmp(ps->text, "IN") == 0) {
+        ps->tok = T_IN;
+    } else {
+        ps->tok = T_NAME;
+    }
+}
+
+static struct filter *
+new_node(int kind) {
+    struct filter *f = calloc(1, sizeof(*f));
+
+    if (!f) {
+        err(1, "malloc");
+    }
+    f->kind = kind;
+    return f;
+}
+
+/*
+ * 按 UTF-8 名字找属性定义，把偏移量等填进叶子结点
+ */
+static void
+bind_attr(struct fparser *ps, struct filter *f, const char *name) {
+    for (int i = 0; i < ps->ndef; i++) {
+        if (strcmp(ps->defu[i].name_utf8, name) == 0) {
+            f->type = ps->defu[i].o.type;
+            f->attr_off = ps->defu[i].o.attr_off;
+            f->size = ps->defu[i].o.size;
+            if (f->type != ATTR_STR && f->type != ATTR_INT && f->type != ATTR_FLOAT && f->type != ATTR_DOUBLE) {
+                errx(1, "--where: 属性 \"%s\" 的类型 %d 不支持", name, f->type);
+            }
+            return;
+        }
+    }
+    errx(1, "--where: 没有名为 \"%s\" 的属性", name);
+}
+
+/*
+ * 读一个常量值，并按属性类型检查。字符串转成 GB18030
+ */
+static void
+parse_value(struct fparser *ps, struct filter *f, struct fvalue *v) {
+    if (ps->tok == T_NUM) {
+        if (f->type == ATTR_STR) {
+            parse_error(ps, "字符串属性只能与 '字符串' 比较");
+        }
+        v->num = ps->num;
+        v->fnum = (float)ps->num;
+    } else if (ps->tok == T_STR) {
+        size_t inbufl, outbufl;
+        char *inbufp, *outbufp;
+        char buf[512];
+
+        if (f->type != ATTR_STR) {
+            parse_error(ps, "数值属性只能与数字比较");
+        }
+        iconv(ps->icv, NULL, NULL, NULL, NULL);
+        inbufp = ps->text;
+        inbufl = strlen(ps->text);
+        outbufp = buf;
+        outbufl = sizeof(buf);
+        if (iconv(ps->icv, &inbufp, &inbufl, &outbufp, &outbufl) == (size_t)-1) {
+            parse_error(ps, "字符串无法转成 GB18030");
+        }
+        v->len = sizeof(buf) - outbufl;
+        v->str = malloc(v->len + 1);
+        if (!v->str) {
+            err(1, "malloc");
+        }
+        memcpy(v->str, buf, v->len);
+        v->str[v->len] = 0;
+    } else {
+        parse_error(ps, "这里应该是一个值");
+    }
+    lex(ps);
+}
+
+static int
+flip_op(int op) {
+    switch (op) {
+    case OP_LT:
+        return OP_GT;
+    case OP_LE:
+        return OP_GE;
+    case OP_GT:
+        return OP_LT;
+    case OP_GE:
+        return OP_LE;
+    }
+    return op;
+}
+
+static struct filter *parse_or(struct fparser *ps);
+
+/*
+ * 比较或 IN 列表，或者括号里的子表达式
+ */
+static struct filter *
+parse_primary(struct fparser *ps) {
+    struct filter *f;
+
+    if (ps->tok == T_LP) {
+        lex(ps);
+        f = parse_or(ps);
+        if (ps->tok != T_RP) {
+            parse_error(ps, "缺少 )");
+        }
+        lex(ps);
+        return f;
+    }
+    f = new_node(F_CMP);
+    f->nvals = 1;
+    f->vals = calloc(1, sizeof(*f->vals));
+    if (!f->vals) {
+        parse_error(ps, "内存不够");
+    }
+    if (ps->tok == T_NUM || ps->tok == T_STR) {  // 值 比较符 属性名
+        int vtok = ps->tok;
+        double num = ps->num;
+        char text[sizeof(ps->text)];
+
+        strcpy(text, ps->text);
+        lex(ps);
+        if (ps->tok != T_OP) {
+            parse_error(ps, "这里应该是比较符");
+        }
+        f->op = flip_op(ps->op);
+        lex(ps);
+        if (ps->tok != T_NAME) {
+            parse_error(ps, "这里应该是属性名");
+        }
+        bind_attr(ps, f, ps->text);
+        // 把值放回去再按属性类型解析
+        ps->tok = vtok;
+        ps->num = num;
+        strcpy(ps->text, text);
+        parse_value(ps, f, f->vals);
+        return f;
+    }
+    if (ps->tok != T_NAME) {
+        parse_error(ps, "这里应该是属性名");
+    }
+    bind_attr(ps, f, ps->text);
+    lex(ps);
+    if (ps->tok == T_OP) {
+        f->op = ps->op;
+        lex(ps);
+        parse_value(ps, f, f->vals);
+        return f;
+    }
+    int negate = 0;
+
+    if (ps->tok == T_NOT) {
+        negate = 1;
+        lex(ps);
+    }
+    if (ps->tok != T_IN) {
+        parse_error(ps, "这里应该是比较符或 IN");
+    }
+    lex(ps);
+    if (ps->tok != T_LP) {
+        parse_error(ps, "IN 后面应该是 (");
+    }
+    lex(ps);
+    f->kind = F_IN;
+    f->nvals = 0;
+    for (int cap = 1;;) {
+        if (f->nvals == cap) {
+            struct fvalue *vals = realloc(f->vals, cap * 2 * sizeof(*f->vals));
+
+            if (!vals) {
+                parse_error(ps, "IN 列表太长，内存不够");
+            }
+            f->vals = vals;
+            cap *= 2;
+        }
+        memset(f->vals + f->nvals, 0, sizeof(*f->vals));
+        parse_value(ps, f, f->vals + f->nvals);
+        f->nvals++;
+        if (ps->tok == T_RP) {
+            break;
+        }
+        if (ps->tok != T_COMMA) {
+            parse_error(ps, "IN 列表中应该是 , 或 )");
+        }
+        lex(ps);
+    }
+    lex(ps);
+    if (negate) {
+        struct filter *n = new_node(F_NOT);
+
+        n->l = f;
+        f = n;
+    }
+    return f;
+}
+
+static struct filter *
+parse_not(struct fparser *ps) {
+    if (ps->tok == T_NOT) {
+        struct filter *f = new_node(F_NOT);
+
+        lex(ps);
+        f->l = parse_not(ps);
+        return f;
+    }
+    return parse_primary(ps);
+}
+
+static struct filter *
+parse_and(struct fparser *ps) {
+    struct filter *f = parse_not(ps);
+
+    while (ps->tok == T_AND) {
+        struct filter *n = new_node(F_AND);
+
+        lex(ps);
+        n->l = f;
+        n->r = parse_not(ps);
+        f = n;
+    }
+    return f;
+}
+
+static struct filter *
+parse_or(struct fparser *ps) {
+    struct filter *f = parse_and(ps);
+
+    while (ps->tok == T_OR) {
+        struct filter *n = new_node(F_OR);
+
+        lex(ps);
+        n->l = f;
+        n->r = parse_and(ps);
+        f = n;
+    }
+    return f;
+}
+
+struct filter *
+filter_compile(const char *expr, struct obj_attr_define_utf8 *defu, int ndef) {
+    struct fparser ps;
+    struct filter *f;
+
+    bzero(&ps, sizeof(ps));
+    ps.expr = expr;
+    ps.p = expr;
+    ps.defu = defu;
+    ps.ndef = ndef;
+    ps.icv = iconv_open("GB18030", "UTF-8");
+    if (ps.icv == (iconv_t)-1) {
+        err(1, "iconv 初始化失败");
+    }
+    lex(&ps);
+    f = parse_or(&ps);
+    if (ps.tok != T_END) {
+        parse_error(&ps, "表达式后面有多余的内容");
+    }
+    iconv_close(ps.icv);
+    return f;
+}
+
+/*
+ * 属性值行中的整数或双精度属性，行内偏移量不一定对齐，所以用 memcpy 取
+ */
+static double
+row_number(const struct filter *f, const char *row) {
+    const char *p = row + f->attr_off;
+    int vi;
+    double vd;
+
+    if (f->type == ATTR_INT) {
+        memcpy(&vi, p, sizeof(vi));
+        return vi;
+    }
+    memcpy(&vd, p, sizeof(vd));
+    return vd;
+}
+
+/*
+ * 属性值行中的单精度属性
+ */
+static float
+row_float(const struct filter *f, const char *row) {
+    float vf;
+
+    memcpy(&vf, row + f->attr_off, sizeof(vf));
+    return vf;
+}
+
+/*
+ * 比较字符串属性的原始字节与常量，属性值以 0 结尾或占满 size 个字节
+ */
+static int
+row_strcmp(const struct filter *f, const char *row, const struct fvalue *v) {
+    const char *p = row + f->attr_off;
+    size_t n = strnlen(p, f->size);
+    int c = memcmp(p, v->str, n < v->len ? n : v->len);
+
+    if (c != 0) {
+        return c;
+    }
+    return n < v->len ? -1 : n > v->len;
+}
+
+static int
+op_result(int op, int c) {
+    switch (op) {
+    case OP_EQ:
+        return c == 0;
+    case OP_NE:
+        return c != 0;
+    case OP_LT:
+        return c < 0;
+    case OP_LE:
+        return c <= 0;
+    case OP_GT:
+        return c > 0;
+    default:
+        return c >= 0;
+    }
+}
+
+int
+filter_match(const struct filter *f, const char *row) {
+    double x;
+    float xf;
+
+    switch (f->kind) {
+    case F_OR:
+        return filter_match(f->l, row) || filter_match(f->r, row);
+    case F_AND:
+        return filter_match(f->l, row) && filter_match(f->r, row);
+    case F_NOT:
+        return !filter_match(f->l, row);
+    case F_CMP:
+        if (f->type == ATTR_STR) {
+            return op_result(f->op, row_strcmp(f, row, f->vals));
+        }
+        if (f->type == ATTR_FLOAT) {
+            xf = row_float(f, row);
+            return op_result(f->op, (xf > f->vals->fnum) - (xf < f->vals->fnum));
+        }
+        x = row_number(f, row);
+        return op_result(f->op, (x > f->vals->num) - (x < f->vals->num));
+    case F_IN:
+        if (f->type == ATTR_STR) {
+            for (int i = 0; i < f->nvals; i++) {
+                if (row_strcmp(f, row, f->vals + i) == 0) {
+                    return 1;
+                }
+            }
+            return 0;
+        }
+        if (f->type == ATTR_FLOAT) {
+            xf = row_float(f, row);
+            for (int i = 0; i < f->nvals; i++) {
+                if (xf == f->vals[i].fnum) {
+                    return 1;
+                }
+            }
+            return 0;
+        }
+        x = row_number(f, row);
+        for (int i = 0; i < f->nvals; i++) {
+            if (x == f->vals[i].num) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return 0;
+}
+
+void
+filter_free(struct filter *f) {
+    if (!f) {
+        return;
+    }
+    filter_free(f->l);
+    filter_free(f->r);
+    for (int i = 0; i < f->nvals; i++) {
+        free(f->vals[i].str);
+    }
+    free(f->vals);
+    free(f);
+}
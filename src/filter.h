@@ -0,0 +1,43 @@
+/*
+ * --where 属性过滤表达式
+ *
+ * 表达式在遍历多边形之前按属性定义编译好，之后直接在属性值行的原始字节上求值，
+ * 不满足条件的多边形就不用再构造环、查颜色和输出了
+ *
+ * 语法（关键字不区分大小写）：
+ *   expr := expr OR expr | expr AND expr | NOT expr | ( expr )
+ *         | 属性名 比较符 值 | 值 比较符 属性名
+ *         | 属性名 [NOT] IN ( 值, 值, ... )
+ *   比较符 := = == != <> < <= > >=
+ *   属性名 := 不带引号的名字（字母、数字、_ 及任意 UTF-8 字符）或 "双引号括起来的名字"
+ *             数字开头的也可以不带引号，如 2级代号，只要整个词不是一个数
+ *   值 := 数字 | '单引号括起来的字符串'
+ * 单精度属性与数字按单精度比较（数字先舍入成 float），所以 周长 = 1.04 能匹配上存成 float 的 1.04
+ */
+#ifndef MAPGIS_FILTER_H
+#define MAPGIS_FILTER_H
+
+#include <iconv.h>
+
+#include "mapgisf.h"
+
+struct filter;
+
+/*
+ * 编译过滤表达式，出错时直接退出
+ *   - expr  表达式文本，UTF-8
+ *   - defu  各属性定义，UTF-8版
+ *   - ndef  属性个数
+ * 字符串常量在这里就转成了 GB18030，求值时不再需要转码
+ */
+struct filter *filter_compile(const char *expr, struct obj_attr_define_utf8 *defu, int ndef);
+
+/*
+ * 对一行属性值求值，满足条件返回 1，否则返回 0
+ *   - row   该对象属性值起始点
+ */
+int filter_match(const struct filter *f, const char *row);
+
+void filter_free(struct filter *f);
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * 64 位的快速非加密散列，算法与 XXH64 相同，用于按内容判断文件是否变了
+ */
+#ifndef MAPGIS_HASH_H
+#define MAPGIS_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash64(const void *p, size_t len, uint64_t seed);
+
+/*
+ * 整个文件内容的 hash64()，读不了返回 0 并设好 errno
+ */
+int hash_file(const char *path, uint64_t seed, uint64_t *h);
+
+#endif
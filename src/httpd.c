@@ -0,0 +1,332 @@
+/*
+ * 极简的 HTTP 服务，见 httpd.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "httpd.h"
+#include "pool.h"
+
+#define HTTPD_MAX_REQUEST 8192  // 请求头最长这么多字节
+#define HTTPD_TIMEOUT 10  // 读请求头和写响应的超时，秒
+#define HTTPD_SAMPLES 8192  // 保留最近这么多个请求的用时
+#define HTTPD_MAX_PENDING 1024  // 最多同时有这么多个连接在读请求头
+
+/*
+ * 还在读请求头的连接，由主线程 poll
+ */
+struct conn {
+    struct http_req *req;
+    char buf[HTTPD_MAX_REQUEST + 1];
+    size_t len;
+};
+
+struct httpd {
+    int fd;
+    struct pool *pool;
+    httpd_handler handler;
+    void *arg;
+    pthread_mutex_t lock;  // 保护下面的统计
+    long requests;
+    double samples[HTTPD_SAMPLES];  // 环形，第 i 个请求放在 i % HTTPD_SAMPLES
+};
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct httpd *
+httpd_create(int port, struct pool *pool, httpd_handler handler, void *arg) {
+    struct httpd *s = calloc(1, sizeof(*s));
+    struct sockaddr_in sa;
+    int one = 1;
+
+    if (!s) {
+        err(1, "calloc");
+    }
+    s->pool = pool;
+    s->handler = handler;
+    s->arg = arg;
+    pthread_mutex_init(&s->lock, NULL);
+    signal(SIGPIPE, SIG_IGN);  // 客户端提前断开时 write() 返回错误就行了，不要退出
+    s->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->fd == -1) {
+        err(1, "socket");
+    }
+    setsockopt(s->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s->fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        err(1, "监听端口 %d 失败", port);
+    }
+    if (listen(s->fd, 128) != 0) {
+        err(1, "listen");
+    }
+    return s;
+}
+
+/*
+ * 解析请求头，得出路径，成功返回 1
+ */
+static int
+parse_request(struct http_req *req, const char *buf) {
+    const char *path, *sp;
+
+    if (strncmp(buf, "GET ", 4) != 0) {
+        return 0;
+    }
+    path = buf + 4;
+    sp = strpbrk(path, " ?\r\n");
+    if (!sp || (size_t)(sp - path) >= sizeof(req->path)) {
+        return 0;
+    }
+    memcpy(req->path, path, sp - path);
+    req->path[sp - path] = 0;
+    return 1;
+}
+
+static void
+write_full(int fd, const void *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {  // 客户端走了，不管它
+            return;
+        }
+        p = (const char *)p + r;
+        n -= r;
+    }
+}
+
+static const char *
+status_text(int status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+void
+httpd_respond(struct http_req *req, int status, const char *type, const void *body, size_t len) {
+    char head[512];
+    int n;
+
+    n = snprintf(head, sizeof(head),
+            "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+            "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n",
+            status, status_text(status), type, len);
+    write_full(req->fd, head, n);
+    write_full(req->fd, body, len);
+    req->status = status;
+}
+
+/*
+ * 关闭连接，记下用时
+ */
+static void
+finish_conn(struct http_req *req) {
+    struct httpd *s = req->server;
+
+    close(req->fd);
+
+    double ms = (now() - req->t0) * 1000;
+
+    pthread_mutex_lock(&s->lock);
+    s->samples[s->requests % HTTPD_SAMPLES] = ms;
+    s->requests++;
+    pthread_mutex_unlock(&s->lock);
+    free(req);
+}
+
+/*
+ * 处理一个读完了请求头的连接，在线程池中执行
+ */
+static void
+serve_conn(void *arg) {
+    struct http_req *req = arg;
+
+    req->server->handler(req, req->server->arg);
+    finish_conn(req);
+}
+
+static void
+set_nonblock(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags == -1 || fcntl(fd, F_SETFL, on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == -1) {
+        err(1, "fcntl");
+    }
+}
+
+/*
+ * 读一个连接上已到的数据，返回 1 表示请求头还没读完，0 表示这个连接已经交出去或关掉了
+ */
+static int
+conn_read(struct conn *c) {
+    struct http_req *req = c->req;
+
+    for (;;) {
+        ssize_t r;
+
+        if (c->len == HTTPD_MAX_REQUEST) {
+            break;
+        }
+        r = read(req->fd, c->buf + c->len, HTTPD_MAX_REQUEST - c->len);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        }
+        if (r <= 0) {
+            break;
+        }
+        c->len += r;
+        c->buf[c->len] = 0;
+        if (strstr(c->buf, "\r\n\r\n") || strstr(c->buf, "\n\n")) {  // 读完了
+            if (!parse_request(req, c->buf)) {
+                break;
+            }
+            set_nonblock(req->fd, 0);  // 处理时按原来的方式阻塞写，有 SO_SNDTIMEO 兜底
+            pool_submit(req->server->pool, serve_conn, req);
+            return 0;
+        }
+    }
+    httpd_respond(req, 400, "text/plain", "bad request\n", 12);  // 响应很短，非阻塞也能一次写进发送缓冲区
+    finish_conn(req);
+    return 0;
+}
+
+void
+httpd_run(struct httpd *s) {
+    struct timeval tv = {HTTPD_TIMEOUT, 0};
+    struct conn *conns[HTTPD_MAX_PENDING];
+    struct pollfd pfds[HTTPD_MAX_PENDING + 1];
+    int n = 0;
+
+    set_nonblock(s->fd, 1);
+    for (;;) {
+        double t = now();
+        int timeout = -1;
+
+        for (int i = 0; i < n;) {  // 超时的连接不再等了，和以前阻塞读超时一样回 400
+            if (t - conns[i]->req->t0 >= HTTPD_TIMEOUT) {
+                httpd_respond(conns[i]->req, 400, "text/plain", "bad request\n", 12);
+                finish_conn(conns[i]->req);
+                free(conns[i]);
+                conns[i] = conns[--n];
+                continue;
+            }
+            int ms = (conns[i]->req->t0 + HTTPD_TIMEOUT - t) * 1000 + 1;
+
+            if (timeout < 0 || ms < timeout) {
+                timeout = ms;
+            }
+            pfds[i] = (struct pollfd){conns[i]->req->fd, POLLIN, 0};
+            i++;
+        }
+        pfds[n] = (struct pollfd){s->fd, n < HTTPD_MAX_PENDING ? POLLIN : 0, 0};  // 满了先不接受新连接
+        if (poll(pfds, n + 1, timeout) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "poll");
+        }
+        int accepting = pfds[n].revents & POLLIN;
+
+        for (int i = n - 1; i >= 0; i--) {  // 倒着处理，换过来的是已经处理过的
+            if (pfds[i].revents && !conn_read(conns[i])) {
+                free(conns[i]);
+                conns[i] = conns[--n];
+            }
+        }
+        while (accepting && n < HTTPD_MAX_PENDING) {
+            int fd = accept(s->fd, NULL, NULL);
+
+            if (fd == -1) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE || errno == ENFILE) {
+                    break;
+                }
+                err(1, "accept");
+            }
+            set_nonblock(fd, 1);
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+            struct conn *c = calloc(1, sizeof(*c));
+            struct http_req *req = calloc(1, sizeof(*req));
+
+            if (!c || !req) {
+                err(1, "calloc");
+            }
+            req->server = s;
+            req->fd = fd;
+            req->t0 = now();
+            c->req = req;
+            conns[n++] = c;
+        }
+    }
+}
+
+static int
+cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+void
+httpd_get_stats(struct httpd *s, struct httpd_stats *st) {
+    double *v = malloc(HTTPD_SAMPLES * sizeof(*v));
+    int n;
+
+    if (!v) {
+        err(1, "malloc");
+    }
+    pthread_mutex_lock(&s->lock);
+    st->requests = s->requests;
+    n = s->requests < HTTPD_SAMPLES ? (int)s->requests : HTTPD_SAMPLES;
+    memcpy(v, s->samples, n * sizeof(*v));
+    pthread_mutex_unlock(&s->lock);
+
+    qsort(v, n, sizeof(*v), cmp_double);
+    st->samples = n;
+    st->p50 = n ? v[(n - 1) * 50 / 100] : 0;
+    st->p90 = n ? v[(n - 1) * 90 / 100] : 0;
+    st->p99 = n ? v[(n - 1) * 99 / 100] : 0;
+    st->max = n ? v[n - 1] : 0;
+    free(v);
+}
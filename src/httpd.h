@@ -0,0 +1,52 @@
+/*
+ * 极简的 HTTP/1.0 服务，只给本机用（只监听 127.0.0.1），只处理 GET
+ *
+ * 主线程接受连接并用 poll 读请求头，读完了的请求才作为一个任务交给线程池（见 pool.h），
+ * 这样慢的或不发请求的连接不会占着工作线程；处理完就关闭连接
+ * 每个请求从接受连接到写完响应的用时都记下来，最近的若干个用来算百分位数
+ */
+#ifndef MAPGIS_HTTPD_H
+#define MAPGIS_HTTPD_H
+
+#include <stddef.h>
+
+struct pool;
+struct httpd;
+
+struct http_req {
+    struct httpd *server;
+    int fd;
+    char path[1024];  // 请求的路径，不含查询串
+    double t0;  // 接受连接的时刻，秒
+    int status;  // 响应的状态码
+};
+
+/*
+ * 处理一个请求，处理中必须调用一次 httpd_respond()
+ */
+typedef void (*httpd_handler)(struct http_req *req, void *arg);
+
+/*
+ * 在 127.0.0.1:port 上监听，出错时直接退出
+ */
+struct httpd *httpd_create(int port, struct pool *pool, httpd_handler handler, void *arg);
+
+/*
+ * 不断接受连接，不会返回
+ */
+void httpd_run(struct httpd *s);
+
+/*
+ * 写出响应，body 为 len 个字节，type 为 Content-Type
+ */
+void httpd_respond(struct http_req *req, int status, const char *type, const void *body, size_t len);
+
+struct httpd_stats {
+    long requests;  // 处理过的请求数
+    int samples;  // 算百分位数用的请求数
+    double p50, p90, p99, max;  // 用时，毫秒
+};
+
+void httpd_get_stats(struct httpd *s, struct httpd_stats *st);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * 有界无锁队列，见 lfq.h
+ */
+
+#include <stdlib.h>
+#include <err.h>
+
+#include "lfq.h"
+
+#define CACHE_LINE 64
+
+struct lfq_cell {
+    size_t seq;  // 等于位置时可以放入，等于位置 + 1 时可以取出
+    void *data;
+};
+
+struct lfq {
+    struct lfq_cell *cells;
+    size_t mask;
+    char pad0[CACHE_LINE];
+    size_t enq_pos;  // 下一个放入的位置，生产者和消费者的位置放在不同的缓存行上，免得互相干扰
+    char pad1[CACHE_LINE];
+    size_t deq_pos;  // 下一个取出的位置
+    char pad2[CACHE_LINE];
+};
+
+struct lfq *
+lfq_create(size_t cap) {
+    struct lfq *q = calloc(1, sizeof(*q));
+    size_t n = 2;
+
+    while (n < cap) {
+        n *= 2;
+    }
+    if (!q || !(q->cells = malloc(n * sizeof(*q->cells)))) {
+        err(1, "malloc");
+    }
+    for (size_t i = 0; i < n; i++) {
+        q->cells[i].seq = i;
+    }
+    q->mask = n - 1;
+    return q;
+}
+
+int
+lfq_push(struct lfq *q, void *data) {
+    size_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+    struct lfq_cell *c;
+
+    for (;;) {
+        c = q->cells + (pos & q->mask);
+        size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)seq - (long)pos;
+
+        if (dif == 0) {  // 格子空着，抢这个位置
+            if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {  // 格子里的还没被取走，满了
+            return 0;
+        } else {  // 被别的生产者抢先了
+            pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    c->data = data;
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void *
+lfq_pop(struct lfq *q) {
+    size_t pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+    struct lfq_cell *c;
+    void *data;
+
+    for (;;) {
+        c = q->cells + (pos & q->mask);
+        size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)seq - (long)(pos + 1);
+
+        if (dif == 0) {  // 格子里有东西，抢这个位置
+            if (__atomic_compare_exchange_n(&q->deq_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {  // 空了
+            return NULL;
+        } else {  // 被别的消费者抢先了
+            pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    data = c->data;
+    __atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+void
+lfq_free(struct lfq *q) {
+    if (q) {
+        free(q->cells);
+        free(q);
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * 有界无锁队列，多生产者多消费者，算法见 Dmitry Vyukov 的 bounded MPMC queue
+ *
+ * 每个格子有一个序号，生产者和消费者各自用 CAS 抢位置，抢到后只碰自己的格子，不用加锁
+ * 容量固定，满了 push 失败，空了 pop 失败，由调用者决定是等待还是干别的
+ */
+#ifndef MAPGIS_LFQ_H
+#define MAPGIS_LFQ_H
+
+#include <stddef.h>
+
+struct lfq;
+
+/*
+ * 创建队列，容量向上取整到 2 的幂
+ */
+struct lfq *lfq_create(size_t cap);
+
+/*
+ * 放入一项，队列满了返回 0
+ */
+int lfq_push(struct lfq *q, void *data);
+
+/*
+ * 取出一项，队列空了返回 NULL
+ */
+void *lfq_pop(struct lfq *q);
+
+void lfq_free(struct lfq *q);
+
+#endif
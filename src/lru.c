@@ -0,0 +1,225 @@
+/*
+ * LRU 缓存，见 lru.h
+ *
+ * 散列表（拉链）找项，双向链表按使用先后排，表头是最近用过的
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "lru.h"
+
+struct lru_entry {
+    struct lru_entry *hnext;  // 散列表同一个桶中的下一项
+    struct lru_entry *prev, *next;  // 使用先后
+    char *key;
+    void *data;
+    size_t len;
+    size_t cost;  // 记在总字节数中的大小，见 entry_cost()
+};
+
+struct lru {
+    pthread_mutex_t lock;
+    struct lru_entry **buckets;
+    size_t num_buckets;  // 2 的幂
+    struct lru_entry *head, *tail;  // head 最近用过，tail 最久没用
+    size_t max_bytes;
+    size_t bytes;
+    int entries;
+    long hits, misses, evictions;
+};
+
+/*
+ * 一项占的字节数：值、键，加上项本身和几次 malloc 的开销，这样空的值（比如 204 的瓦片）也有代价，会被淘汰
+ */
+static size_t
+entry_cost(const char *key, size_t len) {
+    return len + strlen(key) + 1 + sizeof(struct lru_entry) + 4 * sizeof(void *);
+}
+
+static size_t
+hash_str(const char *s) {
+    size_t h = 14695981039346656037u;  // FNV-1a
+
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 1099511628211u;
+    }
+    return h;
+}
+
+static void
+list_unlink(struct lru *c, struct lru_entry *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        c->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        c->tail = e->prev;
+    }
+}
+
+static void
+list_push_head(struct lru *c, struct lru_entry *e) {
+    e->prev = NULL;
+    e->next = c->head;
+    if (c->head) {
+        c->head->prev = e;
+    } else {
+        c->tail = e;
+    }
+    c->head = e;
+}
+
+/*
+ * 找 key 所在的位置，*pp 指向它（没有时指向桶尾的 NULL）
+ */
+static struct lru_entry **
+find(struct lru *c, const char *key) {
+    struct lru_entry **pp = c->buckets + (hash_str(key) & (c->num_buckets - 1));
+
+    while (*pp && strcmp((*pp)->key, key) != 0) {
+        pp = &(*pp)->hnext;
+    }
+    return pp;
+}
+
+static void
+remove_entry(struct lru *c, struct lru_entry *e) {
+    struct lru_entry **pp = find(c, e->key);
+
+    *pp = e->hnext;
+    list_unlink(c, e);
+    c->bytes -= e->cost;
+    c->entries--;
+    free(e->key);
+    free(e->data);
+    free(e);
+}
+
+/*
+ * 项数多于桶数时桶数加倍
+ */
+static void
+grow(struct lru *c) {
+    size_t n = c->num_buckets * 2;
+    struct lru_entry **b = calloc(n, sizeof(*b));
+
+    if (!b) {
+        err(1, "calloc");
+    }
+    for (struct lru_entry *e = c->head; e; e = e->next) {
+        size_t i = hash_str(e->key) & (n - 1);
+
+        e->hnext = b[i];
+        b[i] = e;
+    }
+    free(c->buckets);
+    c->buckets = b;
+    c->num_buckets = n;
+}
+
+struct lru *
+lru_create(size_t max_bytes) {
+    struct lru *c = calloc(1, sizeof(*c));
+
+    if (!c) {
+        err(1, "calloc");
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->num_buckets = 1024;
+    c->buckets = calloc(c->num_buckets, sizeof(*c->buckets));
+    if (!c->buckets) {
+        err(1, "calloc");
+    }
+    c->max_bytes = max_bytes;
+    return c;
+}
+
+int
+lru_get(struct lru *c, const char *key, char **data, size_t *len) {
+    struct lru_entry *e;
+
+    pthread_mutex_lock(&c->lock);
+    e = *find(c, key);
+    if (!e) {
+        c->misses++;
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+    c->hits++;
+    list_unlink(c, e);
+    list_push_head(c, e);
+    *data = malloc(e->len ? e->len : 1);
+    if (!*data) {
+        err(1, "malloc");
+    }
+    memcpy(*data, e->data, e->len);
+    *len = e->len;
+    pthread_mutex_unlock(&c->lock);
+    return 1;
+}
+
+void
+lru_put(struct lru *c, const char *key, const void *data, size_t len) {
+    struct lru_entry *e;
+    size_t cost = entry_cost(key, len);
+
+    if (cost > c->max_bytes) {
+        return;
+    }
+    // 先复制好再加锁
+    e = calloc(1, sizeof(*e));
+    if (!e || !(e->key = strdup(key)) || !(e->data = malloc(len ? len : 1))) {
+        err(1, "malloc");
+    }
+    memcpy(e->data, data, len);
+    e->len = len;
+    e->cost = cost;
+
+    pthread_mutex_lock(&c->lock);
+    struct lru_entry *old = *find(c, key);
+
+    if (old) {  // 别的线程同时也生成了一份
+        remove_entry(c, old);
+    }
+    while (c->bytes + cost > c->max_bytes && c->tail) {
+        remove_entry(c, c->tail);
+        c->evictions++;
+    }
+    struct lru_entry **pp = find(c, key);
+
+    *pp = e;
+    list_push_head(c, e);
+    c->bytes += cost;
+    c->entries++;
+    if ((size_t)c->entries > c->num_buckets) {
+        grow(c);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+void
+lru_get_stats(struct lru *c, struct lru_stats *st) {
+    pthread_mutex_lock(&c->lock);
+    st->hits = c->hits;
+    st->misses = c->misses;
+    st->evictions = c->evictions;
+    st->bytes = c->bytes;
+    st->entries = c->entries;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void
+lru_free(struct lru *c) {
+    while (c->head) {
+        remove_entry(c, c->head);
+    }
+    free(c->buckets);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
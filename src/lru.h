@@ -0,0 +1,40 @@
+/*
+ * 按字节数限制大小的 LRU 缓存，键是字符串，值是一块字节，多线程共用，内部加锁
+ *
+ * 取出时复制一份给调用者，放进去之后缓存里的东西与调用者无关，不用担心被淘汰时还有人在用
+ */
+#ifndef MAPGIS_LRU_H
+#define MAPGIS_LRU_H
+
+#include <stddef.h>
+
+struct lru;
+
+/*
+ * 创建缓存，所有项加起来不超过 max_bytes 字节，每项按值、键和固定的每项开销算
+ */
+struct lru *lru_create(size_t max_bytes);
+
+/*
+ * 取出 key 的值，复制到 malloc() 出来的 *data 中，没有返回 0
+ */
+int lru_get(struct lru *c, const char *key, char **data, size_t *len);
+
+/*
+ * 放入 key 的值，已有的替换掉，放不下时淘汰最久没用的，比整个缓存还大的不放
+ */
+void lru_put(struct lru *c, const char *key, const void *data, size_t len);
+
+struct lru_stats {
+    long hits;
+    long misses;
+    long evictions;
+    size_t bytes;
+    int entries;
+};
+
+void lru_get_stats(struct lru *c, struct lru_stats *st);
+
+void lru_free(struct lru *c);
+
+#endif
@@ -3,20 +3,50 @@
  * 目前是将 .WP 文件转成 GeoJSON 文件
  */
 
+#define _GNU_SOURCE  // asprintf()
+
 #include <stdio.h>  // printf()
+#include <stddef.h>  // offsetof()
+#include <limits.h>  // INT_MAX
 #include <sys/types.h>  // open()
 #include <sys/stat.h>  // open()
 #include <fcntl.h>  // open()
 #include <err.h>  // err()
+#include <errno.h>  // errno
 #include <unistd.h>  // read()
 #include <stdlib.h>  // malloc() and free()
 #include <iconv.h>  // iconv_open(), iconv()
 #include <string.h>  // strncpy()
 #include <strings.h>  // bzero()
 #include <math.h>  // round()
+#include <getopt.h>  // getopt_long()
+#include <dirent.h>  // opendir()
+#include <time.h>  // clock_gettime()
+#include <sys/mman.h>  // mmap()
+#include <pthread.h>  // pthread_once()
+#include <poll.h>  // poll()
+#include <sys/inotify.h>  // inotify_init1()
 
-#include "cJSON.h"
 #include "mapgisf.h"
+#include "filter.h"
+#include "lfq.h"
+#include "mvt.h"
+#include "fgb.h"
+#include "shp.h"
+#include "arrow.h"
+#include "pgcopy.h"
+#include "csv.h"
+#include "cache.h"
+#include "convcache.h"
+#include "hash.h"
+#include "lru.h"
+#include "httpd.h"
+#include "obuf.h"
+#include "pgz.h"
+#include "pool.h"
+#include "proj.h"
+#include "sbuf.h"
+#include "simplify.h"
 
 #define MAPGIS_UTIL_DEBUG
 
@@ -26,14 +56,177 @@
 #define DEBUG_PRINT(...)
 #endif
 
+const char *file_type_names[] = {
+    "Line",
+    "Point",
+    "Polygon"
+};
+
 int g_num_line = 0; // 总线数，主e要用于判断线号越界
+/*
+ * -v，打印每个多边形、每条线的详细信息
+ * 原来这些总是打印到标准错误，一个 19 MB 的文件就要打印 57 MB，比转换本身还费时间，所以要 -v 才打印
+ */
+int g_verbose = 0;
+
+#define MAX_LODS 8  // --lod 最多的级数
+
+// 输出格式
+enum {
+    FORMAT_GEOJSON,
+    FORMAT_MVT,  // 矢量瓦片目录 <dir>/z/x/y.pbf
+    FORMAT_FGB,  // FlatGeobuf，带空间索引
+    FORMAT_SHP,  // ESRI Shapefile
+    FORMAT_ARROW,  // Arrow IPC 文件，几何为 GeoArrow
+    FORMAT_PGCOPY,  // PostgreSQL 二进制 COPY，几何为 EWKB
+    FORMAT_CSV,  // CSV，几何为 WKT
+};
+
+/*
+ * 命令行选项
+ */
+struct options {
+    char *select;  // --select，逗号分隔的属性名（UTF-8），只输出这些属性
+    char *exclude;  // --exclude，逗号分隔的属性名（UTF-8），不输出这些属性
+    char *where;  // --where，属性过滤表达式，见 filter.h
+    unsigned char *layers;  // --layer，只输出这些图层，按位表示，NULL 表示所有图层
+    int split_by_layer;  // --split-by layer，每个图层输出到一个文件
+    size_t shard_size;  // --shard-size，每个输出分片的最大字节数
+    long shard_features;  // --shard-features，每个输出分片的最大要素数
+    char *output;  // -o，输出文件名，NULL 表示标准输出；分文件时用它去掉扩展名的部分作为文件名前缀
+    int gzip;  // --gzip，并行压缩输出
+    int threads;  // -j，工作线程数，0 表示用 CPU 个数
+    char *out_dir;  // --out-dir，批量转换时的输出目录，NULL 表示输出到输入文件旁边
+    int to_epsg;  // --to-epsg，转成 WGS84（4326）或 CGCS2000（4490）经纬度，0 表示不转换
+    int zone;  // --zone，高斯-克吕格投影带号，0 表示从 x 坐标前面的带号得到
+    int zone_width;  // --zone-width，3 或 6 度带，0 表示按带号猜：大于 23 的是 3 度带
+    double central_meridian;  // --central-meridian，中央经线（度），NAN 表示由带号算
+    double towgs84[7];  // --towgs84，北京1954 到目标基准的七参数
+    double lod[MAX_LODS];  // --simplify 或 --lod，各级的化简容差，与输出坐标的单位相同，0 表示不化简
+    int num_lods;  // 化简的级数，不化简时也是 1 级
+    int lod_files;  // --lod，每级输出到自己的文件
+    int simplify;  // 有一级要化简
+    int format;  // --format
+    int min_zoom, max_zoom;  // --zoom，切瓦片的缩放级别范围
+    int serve_port;  // --serve，在本机这个端口上按请求生成瓦片，0 表示不用
+    size_t cache_size;  // --cache-size，--serve 时缓存瓦片的最大字节数
+    int batch;  // 批量转换：多个输入、输入是目录、--batch-list 或 --out-dir
+    int native_cache;  // --native-cache，各文件解码后写成本机缓存，以后直接映射缓存
+    char *cache_dir;  // --cache-dir，转换结果缓存的目录，NULL 表示不用
+    size_t cache_max;  // --cache-max，转换结果缓存的最大字节数
+    uint64_t cache_salt;  // 程序、色号定义和影响输出的各选项的散列，见 conv_cache_salt()
+    int watch;  // --watch，转换完后监视输入，有 .WP 文件改了就重新转换
+    int *get_ids;  // --get，只输出这些多边形（从 1 开始的序号），NULL 表示全部
+    int num_get_ids;
+};
+
+/*
+ * 组装好的多边形坐标，各环的点连续存放
+ */
+struct poly_coords {
+    double *xy;  // x0, y0, x1, y1, ...
+    int num_points;
+    int cap_points;
+    int *ring_end;  // 各环最后一点的下一个点的序号
+    int num_rings;
+    int cap_rings;
+};
+
+/*
+ * 要输出的属性
+ */
+struct out_attr {
+    struct obj_attr_define_utf8 *def;
+    char key[200];  // 转义好的 "属性名":
+    int key_len;
+    int str_col;  // 字符串属性在 sheet 的 UTF-8 属性列中的序号
+};
+
+/*
+ * 色号定义，从 Pcolor.lib 读出，所有文件共用
+ */
+struct palette {
+    struct pcolor_header h;
+    struct pcolor_def *table;
+    int max;  // 最大色号 + 1，目前把 1 到 max 都当作合法色号
+    char (*fill_strs)[32];  // 各色号的 FillRGB 值，预先都算好，转换时多个线程只读不写
+};
+
+/*
+ * 一个 .WP 文件，整个映射到内存中，各区直接指向映射的位置，用到哪里才由内核读进来
+ * 转换只用下面按序号排好的各数组（线表、环表、色号、图层）和对齐的坐标、线号数组，
+ * 它们由 sheet_decode() 从线信息和多边形信息中解出来，或者直接指向 --native-cache 的缓存文件（见 sheet_open()），
+ * 两种情况下的布局是一样的，转换时不再读未对齐的 packed 结构
+ */
+struct sheet {
+    const char *name;
+    void *map;  // 映射的整个文件，用缓存时是缓存文件
+    size_t map_len;
+    struct file_header fh;
+    struct data_headers dhs;
+    void *line_coords;  // 各线的坐标，按线号一条接一条，起点对齐到 CACHE_ALIGN；sheet_load() 时暂时指向 .WP 的第二区
+    size_t line_coords_len;
+    void *line_coords_buf;  // 自己分配的 line_coords：解码时复制出来的，或从缓存打开后转换坐标前复制的，见 prepare_arcs()
+    const char *poly_recs;  // 第九个区（[8]多边形信息），每个多边形一个 struct polygon_info，只在解码时用
+    const char *line_recs;  // 第一个区（[0]线信息），第一条线的 struct line_info 在 LINE_INFO_FIRST 处，只在解码时用
+    void *attr_buf;  // --get 时只复制了要的多边形的属性区，见 sheet_decode_subset()
+    double *sig;  // 化简时各线各点的重要性，见 prepare_arcs()
+    long *sig_start;  // 各线的第一点在 sig 中的序号，-1 表示坏的线
+    void *attr;  // 多边形属性区
+    size_t attr_len;
+    int32_t *arc_n;  // 各线的点数，坏的线为 0
+    int64_t *arc_off;  // 各线的坐标在 line_coords 中的字节偏移量
+    int32_t *ring_n;  // 各多边形的线号个数，包括分隔环的 0，不包括前面的总点数
+    int64_t *ring_off;  // 各多边形的线号数组在 refs 中的字节偏移量
+    const char *refs;  // 线号数组所在的区，prepare_arcs() 换掉 line_coords 之后它不变
+    int32_t *color;  // 各多边形的色号
+    uint16_t *layer;  // 各多边形的图层号
+    const char (*fill_strs)[32];  // 各色号的 FillRGB 值，NULL 表示还没用到，见 conv_setup()
+    int fill_max;  // 最大色号
+    const uint64_t *str_off;  // 缓存中的 UTF-8 字符串属性：每个字符串属性一列，各多边形的值在 str_data 中的起止位置
+    const char *str_data;  // 没有缓存时为 NULL，用到时再转换
+    int cached;  // 各数组指向缓存文件
+};
+
+#define MAX_LAYERS 65536  // polygon_info.layer 是 unsigned short
+#define MAX_OPEN_LAYERS 64  // 按图层分文件时最多同时打开这么多个输出，多了就暂时关掉最久没写的，见 conv_writer()
+#define LINE_INFO_FIRST 59  // 第一条线的线信息在线信息区中的偏移量，奇怪的偏移量，前面大概是 0 号线的 57 字节和 2 个未知字节
+
+/*
+ * 一个 GeoJSON FeatureCollection 输出，要素生成一个写一个，不在内存中拼出整个文档
+ * 每个输出有自己的缓冲区（见 obuf.h），按图层分文件时互不干扰
+ */
+struct fc_writer {
+    struct obuf ob;
+    char *stem;  // 分片时输出文件名去掉 .geojson 的部分
+    char *path;  // 当前输出文件名，NULL 表示标准输出
+    char *name_json;  // FeatureCollection 的 name，已转义成 JSON 字符串
+    size_t shard_size;  // 分片的最大字节数，0 表示不限
+    long shard_features;  // 分片的最大要素数，0 表示不限
+    int shard;  // 当前分片号，从 1 开始
+    long num_features;  // 当前分片已写出的要素数
+    int gzip;  // 压缩输出
+    const char *crs;  // 坐标系名称
+    long used;  // 最近一次写要素的时刻，按图层分文件时用来挑最久没写的
+};
+
+#define FC_TAIL "\n]\n}\n"  // FeatureCollection 的结尾
+
+// 北京1954 到 WGS84 的三参数（EPSG 中的一组，即 PROJ 对 EPSG:4214 的缺省值），精度只有十米级，有当地参数时用 --towgs84 指定
+#define BJ54_TOWGS84_STR "15.8,-154.4,-82.3"
+
+#define FILL_RGB_NAME "FillRGB"  // 由色号算出来的填充色，作为一个伪属性，也可以被 --select/--exclude 选择
+#define FILL_RGB_NONE "0, 0, 0, 255"  // 色号超出范围时的 FillRGB
+#define PCOLOR_PATH "Pcolor.lib"  // 色号定义文件，在当前目录下
+#define ATTR_UTF8_MAX 512  // 一个字符串属性值转成 UTF-8 后最多的字节数，再长的截掉
+#define NATIVE_CACHE_EXT ".mgc"  // --native-cache 的缓存文件名是输入文件名加上它
 
 // 还有一堆懒得写在这里了
 static void print_fh(struct file_header *fh);
 static void print_dh(struct data_header *dh);
 static void print_dhs(int file_type, struct data_headers *dhs);
 static void print_polygon_info(struct polygon_info *pi, void *line_coords, size_t line_coords_len);
-static void print_polygon_infos(int n, struct polygon_info *pis, void *line_coords, size_t line_coords_len);
+static void print_polygon_infos(int n, const char *recs, void *line_coords, size_t line_coords_len);
 
 static void
 print_fh(struct file_header *fh) {
@@ -137,7 +330,7 @@ print_polygon_info(struct polygon_info *pi, void *line_coords, size_t line_coord
             pi->fill_pattern_index, pi->pattern_height, pi->pattern_width);
     DEBUG_PRINT("笔宽=%d, 图案颜色=%d, 透明输出=%d, 图层=%d, 线号1=%d, 线号2=%d\n", pi->pen_width, pi->pattern_color, pi->transparent_output, pi->layer,
             pi->line_index1, pi->line_index2);
-    if (pi->off_line_info >= line_coords_len) {
+    if ((size_t)pi->off_line_info >= line_coords_len) {  // 负的转成无符号数后也超出
         err(1, "线号信息超出范围");
     }
     line_num = (int *)(line_coords + pi->off_line_info);
@@ -157,13 +350,13 @@ print_polygon_info(struct polygon_info *pi, void *line_coords, size_t line_coord
  * 打印每个 polygon 的信息
  */
 static void
-print_polygon_infos(int n, struct polygon_info *pis, void *line_coords, size_t line_coords_len) {
-    struct polygon_info *pi = pis;
+print_polygon_infos(int n, const char *recs, void *line_coords, size_t line_coords_len) {
+    struct polygon_info pi;
 
     for (int i = 0; i <= n; i++) {  // 故意这么写的，多了一次循环
         DEBUG_PRINT("Polygon %d:\n", i);
-        print_polygon_info(pi, line_coords, line_coords_len);
-        pi++;
+        memcpy(&pi, recs + (size_t)i * sizeof(pi), sizeof(pi));  // 复制出来，不在未对齐的地方读
+        print_polygon_info(&pi, line_coords, line_coords_len);
     }
     DEBUG_PRINT("前面 line_coords=%p\n", line_coords);
 }
@@ -184,7 +377,7 @@ print_line_info(struct line_info *pi, void *line_coords, size_t line_coords_len)
     DEBUG_PRINT("线型号=%d, 辅助线型号=%d, 覆盖方式=%d, 线颜色号=%d\n", pi->line_pattern, pi->aux_line_pattern, pi->cover_type, pi->color_index);
     DEBUG_PRINT("线宽=%f, 线各类=%d, X系数=%f, Y系数=%f, 辅助色=%d\n", pi->line_width, pi->line_type, pi->x_factor, pi->y_factor, pi->aux_color);
     DEBUG_PRINT("图层=%d, int4=%d, int5=%d\n", pi->layer, pi->int4, pi->int5);
-    if (pi->off_points_coords >= line_coords_len) {
+    if ((size_t)pi->off_points_coords >= line_coords_len) {
         err(1, "坐标信息地址超出范围");
     }
     pos = (double *)(line_coords + pi->off_points_coords);
@@ -200,15 +393,20 @@ print_line_info(struct line_info *pi, void *line_coords, size_t line_coords_len)
 
 /*
  * 打印每条 line 的信息
+ *   - recs 第一条线的线信息
+ *   - avail 从 recs 起还在文件内的字节数，最后一条线的线信息可能缺 2 个字节，缺的当作 0
  */
 static void
-print_line_infos(int n, struct line_info *lis, void *line_coords, size_t line_coords_len) {
-    struct line_info *li = lis;
+print_line_infos(int n, const char *recs, size_t avail, void *line_coords, size_t line_coords_len) {
+    struct line_info li;
 
     for (int i = 0; i < n; i++) {  // 
+        size_t off = (size_t)i * sizeof(li);
+
+        bzero(&li, sizeof(li));
+        memcpy(&li, recs + off, avail - off < sizeof(li) ? avail - off : sizeof(li));
         DEBUG_PRINT("line %d:\n", i + 1);  // 它的 line 是从 1 开始编号的
-        print_line_info(li, line_coords, line_coords_len);
-        li++;
+        print_line_info(&li, line_coords, line_coords_len);
     }
 }
 
@@ -240,56 +438,274 @@ iconv_attr_def(struct obj_attr_define *def, struct obj_attr_define_utf8 *defu, i
 }
 
 /*
- * 为一个对象添加其属性值
- *   - ps    GeoJSON 中对象的 properties
- *   - def   各属性定义，UTF-8版
+ * 追加一个 JSON 字符串（带引号），转义方法与 cJSON 相同
+ */
+static void
+json_add_string(struct sbuf *sb, const char *str, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+
+    sbuf_reserve(sb, n * 6 + 2);  // 最坏情况下每个字节都转成 \u00XX
+    char *o = sb->data + sb->len;
+
+    *o++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = str[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            *o++ = c;
+            continue;
+        }
+        *o++ = '\\';
+        switch (c) {
+        case '"':
+        case '\\':
+            *o++ = c;
+            break;
+        case '\b':
+            *o++ = 'b';
+            break;
+        case '\f':
+            *o++ = 'f';
+            break;
+        case '\n':
+            *o++ = 'n';
+            break;
+        case '\r':
+            *o++ = 'r';
+            break;
+        case '\t':
+            *o++ = 't';
+            break;
+        default:
+            memcpy(o, "u00", 3);
+            o[3] = hex[c >> 4];
+            o[4] = hex[c & 0xf];
+            o += 5;
+        }
+    }
+    *o++ = '"';
+    sb->len = o - sb->data;
+}
+
+/*
+ * 第 i 个多边形的属性值，i 从 0 开始（属性区中的第一块不是多边形的）
+ */
+static char *
+attr_row(struct sheet *sh, int i) {
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+
+    return (char *)sh->attr + ah->off_attr_value + (size_t)ah->attrs_size * (i + 1);
+}
+
+/*
+ * 把一个 GB18030 的字符串属性值转成 UTF-8，返回字节数
+ *   - p, size 属性值和它的定长，值不满时以 0 结尾
+ *   - buf 至少 ATTR_UTF8_MAX 字节
+ */
+static size_t
+attr_iconv(iconv_t icv, char *p, int size, char *buf) {
+    char *inbufp = p, *outbufp = buf;
+    size_t inbufl = strnlen(p, size), outbufl = ATTR_UTF8_MAX;
+
+    iconv(icv, NULL, NULL, NULL, NULL);
+    iconv(icv, &inbufp, &inbufl, &outbufp, &outbufl);
+    return ATTR_UTF8_MAX - outbufl;
+}
+
+/*
+ * 第 i 个多边形的一个字符串属性的 UTF-8 值，从本机缓存打开时直接指向缓存，否则转换到 buf 中
+ *   - oa 要输出的属性，类型是 ATTR_STR
+ *   - buf 至少 ATTR_UTF8_MAX 字节
+ *   - len 返回字节数
+ */
+static const char *
+attr_utf8(struct sheet *sh, struct out_attr *oa, int i, iconv_t icv, char *buf, size_t *len) {
+    if (sh->str_data) {
+        const uint64_t *off = sh->str_off + (size_t)oa->str_col * (sh->fh.num_polygons + 1) + i;
+
+        *len = off[1] - off[0];
+        return sh->str_data + off[0];
+    }
+    *len = attr_iconv(icv, attr_row(sh, i) + oa->def->o.attr_off, oa->def->o.size, buf);
+    return buf;
+}
+
+/*
+ * 第 i 个多边形的 FillRGB 值
+ */
+static const char *
+fill_rgb(struct sheet *sh, int i) {
+    int c = sh->color[i];
+
+    return c >= 1 && c <= sh->fill_max ? sh->fill_strs[c - 1] : FILL_RGB_NONE;
+}
+
+/*
+ * 输出一个对象的属性值，即 properties 对象中的各项，不包括两边的 {}
+ *   - sb    输出
+ *   - sh    属性值所在的文件
+ *   - oa    要输出的各属性，带有预先转义好的属性名
  *   - ndef  属性个数
- *   - attrv 该对象属性值起始点
+ *   - i     多边形序号，从 0 开始
  *   - icv   iconv 上下文
- * XXX 用了 iconv 上下文，也没有线程安全，没有安全性检查
+ * XXX 用了 iconv 上下文，也没有线程安全
  */
 static void
-geojson_add_attrs(cJSON *ps, struct obj_attr_define_utf8 *def, int ndef, void *attrv, iconv_t icv) {
-    char utf8_str[512]; // 用于转换后的 UTF8 字符串
-    size_t inbufl, outbufl;  // iconv 用
-    char *inbufp, *outbufp;  // iconv 用
-    char *p = attrv + def->o.attr_off;
-    int *val_int;
-    double *val_double;
-    float *val_float;
+enc_attrs(struct sbuf *sb, struct sheet *sh, struct out_attr *oa, int ndef, int i, iconv_t icv) {
+    char utf8_str[ATTR_UTF8_MAX]; // 用于转换后的 UTF8 字符串
+    char *attrv = attr_row(sh, i);
+    const char *str;
+    size_t len;
+    char *p;
+    int val_int;
+    double val_double;
+    float val_float;
 
-    for (int i = 0; i < ndef; i++) {  // 遍历所有属性
-        switch (def->o.type) {
+    for (int k = 0; k < ndef; k++, oa++) {  // 遍历所有属性
+        p = attrv + oa->def->o.attr_off;
+        if (k > 0) {
+            sbuf_addc(sb, ',');
+        }
+        sbuf_add(sb, oa->key, oa->key_len);
+        switch (oa->def->o.type) {
         case ATTR_STR:
-            iconv(icv, NULL, NULL, NULL, NULL);
-            bzero(utf8_str, sizeof(utf8_str));
-            inbufp = (char *)p;  // 其实多此一举
-            inbufl = strlen(inbufp);
-            outbufp = utf8_str;
-            outbufl = sizeof(utf8_str);
-            iconv(icv, &inbufp, &inbufl, &outbufp, &outbufl);
-            cJSON_AddStringToObject(ps, def->name_utf8, utf8_str);
+            str = attr_utf8(sh, oa, i, icv, utf8_str, &len);
+            json_add_string(sb, str, len);
             break;
-        case ATTR_INT:
-            val_int = (int *)p;
-            cJSON_AddNumberToObject(ps, def->name_utf8, *val_int);
+        case ATTR_INT:  // 行内偏移量不一定对齐，用 memcpy 取值
+            memcpy(&val_int, p, sizeof(val_int));
+            sbuf_add_long(sb, val_int);
             break;
         case ATTR_FLOAT:
-            val_float = (float *)p;
-            cJSON_AddNumberToObject(ps, def->name_utf8, *val_float);
+            memcpy(&val_float, p, sizeof(val_float));
+            sbuf_add_double(sb, val_float, -1);
             break;
         case ATTR_DOUBLE:
-            val_double = (double *)p;
-            cJSON_AddNumberToObject(ps, def->name_utf8, *val_double);
+            memcpy(&val_double, p, sizeof(val_double));
+            sbuf_add_double(sb, val_double, -1);
             break;
         default:
-            DEBUG_PRINT("未知的属性类型 %d\n", def->o.type);
+            DEBUG_PRINT("未知的属性类型 %d\n", oa->def->o.type);
+            sbuf_add(sb, "null", 4);
         }
+    }
+}
 
-        //p += def->o.size;
-        def++;
-        p = attrv + def->o.attr_off;
+/*
+ * 为要输出的各属性准备好转义过的属性名 "名字":
+ */
+static struct out_attr *
+make_out_attrs(struct obj_attr_define_utf8 *defu, int n) {
+    struct out_attr *oa = calloc(n ? n : 1, sizeof(*oa));
+    struct sbuf sb;
+
+    bzero(&sb, sizeof(sb));
+    for (int i = 0; i < n; i++) {
+        sb.len = 0;
+        json_add_string(&sb, defu[i].name_utf8, strlen(defu[i].name_utf8));
+        sbuf_addc(&sb, ':');
+        if (sb.len > sizeof(oa[i].key)) {
+            errx(1, "属性名太长: %s", defu[i].name_utf8);
+        }
+        memcpy(oa[i].key, sb.data, sb.len);
+        oa[i].key_len = sb.len;
+        oa[i].def = defu + i;
+    }
+    sbuf_free(&sb);
+    return oa;
+}
+
+/*
+ * 看 name 是否在逗号分隔的名字列表 list 中
+ */
+static int
+name_in_list(const char *name, const char *list) {
+    size_t n = strlen(name);
+    const char *p = list;
+
+    while (*p) {
+        const char *e = strchr(p, ',');
+        size_t l = e ? (size_t)(e - p) : strlen(p);
+
+        if (l == n && strncmp(p, name, n) == 0) {
+            return 1;
+        }
+        if (!e) {
+            break;
+        }
+        p = e + 1;
+    }
+    return 0;
+}
+
+/*
+ * 检查名字列表中的每个名字都是存在的属性名（或 FillRGB），写错了名字直接报错，免得悄悄输出个空属性
+ */
+static void
+check_attr_names(const char *opt_name, const char *list, struct obj_attr_define_utf8 *defu, int n) {
+    char name[128];
+    const char *p = list;
+
+    while (*p) {
+        const char *e = strchr(p, ',');
+        size_t l = e ? (size_t)(e - p) : strlen(p);
+        int found = 0;
+
+        if (l >= sizeof(name)) {
+            errx(1, "%s: 属性名太长", opt_name);
+        }
+        memcpy(name, p, l);
+        name[l] = 0;
+        if (l > 0) {
+            found = strcmp(name, FILL_RGB_NAME) == 0;
+            for (int i = 0; !found && i < n; i++) {
+                found = strcmp(defu[i].name_utf8, name) == 0;
+            }
+            if (!found) {
+                errx(1, "%s: 没有名为 \"%s\" 的属性", opt_name, name);
+            }
+        }
+        if (!e) {
+            break;
+        }
+        p = e + 1;
+    }
+}
+
+/*
+ * 属性是否要输出
+ */
+static int
+attr_wanted(const char *name, struct options *opt) {
+    if (opt->select && !name_in_list(name, opt->select)) {
+        return 0;
+    }
+    if (opt->exclude && name_in_list(name, opt->exclude)) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * 按 --select/--exclude 裁剪属性定义（UTF-8版），原地压缩，返回剩下的属性个数
+ * 这样在遍历多边形之前就把不要的列去掉了，它们的值不会被读取、转码和输出
+ */
+static int
+prune_attr_def(struct obj_attr_define_utf8 *defu, int n, struct options *opt) {
+    int k = 0;
+
+    if (opt->select) {
+        check_attr_names("--select", opt->select, defu, n);
+    }
+    if (opt->exclude) {
+        check_attr_names("--exclude", opt->exclude, defu, n);
+    }
+    for (int i = 0; i < n; i++) {
+        if (attr_wanted(defu[i].name_utf8, opt)) {
+            defu[k++] = defu[i];
+        }
     }
+    return k;
 }
 
 /*
@@ -327,51 +743,98 @@ print_attr_header(struct obj_attr_header *h) {
 }
 
 /*
- * 把一条线上的各点坐标加入多边形的坐标数组中
- *   - cs 环
- *   - li 线信息
+ * 清空，开始组装新的一批多边形
+ */
+static void
+poly_reset(struct poly_coords *pc) {
+    pc->num_points = 0;
+    pc->num_rings = 0;
+}
+
+/*
+ * 当前环（最后一个没有结束的环）的起始点序号
+ */
+static int
+poly_ring_start(struct poly_coords *pc) {
+    return pc->num_rings > 0 ? pc->ring_end[pc->num_rings - 1] : 0;
+}
+
+/*
+ * 化简的一级：线上各点的重要性（见 simplify.h）大于 tol2 的才要
+ */
+struct arc_filter {
+    const double *sig;  // 所有线的点的重要性，一条接一条
+    const long *start;  // 各线的第一点在 sig 中的序号
+    double tol2;  // 容差的平方
+};
+
+/*
+ * 把一条线上的各点坐标加入多边形的当前环
+ *   - pc 多边形坐标
+ *   - xy 该线的各点坐标
+ *   - num_p 该线的点数
  *   - reverse 是否要从尾部逆着加入各点坐标
- *   - line_coords 第二区（[1]线坐标信息），包含各多边形的线号数组，各线的坐标数组
+ *   - sig 该线各点的重要性，NULL 表示不化简
+ *   - tol2 化简时只要重要性大于它的点，两个端点总是要的
  */
 static void
-poly_add_line(cJSON *cs, struct line_info *li, int reverse, void *line_coords) {
-    double *pos;  // 指向单个坐标分量的 double
-    int num_p = li->num_points;  // XXX 点数，没判断合法性
-    cJSON *p, *x, *y;
+poly_add_line(struct poly_coords *pc, const double *xy, int num_p, int reverse, const double *sig, double tol2) {
+    const double *pos;  // 指向单个坐标分量的 double
     int step;  // 正序时步长为 2，逆序时为 -2
+    int k;  // pos 所指点在线中的序号
 
+    if (num_p <= 0) {
+        return;
+    }
     if (!reverse) {  // 正序
-        pos = (double *)(line_coords + li->off_points_coords);
+        pos = xy;
         step = 2;
+        k = 0;
     } else {
-        pos = (double *)(line_coords + li->off_points_coords) + 2 * (num_p - 1);
+        pos = xy + 2 * (num_p - 1);
         step = -2;
+        k = num_p - 1;
     }
 
-    int points = cJSON_GetArraySize(cs);  // 当前环总点数, 新开的环为0，否则正常至少是 2
-    if (points > 0) {  // 非空环
+    if (pc->num_points > poly_ring_start(pc)) {  // 非空环
         // 比较一下当前最后一点与我们要新加的第一点是否重合
-        cJSON *last = cJSON_GetArrayItem(cs, points - 1);
-        double x_last = (cJSON_GetArrayItem(last, 0))->valuedouble;
-        double y_last = (cJSON_GetArrayItem(last, 1))->valuedouble;
+        double *last = pc->xy + 2 * (pc->num_points - 1);
 
-        if (*pos == x_last && *(pos + 1) == y_last) { // 重合了，跳过第一点
+        if (pos[0] == last[0] && pos[1] == last[1]) { // 重合了，跳过第一点
             num_p--;
             pos += step;
-            DEBUG_PRINT("跳过弧段终点的重合\n");
+            k += step / 2;
         }
     }
-    for (int i = 0; i < num_p; i++) {
-        p = cJSON_CreateArray();
+    if (pc->num_points + num_p + 1 > pc->cap_points) {  // 多留一个点给 poly_end_ring() 闭合用
+        while (pc->num_points + num_p + 1 > pc->cap_points) {
+            pc->cap_points = pc->cap_points ? pc->cap_points * 2 : 1024;
+        }
+        pc->xy = realloc(pc->xy, pc->cap_points * 2 * sizeof(double));
+        if (!pc->xy) {
+            err(1, "realloc");
+        }
+    }
+    double *o = pc->xy + 2 * pc->num_points;
 
-        x = cJSON_CreateNumber(*pos);
-        cJSON_AddItemToArray(p, x);
-        y = cJSON_CreateNumber(*(pos + 1));
-        cJSON_AddItemToArray(p, y);
+    if (sig) {
+        for (int i = 0; i < num_p; i++, pos += step, k += step / 2) {
+            if (sig[k] > tol2) {
+                o[0] = pos[0];
+                o[1] = pos[1];
+                o += 2;
+            }
+        }
+        pc->num_points = (o - pc->xy) / 2;
+        return;
+    }
+    for (int i = 0; i < num_p; i++) {
+        o[0] = pos[0];
+        o[1] = pos[1];
+        o += 2;
         pos += step;
-
-        cJSON_AddItemToArray(cs, p);
     }
+    pc->num_points += num_p;
 }
 
 static double
@@ -381,38 +844,136 @@ distance(double x1, double y1, double x2, double y2) {
 
 double small_double = 0.000001;
 /*
- * Make Coordinates Ring
- * 使用坐标构成一个环，也就是保证最后一点与第一点相同
+ * 结束当前环，保证最后一点与第一点相同，空环直接丢掉
  */
 static void
-make_cs_ring(cJSON *r) {
-    int points = cJSON_GetArraySize(r);  // 总点数, 正常至少是 2
+poly_end_ring(struct poly_coords *pc) {
+    int start = poly_ring_start(pc);
 
+    if (pc->num_points == start) {
+        return;
+    }
     // 检查是否成环，如没成环则要追加第一个点的坐标到最后以让它成环
-    cJSON *first = cJSON_GetArrayItem(r, 0);
-    cJSON *last = cJSON_GetArrayItem(r, points - 1);
-    double x_first = (cJSON_GetArrayItem(first, 0))->valuedouble;
-    double y_first = (cJSON_GetArrayItem(first, 1))->valuedouble;
-    double x_last = (cJSON_GetArrayItem(last, 0))->valuedouble;
-    double y_last = (cJSON_GetArrayItem(last, 1))->valuedouble;
+    double *first = pc->xy + 2 * start;
+    double *last = pc->xy + 2 * (pc->num_points - 1);
+
+    if (first[0] != last[0] || first[1] != last[1]) {
+        if (distance(first[0], first[1], last[0], last[1]) < small_double) {
+            DEBUG_PRINT("首尾点非常接近: %.6f, %.6f : %.6f, %.6f\n", first[0], first[1], last[0], last[1]);
+        }
+        last[2] = first[0];  // poly_add_line() 留了位置
+        last[3] = first[1];
+        pc->num_points++;
+    }
+    if (pc->num_rings == pc->cap_rings) {
+        pc->cap_rings = pc->cap_rings ? pc->cap_rings * 2 : 16;
+        pc->ring_end = realloc(pc->ring_end, pc->cap_rings * sizeof(int));
+        if (!pc->ring_end) {
+            err(1, "realloc");
+        }
+    }
+    pc->ring_end[pc->num_rings++] = pc->num_points;
+}
+
+/*
+ * 组装一个多边形的各环，接在 pc 中已有的环后面，这样一批多边形可以放在一起
+ *   - sh 线表和环表
+ *   - i 多边形序号，从 0 开始
+ *   - af 化简的级，NULL 表示不化简
+ */
+static void
+poly_assemble(struct poly_coords *pc, struct sheet *sh, int i, const struct arc_filter *af) {
+    // MapGIS 6 可能只有多边形，没有多多边形。多边形由一个闭合区（外环）及其中任意个洞（当然也是闭合区）构成
+    // 线号 0 用于分隔闭合区，每个闭合区可由1条或多条线构成，第一个闭合区是所谓外环，后续的闭合区是从外环中抠除的洞
+    int num_lines_total = sh->fh.num_lines;  // 总线数，用于判断线号越界（批量转换时各文件不同，不能用 g_num_line）
+    const int *line_num = (const int *)(sh->refs + sh->ring_off[i]);  // 指向线号的指针
+
+    for (int j = 0; j < sh->ring_n[i]; j++, line_num++) {  // 遍历该多边形所有的线（弧段）
+        int ln = *line_num;  // 负的线号表示要逆过来
+
+        if (ln == 0) {  // 此环结束，检查如不是闭环则添加一点使其闭合，然后再开一个新环
+            poly_end_ring(pc);
+            continue;
+        }
+        if (ln > num_lines_total || ln < -num_lines_total) {
+            DEBUG_PRINT("线号 %d 越界，最大 %d\n", ln, num_lines_total);
+            continue;
+        }
+        // 取线信息，线号是从 1 开始编号的
+        int idx = (ln < 0 ? -ln : ln) - 1;
+
+        const double *sig = af && af->start[idx] >= 0 ? af->sig + af->start[idx] : NULL;  // 坏的线没有算重要性，不化简
 
-    if (x_first != x_last || y_first != y_last) {
-        if (distance(x_first, y_first, x_last, y_last) < small_double) {
-            DEBUG_PRINT("首尾点非常接近: %.6f, %.6f : %.6f, %.6f\n", x_first, y_first, x_last, y_last);
+        poly_add_line(pc, (const double *)((char *)sh->line_coords + sh->arc_off[idx]), sh->arc_n[idx], ln < 0, sig,
+                af ? af->tol2 : 0);
+    }
+    // 最后一个环后面没有 0，原来不检查闭合，但 GeoJSON、WKT/EWKB、Shapefile 都要求每个环首尾相同，
+    // poly_drop_small_rings() 和化简也是按闭合的环算的，所以与其它环一样闭合
+    poly_end_ring(pc);
+}
+
+/*
+ * 化简后可能有环退化成少于 4 个点（闭合后），去掉这些环；外环退化时整个多边形都去掉，输出空的 coordinates
+ *   - r0 该多边形的第一个环在 pc 中的序号
+ */
+static void
+poly_drop_small_rings(struct poly_coords *pc, int r0) {
+    int base = r0 > 0 ? pc->ring_end[r0 - 1] : 0;
+    int k = base;  // 下一个保留的点放在这里
+    int start = base;  // 当前环的第一点
+    int nr = r0;
+
+    for (int r = r0; r < pc->num_rings; r++) {
+        int end = pc->ring_end[r];  // 先读出来，下面写 ring_end[nr] 时 nr <= r，不会覆盖还没读的
+
+        if (end - start >= 4) {
+            memmove(pc->xy + 2 * k, pc->xy + 2 * start, (end - start) * 2 * sizeof(double));
+            k += end - start;
+            pc->ring_end[nr++] = k;
+        } else if (r == r0) {
+            k = base;
+            nr = r0;
+            break;
         }
-        cJSON *p = cJSON_CreateArray();
-        cJSON_AddItemToArray(p, cJSON_CreateNumber(x_first));
-        cJSON_AddItemToArray(p, cJSON_CreateNumber(y_first));
-        cJSON_AddItemToArray(r, p);
+        start = end;
     }
+    pc->num_points = k;
+    pc->num_rings = nr;
+}
+
+/*
+ * 输出多边形的 coordinates 数组
+ *   - r0, r1 该多边形的环在 pc 中的序号范围 [r0, r1)
+ */
+static void
+enc_poly_coords(struct sbuf *sb, struct poly_coords *pc, int r0, int r1) {
+    int k = r0 > 0 ? pc->ring_end[r0 - 1] : 0;
+
+    sbuf_addc(sb, '[');
+    for (int r = r0; r < r1; r++) {
+        int start = k;  // 本环的第一点
+
+        if (r > r0) {
+            sbuf_addc(sb, ',');
+        }
+        sbuf_addc(sb, '[');
+        for (; k < pc->ring_end[r]; k++) {
+            sbuf_reserve(sb, 2 * NUMFMT_MAX + 4);
+            char *o = sb->data + sb->len;
 
-    // 检查一下最后两点之间距离
-    //cJSON *last2 = cJSON_GetArrayItem(r, points - 2);  // points 没改过，所以是倒数第2点
-    //double x_last2 = (cJSON_GetArrayItem(last2, 0))->valuedouble;
-    //double y_last2 = (cJSON_GetArrayItem(last2, 1))->valuedouble;
-    //if (distance(x_last2, y_last2, x_last, y_last) < small_double) {
-        //DEBUG_PRINT("最后两点非常接近\n");
-    //}
+            if (k > start) {
+                *o++ = ',';
+            }
+            *o++ = '[';
+            o += fmt_double(o, pc->xy[2 * k], -1);
+            *o++ = ',';
+            o += fmt_double(o, pc->xy[2 * k + 1], -1);
+            *o++ = ']';
+            sb->len = o - sb->data;
+        }
+        sbuf_addc(sb, ']');
+    }
+    sbuf_addc(sb, ']');
 }
 
 /*
@@ -511,231 +1072,4306 @@ kcmy_to_rgb(struct pcolor_def *k, struct pcolor_header *ch, struct color_rgb *rg
 }
 
 /*
- * 生成 GeoJSON 文件
- *   - fh 文件头部信息，从中得到总的线数，多边形数
- *   - lis 第一个区（[0]线信息），包含每条线的索引信息，它由几个点构成，点坐标数组在第二区的偏移量
- *   - pis 第九个区（[8]多边形信息），包含多边形信息：它由几条线构成，线号数组在第二区的偏移量
- *   - line_coords 第二区（[1]线坐标信息），包含各多边形的线号数组，各线的坐标数组
- *   - attr 属性区
- *   - pcolor_table 从 Pcolor.lib 文件中读出来的颜色表
- *   - pcolor_max 最大颜色号 + 1，目前没用它进行判断
+ * 打开当前分片的输出文件，写出 features 数组之前的部分
  */
 static void
-gen_geojson(const char *name, struct file_header *fh, struct line_info *lis, struct polygon_info *pis, void *line_coords, void *attr,
-        struct pcolor_header *pcolh, struct pcolor_def *pcolor_table, int pcolor_max) {
-    int num_total_lines = fh->num_lines;
-    int num_total_polys = fh->num_polygons;
-    struct polygon_info *pi = pis + 1;  // 真正的数据是从第二块开始的
-    iconv_t icv = iconv_open("UTF-8", "GB18030");  // 用于属性名和属性值的编码，从GB2312到UTF-8，XXX 没 close
-    cJSON *gj = cJSON_CreateObject();  // GeoJSON
-    cJSON *fs = cJSON_CreateArray();  // features
-
-    cJSON_AddStringToObject(gj, "type", "FeatureCollection");
-    cJSON_AddStringToObject(gj, "name", name);
+fc_begin(struct fc_writer *w) {
+    if (w->stem) {
+        free(w->path);
+        w->shard++;
+        if (asprintf(&w->path, "%s.%04d.geojson%s", w->stem, w->shard, w->gzip ? ".gz" : "") == -1) {
+            err(1, "asprintf");
+        }
+    }
+    obuf_open(&w->ob, w->path, w->gzip);
+    if (w->shard_size) {  // 分片的大小是知道的
+        obuf_prealloc(&w->ob, w->shard_size);
+    }
+    if (w->path) {
+        DEBUG_PRINT("输出到 %s\n", w->path);
+    }
 
     // 老的一般采用 北京1954 坐标系，所以我们就缺省生成老版本的 GeoJSON 文件，带坐标系的
-    cJSON *crs = cJSON_CreateObject();
-    cJSON_AddStringToObject(crs, "type", "name");
-    cJSON *crs_prop = cJSON_CreateObject();  // crs 下的 properties 对象
-    cJSON_AddStringToObject(crs_prop, "name", "urn:ogc:def:crs:EPSG::4214");
-    cJSON_AddItemToObject(crs, "properties", crs_prop);
-    cJSON_AddItemToObject(gj, "crs", crs);
+    obuf_puts(&w->ob, "{\n\"type\": \"FeatureCollection\",\n\"name\": ");
+    obuf_puts(&w->ob, w->name_json);
+    obuf_puts(&w->ob, ",\n\"crs\": {\"type\": \"name\", \"properties\": {\"name\": \"");
+    obuf_puts(&w->ob, w->crs);
+    obuf_puts(&w->ob, "\"}},\n\"features\": [\n");
+    w->num_features = 0;
+}
 
-    // 属性
-    cJSON_AddItemToObject(gj, "features", fs);
-    // 先把属性名转成 UTF-8
-    struct obj_attr_header *ah = (struct obj_attr_header *)attr;
-    struct obj_attr_define *def = (struct obj_attr_define *)(attr + sizeof(*ah));
-    struct obj_attr_define_utf8 *defu = (struct obj_attr_define_utf8 *)malloc(sizeof(*defu) * ah->num_attrs);
-    iconv_attr_def(def, defu, ah->num_attrs, icv);  // 做 UTF-8 转换
-    char *attr_values = (char *)(attr + ah->off_attr_value + ah->attrs_size);
-
-    for (int i = 0; i < num_total_polys; i++) {  // 遍历所有的多边形
-        cJSON *f = cJSON_CreateObject();  // Feature
-        cJSON *ps = cJSON_CreateObject();  // properties
-        cJSON *gm = cJSON_CreateObject();  // geometry
-        cJSON *cs = cJSON_CreateArray();  // coordinates
-        cJSON *ring = cJSON_CreateArray();  // 多边形环，这里先分配外环，后面遇到一个0再分配一个新的环，后面的环都是要从外环抠除的
-
-        geojson_add_attrs(ps, defu, ah->num_attrs, attr_values, icv);  // 该多边形的属性
-
-        //cJSON_AddNumberToObject(ps, "FillIndex", pi->color);  // 多边形填充色号
-        char fillstr[32];  // 形如 [120, 220, 22, 255] 的字符串，表示填充色的 RGBA 值
-        struct color_rgb rgb2;  // 转换后的 RGB 值
-        struct pcolor_def *pdef = pcolor_table + pi->color - 1;
-
-        kcmy_to_rgb(pdef, pcolh, &rgb2);  // 将 MapGIS 的 4 字节 KCMY 和后续 专色分量 转成 RGB 值
-        snprintf(fillstr, sizeof(fillstr) - 1, "%d, %d, %d, 255", rgb2.r, rgb2.g, rgb2.b);
-        DEBUG_PRINT("多边形 %d, 色号 %d, fileoff=0x%lx, KCMY=%d,%d,%d,%d,%d,%d RGBA=%s\n", i + 1, pi->color,
-                sizeof(struct pcolor_header) + (pi->color - 1) * sizeof(struct pcolor_def), pdef->kcmy.k, pdef->kcmy.c,
-                pdef->kcmy.m, pdef->kcmy.y, pdef->zs[0], pdef->zs[1], fillstr);
-        cJSON_AddStringToObject(ps, "FillRGB", fillstr);  // 适合于 QGIS 用来填充颜色
-
-        // 坐标
-        // MapGIS 6 可能只有多边形，没有多多边形。多边形由一个闭合区（外环）及其中任意个洞（当然也是闭合区）构成
-        // 线号 0 用于分隔闭合区，每个闭合区可由1条或多条线构成，第一个闭合区是所谓外环，后续的闭合区是从外环中抠除的洞
-        cJSON_AddItemToArray(cs, ring); // 先把外环放进去
-
-        int num_lines = pi->num_lines;  // 本多边形的线数（应该包含特殊的：第一个所谓线号其实是总点数，以及线号为0的线）
-        int *line_num;  // 指向线号的指针
-
-        line_num = (int *)(line_coords + pi->off_line_info) + 1;  // 第一个数应该是构成多边形的各线的总点数，+ 1 跳过
-        //DEBUG_PRINT("线号存储偏移量：%d\n", pi->off_line_info);
-        //DEBUG_PRINT("构造多边形 %d\n", i + 1);
-        for (int j = 0; j < (num_lines - 1); j++) {  // 遍历该多边形所有的线（弧段）
-            int reverse;  // 负的线号表示要逆过来
-            int ln; // 非负线号
-            struct line_info *li;
-
-            if (*line_num == 0) {  // 此环结束，检查如不是闭环则添加一点使其闭合，然后再开一个新环
-                make_cs_ring(ring);  // 使之闭合
-                ring = cJSON_CreateArray();  // 新开一个环
-                cJSON_AddItemToArray(cs, ring);  // 把这个闭合区放进 coordinates 数组中
-                line_num++;
-                continue;
-            }
-            // 看线号的正负
-            if (*line_num < 0) {
-                ln = - *line_num;
-                reverse = 1;  // 将来要逆过来取坐标
-            } else {
-                ln = *line_num;
-                reverse = 0;
-            }
-            li = lis + (ln - 1);  // 取线信息，线号是从 1 开始编号的
-            //cJSON *hole_j = cJSON_CreateArray();  // XXX 应该是垃圾代码
-            poly_add_line(ring, li, reverse, line_coords);
-            line_num++;
-        }
+/*
+ * 结束当前分片的 FeatureCollection 并关闭输出
+ */
+static void
+fc_end(struct fc_writer *w) {
+    obuf_write(&w->ob, FC_TAIL, sizeof(FC_TAIL) - 1);
+    obuf_close(&w->ob);
+}
+
+/*
+ * 输出的坐标系名称，不转换时是北京1954
+ */
+static const char *
+crs_name(int epsg) {
+    switch (epsg) {
+    case 4326:
+        return "urn:ogc:def:crs:OGC:1.3:CRS84";  // 即经度在前的 WGS84
+    case 4490:
+        return "urn:ogc:def:crs:EPSG::4490";
+    default:
+        return "urn:ogc:def:crs:EPSG::4214";
+    }
+}
+
+/*
+ * 开始输出一个 FeatureCollection
+ *   - path  输出文件名，NULL 表示输出到标准输出
+ *   - stem  分片时输出文件名去掉 .geojson 的部分，不为 NULL 时不用 path
+ *   - name  FeatureCollection 的 name
+ *   - opt   命令行选项，这里用到分片大小和是否压缩
+ * 分片时输出文件名为 <stem>.0001.geojson、<stem>.0002.geojson ...，每个都是完整的 FeatureCollection
+ * 压缩时文件名后面再加上 .gz，分片大小按压缩前的大小算
+ */
+static void
+fc_open(struct fc_writer *w, const char *path, const char *stem, const char *name, struct options *opt) {
+    bzero(w, sizeof(*w));
+    w->gzip = opt->gzip;
+    w->crs = crs_name(opt->to_epsg);
+    if (stem) {
+        w->stem = strdup(stem);
+        w->shard_size = opt->shard_size;
+        w->shard_features = opt->shard_features;
+    } else if (path) {
+        w->path = strdup(path);
+    }
 
-        cJSON_AddStringToObject(gm, "type", "Polygon");
-        cJSON_AddItemToObject(gm, "coordinates", cs);
+    struct sbuf sb;
 
-        cJSON_AddStringToObject(f, "type", "Feature");
-        cJSON_AddItemToObject(f, "properties", ps);
-        cJSON_AddItemToObject(f, "geometry", gm);
+    bzero(&sb, sizeof(sb));
+    json_add_string(&sb, name, strlen(name));
+    sbuf_addc(&sb, 0);
+    w->name_json = sb.data;
+    fc_begin(w);
+}
 
-        cJSON_AddItemToArray(fs, f);
-        attr_values += ah->attrs_size;
-        pi++;
+/*
+ * 写出一个已编码好的要素，每个要素占一行。写之前如果当前分片装不下了，就先换一个新分片
+ */
+static void
+fc_write_feature(struct fc_writer *w, const char *feature, size_t len) {
+    if (w->stem && w->num_features > 0 &&
+            ((w->shard_features && w->num_features >= w->shard_features) ||
+             (w->shard_size && obuf_size(&w->ob) + len + 2 + sizeof(FC_TAIL) - 1 > w->shard_size))) {
+        fc_end(w);
+        fc_begin(w);
+    }
+    if (w->num_features > 0) {
+        obuf_write(&w->ob, ",\n", 2);
     }
+    obuf_write(&w->ob, feature, len);
+    w->num_features++;
+}
 
-    char *str = cJSON_Print(gj);
-    printf("%s", str);
-    free(str);
-    cJSON_Delete(gj);
-    free(defu);
+/*
+ * 结束输出
+ */
+static void
+fc_close(struct fc_writer *w) {
+    if (w->ob.suspended) {  // 还要写结尾
+        obuf_resume(&w->ob);
+    }
+    fc_end(w);
+    free(w->path);
+    free(w->stem);
+    free(w->name_json);
 }
 
-int
-main(int argc, char **argv) {
-    ssize_t r;
-    size_t len;
-    off_t off;
-    char *file_name;
-    struct file_header fh;
-    struct data_headers dhs;
-    struct polygon_info *pis;
-    void *line_coords;
-    struct line_info *lis;
-    size_t line_coords_len;
-    void *attr;
-    struct obj_attr_header *attr_header;
+/*
+ * 输出文件名去掉 .geojson 的部分: 输出（没有 -o 时是输入）文件名去掉扩展名，
+ * 按级分文件时再加上 .lod<N>，按图层分文件时再加上 .layer<N>
+ *   - name   -o 指定的输出文件名或者输入文件名
+ *   - lod    化简的级，从 0 开始，-1 表示不分级
+ *   - layer  图层号，-1 表示不分图层
+ */
+static char *
+output_stem(const char *name, int lod, int layer) {
+    const char *base = strrchr(name, '/');
+    const char *dot = strrchr(base ? base : name, '.');
+    int stem_len = dot ? (int)(dot - name) : (int)strlen(name);
+    char lod_str[16] = "", layer_str[16] = "";
+    char *stem;
 
-    if (argc < 2) {
-        DEBUG_PRINT("Usage: %s <file>\n", argv[0]);
-        return 1;
+    if (lod >= 0) {
+        snprintf(lod_str, sizeof(lod_str), ".lod%d", lod);
     }
-    file_name = argv[1];
-    int fd = open(file_name, O_RDONLY);
-    if (fd == -1) {
-        err(1, "Open file %s failed", argv[1]);
+    if (layer >= 0) {
+        snprintf(layer_str, sizeof(layer_str), ".layer%d", layer);
     }
-    r = read(fd, &fh, sizeof(fh));
-    if (r != sizeof(fh)) {
-        err(1, "Read file header failed");
+    if (asprintf(&stem, "%.*s%s%s", stem_len, name, lod_str, layer_str) == -1) {
+        err(1, "asprintf");
     }
-    g_num_line = fh.num_lines;  // 设置总线数
+    return stem;
+}
 
-    print_fh(&fh);
-    off = lseek(fd, fh.off_data_headers, SEEK_SET);
-    r = read(fd, &dhs, sizeof(dhs));
-    if (r != sizeof(dhs)) {
-        err(1, "Read data headers failed");
-    }
-    print_dhs(fh.ftype_id, &dhs);
+/*
+ * 解析带 K/M/G 后缀的字节数，如 "512M"
+ */
+static size_t
+parse_size(const char *opt_name, const char *str) {
+    char *end;
+    double n = strtod(str, &end);
 
-    // 这里包含有区信息：每个区所属的线的编号连续存放
-    // 这里包含线信息：每条线所属点坐标连续存放
-    line_coords_len = dhs.line_coords_or_point_string.data_len;
-    line_coords = malloc(line_coords_len);
-    off = lseek(fd, dhs.line_coords_or_point_string.data_offset, SEEK_SET);
-    r = read(fd, line_coords, line_coords_len);
-    if (r != line_coords_len) {
-        err(1, "读线坐标数据出错");
+    switch (*end) {
+    case 'k':
+    case 'K':
+        n *= 1024;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        n *= 1024 * 1024;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        n *= 1024.0 * 1024 * 1024;
+        end++;
+        break;
     }
-
-    len = sizeof(*pis) * (fh.num_polygons + 1);
-    pis = (struct polygon_info *)malloc(len);
-    off = lseek(fd, dhs.polygon_info.data_offset, SEEK_SET);
-    r = read(fd, pis, len);
-    if (r != len) {
-        err(1, "读区信息出错");
+    if (end == str || *end != 0 || n < 1) {
+        errx(1, "%s: 大小格式不对: %s", opt_name, str);
     }
-    print_polygon_infos(fh.num_polygons, pis, line_coords, line_coords_len);
+    return (size_t)n;
+}
 
-    // 读第一个数据区，line info 区（对多边形文件而言）
-    // 这个区里包含有由大小为57字节的线信息结构构成的结构数组，该线信息结构中包含：
-    //   - 此线包含几个点
-    //   - 此线的点坐标在第二区（包含各点的坐标值）的偏移量
-    len = sizeof(*lis) * (fh.num_lines + 1);
-    lis = (struct line_info *)malloc(len);
-    off = lseek(fd, dhs.line_or_point_info.data_offset, SEEK_SET);
-    r = read(fd, lis, len);
-    if (r != len) {
-        err(1, "读线信息区出错");
-    }
-    lis = (struct line_info *)( (char *)lis + 59);  // 奇怪的偏移量，造成了2字节的越界
-    print_line_infos(fh.num_lines, lis, line_coords, line_coords_len);
-
-    len = dhs.polygon_attr.data_len;
-    attr = malloc(len);
-    off = lseek(fd, dhs.polygon_attr.data_offset, SEEK_SET);
-    r = read(fd, attr, len);
-    if (r != len) {
-        err(1, "读多边形属性区出错");
-    }
-    attr_header = (struct obj_attr_header *)attr;
-    print_attr_header(attr_header);
-
-    struct pcolor_header pcolorh;
-    struct pcolor_def *pcolor_table;
-    unsigned short pcolor_max;  // 最大许可色号加 1
+/*
+ * 解析 --towgs84 的三参数或七参数，逗号分隔
+ */
+static void
+parse_towgs84(const char *str, double v[7]) {
+    const char *p = str;
+    int n = 0;
+
+    bzero(v, 7 * sizeof(double));
+    while (n < 7) {
+        char *end;
+
+        v[n++] = strtod(p, &end);
+        if (end == p || (*end != ',' && *end != 0)) {
+            break;
+        }
+        if (*end == 0) {
+            if (n == 3 || n == 7) {
+                return;
+            }
+            break;
+        }
+        p = end + 1;
+    }
+    errx(1, "--towgs84: 应该是 dx,dy,dz 或 dx,dy,dz,rx,ry,rz,ds: %s", str);
+}
+
+/*
+ * 解析 --lod 的各级容差，逗号分隔，如 "0,10,100"
+ */
+static void
+parse_lods(const char *list, struct options *opt) {
+    const char *p = list;
+
+    opt->num_lods = 0;
+    for (;;) {
+        char *end;
+        double tol = strtod(p, &end);
+
+        if (end == p || (*end != ',' && *end != 0) || !(tol >= 0)) {
+            errx(1, "--lod: 应该是逗号分隔的非负容差: %s", list);
+        }
+        if (opt->num_lods == MAX_LODS) {
+            errx(1, "--lod: 最多 %d 级", MAX_LODS);
+        }
+        opt->lod[opt->num_lods++] = tol;
+        if (tol > 0) {
+            opt->simplify = 1;
+        }
+        if (*end == 0) {
+            break;
+        }
+        p = end + 1;
+    }
+    opt->lod_files = 1;
+}
+
+/*
+ * 解析 --layer 的图层号列表，如 "1,3,5"
+ */
+static unsigned char *
+parse_layers(const char *list) {
+    unsigned char *bits = calloc(MAX_LAYERS / 8, 1);
+    const char *p = list;
+
+    if (!bits) {
+        err(1, "calloc");
+    }
+    while (*p) {
+        char *end;
+        long n = strtol(p, &end, 10);
+
+        if (end == p || n < 0 || n >= MAX_LAYERS || (*end != ',' && *end != 0)) {
+            errx(1, "--layer: 图层号列表格式不对: %s", list);
+        }
+        bits[n / 8] |= 1 << (n % 8);
+        p = *end ? end + 1 : end;
+    }
+    return bits;
+}
+
+/*
+ * 解析 --get 的多边形序号列表，如 "12,7"，按给出的顺序输出，可以重复
+ */
+static void
+parse_get_ids(const char *list, struct options *opt) {
+    const char *p = list;
+
+    while (*p) {
+        char *end;
+        long n = strtol(p, &end, 10);
+
+        if (end == p || n < 1 || n > INT_MAX || (*end != ',' && *end != 0)) {
+            errx(1, "--get: 多边形序号列表格式不对: %s", list);
+        }
+        opt->get_ids = realloc(opt->get_ids, (opt->num_get_ids + 1) * sizeof(*opt->get_ids));
+        if (!opt->get_ids) {
+            err(1, "realloc");
+        }
+        opt->get_ids[opt->num_get_ids++] = n;
+        p = *end ? end + 1 : end;
+    }
+    if (opt->num_get_ids == 0) {
+        errx(1, "--get: 没有多边形序号");
+    }
+}
+
+#define BATCH_POLYS 1024  // 每批的多边形数
+#define BATCH_WINDOW 4  // 每个文件在途的批数为线程数的这么多倍
+
+/*
+ * 一批多边形在化简的一级上的结果
+ */
+struct batch_lod {
+    int *ring_hi;  // 各要素最后一个环在 pc 中的序号 + 1
+    struct poly_coords pc;  // 各要素的环，一个接一个
+    struct sbuf sb;  // 各要素的编码结果，首尾相接
+    size_t *ends;  // 各要素在 sb 中的结束位置
+    double *bbox;  // --format fgb 时各要素的范围，每个 4 个数
+    off_t off;  // 定位写出时 sb 在输出文件中的位置
+    size_t skip;  // 定位写出时 sb 开头不写的字节数，即文件中第一个要素前面的分隔符
+};
+
+/*
+ * 一批连续的多边形，在流水线中依次经过：
+ *   取数据（convert_file() 提示内核预读）-> 组装多边形（assemble_batch()）-> 编码要素（encode_batch()）
+ *   -> 按顺序写出（convert_file()，压缩见 pgz.h）
+ * 定位写出时按顺序的只是定下各批在文件中的位置，写由线程池执行（write_batch()）
+ * 批次对象的个数是固定的，写出后再用于后面的批次，所以内存占用与文件大小无关
+ */
+struct batch {
+    struct conv *cv;
+    long seq;  // 批次号，按它的顺序写出
+    int first;  // 第一个多边形的序号，从 0 开始
+    int count;
+    int num_features;  // 通过过滤的多边形数，即要输出的要素数
+    int *polys;  // 各要素的多边形序号
+    struct batch_lod lod[MAX_LODS];  // 各级的结果，多边形的线刚读进缓存就把各级都组装了
+    char *rows;  // --format shp 时各要素的 .dbf 记录，各级共用，每个 cv->row_len 字节
+    int written;  // 定位写出已完成，可以回收了
+};
+
+/*
+ * 一个文件的转换
+ */
+struct conv {
+    char *name;  // 输入文件名
+    char *output;  // 不分文件时的输出文件名，NULL 表示标准输出；切瓦片时为瓦片目录
+    char *out_name;  // 分片、按级或按图层分文件时从它得到输出文件名，见 output_stem()
+    off_t size;  // 输入文件大小，先转换大文件
+    struct options *opt;
+    struct pool *pool;
+    struct convcache *cache;  // --cache-dir 时的转换结果缓存
+    int cache_hit;  // 输出是从缓存复制的
+    struct sheet *sh;
+    struct obj_attr_define_utf8 *defu;
+    struct filter *where;
+    struct out_attr *oa;
+    int num_attrs;  // 裁剪后实际输出的属性个数
+    int fill_rgb;  // 是否输出 FillRGB
+    struct fc_writer out[MAX_LODS];  // 不分图层时各级的输出
+    struct fc_writer **layer_out[MAX_LODS];  // 按图层分文件时各级各图层的输出，用到时才创建
+    struct fc_writer *layer_open[MAX_OPEN_LAYERS];  // 其中打开着的
+    int num_layer_open;
+    long layer_clock;  // 每写一个要素加一，记在 fc_writer.used 中
+    struct fgb_writer *fgb[MAX_LODS];  // --format fgb 时各级的输出
+    struct shp_writer *shp[MAX_LODS];  // --format shp 时各级的输出
+    struct dbf_field *dbf_fields;  // --format shp 时 .dbf 的各字段，与 oa 一一对应，FillRGB 在最后
+    struct arrow_writer *arrow[MAX_LODS];  // --format arrow 时各级的输出
+    struct pgcopy_writer *pgcopy[MAX_LODS];  // --format pgcopy 时各级的输出
+    struct csv_writer *csv[MAX_LODS];  // --format csv 时各级的输出
+    int row_len;  // .dbf 每个记录的字节数
+    struct proj proj;  // --to-epsg 时的坐标转换参数
+    int tasks_left;  // 分出去还没完成的任务数，见 prepare_arcs() 和 tile_level()
+    int tasks_done;  // 分出去的任务都完成了
+    const char **tile_keys;  // 切瓦片时的各属性名
+    int num_tile_keys;
+    char *tile_layer;  // 切瓦片时的层名，即输入文件名去掉目录和扩展名
+    struct tile_zoom *tz;  // 正在切的一级
+    long num_tiles;  // 写出的瓦片数
+    struct lfq *done_q;  // 编码好的批次，等待写出；定位写出时还有写完了的批次，等待回收
+    int positioned;  // 定位写出：各级输出都是不压缩、不分片的普通文件时，各批编码好就知道确切长度，定好位置后并行 pwrite()
+    int ready;  // 有批次编码好了
+    long num_features;  // 写出的要素数
+    int failed;
+    double seconds;  // 转换用时
+};
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * 读色号定义文件，并算好各色号的 FillRGB 值
+ */
+static struct palette *
+palette_load(const char *path) {
+    struct palette *pal = calloc(1, sizeof(*pal));
+    ssize_t r;
     int fdc; // Pcolor.lib 文件句柄
 
-    fdc = open("Pcolor.lib", O_RDONLY);
+    fdc = open(path, O_RDONLY);
     if (fdc == -1) {
-        err(1, "打开色号定义文件 Pcolor.lib 失败");
-    }
-    r = read(fdc, &pcolorh, sizeof(pcolorh));
-    DEBUG_PRINT("读 Pcolor.lib 文件头 %ld 字节\n", r);
-    size_t pcolor_table_size = pcolorh.colors * sizeof(*pcolor_table);
-    pcolor_table = (struct pcolor_def *)malloc(pcolor_table_size);
-    r = read(fdc, pcolor_table, pcolor_table_size);
-    if (r != pcolor_table_size) {
-        err(1, "读色号定义文件 Pcolor.lib 失败");
-    }
-    DEBUG_PRINT("读 Pcolor.lib 文件中的 %d 个色标定义共 %ld 字节\n", pcolorh.colors, pcolor_table_size);
-
-    gen_geojson(file_name, &fh, lis, pis, line_coords, attr, &pcolorh, pcolor_table, pcolorh.colors);
-    //free(lis);
-    free(pis);
-
-    //DEBUG_PRINT("float 的大小为：%ld\n", sizeof(float));
-    //DEBUG_PRINT("polygon_info 大小：%ld\n", sizeof(struct polygon_info));
-    //DEBUG_PRINT("line_info 大小：%ld\n", sizeof(struct line_info));
-    //DEBUG_PRINT("属性区头部大小：%ld(0x%lx)\n", sizeof(struct obj_attr_header), sizeof(struct obj_attr_header));
-    //DEBUG_PRINT("属性定义大小：%ld(0x%lx)\n", sizeof(struct obj_attr_define), sizeof(struct obj_attr_define));
-    return 0;
+        err(1, "打开色号定义文件 %s 失败", path);
+    }
+    r = read(fdc, &pal->h, sizeof(pal->h));
+    DEBUG_PRINT("读 %s 文件头 %ld 字节\n", path, r);
+    if (r != sizeof(pal->h) || pal->h.colors < 0) {
+        errx(1, "色号定义文件 %s 格式不对", path);
+    }
+    size_t pcolor_table_size = pal->h.colors * sizeof(*pal->table);
+    pal->table = (struct pcolor_def *)malloc(pcolor_table_size ? pcolor_table_size : 1);
+    r = read(fdc, pal->table, pcolor_table_size);
+    if (r != (ssize_t)pcolor_table_size) {
+        err(1, "读色号定义文件 %s 失败", path);
+    }
+    close(fdc);
+    DEBUG_PRINT("读 %s 文件中的 %d 个色标定义共 %ld 字节\n", path, pal->h.colors, pcolor_table_size);
+
+    pal->max = pal->h.colors;
+    pal->fill_strs = calloc(pal->max ? pal->max : 1, sizeof(*pal->fill_strs));
+    for (int i = 0; i < pal->max; i++) {
+        struct color_rgb rgb2;  // 转换后的 RGB 值
+        struct pcolor_def *pdef = pal->table + i;
+
+        kcmy_to_rgb(pdef, &pal->h, &rgb2);  // 将 MapGIS 的 4 字节 KCMY 和后续 专色分量 转成 RGB 值
+        snprintf(pal->fill_strs[i], sizeof(pal->fill_strs[0]) - 1, "%d, %d, %d, 255", rgb2.r, rgb2.g, rgb2.b);
+        if (g_verbose) {
+            DEBUG_PRINT("色号 %d, fileoff=0x%lx, KCMY=%d,%d,%d,%d,%d,%d RGBA=%s\n", i + 1,
+                    sizeof(struct pcolor_header) + i * sizeof(struct pcolor_def), pdef->kcmy.k, pdef->kcmy.c,
+                    pdef->kcmy.m, pdef->kcmy.y, pdef->zs[0], pdef->zs[1], pal->fill_strs[i]);
+        }
+    }
+    return pal;
+}
+
+static struct palette *g_pal;  // 所有文件共用的色号定义，见 palette_get()
+static pthread_once_t g_pal_once = PTHREAD_ONCE_INIT;
+
+static void
+palette_init(void) {
+    g_pal = palette_load(PCOLOR_PATH);
+}
+
+/*
+ * 色号定义，第一次用到时才读，各线程都可以调用；文件从本机缓存打开时不用它
+ */
+static struct palette *
+palette_get(void) {
+    pthread_once(&g_pal_once, palette_init);
+    return g_pal;
+}
+
+static void
+sheet_free(struct sheet *sh) {
+    if (!sh) {
+        return;
+    }
+    if (sh->map) {
+        munmap(sh->map, sh->map_len);
+    }
+    if (!sh->cached) {
+        free(sh->arc_n);
+        free(sh->arc_off);
+        free(sh->ring_n);
+        free(sh->ring_off);
+        free(sh->color);
+        free(sh->layer);
+        free((void *)sh->refs);
+    }
+    free(sh->line_coords_buf);
+    free(sh->attr_buf);
+    free(sh->sig);
+    free(sh->sig_start);
+    free(sh);
+}
+
+/*
+ * 对映射中的一段给内核提示，如 MADV_WILLNEED 让内核在后台预读，只是提示，失败了也没关系
+ */
+static void
+madvise_range(struct sheet *sh, void *p, size_t len, int advice) {
+    static long page_size;
+    char *start, *end = (char *)p + len;
+
+    if (!page_size) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    start = sh->map + ((char *)p - (char *)sh->map) / page_size * page_size;  // madvise() 要求从页边界开始
+    if (end > start) {
+        madvise(start, end - start, advice);
+    }
+}
+
+/*
+ * 检查数据区是否在文件之内
+ */
+static int
+region_ok(struct sheet *sh, struct data_header *dh) {
+    return dh->data_offset >= 0 && dh->data_len >= 0 && (size_t)dh->data_offset + dh->data_len <= sh->map_len;
+}
+
+/*
+ * 属性定义和每个多边形的属性值是否都在属性区之内，不然后面就读越界了
+ */
+static int
+attr_ok(struct sheet *sh) {
+    struct obj_attr_header *ah = sh->attr;
+
+    return sh->attr_len >= sizeof(*ah) && ah->num_attrs >= 0 && ah->attrs_size >= 0 && ah->off_attr_value >= 0 &&
+        sizeof(*ah) + ah->num_attrs * sizeof(struct obj_attr_define) <= sh->attr_len &&
+        ah->off_attr_value + (size_t)ah->attrs_size * (sh->fh.num_polygons + 1) <= sh->attr_len;
+}
+
+/*
+ * 从不一定对齐的地方读整数，线信息和多边形信息都是 packed 结构
+ */
+static inline int32_t
+load_i32(const char *p) {
+    int32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint16_t
+load_u16(const char *p) {
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * 分配起点对齐到 CACHE_ALIGN 的内存，与缓存文件中的各区一样
+ */
+static void *
+aligned_malloc(size_t n) {
+    void *p;
+
+    if (posix_memalign(&p, CACHE_ALIGN, n ? n : 1) != 0) {
+        err(1, "posix_memalign");
+    }
+    return p;
+}
+
+/*
+ * 解出第 i 条线（从 0 开始）的点数和坐标在第二区中的位置，坐标不在第二区之内的线当作坏的线（点数为 0）
+ */
+static void
+decode_line(struct sheet *sh, int i, int32_t *num_points, int64_t *off) {
+    const char *li = sh->line_recs + LINE_INFO_FIRST + (size_t)i * sizeof(struct line_info);
+    int32_t n = load_i32(li + offsetof(struct line_info, num_points));
+    int32_t o = load_i32(li + offsetof(struct line_info, off_points_coords));
+    int ok = n > 0 && o >= 0 && (size_t)o + (size_t)n * 2 * sizeof(double) <= sh->line_coords_len;
+
+    *num_points = ok ? n : 0;
+    *off = ok ? o : 0;
 }
 
+/*
+ * 解出第 i 个多边形（从 0 开始）的线号个数、线号数组在第二区中的位置、色号和图层，放在各数组的第 k 项
+ * 线号数组不在第二区之内的多边形没有环
+ */
+static void
+decode_poly(struct sheet *sh, int i, int k) {
+    const char *pi = sh->poly_recs + (size_t)(i + 1) * sizeof(struct polygon_info);  // 真正的数据是从第二块开始的
+    int32_t num_lines = load_i32(pi + offsetof(struct polygon_info, num_lines));
+    int32_t off = load_i32(pi + offsetof(struct polygon_info, off_line_info));
+    // 第一个数是构成多边形的各线的总点数，后面 num_lines - 1 个是线号
+    int ok = num_lines >= 1 && off >= 0 && (size_t)off + (size_t)num_lines * sizeof(int) <= sh->line_coords_len;
+
+    if (!ok && num_lines > 1) {
+        DEBUG_PRINT("%s: 多边形 %d 的线号数组越界\n", sh->name, i + 1);
+    }
+    sh->ring_n[k] = ok ? num_lines - 1 : 0;
+    sh->ring_off[k] = ok ? off + sizeof(int) : 0;
+    sh->color[k] = load_i32(pi + offsetof(struct polygon_info, color));
+    sh->layer[k] = load_u16(pi + offsetof(struct polygon_info, layer));
+}
+
+/*
+ * 把各线的坐标复制到对齐的 line_coords 中，arc_off 由在第二区中的位置换成在 line_coords 中的
+ * 第二区在文件中的位置是任意的，坐标大多不对齐；复制一遍，以后按线号顺序读的都是对齐、连续的 double
+ */
+static void
+copy_arcs(struct sheet *sh, int nl) {
+    const char *wp_coords = sh->line_coords;
+    size_t len = 0;
+    char *coords;
+
+    for (int i = 0; i < nl; i++) {
+        len += (size_t)sh->arc_n[i] * 2 * sizeof(double);
+    }
+    coords = sh->line_coords_buf = aligned_malloc(len);
+    for (int i = 0; i < nl; i++) {
+        size_t n = (size_t)sh->arc_n[i] * 2 * sizeof(double), off = sh->arc_off[i];
+
+        sh->arc_off[i] = coords - (char *)sh->line_coords_buf;
+        memcpy(coords, wp_coords + off, n);
+        coords += n;
+    }
+    sh->line_coords = sh->line_coords_buf;
+    sh->line_coords_len = len;
+}
+
+/*
+ * 从线信息和多边形信息中解出转换用的各数组，按字段的偏移量读，不通过 packed 结构
+ * 各线的坐标按线号复制到对齐的 line_coords 中，各多边形的线号数组也复制到对齐的 refs 中，与缓存文件的布局一样
+ */
+static void
+sheet_decode(struct sheet *sh) {
+    int nl = sh->fh.num_lines, np = sh->fh.num_polygons;
+    const char *wp_coords = sh->line_coords;
+    size_t wp_coords_len = sh->line_coords_len, refs_len = 0;
+    char *refs;
+
+    sh->arc_n = aligned_malloc(nl * sizeof(*sh->arc_n));
+    sh->arc_off = aligned_malloc(nl * sizeof(*sh->arc_off));
+    sh->ring_n = aligned_malloc(np * sizeof(*sh->ring_n));
+    sh->ring_off = aligned_malloc(np * sizeof(*sh->ring_off));
+    sh->color = aligned_malloc(np * sizeof(*sh->color));
+    sh->layer = aligned_malloc(np * sizeof(*sh->layer));
+    for (int i = 0; i < nl; i++) {
+        decode_line(sh, i, sh->arc_n + i, sh->arc_off + i);
+    }
+    for (int i = 0; i < np; i++) {
+        decode_poly(sh, i, i);
+        refs_len += (size_t)sh->ring_n[i] * sizeof(int);
+    }
+    refs = aligned_malloc(refs_len);
+    sh->refs = refs;
+    for (int i = 0; i < np; i++) {
+        size_t n = (size_t)sh->ring_n[i] * sizeof(int), off = sh->ring_off[i];
+
+        sh->ring_off[i] = refs - sh->refs;
+        memcpy(refs, wp_coords + off, n);
+        refs += n;
+    }
+    copy_arcs(sh, nl);
+    madvise_range(sh, (void *)wp_coords, wp_coords_len, MADV_DONTNEED);  // 映射中的第二区不再用了
+}
+
+static int
+cmp_int32(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * --get：只解出 ids 中的多边形（从 1 开始的序号，与 -v 打印的一样），只读它们的多边形信息、线号数组、线信息、坐标和属性，
+ * 与文件大小无关。得到的是一个只有这几个多边形的文件：多边形按 ids 的顺序从 0 编号，用到的线重新从 1 编号，
+ * 属性区只复制这几行，各数组与 sheet_decode() 的一样，之后照常转换
+ * ids 中有不存在的序号时打印警告并返回 0
+ */
+static int
+sheet_decode_subset(struct sheet *sh, const int *ids, int n) {
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    int nl = sh->fh.num_lines, m = 0;
+    const char *wp_coords = sh->line_coords;
+    size_t refs_len = 0, head = ah->off_attr_value + (size_t)ah->attrs_size;  // 属性区中第一个多边形的属性之前的部分
+    int32_t *lines;  // 用到的线的线号，排好序去掉重复的
+    int32_t *refs;
+
+    for (int k = 0; k < n; k++) {
+        if (ids[k] < 1 || ids[k] > sh->fh.num_polygons) {
+            warnx("%s: 没有多边形 %d，多边形的序号是 1 到 %d", sh->name, ids[k], sh->fh.num_polygons);
+            return 0;
+        }
+    }
+    sh->ring_n = aligned_malloc(n * sizeof(*sh->ring_n));
+    sh->ring_off = aligned_malloc(n * sizeof(*sh->ring_off));
+    sh->color = aligned_malloc(n * sizeof(*sh->color));
+    sh->layer = aligned_malloc(n * sizeof(*sh->layer));
+    for (int k = 0; k < n; k++) {
+        decode_poly(sh, ids[k] - 1, k);
+        refs_len += (size_t)sh->ring_n[k] * sizeof(int);
+    }
+    lines = aligned_malloc(refs_len);
+    for (int k = 0; k < n; k++) {
+        for (int j = 0; j < sh->ring_n[k]; j++) {
+            int32_t ln = load_i32(wp_coords + sh->ring_off[k] + j * sizeof(int));
+
+            if (ln != 0 && ln >= -nl && ln <= nl) {
+                lines[m++] = ln < 0 ? -ln : ln;
+            }
+        }
+    }
+    qsort(lines, m, sizeof(*lines), cmp_int32);
+    int u = 0;
+
+    for (int j = 0; j < m; j++) {  // 去掉重复的，相邻的多边形共用线
+        if (u == 0 || lines[j] != lines[u - 1]) {
+            lines[u++] = lines[j];
+        }
+    }
+    m = u;
+
+    // 线号数组换成新的线号，越界的还是越界
+    refs = aligned_malloc(refs_len);
+    sh->refs = (const char *)refs;
+    for (int k = 0; k < n; k++) {
+        const char *p = wp_coords + sh->ring_off[k];
+
+        sh->ring_off[k] = (char *)refs - sh->refs;
+        for (int j = 0; j < sh->ring_n[k]; j++, refs++) {
+            int32_t ln = load_i32(p + j * sizeof(int)), a = ln < 0 ? -ln : ln;
+            int32_t *hit = ln != 0 && a <= nl ? bsearch(&a, lines, m, sizeof(*lines), cmp_int32) : NULL;
+
+            *refs = ln == 0 ? 0 : (hit ? hit - lines + 1 : m + 1) * (ln < 0 ? -1 : 1);
+        }
+    }
+    sh->arc_n = aligned_malloc(m * sizeof(*sh->arc_n));
+    sh->arc_off = aligned_malloc(m * sizeof(*sh->arc_off));
+    for (int j = 0; j < m; j++) {
+        decode_line(sh, lines[j] - 1, sh->arc_n + j, sh->arc_off + j);
+    }
+    copy_arcs(sh, m);
+    free(lines);
+
+    sh->attr_buf = malloc(head + (size_t)n * ah->attrs_size);
+    if (!sh->attr_buf) {
+        err(1, "malloc");
+    }
+    memcpy(sh->attr_buf, sh->attr, head);
+    for (int k = 0; k < n; k++) {
+        memcpy((char *)sh->attr_buf + head + (size_t)k * ah->attrs_size, attr_row(sh, ids[k] - 1), ah->attrs_size);
+    }
+    sh->attr = sh->attr_buf;
+    sh->attr_len = head + (size_t)n * ah->attrs_size;
+    sh->fh.num_polygons = n;
+    sh->fh.num_lines = m;
+    return 1;
+}
+
+/*
+ * 映射一个 .WP 文件并找到各区，出错时打印警告并返回 NULL，批量转换时一个坏文件不影响其它文件
+ *   - dump 是否打印文件头等信息（-v 时还打印每个多边形、每条线的信息）
+ *   - ids  不为 NULL 时只要这 num_ids 个多边形，见 sheet_decode_subset()
+ */
+static struct sheet *
+sheet_load(const char *name, int dump, const int *ids, int num_ids) {
+    struct sheet *sh = calloc(1, sizeof(*sh));
+    struct stat st;
+    const char *what;
+    size_t len;
+    int fd;
+
+    sh->name = name;
+    fd = open(name, O_RDONLY);
+    if (fd == -1) {
+        warn("Open file %s failed", name);
+        free(sh);
+        return NULL;
+    }
+    what = "文件头";
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sh->fh)) {
+        goto fail;
+    }
+    sh->map_len = st.st_size;
+    sh->map = mmap(NULL, sh->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    fd = -1;
+    if (sh->map == MAP_FAILED) {
+        sh->map = NULL;
+        warn("%s: mmap", name);
+        goto fail_quiet;
+    }
+    memcpy(&sh->fh, sh->map, sizeof(sh->fh));
+    if (sh->fh.ftype_id != MAPGIS_F_TYPE_POLYGON) {
+        warnx("%s: 不是多边形文件", name);
+        goto fail_quiet;
+    }
+    if (dump) {
+        g_num_line = sh->fh.num_lines;  // 只给打印用
+        print_fh(&sh->fh);
+    }
+    what = "数据区头";
+    if (sh->fh.off_data_headers < 0 || (size_t)sh->fh.off_data_headers + sizeof(sh->dhs) > sh->map_len) {
+        goto fail;
+    }
+    memcpy(&sh->dhs, sh->map + sh->fh.off_data_headers, sizeof(sh->dhs));
+    if (dump) {
+        print_dhs(sh->fh.ftype_id, &sh->dhs);
+    }
+
+    // 这里包含有区信息：每个区所属的线的编号连续存放
+    // 这里包含线信息：每条线所属点坐标连续存放
+    what = "线坐标数据";
+    if (!region_ok(sh, &sh->dhs.line_coords_or_point_string)) {
+        goto fail;
+    }
+    sh->line_coords_len = sh->dhs.line_coords_or_point_string.data_len;
+    sh->line_coords = sh->map + sh->dhs.line_coords_or_point_string.data_offset;
+    // 线坐标是按线号随机访问的，让内核先在后台把整个区读进来
+    madvise_range(sh, sh->line_coords, sh->line_coords_len, MADV_WILLNEED);
+
+    what = "区信息";
+    if (sh->fh.num_polygons < 0 || sh->fh.num_lines < 0) {
+        goto fail;
+    }
+    len = sizeof(struct polygon_info) * (sh->fh.num_polygons + 1);
+    if (sh->dhs.polygon_info.data_offset < 0 || (size_t)sh->dhs.polygon_info.data_offset + len > sh->map_len) {
+        goto fail;
+    }
+    sh->poly_recs = sh->map + sh->dhs.polygon_info.data_offset;
+    if (dump && g_verbose) {
+        print_polygon_infos(sh->fh.num_polygons, sh->poly_recs, sh->line_coords, sh->line_coords_len);
+    }
+
+    // 读第一个数据区，line info 区（对多边形文件而言）
+    // 这个区里包含有由大小为57字节的线信息结构构成的结构数组，该线信息结构中包含：
+    //   - 此线包含几个点
+    //   - 此线的点坐标在第二区（包含各点的坐标值）的偏移量
+    // 从 LINE_INFO_FIRST 起每条线 57 字节，解码只读每条线前 16 个字节中的点数和坐标位置，不会超出这个长度
+    what = "线信息区";
+    len = sizeof(struct line_info) * (sh->fh.num_lines + 1);
+    if (sh->dhs.line_or_point_info.data_offset < 0 || (size_t)sh->dhs.line_or_point_info.data_offset + len > sh->map_len) {
+        goto fail;
+    }
+    sh->line_recs = sh->map + sh->dhs.line_or_point_info.data_offset;
+    if (dump && g_verbose) {
+        print_line_infos(sh->fh.num_lines, sh->line_recs + LINE_INFO_FIRST, sh->map_len - sh->dhs.line_or_point_info.data_offset - LINE_INFO_FIRST,
+                sh->line_coords, sh->line_coords_len);
+    }
+
+    what = "多边形属性区";
+    if (!region_ok(sh, &sh->dhs.polygon_attr)) {
+        goto fail;
+    }
+    sh->attr_len = sh->dhs.polygon_attr.data_len;
+    sh->attr = sh->map + sh->dhs.polygon_attr.data_offset;
+    if (!attr_ok(sh)) {
+        goto fail;
+    }
+    if (dump) {
+        print_attr_header(sh->attr);
+    }
+    if (!ids) {
+        sheet_decode(sh);
+    } else if (!sheet_decode_subset(sh, ids, num_ids)) {
+        goto fail_quiet;
+    }
+    return sh;
+
+fail:
+    warnx("%s: 读%s出错", name, what);
+fail_quiet:
+    if (fd != -1) {
+        close(fd);
+    }
+    sheet_free(sh);
+    return NULL;
+}
+
+// --native-cache 的缓存文件中的各区，见 sheet_write_cache()
+enum {
+    SEC_FH,  // 文件头，转换时只用到其中的多边形数、线数和坐标范围
+    SEC_ARC_N,
+    SEC_ARC_OFF,
+    SEC_COORDS,  // 各线的坐标，一条接一条
+    SEC_RING_N,
+    SEC_RING_OFF,
+    SEC_REFS,  // 各多边形的线号数组，一个接一个
+    SEC_COLOR,
+    SEC_LAYER,
+    SEC_FILL,  // 各色号的 FillRGB 值
+    SEC_ATTR,  // 原样的属性区，过滤条件和数值属性还从这里取
+    SEC_STR_OFF,
+    SEC_STR_DATA,  // 各字符串属性的 UTF-8 值
+    NUM_SECS
+};
+
+#define SHEET_CACHE_VERSION 1  // 各区的内容变了就加一，旧的缓存就不用了
+
+/*
+ * 属性中字符串属性的个数
+ */
+static int
+num_str_attrs(struct sheet *sh) {
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    struct obj_attr_define *def = (struct obj_attr_define *)(sh->attr + sizeof(*ah));
+    int n = 0;
+
+    for (int k = 0; k < ah->num_attrs; k++) {
+        n += def[k].type == ATTR_STR;
+    }
+    return n;
+}
+
+/*
+ * 缓存的戳：版本、.WP 文件和色号定义文件的大小和修改时间，有一个变了缓存就作废
+ */
+static void
+sheet_stamp(const char *name, uint64_t *stamp) {
+    struct stat st;
+
+    bzero(stamp, CACHE_STAMP_WORDS * sizeof(*stamp));
+    stamp[0] = SHEET_CACHE_VERSION;
+    if (stat(name, &st) == 0) {
+        stamp[1] = st.st_size;
+        stamp[2] = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    }
+    if (stat(PCOLOR_PATH, &st) == 0) {
+        stamp[3] = st.st_size;
+        stamp[4] = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    }
+}
+
+/*
+ * 把刚解码的 .WP 文件写成缓存：各数组原样写出，字符串属性转好 UTF-8，FillRGB 算好
+ * 写不了返回 0
+ */
+static int
+sheet_write_cache(struct sheet *sh, const char *path, const uint64_t *stamp) {
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    struct obj_attr_define *def = (struct obj_attr_define *)(sh->attr + sizeof(*ah));
+    struct palette *pal = palette_get();
+    int nl = sh->fh.num_lines, np = sh->fh.num_polygons, ns = num_str_attrs(sh);
+    size_t num_str_off = (size_t)ns * (np + 1);
+    uint64_t *str_off = malloc((num_str_off ? num_str_off : 1) * sizeof(*str_off));
+    struct cache_section secs[NUM_SECS];
+    struct sbuf strs;
+    char utf8_str[ATTR_UTF8_MAX];
+    iconv_t icv = iconv_open("UTF-8", "GB18030");
+    size_t n = 0;
+    int ok;
+
+    if (!str_off) {
+        err(1, "malloc");
+    }
+    bzero(&strs, sizeof(strs));
+    for (int k = 0, c = 0; k < ah->num_attrs; k++) {  // 一个字符串属性一列
+        uint64_t *off = str_off + (size_t)c * (np + 1);
+
+        if (def[k].type != ATTR_STR) {
+            continue;
+        }
+        for (int i = 0; i < np; i++) {
+            off[i] = strs.len;
+            n = attr_iconv(icv, attr_row(sh, i) + def[k].attr_off, def[k].size, utf8_str);
+            sbuf_add(&strs, utf8_str, n);
+        }
+        off[np] = strs.len;
+        c++;
+    }
+    iconv_close(icv);
+
+    secs[SEC_FH] = (struct cache_section){&sh->fh, sizeof(sh->fh)};
+    secs[SEC_ARC_N] = (struct cache_section){sh->arc_n, nl * sizeof(*sh->arc_n)};
+    secs[SEC_ARC_OFF] = (struct cache_section){sh->arc_off, nl * sizeof(*sh->arc_off)};
+    secs[SEC_COORDS] = (struct cache_section){sh->line_coords, sh->line_coords_len};
+    secs[SEC_RING_N] = (struct cache_section){sh->ring_n, np * sizeof(*sh->ring_n)};
+    secs[SEC_RING_OFF] = (struct cache_section){sh->ring_off, np * sizeof(*sh->ring_off)};
+    secs[SEC_REFS] = (struct cache_section){sh->refs, np ? sh->ring_off[np - 1] + sh->ring_n[np - 1] * sizeof(int) : 0};
+    secs[SEC_COLOR] = (struct cache_section){sh->color, np * sizeof(*sh->color)};
+    secs[SEC_LAYER] = (struct cache_section){sh->layer, np * sizeof(*sh->layer)};
+    secs[SEC_FILL] = (struct cache_section){pal->fill_strs, pal->max * sizeof(*pal->fill_strs)};
+    secs[SEC_ATTR] = (struct cache_section){sh->attr, sh->attr_len};
+    secs[SEC_STR_OFF] = (struct cache_section){str_off, num_str_off * sizeof(*str_off)};
+    secs[SEC_STR_DATA] = (struct cache_section){strs.data, strs.len};
+    ok = cache_write(path, stamp, secs, NUM_SECS);
+
+    free(str_off);
+    sbuf_free(&strs);
+    return ok;
+}
+
+/*
+ * 检查缓存中各偏移量都落在所指的区内，且对齐，免得坏了的缓存文件让后面越界访问
+ *   - refs_len      线号数组区的长度
+ *   - str_data_len  字符串属性区的长度
+ */
+static int
+sheet_cache_offsets_ok(struct sheet *sh, size_t refs_len, size_t str_data_len) {
+    int nl = sh->fh.num_lines, np = sh->fh.num_polygons, ns = num_str_attrs(sh);
+
+    for (int i = 0; i < nl; i++) {  // 每点两个 double
+        if (sh->arc_n[i] < 0 || sh->arc_off[i] < 0 || sh->arc_off[i] % sizeof(double) != 0 ||
+                (uint64_t)sh->arc_off[i] + (uint64_t)sh->arc_n[i] * 2 * sizeof(double) > sh->line_coords_len) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < np; i++) {
+        if (sh->ring_n[i] < 0 || sh->ring_off[i] < 0 || sh->ring_off[i] % sizeof(int) != 0 ||
+                (uint64_t)sh->ring_off[i] + (uint64_t)sh->ring_n[i] * sizeof(int) > refs_len) {
+            return 0;
+        }
+    }
+    for (int c = 0; c < ns; c++) {  // 每列 np + 1 个，单调不减
+        const uint64_t *off = sh->str_off + (size_t)c * (np + 1);
+
+        for (int i = 0; i < np; i++) {
+            if (off[i] > off[i + 1]) {
+                return 0;
+            }
+        }
+        if (off[np] > str_data_len) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * 从缓存打开一个文件，各数组直接指向映射的缓存文件；没有缓存或已经作废时返回 NULL
+ */
+static struct sheet *
+sheet_map_cache(const char *name, const char *path, const uint64_t *stamp) {
+    struct sheet *sh = calloc(1, sizeof(*sh));
+    struct cache_section secs[NUM_SECS];
+    size_t nl, np;
+
+    sh->name = name;
+    sh->map = cache_map(path, stamp, secs, NUM_SECS, &sh->map_len);
+    if (!sh->map) {
+        free(sh);
+        return NULL;
+    }
+    sh->cached = 1;
+    if (secs[SEC_FH].len != sizeof(sh->fh)) {
+        goto fail;
+    }
+    memcpy(&sh->fh, secs[SEC_FH].p, sizeof(sh->fh));
+    nl = sh->fh.num_lines;
+    np = sh->fh.num_polygons;
+    sh->attr = (void *)secs[SEC_ATTR].p;
+    sh->attr_len = secs[SEC_ATTR].len;
+    if (sh->fh.num_lines < 0 || sh->fh.num_polygons < 0 || !attr_ok(sh) ||
+            secs[SEC_ARC_N].len != nl * sizeof(*sh->arc_n) || secs[SEC_ARC_OFF].len != nl * sizeof(*sh->arc_off) ||
+            secs[SEC_RING_N].len != np * sizeof(*sh->ring_n) || secs[SEC_RING_OFF].len != np * sizeof(*sh->ring_off) ||
+            secs[SEC_COLOR].len != np * sizeof(*sh->color) || secs[SEC_LAYER].len != np * sizeof(*sh->layer) ||
+            secs[SEC_FILL].len % sizeof(*sh->fill_strs) != 0 ||
+            secs[SEC_STR_OFF].len != (size_t)num_str_attrs(sh) * (np + 1) * sizeof(*sh->str_off)) {
+        goto fail;
+    }
+    sh->arc_n = (int32_t *)secs[SEC_ARC_N].p;
+    sh->arc_off = (int64_t *)secs[SEC_ARC_OFF].p;
+    sh->line_coords = (void *)secs[SEC_COORDS].p;
+    sh->line_coords_len = secs[SEC_COORDS].len;
+    sh->ring_n = (int32_t *)secs[SEC_RING_N].p;
+    sh->ring_off = (int64_t *)secs[SEC_RING_OFF].p;
+    sh->refs = secs[SEC_REFS].p;
+    sh->color = (int32_t *)secs[SEC_COLOR].p;
+    sh->layer = (uint16_t *)secs[SEC_LAYER].p;
+    sh->fill_strs = secs[SEC_FILL].p;
+    sh->fill_max = secs[SEC_FILL].len / sizeof(*sh->fill_strs);
+    sh->str_off = secs[SEC_STR_OFF].p;
+    sh->str_data = secs[SEC_STR_DATA].p;
+    if (!sheet_cache_offsets_ok(sh, secs[SEC_REFS].len, secs[SEC_STR_DATA].len)) {
+        goto fail;
+    }
+    madvise_range(sh, sh->line_coords, sh->line_coords_len, MADV_WILLNEED);
+    return sh;
+
+fail:
+    warnx("缓存文件 %s 坏了，重新生成", path);
+    sheet_free(sh);
+    return NULL;
+}
+
+/*
+ * 打开一个 .WP 文件，--native-cache 时先找 <文件名>.mgc 缓存，没有或作废了就读 .WP 文件，写好缓存再从缓存打开，
+ * 这样两种情况下转换用的都是同样的数据；缓存写不了时就用 .WP 文件
+ *   - dump 见 sheet_load()，从缓存打开时没有可打印的
+ */
+static struct sheet *
+sheet_open(const char *name, int dump, int native_cache) {
+    uint64_t stamp[CACHE_STAMP_WORDS];
+    struct sheet *sh, *c;
+    char *path;
+
+    if (!native_cache) {
+        return sheet_load(name, dump, NULL, 0);
+    }
+    if (asprintf(&path, "%s" NATIVE_CACHE_EXT, name) == -1) {
+        err(1, "asprintf");
+    }
+    sheet_stamp(name, stamp);
+    sh = sheet_map_cache(name, path, stamp);
+    if (sh) {
+        if (dump) {
+            DEBUG_PRINT("%s: 从缓存 %s 打开\n", name, path);
+        }
+        free(path);
+        return sh;
+    }
+    sh = sheet_load(name, dump, NULL, 0);
+    if (sh && sheet_write_cache(sh, path, stamp) && (c = sheet_map_cache(name, path, stamp)) != NULL) {
+        if (dump) {
+            DEBUG_PRINT("%s: 写了缓存 %s\n", name, path);
+        }
+        sheet_free(sh);
+        sh = c;
+    }
+    free(path);
+    return sh;
+}
+
+/*
+ * 由文件头中的坐标范围和命令行选项定下坐标转换参数，定不下来时返回 0
+ * 范围在经纬度之内的当作经纬度，只做基准转换；否则当作高斯-克吕格投影坐标，
+ * x 坐标大于一百万时前面的数字是带号，带号不在坐标中时要用 --zone 或 --central-meridian 指定
+ */
+static int
+conv_proj_init(struct conv *cv) {
+    struct options *opt = cv->opt;
+    struct file_header *fh = &cv->sh->fh;
+    double cm = opt->central_meridian;
+    double false_easting = 500000;
+    int zone = opt->zone;
+    int gk = !(fabs(fh->xmin) <= 180 && fabs(fh->xmax) <= 180 && fabs(fh->ymin) <= 90 && fabs(fh->ymax) <= 90);
+
+    if (gk) {
+        double x = (fh->xmin + fh->xmax) / 2;
+
+        if (x >= 1000000) {  // 带号在坐标中
+            int z = (int)(x / 1000000);
+
+            false_easting += z * 1000000.0;
+            if (!zone) {
+                zone = z;
+            }
+        }
+        if (isnan(cm)) {
+            int width = opt->zone_width;
+
+            if (!zone) {
+                warnx("%s: 坐标中没有带号，请用 --zone 或 --central-meridian 指定", cv->name);
+                return 0;
+            }
+            if (!width) {
+                width = zone > 23 ? 3 : 6;
+            }
+            cm = width == 3 ? zone * 3 : zone * 6 - 3;
+        }
+    }
+    proj_init(&cv->proj, gk, gk ? cm : 0, false_easting, opt->to_epsg, opt->towgs84);
+    if (g_verbose) {
+        if (gk) {
+            DEBUG_PRINT("%s: 高斯-克吕格投影，中央经线 %g 度，东偏 %.0f 米，转成 EPSG:%d\n", cv->name, cm, false_easting, opt->to_epsg);
+        } else {
+            DEBUG_PRINT("%s: 经纬度，转成 EPSG:%d\n", cv->name, opt->to_epsg);
+        }
+    }
+    return 1;
+}
+
+/*
+ * 文件任务分出去的一个任务完成了，最后一个完成时叫醒在 pool_wait_flag() 中等着的文件任务
+ */
+static void
+task_done(struct conv *cv) {
+    if (__atomic_sub_fetch(&cv->tasks_left, 1, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_store_n(&cv->tasks_done, 1, __ATOMIC_RELEASE);
+        pool_notify(cv->pool);
+    }
+}
+
+/*
+ * 提交 n 个任务，等它们都完成，等的时候也帮着干
+ */
+static void
+run_tasks(struct conv *cv, pool_fn fn, void *tasks, size_t size, int n) {
+    if (n == 0) {
+        return;
+    }
+    cv->tasks_left = n;
+    cv->tasks_done = 0;
+    for (int i = 0; i < n; i++) {
+        pool_submit(cv->pool, fn, (char *)tasks + i * size);
+    }
+    pool_wait_flag(cv->pool, &cv->tasks_done);
+}
+
+#define ARC_TASK_LINES 4096  // 每个线处理任务的线数
+
+struct arc_task {
+    struct conv *cv;
+    int first;  // 第一条线的序号，从 0 开始
+    int count;
+};
+
+/*
+ * 处理一段线：转换坐标，再算出各点的重要性供各级化简用，在线程池中执行
+ */
+static void
+prepare_arc_task(void *arg) {
+    struct arc_task *t = arg;
+    struct conv *cv = t->cv;
+    struct sheet *sh = cv->sh;
+    struct simplify_scratch ss;
+
+    bzero(&ss, sizeof(ss));
+    for (int i = t->first; i < t->first + t->count; i++) {
+        int n = sh->arc_n[i];
+        double *xy = (double *)((char *)sh->line_coords + sh->arc_off[i]);
+
+        // 坏的线没有点，组装多边形时也用不到它
+        if (n == 0) {
+            continue;
+        }
+        if (cv->opt->to_epsg) {
+            proj_apply(&cv->proj, xy, n);
+        }
+        if (cv->opt->format == FORMAT_MVT) {  // 切瓦片时在 Web Mercator 下化简，各级的容差都是一个瓦片像素
+            mvt_mercator(xy, n);
+        }
+        if (cv->opt->simplify) {
+            simplify_significance(xy, n, sh->sig + sh->sig_start[i], &ss);
+        }
+    }
+    simplify_free(&ss);
+    task_done(cv);
+}
+
+/*
+ * 在组装多边形之前把每条线的坐标转换一次，化简时算出各点的重要性，两个多边形共用的线只处理一次，
+ * 各级化简后也还是同一条线，不会有缝隙。重要性算一次就够所有级用了，不用每级都跑一遍 Douglas-Peucker
+ * 转换时坐标区复制一份再原地处理。分成几段由线程池并行执行
+ */
+static void
+prepare_arcs(struct conv *cv) {
+    struct sheet *sh = cv->sh;
+    int num_tasks = (sh->fh.num_lines + ARC_TASK_LINES - 1) / ARC_TASK_LINES;
+    struct arc_task *tasks;
+
+    if (cv->opt->to_epsg && !sh->line_coords_buf) {  // 缓存文件是只读映射的，复制出来再就地转换；解码的已经是自己的了
+        sh->line_coords_buf = aligned_malloc(sh->line_coords_len);
+        memcpy(sh->line_coords_buf, sh->line_coords, sh->line_coords_len);
+        sh->line_coords = sh->line_coords_buf;
+    }
+    if (cv->opt->simplify) {
+        long n = 0;
+
+        sh->sig_start = malloc((sh->fh.num_lines ? sh->fh.num_lines : 1) * sizeof(*sh->sig_start));
+        for (int i = 0; i < sh->fh.num_lines; i++) {
+            sh->sig_start[i] = sh->arc_n[i] > 0 ? n : -1;
+            n += sh->arc_n[i];
+        }
+        sh->sig = malloc((n ? n : 1) * sizeof(*sh->sig));
+        if (!sh->sig_start || !sh->sig) {
+            err(1, "malloc");
+        }
+    }
+    if (num_tasks == 0) {
+        return;
+    }
+    tasks = calloc(num_tasks, sizeof(*tasks));
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].cv = cv;
+        tasks[i].first = i * ARC_TASK_LINES;
+        tasks[i].count = sh->fh.num_lines - tasks[i].first < ARC_TASK_LINES ? sh->fh.num_lines - tasks[i].first : ARC_TASK_LINES;
+    }
+    run_tasks(cv, prepare_arc_task, tasks, sizeof(*tasks), num_tasks);
+    free(tasks);
+}
+
+/*
+ * 输出文件的扩展名，不包括 .gz
+ */
+static const char *
+output_ext(struct options *opt) {
+    switch (opt->format) {
+    case FORMAT_FGB:
+        return "fgb";
+    case FORMAT_SHP:
+        return "shp";
+    case FORMAT_ARROW:
+        return "arrow";
+    case FORMAT_PGCOPY:
+        return "pgcopy";
+    case FORMAT_CSV:
+        return "csv";
+    default:
+        return "geojson";
+    }
+}
+
+/*
+ * 第 l 级的输出文件名：按级分文件时为 <stem>.lod<N>.<扩展名>[.gz]，否则就是 cv->output（NULL 表示标准输出）
+ * 返回的用完 free()
+ */
+static char *
+level_output(struct conv *cv, int l) {
+    char *stem, *path;
+
+    if (!cv->opt->lod_files) {
+        return cv->output ? strdup(cv->output) : NULL;
+    }
+    stem = output_stem(cv->out_name, l, -1);
+    if (asprintf(&path, "%s.%s%s", stem, output_ext(cv->opt), cv->opt->gzip ? ".gz" : "") == -1) {
+        err(1, "asprintf");
+    }
+    free(stem);
+    return path;
+}
+
+/*
+ * 打开各级的 FlatGeobuf 输出，属性列的类型和宽度来自属性定义
+ */
+static void
+conv_open_fgb(struct conv *cv) {
+    struct options *opt = cv->opt;
+    struct fgb_column *cols = malloc((cv->num_attrs + 1) * sizeof(*cols));
+    int n = 0;
+
+    for (int k = 0; k < cv->num_attrs; k++, n++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+
+        cols[n] = (struct fgb_column){cv->oa[k].def->name_utf8, FGB_STRING, -1, -1, -1};
+        switch (def->type) {
+        case ATTR_STR:
+            cols[n].width = def->size2;
+            break;
+        case ATTR_INT:
+            cols[n].type = FGB_INT;
+            cols[n].width = def->size2;
+            break;
+        case ATTR_FLOAT:
+        case ATTR_DOUBLE:
+            cols[n].type = def->type == ATTR_FLOAT ? FGB_FLOAT : FGB_DOUBLE;
+            cols[n].precision = def->size2 + def->size3;
+            cols[n].scale = def->size3;
+            break;
+        default:  // 未知类型，当作字符串列，值都是空的
+            break;
+        }
+    }
+    if (cv->fill_rgb) {
+        cols[n++] = (struct fgb_column){FILL_RGB_NAME, FGB_STRING, -1, -1, -1};
+    }
+    for (int l = 0; l < opt->num_lods; l++) {
+        char *path = level_output(cv, l);
+
+        cv->fgb[l] = fgb_open(path, cv->name, opt->to_epsg ? opt->to_epsg : 4214, cols, n);
+        free(path);
+    }
+    free(cols);
+}
+
+/*
+ * 转换后的坐标系的 .prj（ESRI WKT），不转换时坐标系不确定，不写
+ */
+static const char *
+prj_wkt(int epsg) {
+    switch (epsg) {
+    case 4326:
+        return "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+            "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]";
+    case 4490:
+        return "GEOGCS[\"GCS_China_Geodetic_Coordinate_System_2000\",DATUM[\"D_China_2000\","
+            "SPHEROID[\"CGCS2000\",6378137.0,298.257222101]],PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]";
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * 打开各级的 Shapefile 输出。.dbf 的字段由属性定义直接对应：size2 是宽度，size3 是小数位数；
+ * 字段名和字符串值都是原来的 GB18030
+ */
+static void
+conv_open_shp(struct conv *cv) {
+    struct options *opt = cv->opt;
+    struct dbf_field *f = calloc(cv->num_attrs + 1, sizeof(*f));
+    int n = 0;
+
+    for (int k = 0; k < cv->num_attrs; k++, n++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        char name[sizeof(def->attr_name) + 1];
+
+        memcpy(name, def->attr_name, sizeof(def->attr_name));
+        name[sizeof(def->attr_name)] = 0;
+        dbf_set_name(f, n, name);
+        switch (def->type) {
+        case ATTR_STR:
+            f[n].type = 'C';
+            f[n].width = def->size2 > 0 && def->size2 < def->size ? def->size2 : def->size;
+            break;
+        case ATTR_INT:
+            f[n].type = 'N';
+            f[n].width = def->size2 > 0 ? def->size2 : 11;
+            break;
+        case ATTR_FLOAT:
+        case ATTR_DOUBLE:
+            f[n].type = 'N';
+            f[n].width = def->size2 > 0 ? def->size2 : 19;
+            f[n].decimals = def->size3 < 0 ? 0 : def->size3 > 15 ? 15 : def->size3;
+            if (f[n].decimals > f[n].width - 2) {
+                f[n].decimals = f[n].width > 2 ? f[n].width - 2 : 0;
+            }
+            break;
+        default:  // 未知类型，留一个空的字符串字段
+            f[n].type = 'C';
+            f[n].width = 1;
+        }
+        f[n].width = f[n].width < 1 ? 1 : f[n].width > 254 ? 254 : f[n].width;
+    }
+    if (cv->fill_rgb) {
+        dbf_set_name(f, n, FILL_RGB_NAME);
+        f[n].type = 'C';
+        f[n].width = 18;  // "255, 255, 255, 255"
+        n++;
+    }
+    cv->dbf_fields = f;
+    cv->row_len = dbf_row_len(f, n);
+    for (int l = 0; l < opt->num_lods; l++) {
+        char *path = level_output(cv, l);
+
+        cv->shp[l] = shp_open(path, f, n, prj_wkt(opt->to_epsg));
+        free(path);
+    }
+}
+
+/*
+ * 打开各级的 Arrow 输出，属性列的类型来自属性定义，数值列与 .WP 中的值类型相同
+ */
+static void
+conv_open_arrow(struct conv *cv) {
+    struct options *opt = cv->opt;
+    struct arrow_column *cols = malloc((cv->num_attrs + 1) * sizeof(*cols));
+    int n = 0;
+
+    for (int k = 0; k < cv->num_attrs; k++, n++) {
+        cols[n].name = cv->oa[k].def->name_utf8;
+        switch (cv->oa[k].def->o.type) {
+        case ATTR_STR:
+            cols[n].type = ARROW_UTF8;
+            break;
+        case ATTR_INT:
+            cols[n].type = ARROW_INT32;
+            break;
+        case ATTR_FLOAT:
+            cols[n].type = ARROW_FLOAT32;
+            break;
+        case ATTR_DOUBLE:
+            cols[n].type = ARROW_FLOAT64;
+            break;
+        default:  // 未知类型，值都是空的
+            cols[n].type = ARROW_NULL;
+        }
+    }
+    if (cv->fill_rgb) {
+        cols[n++] = (struct arrow_column){FILL_RGB_NAME, ARROW_UTF8};
+    }
+    for (int l = 0; l < opt->num_lods; l++) {
+        char *path = level_output(cv, l);
+
+        cv->arrow[l] = arrow_open(path, cols, n, opt->to_epsg);
+        free(path);
+    }
+    free(cols);
+}
+
+/*
+ * 在 sb 后面加上双引号括起来的 SQL 标识符
+ */
+static void
+sql_add_ident(struct sbuf *sb, const char *name) {
+    sbuf_addc(sb, '"');
+    for (const char *p = name; *p; p++) {
+        if (*p == '"') {
+            sbuf_addc(sb, '"');
+        }
+        sbuf_addc(sb, *p);
+    }
+    sbuf_addc(sb, '"');
+}
+
+/*
+ * 打开各级的 PostgreSQL 二进制 COPY 输出。表名是输入文件名去掉目录和扩展名，
+ * 各列的类型来自属性定义，建表语句写在输出旁边
+ */
+static void
+conv_open_pgcopy(struct conv *cv) {
+    struct options *opt = cv->opt;
+    const char *base = strrchr(cv->name, '/');
+    char *table = output_stem(base ? base + 1 : cv->name, -1, -1);
+    struct sbuf ddl;
+
+    bzero(&ddl, sizeof(ddl));
+    sbuf_adds(&ddl, "CREATE TABLE ");
+    sql_add_ident(&ddl, table);
+    sbuf_adds(&ddl, " (\n");
+    for (int k = 0; k < cv->num_attrs; k++) {
+        static const char *types[] = {
+            [ATTR_STR] = "text",
+            [ATTR_INT] = "integer",
+            [ATTR_FLOAT] = "real",
+            [ATTR_DOUBLE] = "double precision",
+        };
+        int type = cv->oa[k].def->o.type;
+
+        sbuf_adds(&ddl, "    ");
+        sql_add_ident(&ddl, cv->oa[k].def->name_utf8);
+        sbuf_addc(&ddl, ' ');
+        sbuf_adds(&ddl, type >= 0 && type <= ATTR_DOUBLE && types[type] ? types[type] : "text");  // 未知类型都是 NULL
+        sbuf_adds(&ddl, ",\n");
+    }
+    if (cv->fill_rgb) {
+        sbuf_adds(&ddl, "    \"" FILL_RGB_NAME "\" text,\n");
+    }
+    sbuf_adds(&ddl, "    geom geometry(Polygon");
+    if (opt->to_epsg) {
+        sbuf_adds(&ddl, ", ");
+        sbuf_add_long(&ddl, opt->to_epsg);
+    }
+    sbuf_adds(&ddl, ")\n);\n-- load with: COPY ");
+    sql_add_ident(&ddl, table);
+    sbuf_adds(&ddl, " FROM STDIN (FORMAT binary);\n");
+    sbuf_addc(&ddl, 0);
+
+    for (int l = 0; l < opt->num_lods; l++) {
+        char *path = level_output(cv, l);
+
+        cv->pgcopy[l] = pgcopy_open(path, opt->gzip, ddl.data);
+        free(path);
+    }
+    sbuf_free(&ddl);
+    free(table);
+}
+
+/*
+ * 打开各级的 CSV 输出
+ */
+static void
+conv_open_csv(struct conv *cv) {
+    const char **names = malloc((cv->num_attrs + 1) * sizeof(*names));
+    int n = 0;
+
+    for (int k = 0; k < cv->num_attrs; k++) {
+        names[n++] = cv->oa[k].def->name_utf8;
+    }
+    if (cv->fill_rgb) {
+        names[n++] = FILL_RGB_NAME;
+    }
+    for (int l = 0; l < cv->opt->num_lods; l++) {
+        char *path = level_output(cv, l);
+
+        cv->csv[l] = csv_open(path, cv->opt->gzip, names, n);
+        free(path);
+    }
+    free(names);
+}
+
+/*
+ * 打开各级的 GeoJSON 输出
+ */
+static void
+conv_open_outputs(struct conv *cv) {
+    struct options *opt = cv->opt;
+    int sharded = opt->shard_size || opt->shard_features;
+
+    for (int l = 0; l < opt->num_lods; l++) {
+        int lod = opt->lod_files ? l : -1;
+
+        if (opt->split_by_layer) {
+            cv->layer_out[l] = calloc(MAX_LAYERS, sizeof(*cv->layer_out[l]));
+        } else if (sharded) {  // 分片输出不能写到标准输出
+            char *stem = output_stem(cv->out_name, lod, -1);
+
+            fc_open(cv->out + l, NULL, stem, cv->name, opt);
+            free(stem);
+        } else if (opt->lod_files) {
+            char *stem = output_stem(cv->out_name, lod, -1);
+            char *path;
+
+            if (asprintf(&path, "%s.geojson%s", stem, opt->gzip ? ".gz" : "") == -1) {
+                err(1, "asprintf");
+            }
+            fc_open(cv->out + l, path, NULL, cv->name, opt);
+            free(path);
+            free(stem);
+        } else {
+            fc_open(cv->out + l, cv->output, NULL, cv->name, opt);
+        }
+    }
+    cv->positioned = !opt->split_by_layer && !sharded;
+    for (int l = 0; cv->positioned && l < opt->num_lods; l++) {
+        cv->positioned = obuf_can_pwrite(&cv->out[l].ob);
+    }
+}
+
+/*
+ * 打开输出，准备好要输出的属性
+ */
+static void
+conv_setup(struct conv *cv) {
+    struct options *opt = cv->opt;
+    struct sheet *sh = cv->sh;
+
+    if (opt->format == FORMAT_GEOJSON) {
+        conv_open_outputs(cv);
+    }
+
+    // 属性
+    // 先把属性名转成 UTF-8
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    struct obj_attr_define *def = (struct obj_attr_define *)(sh->attr + sizeof(*ah));
+    iconv_t icv = iconv_open("UTF-8", "GB18030");  // 用于属性名的编码，从GB2312到UTF-8
+
+    cv->defu = (struct obj_attr_define_utf8 *)malloc(sizeof(*cv->defu) * (ah->num_attrs ? ah->num_attrs : 1));
+    iconv_attr_def(def, cv->defu, ah->num_attrs, icv);  // 做 UTF-8 转换
+    iconv_close(icv);
+    // 过滤表达式可以用到所有属性，所以要在裁剪属性之前编译
+    cv->where = opt->where ? filter_compile(opt->where, cv->defu, ah->num_attrs) : NULL;
+    cv->num_attrs = prune_attr_def(cv->defu, ah->num_attrs, opt);
+    cv->oa = make_out_attrs(cv->defu, cv->num_attrs);
+    for (int k = 0; k < cv->num_attrs; k++) {  // 裁剪后的属性在原来的字符串属性中是第几个，属性值的位置各不相同
+        for (int j = 0; j < ah->num_attrs && def[j].attr_off != cv->oa[k].def->o.attr_off; j++) {
+            cv->oa[k].str_col += def[j].type == ATTR_STR;
+        }
+    }
+    cv->fill_rgb = attr_wanted(FILL_RGB_NAME, opt);
+    if (cv->fill_rgb && !sh->fill_strs) {  // 从缓存打开时已经有了
+        struct palette *pal = palette_get();
+
+        sh->fill_strs = (const char (*)[32])pal->fill_strs;
+        sh->fill_max = pal->max;
+    }
+
+    if (opt->format == FORMAT_FGB) {  // 属性列要在裁剪属性之后才知道
+        conv_open_fgb(cv);
+    } else if (opt->format == FORMAT_SHP) {
+        conv_open_shp(cv);
+    } else if (opt->format == FORMAT_ARROW) {
+        conv_open_arrow(cv);
+    } else if (opt->format == FORMAT_PGCOPY) {
+        conv_open_pgcopy(cv);
+    } else if (opt->format == FORMAT_CSV) {
+        conv_open_csv(cv);
+    }
+    if (opt->format == FORMAT_MVT) {
+        cv->tile_keys = malloc((cv->num_attrs + 1) * sizeof(*cv->tile_keys));
+        for (int k = 0; k < cv->num_attrs; k++) {
+            cv->tile_keys[k] = cv->defu[k].name_utf8;
+        }
+        cv->num_tile_keys = cv->num_attrs;
+        if (cv->fill_rgb) {
+            cv->tile_keys[cv->num_tile_keys++] = FILL_RGB_NAME;
+        }
+        const char *base = strrchr(cv->name, '/');
+
+        cv->tile_layer = output_stem(base ? base + 1 : cv->name, -1, -1);
+    }
+}
+
+static void encode_batch(void *arg);
+
+/*
+ * 流水线的组装阶段：按图层和过滤条件选出要输出的多边形，组装它们各级的环，在线程池中执行
+ */
+static void
+assemble_batch(void *arg) {
+    struct batch *b = arg;
+    struct conv *cv = b->cv;
+    struct sheet *sh = cv->sh;
+    struct options *opt = cv->opt;
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    char *attr_values = attr_row(sh, b->first);
+    struct arc_filter af[MAX_LODS];
+
+    for (int l = 0; l < opt->num_lods; l++) {
+        poly_reset(&b->lod[l].pc);
+        af[l].sig = sh->sig;
+        af[l].start = sh->sig_start;
+        af[l].tol2 = opt->lod[l] * opt->lod[l];
+    }
+    b->num_features = 0;
+    for (int i = b->first; i < b->first + b->count; i++, attr_values += ah->attrs_size) {
+        if (opt->layers && !(opt->layers[sh->layer[i] / 8] & (1 << (sh->layer[i] % 8)))) {  // 不要的图层
+            continue;
+        }
+        if (cv->where && !filter_match(cv->where, attr_values)) {  // 不满足过滤条件，直接跳过
+            continue;
+        }
+        for (int l = 0; l < opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            int r0 = bl->pc.num_rings;
+
+            poly_assemble(&bl->pc, sh, i, opt->lod[l] > 0 ? af + l : NULL);
+            if (opt->lod[l] > 0) {
+                poly_drop_small_rings(&bl->pc, r0);
+            }
+            bl->ring_hi[b->num_features] = bl->pc.num_rings;
+        }
+        b->polys[b->num_features] = i;
+        b->num_features++;
+    }
+    pool_submit(cv->pool, encode_batch, b);  // 提交到本线程的队列，多半接着就由本线程执行，闲着的线程也可以偷去
+}
+
+/*
+ * 编码要素中坐标之前的部分，即类型、属性和 geometry 的开头
+ *   - i 多边形序号，从 0 开始
+ */
+static void
+enc_feature_head(struct sbuf *sb, struct conv *cv, int i, iconv_t icv) {
+    struct sheet *sh = cv->sh;
+
+    sbuf_adds(sb, "{\"type\":\"Feature\",\"properties\":{");
+    enc_attrs(sb, sh, cv->oa, cv->num_attrs, i, icv);  // 该多边形的属性
+
+    //cJSON_AddNumberToObject(ps, "FillIndex", pi->color);  // 多边形填充色号
+    if (cv->fill_rgb) {
+        if (cv->num_attrs > 0) {
+            sbuf_addc(sb, ',');
+        }
+        sbuf_adds(sb, "\"" FILL_RGB_NAME "\":\"");  // 适合于 QGIS 用来填充颜色
+        if (sh->color[i] < 1 || sh->color[i] > sh->fill_max) {
+            DEBUG_PRINT("%s: 多边形 %d 的色号 %d 超出范围\n", sh->name, i + 1, sh->color[i]);
+        }
+        sbuf_adds(sb, fill_rgb(sh, i));
+        sbuf_addc(sb, '"');
+    }
+
+    // 坐标
+    sbuf_adds(sb, "},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":");
+}
+
+/*
+ * 要素的属性值，编码成 FlatGeobuf 的 properties，与 enc_attrs() 输出的属性相同，只是数值保持原来的类型
+ */
+static void
+fgb_props(struct sbuf *props, struct conv *cv, int i, iconv_t icv) {
+    char utf8_str[ATTR_UTF8_MAX];
+    char *attrv = attr_row(cv->sh, i);
+    const char *str;
+    size_t len;
+    int val_int;
+    float val_float;
+    double val_double;
+
+    for (int k = 0; k < cv->num_attrs; k++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        char *p = attrv + def->attr_off;
+
+        switch (def->type) {
+        case ATTR_STR:
+            str = attr_utf8(cv->sh, cv->oa + k, i, icv, utf8_str, &len);
+            fgb_prop_string(props, k, str, len);
+            break;
+        case ATTR_INT:
+            memcpy(&val_int, p, sizeof(val_int));
+            fgb_prop_int(props, k, val_int);
+            break;
+        case ATTR_FLOAT:
+            memcpy(&val_float, p, sizeof(val_float));
+            fgb_prop_float(props, k, val_float);
+            break;
+        case ATTR_DOUBLE:
+            memcpy(&val_double, p, sizeof(val_double));
+            fgb_prop_double(props, k, val_double);
+            break;
+        default:  // 未知类型，不写就是空值
+            break;
+        }
+    }
+    if (cv->fill_rgb) {
+        const char *rgb = fill_rgb(cv->sh, i);
+
+        fgb_prop_string(props, cv->num_attrs, rgb, strlen(rgb));
+    }
+}
+
+/*
+ * 编码一批要素的 FlatGeobuf 格式，属性值只编码一次，各级共用
+ */
+static void
+encode_batch_fgb(struct batch *b, iconv_t icv) {
+    struct conv *cv = b->cv;
+    struct sbuf props;
+
+    bzero(&props, sizeof(props));
+    for (int f = 0; f < b->num_features; f++) {
+        int i = b->polys[f];
+
+        props.len = 0;
+        fgb_props(&props, cv, i, icv);
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            int r0 = f > 0 ? bl->ring_hi[f - 1] : 0;
+
+            fgb_polygon(&bl->sb, bl->pc.xy, bl->pc.ring_end + r0, bl->ring_hi[f] - r0, r0 > 0 ? bl->pc.ring_end[r0 - 1] : 0,
+                    props.data, props.len, bl->bbox + 4 * f);
+            bl->ends[f] = bl->sb.len;
+        }
+    }
+    sbuf_free(&props);
+}
+
+/*
+ * 要素的 .dbf 记录，字符串不转换编码
+ */
+static void
+dbf_row(char *row, struct conv *cv, int i) {
+    char *attrv = attr_row(cv->sh, i);
+    char *o = row + 1;
+    int val_int;
+    float val_float;
+    double val_double;
+
+    row[0] = ' ';  // 没有删除
+    for (int k = 0; k < cv->num_attrs; k++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        struct dbf_field *f = cv->dbf_fields + k;
+        char *p = attrv + def->attr_off;
+
+        switch (def->type) {
+        case ATTR_STR:
+            dbf_string(o, f->width, p, strnlen(p, def->size));
+            break;
+        case ATTR_INT:
+            memcpy(&val_int, p, sizeof(val_int));
+            dbf_number(o, f->width, 0, val_int);
+            break;
+        case ATTR_FLOAT:
+            memcpy(&val_float, p, sizeof(val_float));
+            dbf_number(o, f->width, f->decimals, val_float);
+            break;
+        case ATTR_DOUBLE:
+            memcpy(&val_double, p, sizeof(val_double));
+            dbf_number(o, f->width, f->decimals, val_double);
+            break;
+        default:
+            memset(o, ' ', f->width);
+        }
+        o += f->width;
+    }
+    if (cv->fill_rgb) {
+        const char *rgb = fill_rgb(cv->sh, i);
+
+        dbf_string(o, cv->dbf_fields[cv->num_attrs].width, rgb, strlen(rgb));
+    }
+}
+
+/*
+ * 编码一批要素的 Shapefile 记录，.dbf 记录只编码一次，各级共用
+ */
+static void
+encode_batch_shp(struct batch *b) {
+    struct conv *cv = b->cv;
+
+    for (int f = 0; f < b->num_features; f++) {
+        int i = b->polys[f];
+
+        dbf_row(b->rows + (size_t)cv->row_len * f, cv, i);
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            int r0 = f > 0 ? bl->ring_hi[f - 1] : 0;
+
+            shp_polygon(&bl->sb, bl->pc.xy, bl->pc.ring_end + r0, bl->ring_hi[f] - r0, r0 > 0 ? bl->pc.ring_end[r0 - 1] : 0);
+            bl->ends[f] = bl->sb.len;
+        }
+    }
+}
+
+/*
+ * 把一批要素的字符串属性转成 UTF-8，放在第一级的 sb 中，每个是 4 字节的长度和内容，各级共用
+ * 数值和坐标写出时直接从 .WP 的属性值和组装好的多边形复制到各列，这里不用编码
+ */
+static void
+encode_batch_arrow(struct batch *b, iconv_t icv) {
+    struct conv *cv = b->cv;
+    struct sbuf *sb = &b->lod[0].sb;
+    char utf8_str[ATTR_UTF8_MAX];
+
+    for (int f = 0; f < b->num_features; f++) {
+        for (int k = 0; k < cv->num_attrs; k++) {
+            const char *str;
+            size_t n;
+            uint32_t len;
+
+            if (cv->oa[k].def->o.type != ATTR_STR) {
+                continue;
+            }
+            str = attr_utf8(cv->sh, cv->oa + k, b->polys[f], icv, utf8_str, &n);
+            len = n;
+            sbuf_add(sb, &len, sizeof(len));
+            sbuf_add(sb, str, len);
+        }
+        b->lod[0].ends[f] = sb->len;
+    }
+}
+
+/*
+ * 写出一批要素的 Arrow 各列，属性值各级都一样
+ */
+static void
+emit_batch_arrow(struct conv *cv, struct batch *b) {
+    struct sheet *sh = cv->sh;
+    struct sbuf *sb = &b->lod[0].sb;
+
+    for (int l = 0; l < cv->opt->num_lods; l++) {
+        struct arrow_writer *w = cv->arrow[l];
+        struct batch_lod *bl = b->lod + l;
+        size_t pos = 0;
+
+        for (int f = 0; f < b->num_features; f++) {
+            int i = b->polys[f];
+            char *attrv = attr_row(sh, i);
+            int r0 = f > 0 ? bl->ring_hi[f - 1] : 0;
+
+            for (int k = 0; k < cv->num_attrs; k++) {
+                struct obj_attr_define *def = &cv->oa[k].def->o;
+                uint32_t len;
+
+                switch (def->type) {
+                case ATTR_STR:
+                    memcpy(&len, sb->data + pos, sizeof(len));
+                    arrow_utf8(w, k, sb->data + pos + sizeof(len), len);
+                    pos += sizeof(len) + len;
+                    break;
+                case ATTR_INT:
+                case ATTR_FLOAT:
+                case ATTR_DOUBLE:
+                    arrow_fixed(w, k, attrv + def->attr_off);
+                    break;
+                default:  // ARROW_NULL 列
+                    break;
+                }
+            }
+            if (cv->fill_rgb) {
+                const char *rgb = fill_rgb(sh, i);
+
+                arrow_utf8(w, cv->num_attrs, rgb, strlen(rgb));
+            }
+            arrow_polygon(w, bl->pc.xy, bl->pc.ring_end + r0, bl->ring_hi[f] - r0, r0 > 0 ? bl->pc.ring_end[r0 - 1] : 0);
+            arrow_end_row(w);
+        }
+    }
+}
+
+/*
+ * 要素的 COPY 元组中几何之前的部分：字段数和各属性值，与 enc_attrs() 输出的属性相同，只是数值保持原来的类型
+ */
+static void
+pgcopy_head(struct sbuf *sb, struct conv *cv, int i, iconv_t icv) {
+    char utf8_str[ATTR_UTF8_MAX];
+    char *attrv = attr_row(cv->sh, i);
+    const char *str;
+    size_t len;
+    int val_int;
+    float val_float;
+    double val_double;
+
+    pgcopy_tuple(sb, cv->num_attrs + cv->fill_rgb + 1);
+    for (int k = 0; k < cv->num_attrs; k++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        char *p = attrv + def->attr_off;
+
+        switch (def->type) {
+        case ATTR_STR:
+            str = attr_utf8(cv->sh, cv->oa + k, i, icv, utf8_str, &len);
+            pgcopy_text(sb, str, len);
+            break;
+        case ATTR_INT:
+            memcpy(&val_int, p, sizeof(val_int));
+            pgcopy_int4(sb, val_int);
+            break;
+        case ATTR_FLOAT:
+            memcpy(&val_float, p, sizeof(val_float));
+            pgcopy_float4(sb, val_float);
+            break;
+        case ATTR_DOUBLE:
+            memcpy(&val_double, p, sizeof(val_double));
+            pgcopy_float8(sb, val_double);
+            break;
+        default:
+            pgcopy_null(sb);
+        }
+    }
+    if (cv->fill_rgb) {
+        const char *rgb = fill_rgb(cv->sh, i);
+
+        pgcopy_text(sb, rgb, strlen(rgb));
+    }
+}
+
+/*
+ * 编码一批要素的 COPY 元组，属性值只在第一级编码一次，其它级复制过去
+ */
+static void
+encode_batch_pgcopy(struct batch *b, iconv_t icv) {
+    struct conv *cv = b->cv;
+    struct sbuf *sb = &b->lod[0].sb;
+
+    for (int f = 0; f < b->num_features; f++) {
+        int i = b->polys[f];
+        size_t start = sb->len;
+
+        pgcopy_head(sb, cv, i, icv);
+        size_t head = sb->len;
+
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            int r0 = f > 0 ? bl->ring_hi[f - 1] : 0;
+
+            if (l > 0) {
+                sbuf_add(&bl->sb, sb->data + start, head - start);
+            }
+            pgcopy_polygon(&bl->sb, bl->pc.xy, bl->pc.ring_end + r0, bl->ring_hi[f] - r0, r0 > 0 ? bl->pc.ring_end[r0 - 1] : 0,
+                    cv->opt->to_epsg);
+            bl->ends[f] = bl->sb.len;
+        }
+    }
+}
+
+/*
+ * CSV 一行中 WKT 之后的部分：各属性值和行尾，与 enc_attrs() 输出的属性相同
+ */
+static void
+csv_attrs(struct sbuf *sb, struct conv *cv, int i, iconv_t icv) {
+    char utf8_str[ATTR_UTF8_MAX];
+    char *attrv = attr_row(cv->sh, i);
+    const char *str;
+    size_t len;
+    int val_int;
+    float val_float;
+    double val_double;
+
+    for (int k = 0; k < cv->num_attrs; k++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        char *p = attrv + def->attr_off;
+
+        sbuf_addc(sb, ',');
+        switch (def->type) {
+        case ATTR_STR:
+            str = attr_utf8(cv->sh, cv->oa + k, i, icv, utf8_str, &len);
+            csv_add_string(sb, str, len);
+            break;
+        case ATTR_INT:
+            memcpy(&val_int, p, sizeof(val_int));
+            sbuf_add_long(sb, val_int);
+            break;
+        case ATTR_FLOAT:
+            memcpy(&val_float, p, sizeof(val_float));
+            csv_add_double(sb, val_float);
+            break;
+        case ATTR_DOUBLE:
+            memcpy(&val_double, p, sizeof(val_double));
+            csv_add_double(sb, val_double);
+            break;
+        default:  // 未知类型，空值
+            break;
+        }
+    }
+    if (cv->fill_rgb) {
+        const char *rgb = fill_rgb(cv->sh, i);
+
+        sbuf_addc(sb, ',');
+        csv_add_string(sb, rgb, strlen(rgb));
+    }
+    sbuf_addc(sb, '\n');
+}
+
+/*
+ * 编码一批要素的 CSV 行，WKT 在前，属性值只编码一次，追加到各级的 WKT 后面
+ */
+static void
+encode_batch_csv(struct batch *b, iconv_t icv) {
+    struct conv *cv = b->cv;
+    struct sbuf attrs;
+
+    bzero(&attrs, sizeof(attrs));
+    for (int f = 0; f < b->num_features; f++) {
+        int i = b->polys[f];
+
+        attrs.len = 0;
+        csv_attrs(&attrs, cv, i, icv);
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            int r0 = f > 0 ? bl->ring_hi[f - 1] : 0;
+
+            csv_wkt_polygon(&bl->sb, bl->pc.xy, bl->pc.ring_end + r0, bl->ring_hi[f] - r0, r0 > 0 ? bl->pc.ring_end[r0 - 1] : 0);
+            sbuf_add(&bl->sb, attrs.data, attrs.len);
+            bl->ends[f] = bl->sb.len;
+        }
+    }
+    sbuf_free(&attrs);
+}
+
+/*
+ * 流水线的编码阶段：把组装好的多边形连同属性编码成要素，放进待写出队列，在线程池中执行
+ */
+static void
+encode_batch(void *arg) {
+    struct batch *b = arg;
+    struct conv *cv = b->cv;
+    struct options *opt = cv->opt;
+    iconv_t icv = iconv_open("UTF-8", "GB18030");  // 用于属性值的编码，iconv 上下文不能在线程间共用
+    struct sbuf *sb = &b->lod[0].sb;  // 属性只在第一级编码一次，其它级复制过去
+
+    for (int l = 0; l < opt->num_lods; l++) {
+        b->lod[l].sb.len = 0;
+    }
+    if (opt->format == FORMAT_FGB) {
+        encode_batch_fgb(b, icv);
+    } else if (opt->format == FORMAT_SHP) {
+        encode_batch_shp(b);
+    } else if (opt->format == FORMAT_ARROW) {
+        encode_batch_arrow(b, icv);
+    } else if (opt->format == FORMAT_PGCOPY) {
+        encode_batch_pgcopy(b, icv);
+    } else if (opt->format == FORMAT_CSV) {
+        encode_batch_csv(b, icv);
+    }
+    for (int f = 0; opt->format == FORMAT_GEOJSON && f < b->num_features; f++) {
+        int i = b->polys[f];
+        size_t start = sb->len;
+
+        if (cv->positioned) {  // 分隔符也编进来，整批一次写出；文件中第一个要素的在写出时跳过
+            sbuf_add(sb, ",\n", 2);
+        }
+        enc_feature_head(sb, cv, i, icv);
+        size_t head = sb->len;  // 坐标之前的部分各级都一样
+
+        for (int l = 0; l < opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+
+            if (l > 0) {
+                sbuf_add(&bl->sb, sb->data + start, head - start);
+            }
+            enc_poly_coords(&bl->sb, &bl->pc, f > 0 ? bl->ring_hi[f - 1] : 0, bl->ring_hi[f]);
+            sbuf_adds(&bl->sb, "}}");
+            bl->ends[f] = bl->sb.len;
+        }
+    }
+    iconv_close(icv);
+
+    if (!lfq_push(cv->done_q, b)) {  // 队列容量不小于批次对象的个数，不会满
+        errx(1, "待写出队列满了");
+    }
+    __atomic_store_n(&cv->ready, 1, __ATOMIC_SEQ_CST);
+    pool_notify(cv->pool);
+}
+
+/*
+ * 该要素在第 l 级的输出，按图层分文件时遇到新图层就开一个新文件
+ * 各级各图层打开着的输出不超过 MAX_OPEN_LAYERS 个（每个有一个文件描述符和一块 OBUF_SIZE 的缓冲区），
+ * 多了就暂时关掉最久没写的，再用到时以追加方式打开
+ */
+static struct fc_writer *
+conv_writer(struct conv *cv, int l, int layer) {
+    struct options *opt = cv->opt;
+    struct fc_writer *w;
+
+    if (!cv->layer_out[l]) {
+        return cv->out + l;
+    }
+    w = cv->layer_out[l][layer];
+    if (w && !w->ob.suspended) {
+        w->used = ++cv->layer_clock;
+        return w;
+    }
+    if (cv->num_layer_open == MAX_OPEN_LAYERS) {
+        int lru = 0;
+
+        for (int i = 1; i < cv->num_layer_open; i++) {
+            if (cv->layer_open[i]->used < cv->layer_open[lru]->used) {
+                lru = i;
+            }
+        }
+        obuf_suspend(&cv->layer_open[lru]->ob);
+        cv->layer_open[lru] = cv->layer_open[--cv->num_layer_open];
+    }
+    if (w) {
+        obuf_resume(&w->ob);
+    } else {  // 该图层的第一个要素，开一个新文件
+        char *stem = output_stem(cv->out_name, opt->lod_files ? l : -1, layer);
+
+        w = cv->layer_out[l][layer] = malloc(sizeof(*w));
+        if (opt->shard_size || opt->shard_features) {
+            fc_open(w, NULL, stem, cv->name, opt);
+        } else {
+            char *path;
+
+            if (asprintf(&path, "%s.geojson%s", stem, opt->gzip ? ".gz" : "") == -1) {
+                err(1, "asprintf");
+            }
+            fc_open(w, path, NULL, cv->name, opt);
+            free(path);
+        }
+        free(stem);
+    }
+    cv->layer_open[cv->num_layer_open++] = w;
+    w->used = ++cv->layer_clock;
+    return w;
+}
+
+/*
+ * 定位写出阶段：把一批编码好的要素写到 emit_batch() 给它定好的位置，在线程池中执行，各批可以同时写
+ * 写完了放回待写出队列，由 stream_features() 回收
+ */
+static void
+write_batch(void *arg) {
+    struct batch *b = arg;
+    struct conv *cv = b->cv;
+
+    for (int l = 0; l < cv->opt->num_lods; l++) {
+        struct batch_lod *bl = b->lod + l;
+
+        obuf_pwrite(&cv->out[l].ob, bl->sb.data + bl->skip, bl->sb.len - bl->skip, bl->off);
+    }
+    b->written = 1;
+    if (!lfq_push(cv->done_q, b)) {
+        errx(1, "待写出队列满了");
+    }
+    __atomic_store_n(&cv->ready, 1, __ATOMIC_SEQ_CST);
+    pool_notify(cv->pool);
+}
+
+/*
+ * 流水线的写出阶段：写出一批已编码好的要素，压缩时交给 pgz 的线程
+ * 定位写出时只按顺序定下各级在文件中的位置（前面各批长度的前缀和），交给 write_batch() 去写，返回 0 表示批次还不能回收
+ */
+static int
+emit_batch(struct conv *cv, struct batch *b) {
+    if (cv->positioned) {
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = b->lod + l;
+            struct fc_writer *w = cv->out + l;
+
+            bl->skip = w->num_features == 0 && b->num_features > 0 ? 2 : 0;
+            bl->off = obuf_claim(&w->ob, bl->sb.len - bl->skip);
+            w->num_features += b->num_features;
+        }
+        cv->num_features += b->num_features;
+        pool_submit(cv->pool, write_batch, b);
+        return 0;
+    }
+    if (cv->opt->format == FORMAT_ARROW) {
+        emit_batch_arrow(cv, b);
+        cv->num_features += b->num_features;
+        return 1;
+    }
+    if (cv->opt->format == FORMAT_PGCOPY || cv->opt->format == FORMAT_CSV) {  // 元组或行首尾相接，整批写出
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            if (cv->opt->format == FORMAT_PGCOPY) {
+                pgcopy_write(cv->pgcopy[l], b->lod[l].sb.data, b->lod[l].sb.len);
+            } else {
+                csv_write(cv->csv[l], b->lod[l].sb.data, b->lod[l].sb.len);
+            }
+        }
+        cv->num_features += b->num_features;
+        return 1;
+    }
+    for (int l = 0; l < cv->opt->num_lods; l++) {
+        struct batch_lod *bl = b->lod + l;
+        size_t start = 0;
+
+        for (int f = 0; f < b->num_features; f++) {
+            switch (cv->opt->format) {
+            case FORMAT_FGB:
+                fgb_write_feature(cv->fgb[l], bl->sb.data + start, bl->ends[f] - start, bl->bbox + 4 * f);
+                break;
+            case FORMAT_SHP:
+                shp_write(cv->shp[l], bl->sb.data + start, bl->ends[f] - start, b->rows + (size_t)cv->row_len * f);
+                break;
+            default:
+                fc_write_feature(conv_writer(cv, l, cv->sh->layer[b->polys[f]]), bl->sb.data + start, bl->ends[f] - start);
+            }
+            start = bl->ends[f];
+        }
+    }
+    cv->num_features += b->num_features;
+    return 1;
+}
+
+/*
+ * 流水线的取数据阶段：定下一批多边形的范围，提示内核预读它们的多边形信息和属性值，再交去组装
+ */
+static void
+fetch_batch(struct conv *cv, struct batch *b, long seq) {
+    struct sheet *sh = cv->sh;
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    int n = sh->fh.num_polygons;
+
+    b->seq = seq;
+    b->first = seq * BATCH_POLYS;
+    b->count = n - b->first < BATCH_POLYS ? n - b->first : BATCH_POLYS;
+    madvise_range(sh, attr_row(sh, b->first), (size_t)ah->attrs_size * b->count, MADV_WILLNEED);
+    pool_submit(cv->pool, assemble_batch, b);
+}
+
+/*
+ * 关闭输出，释放转换用到的东西
+ */
+static void
+conv_finish(struct conv *cv) {
+    for (int l = 0; cv->opt->format == FORMAT_FGB && l < cv->opt->num_lods; l++) {
+        fgb_close(cv->fgb[l]);
+        cv->fgb[l] = NULL;
+    }
+    for (int l = 0; cv->opt->format == FORMAT_SHP && l < cv->opt->num_lods; l++) {
+        shp_close(cv->shp[l]);
+        cv->shp[l] = NULL;
+    }
+    free(cv->dbf_fields);
+    cv->dbf_fields = NULL;
+    for (int l = 0; cv->opt->format == FORMAT_ARROW && l < cv->opt->num_lods; l++) {
+        arrow_close(cv->arrow[l]);
+        cv->arrow[l] = NULL;
+    }
+    for (int l = 0; cv->opt->format == FORMAT_PGCOPY && l < cv->opt->num_lods; l++) {
+        pgcopy_close(cv->pgcopy[l]);
+        cv->pgcopy[l] = NULL;
+    }
+    for (int l = 0; cv->opt->format == FORMAT_CSV && l < cv->opt->num_lods; l++) {
+        csv_close(cv->csv[l]);
+        cv->csv[l] = NULL;
+    }
+    for (int l = 0; cv->opt->format == FORMAT_GEOJSON && l < cv->opt->num_lods; l++) {
+        if (cv->layer_out[l]) {
+            for (int layer = 0; layer < MAX_LAYERS; layer++) {
+                if (cv->layer_out[l][layer]) {
+                    fc_close(cv->layer_out[l][layer]);
+                    free(cv->layer_out[l][layer]);
+                }
+            }
+            free(cv->layer_out[l]);
+            cv->layer_out[l] = NULL;
+            cv->num_layer_open = 0;
+        } else {
+            fc_close(cv->out + l);
+        }
+    }
+    filter_free(cv->where);
+    free(cv->tile_keys);
+    free(cv->tile_layer);
+    free(cv->oa);
+    free(cv->defu);
+    lfq_free(cv->done_q);
+    cv->done_q = NULL;
+    sheet_free(cv->sh);
+    cv->sh = NULL;
+}
+
+#define TILE_TASK_REFS 4096  // 每个切瓦片任务至少处理这么多个（要素, 瓦片）对
+
+/*
+ * 切瓦片时的一块连续的多边形，组装好的环用单位坐标（见 mvt_mercator()）
+ */
+struct tile_chunk {
+    struct conv *cv;
+    int first;  // 第一个多边形的序号，从 0 开始
+    int count;
+    int num_features;  // 通过过滤的多边形数
+    int *polys;  // 各要素的多边形序号
+    int *ring_hi;  // 各要素最后一个环在 pc 中的序号 + 1
+    double *bbox;  // 各要素的范围 xmin, ymin, xmax, ymax
+    struct poly_coords pc;
+};
+
+/*
+ * 一个要素落在一个瓦片中
+ */
+struct tile_ref {
+    uint64_t tile;  // x << 32 | y
+    int chunk;
+    int feat;  // 在块中的序号
+};
+
+/*
+ * 正在切的一级
+ */
+struct tile_zoom {
+    int z;
+    double scale;  // 单位坐标乘上它就是该级的像素坐标，2^z * MVT_EXTENT
+    struct tile_chunk *chunks;
+    int num_chunks;
+};
+
+/*
+ * 一个切瓦片任务：连续的若干个瓦片
+ */
+struct tile_task {
+    struct conv *cv;
+    struct tile_ref *refs;  // 按瓦片排好序
+    int num_refs;
+};
+
+/*
+ * 组装一块多边形，化简到一个像素，算出各要素的范围，在线程池中执行
+ */
+static void
+tile_assemble(void *arg) {
+    struct tile_chunk *c = arg;
+    struct conv *cv = c->cv;
+    struct sheet *sh = cv->sh;
+    struct options *opt = cv->opt;
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    char *attr_values = attr_row(sh, c->first);
+    struct arc_filter af = {sh->sig, sh->sig_start, 1 / (cv->tz->scale * cv->tz->scale)};
+
+    poly_reset(&c->pc);
+    c->num_features = 0;
+    for (int i = c->first; i < c->first + c->count; i++, attr_values += ah->attrs_size) {
+        if (opt->layers && !(opt->layers[sh->layer[i] / 8] & (1 << (sh->layer[i] % 8)))) {
+            continue;
+        }
+        if (cv->where && !filter_match(cv->where, attr_values)) {
+            continue;
+        }
+        int r0 = c->pc.num_rings;
+        int p0 = r0 > 0 ? c->pc.ring_end[r0 - 1] : 0;
+        double *bb = c->bbox + 4 * c->num_features;
+
+        poly_assemble(&c->pc, sh, i, &af);
+        poly_drop_small_rings(&c->pc, r0);
+        if (c->pc.num_rings == r0) {  // 在这一级上整个没了
+            continue;
+        }
+        bb[0] = bb[1] = INFINITY;
+        bb[2] = bb[3] = -INFINITY;
+        for (int k = p0; k < c->pc.num_points; k++) {
+            double x = c->pc.xy[2 * k], y = c->pc.xy[2 * k + 1];
+
+            bb[0] = fmin(bb[0], x);
+            bb[1] = fmin(bb[1], y);
+            bb[2] = fmax(bb[2], x);
+            bb[3] = fmax(bb[3], y);
+        }
+        c->polys[c->num_features] = i;
+        c->ring_hi[c->num_features] = c->pc.num_rings;
+        c->num_features++;
+    }
+    task_done(cv);
+}
+
+/*
+ * 要素范围（单位坐标）连同缓冲区覆盖的瓦片号范围 [*t0, *t1]
+ */
+static void
+tile_span(struct tile_zoom *tz, double lo, double hi, int *t0, int *t1) {
+    int max = (1 << tz->z) - 1;
+
+    *t0 = (int)floor((lo * tz->scale - MVT_BUFFER) / MVT_EXTENT);
+    *t1 = (int)floor((hi * tz->scale + MVT_BUFFER) / MVT_EXTENT);
+    *t0 = *t0 < 0 ? 0 : *t0 > max ? max : *t0;
+    *t1 = *t1 < 0 ? 0 : *t1 > max ? max : *t1;
+}
+
+static int
+cmp_tile_ref(const void *a, const void *b) {
+    const struct tile_ref *x = a, *y = b;
+
+    if (x->tile != y->tile) {
+        return x->tile < y->tile ? -1 : 1;
+    }
+    if (x->chunk != y->chunk) {  // 瓦片中的要素保持原来的顺序
+        return x->chunk - y->chunk;
+    }
+    return x->feat - y->feat;
+}
+
+/*
+ * 要素的属性作为瓦片中的标签，与 enc_attrs() 输出的属性相同，只是数值保持原来的类型
+ */
+static void
+tile_tags(struct mvt_layer *l, struct conv *cv, int i, iconv_t icv) {
+    char utf8_str[ATTR_UTF8_MAX];
+    char *attrv = attr_row(cv->sh, i);
+    const char *str;
+    size_t len;
+    int val_int;
+    float val_float;
+    double val_double;
+
+    for (int k = 0; k < cv->num_attrs; k++) {
+        struct obj_attr_define *def = &cv->oa[k].def->o;
+        char *p = attrv + def->attr_off;
+
+        switch (def->type) {
+        case ATTR_STR:
+            str = attr_utf8(cv->sh, cv->oa + k, i, icv, utf8_str, &len);
+            mvt_tag_string(l, k, str, len);
+            break;
+        case ATTR_INT:
+            memcpy(&val_int, p, sizeof(val_int));
+            mvt_tag_int(l, k, val_int);
+            break;
+        case ATTR_FLOAT:
+            memcpy(&val_float, p, sizeof(val_float));
+            mvt_tag_float(l, k, val_float);
+            break;
+        case ATTR_DOUBLE:
+            memcpy(&val_double, p, sizeof(val_double));
+            mvt_tag_double(l, k, val_double);
+            break;
+        default:  // 未知类型，没有 null 值可用，不加这个标签
+            break;
+        }
+    }
+    if (cv->fill_rgb) {
+        const char *rgb = fill_rgb(cv->sh, i);
+
+        mvt_tag_string(l, cv->num_attrs, rgb, strlen(rgb));
+    }
+}
+
+/*
+ * 写出一个文件，写不了就退出，与写 GeoJSON 输出时一样
+ */
+static void
+write_file(const char *path, const void *p, size_t n) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        err(1, "创建输出文件 %s 失败", path);
+    }
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "写输出文件 %s 失败", path);
+        }
+        p = (const char *)p + r;
+        n -= r;
+    }
+    if (close(fd) != 0) {
+        err(1, "关闭输出文件 %s 失败", path);
+    }
+}
+
+/*
+ * 建目录，已经有了也行
+ */
+static void
+make_dir(const char *path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        err(1, "创建目录 %s 失败", path);
+    }
+}
+
+/*
+ * 编码瓦片用的临时空间，各线程一个
+ */
+struct tile_scratch {
+    struct mvt_layer l;
+    struct mvt_clip clip;
+    double *pts;  // 转成瓦片内坐标的环
+    int cap_pts;
+    iconv_t icv;  // 用于属性值的编码
+};
+
+static void
+tile_scratch_init(struct tile_scratch *ts, struct conv *cv) {
+    bzero(ts, sizeof(*ts));
+    mvt_layer_init(&ts->l, cv->tile_layer, cv->tile_keys, cv->num_tile_keys);
+    ts->icv = iconv_open("UTF-8", "GB18030");
+}
+
+static void
+tile_scratch_free(struct tile_scratch *ts) {
+    mvt_layer_free(&ts->l);
+    mvt_clip_free(&ts->clip);
+    free(ts->pts);
+    iconv_close(ts->icv);
+}
+
+/*
+ * 把一个组装好的多边形裁剪到瓦片中，加到瓦片的层里
+ *   - pc, r0, r1  多边形的环是 pc 中的 [r0, r1)，单位坐标
+ *   - i           多边形序号，从 0 开始
+ *   - bb          多边形的范围
+ *   - scale       该级的 2^z * MVT_EXTENT
+ *   - ox, oy      瓦片左上角的像素坐标
+ */
+static void
+tile_add_feature(struct tile_scratch *ts, struct conv *cv, struct poly_coords *pc, int r0, int r1, int i,
+        const double *bb, double scale, double ox, double oy) {
+    // 整个要素都在瓦片（连同缓冲区）之内时不用裁剪
+    int inside = bb[0] * scale - ox >= -MVT_BUFFER && bb[2] * scale - ox <= MVT_EXTENT + MVT_BUFFER &&
+        bb[1] * scale - oy >= -MVT_BUFFER && bb[3] * scale - oy <= MVT_EXTENT + MVT_BUFFER;
+
+    mvt_feature_begin(&ts->l, (uint64_t)i + 1);  // 要素号用多边形号，从 1 开始
+    for (int ring = r0; ring < r1; ring++) {
+        int start = ring > 0 ? pc->ring_end[ring - 1] : 0;
+        int n = pc->ring_end[ring] - start;
+        double *xy;
+
+        if (n > ts->cap_pts) {
+            ts->cap_pts = n * 2;
+            ts->pts = realloc(ts->pts, ts->cap_pts * 2 * sizeof(double));
+            if (!ts->pts) {
+                err(1, "realloc");
+            }
+        }
+        for (int k = 0; k < n; k++) {  // 转成瓦片内的坐标
+            ts->pts[2 * k] = pc->xy[2 * (start + k)] * scale - ox;
+            ts->pts[2 * k + 1] = pc->xy[2 * (start + k) + 1] * scale - oy;
+        }
+        xy = ts->pts;
+        if (!inside) {
+            n = mvt_clip_ring(ts->pts, n, -MVT_BUFFER, -MVT_BUFFER, MVT_EXTENT + MVT_BUFFER, MVT_EXTENT + MVT_BUFFER,
+                    &ts->clip, &xy);
+        }
+        mvt_ring(&ts->l, xy, n, ring == r0);
+    }
+    if (ts->l.num_geom > 0) {  // 属性只给留下来的要素编码
+        tile_tags(&ts->l, cv, i, ts->icv);
+    }
+    mvt_feature_end(&ts->l);
+}
+
+/*
+ * 编码并写出一串瓦片，在线程池中执行
+ */
+static void
+tile_task(void *arg) {
+    struct tile_task *t = arg;
+    struct conv *cv = t->cv;
+    struct tile_zoom *tz = cv->tz;
+    struct tile_scratch ts;
+    struct sbuf out, path;
+    long num_tiles = 0;
+
+    tile_scratch_init(&ts, cv);
+    bzero(&out, sizeof(out));
+    bzero(&path, sizeof(path));
+    for (int r = 0; r < t->num_refs;) {
+        uint64_t tile = t->refs[r].tile;
+        int tx = (int)(tile >> 32), ty = (int)(tile & 0xffffffff);
+        double ox = (double)tx * MVT_EXTENT, oy = (double)ty * MVT_EXTENT;  // 瓦片左上角的像素坐标
+
+        mvt_layer_reset(&ts.l);
+        for (; r < t->num_refs && t->refs[r].tile == tile; r++) {
+            struct tile_chunk *c = tz->chunks + t->refs[r].chunk;
+            int f = t->refs[r].feat;
+
+            tile_add_feature(&ts, cv, &c->pc, f > 0 ? c->ring_hi[f - 1] : 0, c->ring_hi[f], c->polys[f],
+                    c->bbox + 4 * f, tz->scale, ox, oy);
+        }
+
+        out.len = 0;
+        mvt_tile_encode(&ts.l, &out);
+        if (out.len == 0) {  // 要素都被裁掉了
+            continue;
+        }
+        path.len = 0;
+        sbuf_adds(&path, cv->output);
+        sbuf_addc(&path, '/');
+        sbuf_add_long(&path, tz->z);
+        sbuf_addc(&path, '/');
+        sbuf_add_long(&path, tx);
+        sbuf_addc(&path, 0);
+        make_dir(path.data);
+        path.len--;
+        sbuf_addc(&path, '/');
+        sbuf_add_long(&path, ty);
+        sbuf_adds(&path, ".pbf");
+        sbuf_addc(&path, 0);
+        write_file(path.data, out.data, out.len);
+        num_tiles++;
+    }
+    __atomic_add_fetch(&cv->num_tiles, num_tiles, __ATOMIC_RELAXED);
+    tile_scratch_free(&ts);
+    sbuf_free(&out);
+    sbuf_free(&path);
+    task_done(cv);
+}
+
+/*
+ * 切一级瓦片：各块并行组装多边形，算出每个要素落在哪些瓦片中，按瓦片排好序后分成几段并行编码、写出
+ */
+static void
+tile_level(struct conv *cv, struct tile_zoom *tz) {
+    struct tile_ref *refs;
+    struct tile_task *tasks;
+    long num_refs = 0;
+    int num_tasks = 0;
+    char *dir;
+
+    cv->tz = tz;
+    run_tasks(cv, tile_assemble, tz->chunks, sizeof(*tz->chunks), tz->num_chunks);
+
+    for (int c = 0; c < tz->num_chunks; c++) {  // 先数一下有多少对
+        for (int f = 0; f < tz->chunks[c].num_features; f++) {
+            double *bb = tz->chunks[c].bbox + 4 * f;
+            int x0, x1, y0, y1;
+
+            tile_span(tz, bb[0], bb[2], &x0, &x1);
+            tile_span(tz, bb[1], bb[3], &y0, &y1);
+            num_refs += (long)(x1 - x0 + 1) * (y1 - y0 + 1);
+        }
+    }
+    refs = malloc((num_refs ? num_refs : 1) * sizeof(*refs));
+    if (!refs) {
+        err(1, "malloc");
+    }
+    num_refs = 0;
+    for (int c = 0; c < tz->num_chunks; c++) {
+        for (int f = 0; f < tz->chunks[c].num_features; f++) {
+            double *bb = tz->chunks[c].bbox + 4 * f;
+            int x0, x1, y0, y1;
+
+            tile_span(tz, bb[0], bb[2], &x0, &x1);
+            tile_span(tz, bb[1], bb[3], &y0, &y1);
+            for (int x = x0; x <= x1; x++) {
+                for (int y = y0; y <= y1; y++) {
+                    refs[num_refs++] = (struct tile_ref){(uint64_t)x << 32 | (uint32_t)y, c, f};
+                }
+            }
+        }
+    }
+    qsort(refs, num_refs, sizeof(*refs), cmp_tile_ref);
+
+    if (asprintf(&dir, "%s/%d", cv->output, tz->z) == -1) {
+        err(1, "asprintf");
+    }
+    make_dir(dir);
+    free(dir);
+
+    // 分段，每段至少 TILE_TASK_REFS 对，不把一个瓦片分在两段中
+    tasks = malloc((num_refs / TILE_TASK_REFS + 1) * sizeof(*tasks));
+    for (long r = 0; r < num_refs;) {
+        long end = r + TILE_TASK_REFS < num_refs ? r + TILE_TASK_REFS : num_refs;
+
+        while (end < num_refs && refs[end].tile == refs[end - 1].tile) {
+            end++;
+        }
+        tasks[num_tasks++] = (struct tile_task){cv, refs + r, (int)(end - r)};
+        r = end;
+    }
+    run_tasks(cv, tile_task, tasks, sizeof(*tasks), num_tasks);
+    free(tasks);
+    free(refs);
+}
+
+/*
+ * 把整个文件切成 --zoom 各级的矢量瓦片，写到 <dir>/z/x/y.pbf
+ * 线已在 prepare_arcs() 中转成 Web Mercator 并算好了重要性，每级只是按该级的像素大小选点组装，
+ * 一级的多边形都组装好（内存与一个文件的坐标相当）再按瓦片分
+ */
+static void
+tile_sheet(struct conv *cv) {
+    struct sheet *sh = cv->sh;
+    struct tile_zoom tz;
+
+    make_dir(cv->output);
+    tz.num_chunks = (sh->fh.num_polygons + BATCH_POLYS - 1) / BATCH_POLYS;
+    tz.chunks = calloc(tz.num_chunks ? tz.num_chunks : 1, sizeof(*tz.chunks));
+    for (int c = 0; c < tz.num_chunks; c++) {
+        struct tile_chunk *ch = tz.chunks + c;
+
+        ch->cv = cv;
+        ch->first = c * BATCH_POLYS;
+        ch->count = sh->fh.num_polygons - ch->first < BATCH_POLYS ? sh->fh.num_polygons - ch->first : BATCH_POLYS;
+        ch->polys = malloc(BATCH_POLYS * sizeof(*ch->polys));
+        ch->ring_hi = malloc(BATCH_POLYS * sizeof(*ch->ring_hi));
+        ch->bbox = malloc(BATCH_POLYS * 4 * sizeof(*ch->bbox));
+    }
+    for (int z = cv->opt->min_zoom; z <= cv->opt->max_zoom; z++) {
+        tz.z = z;
+        tz.scale = ldexp(MVT_EXTENT, z);
+        tile_level(cv, &tz);
+        if (z == cv->opt->max_zoom) {  // 最细一级的要素数
+            for (int c = 0; c < tz.num_chunks; c++) {
+                cv->num_features += tz.chunks[c].num_features;
+            }
+        }
+    }
+    for (int c = 0; c < tz.num_chunks; c++) {
+        free(tz.chunks[c].polys);
+        free(tz.chunks[c].ring_hi);
+        free(tz.chunks[c].bbox);
+        free(tz.chunks[c].pc.xy);
+        free(tz.chunks[c].pc.ring_end);
+    }
+    free(tz.chunks);
+    cv->tz = NULL;
+}
+
+/*
+ * 把整个文件转成 GeoJSON 要素，由本任务驱动取数据、组装、编码、写出的流水线
+ * 本任务负责流水线的两头：不断取出空闲的批次交去组装、编码，同时把编码好的批次按顺序写出并回收。
+ * 中间的阶段由线程池执行，本任务等待时也帮着干（可能是别的文件的批次），
+ * 压缩由 pgz 的线程执行，各阶段之间的队列都是有界的，所以内存占用与文件大小无关
+ */
+static void
+stream_features(struct conv *cv) {
+    long num_batches, next_fetch = 0, next_write = 0;
+    int window, num_free;
+    struct batch *batches, **free_batches, **reorder;
+
+    num_batches = (cv->sh->fh.num_polygons + BATCH_POLYS - 1) / BATCH_POLYS;
+    window = BATCH_WINDOW * pool_threads(cv->pool);
+    if (window > num_batches) {
+        window = num_batches ? num_batches : 1;
+    }
+    cv->done_q = lfq_create(window);
+    batches = calloc(window, sizeof(*batches));
+    free_batches = calloc(window, sizeof(*free_batches));
+    reorder = calloc(window, sizeof(*reorder));  // 编码好了还不能写出的批次，第 i 批放在 reorder[i % window]
+    for (int i = 0; i < window; i++) {
+        batches[i].cv = cv;
+        batches[i].polys = malloc(BATCH_POLYS * sizeof(*batches[i].polys));
+        if (cv->opt->format == FORMAT_SHP) {
+            batches[i].rows = malloc((size_t)BATCH_POLYS * cv->row_len);
+        }
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            batches[i].lod[l].ring_hi = malloc(BATCH_POLYS * sizeof(*batches[i].lod[l].ring_hi));
+            batches[i].lod[l].ends = malloc(BATCH_POLYS * sizeof(*batches[i].lod[l].ends));
+            if (cv->opt->format == FORMAT_FGB) {
+                batches[i].lod[l].bbox = malloc(BATCH_POLYS * 4 * sizeof(*batches[i].lod[l].bbox));
+            }
+        }
+        free_batches[i] = batches + i;
+    }
+    num_free = window;
+
+    while (next_write < num_batches || num_free < window) {  // 定位写出时还要等各批都写完
+        struct batch *b;
+        int progress = 0;
+
+        while (num_free > 0 && next_fetch < num_batches) {
+            fetch_batch(cv, free_batches[--num_free], next_fetch++);
+        }
+        // 先清掉标志再看队列，免得漏掉看过队列之后才放进去的批次
+        __atomic_store_n(&cv->ready, 0, __ATOMIC_SEQ_CST);
+        while ((b = lfq_pop(cv->done_q)) != NULL) {
+            if (b->written) {
+                b->written = 0;
+                free_batches[num_free++] = b;
+                progress = 1;
+            } else {
+                reorder[b->seq % window] = b;
+            }
+        }
+        while (next_write < next_fetch && (b = reorder[next_write % window]) != NULL) {
+            reorder[next_write % window] = NULL;
+            if (emit_batch(cv, b)) {
+                free_batches[num_free++] = b;
+            }
+            next_write++;
+            progress = 1;
+        }
+        if (!progress) {
+            pool_wait_flag(cv->pool, &cv->ready);
+        }
+    }
+    for (int i = 0; i < window; i++) {
+        free(batches[i].polys);
+        free(batches[i].rows);
+        for (int l = 0; l < cv->opt->num_lods; l++) {
+            struct batch_lod *bl = batches[i].lod + l;
+
+            free(bl->ring_hi);
+            free(bl->ends);
+            free(bl->bbox);
+            free(bl->pc.xy);
+            free(bl->pc.ring_end);
+            sbuf_free(&bl->sb);
+        }
+    }
+    free(batches);
+    free(free_batches);
+    free(reorder);
+}
+
+#define MAX_OUTPUTS (MAX_LODS * 5)  // 一个文件最多的输出文件数，shp 每级有 5 个
+
+/*
+ * 转换结果缓存的盐：程序本身、色号定义文件和影响输出的各选项的散列，有一个变了以前的缓存就都不用了
+ */
+static uint64_t
+conv_cache_salt(struct options *opt) {
+    const char *strs[] = {opt->select, opt->exclude, opt->where};
+    struct sbuf sb;
+    uint64_t h;
+
+    bzero(&sb, sizeof(sb));
+    h = hash_file("/proc/self/exe", 0, &h) ? h : 0;
+    sbuf_add(&sb, &h, sizeof(h));
+    h = hash_file(PCOLOR_PATH, 0, &h) ? h : 0;
+    sbuf_add(&sb, &h, sizeof(h));
+    for (int k = 0; k < 3; k++) {
+        sbuf_adds(&sb, strs[k] ? strs[k] : "");
+        sbuf_addc(&sb, 0);
+    }
+    if (opt->layers) {
+        sbuf_add(&sb, opt->layers, MAX_LAYERS / 8);
+    }
+    sbuf_add(&sb, opt->get_ids, opt->num_get_ids * sizeof(*opt->get_ids));
+    sbuf_add(&sb, &opt->num_get_ids, sizeof(opt->num_get_ids));
+    sbuf_add(&sb, &opt->gzip, sizeof(opt->gzip));
+    sbuf_add(&sb, &opt->to_epsg, sizeof(opt->to_epsg));
+    sbuf_add(&sb, &opt->zone, sizeof(opt->zone));
+    sbuf_add(&sb, &opt->zone_width, sizeof(opt->zone_width));
+    sbuf_add(&sb, &opt->central_meridian, sizeof(opt->central_meridian));
+    sbuf_add(&sb, opt->towgs84, sizeof(opt->towgs84));
+    sbuf_add(&sb, opt->lod, opt->num_lods * sizeof(*opt->lod));
+    sbuf_add(&sb, &opt->num_lods, sizeof(opt->num_lods));
+    sbuf_add(&sb, &opt->lod_files, sizeof(opt->lod_files));
+    sbuf_add(&sb, &opt->simplify, sizeof(opt->simplify));
+    sbuf_add(&sb, &opt->format, sizeof(opt->format));
+    h = hash64(sb.data, sb.len, 0);
+    sbuf_free(&sb);
+    return h;
+}
+
+/*
+ * 一个文件的各输出文件名，放在 paths 中，返回个数，用完 free()
+ * 输出文件不是事先定好的（切瓦片、按图层分文件、分片）或输出到标准输出时返回 0，这些不用转换结果缓存
+ */
+static int
+conv_outputs(struct conv *cv, char **paths) {
+    struct options *opt = cv->opt;
+    int n = 0;
+
+    if (opt->format == FORMAT_MVT || opt->split_by_layer || opt->shard_size || opt->shard_features || !cv->output) {
+        return 0;
+    }
+    for (int l = 0; l < (opt->lod_files ? opt->num_lods : 1); l++) {
+        char *path = level_output(cv, l);
+        size_t len = strlen(path);
+
+        paths[n++] = path;
+        if (opt->format == FORMAT_SHP) {  // 与 shp_open() 写的文件相同
+            const char *exts[] = {"shx", "dbf", "cpg", "prj"};
+            int num_exts = prj_wkt(opt->to_epsg) ? 4 : 3;
+
+            len -= len > 4 && strcasecmp(path + len - 4, ".shp") == 0 ? 4 : 0;
+            for (int k = 0; k < num_exts; k++) {
+                if (asprintf(paths + n++, "%.*s.%s", (int)len, path, exts[k]) == -1) {
+                    err(1, "asprintf");
+                }
+            }
+        } else if (opt->format == FORMAT_PGCOPY) {  // 与 pgcopy_open() 写的 DDL 文件相同
+            len -= len > 3 && strcmp(path + len - 3, ".gz") == 0 ? 3 : 0;
+            if (asprintf(paths + n++, "%.*s.sql", (int)len, path) == -1) {
+                err(1, "asprintf");
+            }
+        }
+    }
+    return n;
+}
+
+/*
+ * 转换结果缓存的键：盐、输入文件内容的散列、输入和输出文件名（GeoJSON 的 name、DDL 的表名由它们来）
+ */
+static void
+conv_cache_key(struct conv *cv, uint64_t input_hash, char *key) {
+    struct sbuf sb;
+
+    bzero(&sb, sizeof(sb));
+    sbuf_add(&sb, &cv->opt->cache_salt, sizeof(cv->opt->cache_salt));
+    sbuf_add(&sb, &input_hash, sizeof(input_hash));
+    sbuf_add(&sb, cv->name, strlen(cv->name) + 1);
+    sbuf_add(&sb, cv->output, strlen(cv->output) + 1);
+    snprintf(key, CONVCACHE_KEY_LEN + 1, "%016llx%016llx", (unsigned long long)hash64(sb.data, sb.len, 0),
+            (unsigned long long)hash64(sb.data, sb.len, 1));
+    sbuf_free(&sb);
+}
+
+/*
+ * 转换一个文件，在线程池中执行
+ */
+static void
+convert_file(void *arg) {
+    struct conv *cv = arg;
+    double t0 = now();
+    char *outputs[MAX_OUTPUTS];
+    char key[CONVCACHE_KEY_LEN + 1];
+    int num_outputs = cv->cache ? conv_outputs(cv, outputs) : 0;
+    uint64_t h, stamp[CACHE_STAMP_WORDS], stamp2[CACHE_STAMP_WORDS];
+
+    if (num_outputs > 0) {  // 散列之前记下大小和修改时间，转换完再对一次，见下面的 convcache_put()
+        sheet_stamp(cv->name, stamp);
+    }
+    if (num_outputs > 0 && hash_file(cv->name, 0, &h)) {  // 输入没变、选项也一样就不用再转换了
+        conv_cache_key(cv, h, key);
+        cv->cache_hit = convcache_get(cv->cache, key, outputs, num_outputs, &cv->num_features);
+    } else {
+        for (int k = 0; k < num_outputs; k++) {
+            free(outputs[k]);
+        }
+        num_outputs = 0;
+    }
+    if (cv->cache_hit) {
+        goto done;
+    }
+
+    if (cv->opt->get_ids) {  // 只读这几个多边形用到的部分，不用缓存
+        cv->sh = sheet_load(cv->name, !cv->opt->batch || g_verbose, cv->opt->get_ids, cv->opt->num_get_ids);
+    } else {
+        cv->sh = sheet_open(cv->name, !cv->opt->batch || g_verbose, cv->opt->native_cache);
+    }
+    if (cv->sh && cv->opt->to_epsg && !conv_proj_init(cv)) {
+        sheet_free(cv->sh);
+        cv->sh = NULL;
+    }
+    if (!cv->sh) {
+        cv->failed = 1;
+        goto done;
+    }
+    conv_setup(cv);
+    if (cv->opt->to_epsg || cv->opt->simplify) {
+        prepare_arcs(cv);
+    }
+
+    if (cv->opt->format == FORMAT_MVT) {
+        tile_sheet(cv);
+    } else {
+        stream_features(cv);
+    }
+    conv_finish(cv);
+    if (num_outputs > 0) {
+        // 散列和转换分别读了一次文件，中间被改过（如 --watch 时正在写）的话，输出就不一定是按这个散列值的内容转换的，不能放进缓存
+        sheet_stamp(cv->name, stamp2);
+        if (memcmp(stamp, stamp2, sizeof(stamp)) == 0) {
+            convcache_put(cv->cache, key, outputs, num_outputs, cv->num_features);
+        } else {
+            warnx("%s: 转换时文件变了，结果不放进缓存", cv->name);
+        }
+    }
+
+    cv->seconds = now() - t0;
+    if (cv->opt->format == FORMAT_MVT) {
+        fprintf(stderr, "%s: %ld 个要素，%ld 个瓦片，用时 %.3f 秒\n", cv->name, cv->num_features, cv->num_tiles, cv->seconds);
+    } else if (cv->opt->batch || g_verbose) {
+        fprintf(stderr, "%s: %ld 个要素，用时 %.3f 秒\n", cv->name, cv->num_features, cv->seconds);
+    }
+done:
+    if (cv->cache_hit) {
+        cv->seconds = now() - t0;
+        if (cv->opt->batch || g_verbose) {
+            fprintf(stderr, "%s: %ld 个要素，从缓存复制，用时 %.3f 秒\n", cv->name, cv->num_features, cv->seconds);
+        }
+    }
+    for (int k = 0; k < num_outputs; k++) {
+        free(outputs[k]);
+    }
+}
+
+/*
+ * 批量转换的输入文件列表
+ */
+struct conv_list {
+    struct conv **v;
+    int n;
+    int cap;
+    char **dirs;  // 输入的目录和其下的子目录，--watch 时监视它们
+    int num_dirs;
+    int cap_dirs;
+};
+
+static void
+add_conv(struct conv_list *l, const char *name, off_t size) {
+    struct conv *cv = calloc(1, sizeof(*cv));
+
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->v = realloc(l->v, l->cap * sizeof(*l->v));
+        if (!l->v) {
+            err(1, "realloc");
+        }
+    }
+    cv->name = strdup(name);
+    cv->size = size;
+    l->v[l->n++] = cv;
+}
+
+/*
+ * 文件名是否以 .WP 结尾（不分大小写）
+ */
+static int
+is_wp_name(const char *name) {
+    size_t n = strlen(name);
+
+    return n > 3 && strcasecmp(name + n - 3, ".wp") == 0;
+}
+
+/*
+ * 加入一个输入：普通文件直接加入，目录则递归找出其中所有的 .WP 文件
+ */
+static void
+add_input(struct conv_list *l, const char *path) {
+    struct stat st;
+    struct dirent *de;
+    DIR *dir;
+
+    if (stat(path, &st) != 0) {
+        err(1, "%s", path);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_conv(l, path, st.st_size);
+        return;
+    }
+    dir = opendir(path);
+    if (!dir) {
+        err(1, "打开目录 %s 失败", path);
+    }
+    if (l->num_dirs == l->cap_dirs) {
+        l->cap_dirs = l->cap_dirs ? l->cap_dirs * 2 : 16;
+        l->dirs = realloc(l->dirs, l->cap_dirs * sizeof(*l->dirs));
+        if (!l->dirs) {
+            err(1, "realloc");
+        }
+    }
+    l->dirs[l->num_dirs++] = strdup(path);
+    while ((de = readdir(dir)) != NULL) {
+        char *sub;
+
+        if (de->d_name[0] == '.') {  // 包括 . 和 ..
+            continue;
+        }
+        if (asprintf(&sub, "%s/%s", path, de->d_name) == -1) {
+            err(1, "asprintf");
+        }
+        if (stat(sub, &st) == 0 && (S_ISDIR(st.st_mode) || is_wp_name(de->d_name))) {
+            add_input(l, sub);
+        }
+        free(sub);
+    }
+    closedir(dir);
+}
+
+/*
+ * 从列表文件中读入输入，每行一个文件或目录，空行和 # 开头的行忽略
+ */
+static void
+add_batch_list(struct conv_list *l, const char *list) {
+    FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+
+    if (!f) {
+        err(1, "打开列表文件 %s 失败", list);
+    }
+    while ((n = getline(&line, &cap, f)) != -1) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            line[--n] = 0;
+        }
+        if (n > 0 && line[0] != '#') {
+            add_input(l, line);
+        }
+    }
+    free(line);
+    if (f != stdin) {
+        fclose(f);
+    }
+}
+
+/*
+ * 大文件排在前面，免得最后剩下一个大文件只有几个线程在忙
+ */
+static int
+cmp_conv_size(const void *a, const void *b) {
+    const struct conv *x = *(const struct conv **)a, *y = *(const struct conv **)b;
+
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+/*
+ * 确定各文件的输出文件名
+ * 批量转换时输出到输入文件旁边（或 --out-dir 目录下）同名的 .geojson 文件，否则按 -o，没有 -o 时输出到标准输出
+ * 切瓦片时输出的是目录，没有 -o 时或批量转换时为输入文件名去掉扩展名
+ */
+static void
+set_outputs(struct conv *cv, struct options *opt) {
+    if (!opt->batch) {
+        cv->out_name = strdup(opt->output ? opt->output : cv->name);
+        if (opt->output) {
+            cv->output = strdup(opt->output);
+        } else if (opt->format == FORMAT_MVT) {
+            cv->output = output_stem(cv->name, -1, -1);
+        } else if (opt->format == FORMAT_SHP) {  // 几个文件，不能写到标准输出
+            char *stem = output_stem(cv->name, -1, -1);
+
+            if (asprintf(&cv->output, "%s.shp", stem) == -1) {
+                err(1, "asprintf");
+            }
+            free(stem);
+        } else {
+            cv->output = NULL;
+        }
+        return;
+    }
+    if (opt->out_dir) {
+        const char *base = strrchr(cv->name, '/');
+
+        if (asprintf(&cv->out_name, "%s/%s", opt->out_dir, base ? base + 1 : cv->name) == -1) {
+            err(1, "asprintf");
+        }
+    } else {
+        cv->out_name = strdup(cv->name);
+    }
+
+    char *stem = output_stem(cv->out_name, -1, -1);
+
+    if (opt->format == FORMAT_MVT) {
+        cv->output = stem;
+        return;
+    }
+    if (asprintf(&cv->output, "%s.%s%s", stem, output_ext(opt), opt->gzip ? ".gz" : "") == -1) {
+        err(1, "asprintf");
+    }
+    free(stem);
+}
+
+#define SERVE_GRID 64  // 每个文件的空间索引分成 SERVE_GRID x SERVE_GRID 格
+
+/*
+ * --serve 时打开着的一个文件：整个映射在内存中，线已转成 Web Mercator 并算好了重要性，
+ * 要输出的多边形（通过 --layer 和 --where）按范围建了格网索引
+ */
+struct served {
+    struct conv *cv;
+    int num_polys;
+    int *polys;  // 要输出的多边形的序号
+    double *bbox;  // 它们的范围（单位坐标），每个 4 个数
+    double x0, y0, x1, y1;  // 所有多边形的范围
+    int *cell_start;  // 各格在 cell_items 中的开始，SERVE_GRID * SERVE_GRID + 1 个
+    int *cell_items;  // 各格中的多边形在 polys 中的序号，按序号排好
+};
+
+struct server {
+    struct served *sheets;
+    int num_sheets;
+    struct lru *cache;
+    size_t cache_size;
+    struct httpd *httpd;
+};
+
+/*
+ * 范围落在哪些格中
+ */
+static void
+grid_span(struct served *sv, const double *bb, int *cx0, int *cy0, int *cx1, int *cy1) {
+    double w = (sv->x1 - sv->x0) / SERVE_GRID, h = (sv->y1 - sv->y0) / SERVE_GRID;
+    int c[4];
+
+    c[0] = w > 0 ? (int)floor((bb[0] - sv->x0) / w) : 0;
+    c[1] = h > 0 ? (int)floor((bb[1] - sv->y0) / h) : 0;
+    c[2] = w > 0 ? (int)floor((bb[2] - sv->x0) / w) : 0;
+    c[3] = h > 0 ? (int)floor((bb[3] - sv->y0) / h) : 0;
+    for (int k = 0; k < 4; k++) {
+        c[k] = c[k] < 0 ? 0 : c[k] >= SERVE_GRID ? SERVE_GRID - 1 : c[k];
+    }
+    *cx0 = c[0];
+    *cy0 = c[1];
+    *cx1 = c[2];
+    *cy1 = c[3];
+}
+
+/*
+ * 算出要输出的多边形的范围，建格网索引。多边形的范围由它的各线的范围合起来，化简后的点是原来的点的一部分，不会超出
+ */
+static void
+serve_index(struct served *sv) {
+    struct conv *cv = sv->cv;
+    struct sheet *sh = cv->sh;
+    struct options *opt = cv->opt;
+    struct obj_attr_header *ah = (struct obj_attr_header *)sh->attr;
+    char *attr_values = attr_row(sh, 0);
+    int n = sh->fh.num_polygons;
+    double *lbb = malloc((sh->fh.num_lines ? sh->fh.num_lines : 1) * 4 * sizeof(*lbb));
+    int *count = calloc(SERVE_GRID * SERVE_GRID + 1, sizeof(*count));
+
+    sv->polys = malloc((n ? n : 1) * sizeof(*sv->polys));
+    sv->bbox = malloc((n ? n : 1) * 4 * sizeof(*sv->bbox));
+    if (!lbb || !count || !sv->polys || !sv->bbox) {
+        err(1, "malloc");
+    }
+    for (int i = 0; i < sh->fh.num_lines; i++) {  // 各线的范围，坏的线没有范围
+        double *xy = (double *)((char *)sh->line_coords + sh->arc_off[i]);
+        double *bb = lbb + 4 * i;
+
+        bb[0] = bb[1] = INFINITY;
+        bb[2] = bb[3] = -INFINITY;
+        for (int k = 0; k < sh->arc_n[i]; k++) {
+            bb[0] = fmin(bb[0], xy[2 * k]);
+            bb[1] = fmin(bb[1], xy[2 * k + 1]);
+            bb[2] = fmax(bb[2], xy[2 * k]);
+            bb[3] = fmax(bb[3], xy[2 * k + 1]);
+        }
+    }
+    sv->x0 = sv->y0 = INFINITY;
+    sv->x1 = sv->y1 = -INFINITY;
+    sv->num_polys = 0;
+    for (int i = 0; i < n; i++, attr_values += ah->attrs_size) {
+        const int *line_num = (const int *)(sh->refs + sh->ring_off[i]);
+        double *bb = sv->bbox + 4 * sv->num_polys;
+
+        if (opt->layers && !(opt->layers[sh->layer[i] / 8] & (1 << (sh->layer[i] % 8)))) {
+            continue;
+        }
+        if (cv->where && !filter_match(cv->where, attr_values)) {
+            continue;
+        }
+        bb[0] = bb[1] = INFINITY;
+        bb[2] = bb[3] = -INFINITY;
+        for (int j = 0; j < sh->ring_n[i]; j++) {
+            int ln = line_num[j];
+
+            if (ln == 0 || ln > sh->fh.num_lines || ln < -sh->fh.num_lines) {
+                continue;
+            }
+            double *b = lbb + 4 * ((ln < 0 ? -ln : ln) - 1);
+
+            bb[0] = fmin(bb[0], b[0]);
+            bb[1] = fmin(bb[1], b[1]);
+            bb[2] = fmax(bb[2], b[2]);
+            bb[3] = fmax(bb[3], b[3]);
+        }
+        if (!(bb[0] <= bb[2])) {  // 没有一条好的线
+            continue;
+        }
+        sv->x0 = fmin(sv->x0, bb[0]);
+        sv->y0 = fmin(sv->y0, bb[1]);
+        sv->x1 = fmax(sv->x1, bb[2]);
+        sv->y1 = fmax(sv->y1, bb[3]);
+        sv->polys[sv->num_polys++] = i;
+    }
+    free(lbb);
+
+    // 格网：先数每格有多少，再放进去
+    for (int p = 0; p < sv->num_polys; p++) {
+        int cx0, cy0, cx1, cy1;
+
+        grid_span(sv, sv->bbox + 4 * p, &cx0, &cy0, &cx1, &cy1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                count[cy * SERVE_GRID + cx + 1]++;
+            }
+        }
+    }
+    for (int c = 0; c < SERVE_GRID * SERVE_GRID; c++) {
+        count[c + 1] += count[c];
+    }
+    sv->cell_start = count;
+    sv->cell_items = malloc((count[SERVE_GRID * SERVE_GRID] ? count[SERVE_GRID * SERVE_GRID] : 1) * sizeof(*sv->cell_items));
+    if (!sv->cell_items) {
+        err(1, "malloc");
+    }
+
+    int *fill = malloc(SERVE_GRID * SERVE_GRID * sizeof(*fill));
+
+    memcpy(fill, count, SERVE_GRID * SERVE_GRID * sizeof(*fill));
+    for (int p = 0; p < sv->num_polys; p++) {
+        int cx0, cy0, cx1, cy1;
+
+        grid_span(sv, sv->bbox + 4 * p, &cx0, &cy0, &cx1, &cy1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                sv->cell_items[fill[cy * SERVE_GRID + cx]++] = p;
+            }
+        }
+    }
+    free(fill);
+}
+
+static int
+cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * 范围与 bb 相交的多边形（在 polys 中的序号），按序号排好，返回个数，*out 用完 free()
+ */
+static int
+serve_query(struct served *sv, const double *bb, int **out) {
+    int cx0, cy0, cx1, cy1, n = 0, m = 0;
+    int *v;
+
+    *out = NULL;
+    if (sv->num_polys == 0 || bb[2] < sv->x0 || bb[0] > sv->x1 || bb[3] < sv->y0 || bb[1] > sv->y1) {
+        return 0;
+    }
+    grid_span(sv, bb, &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; cy++) {
+        n += sv->cell_start[cy * SERVE_GRID + cx1 + 1] - sv->cell_start[cy * SERVE_GRID + cx0];
+    }
+    v = malloc((n ? n : 1) * sizeof(*v));
+    if (!v) {
+        err(1, "malloc");
+    }
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int k = sv->cell_start[cy * SERVE_GRID + cx0]; k < sv->cell_start[cy * SERVE_GRID + cx1 + 1]; k++) {
+            double *pb = sv->bbox + 4 * sv->cell_items[k];
+
+            if (pb[2] >= bb[0] && pb[0] <= bb[2] && pb[3] >= bb[1] && pb[1] <= bb[3]) {
+                v[m++] = sv->cell_items[k];
+            }
+        }
+    }
+    qsort(v, m, sizeof(*v), cmp_int);  // 跨格的多边形会出现多次
+    n = 0;
+    for (int k = 0; k < m; k++) {
+        if (n == 0 || v[k] != v[n - 1]) {
+            v[n++] = v[k];
+        }
+    }
+    *out = v;
+    return n;
+}
+
+/*
+ * 生成一个瓦片，mvt 为 0 时生成 GeoJSON（不裁剪，与瓦片相交的要素都完整输出，化简程度与瓦片相同）
+ */
+static void
+serve_render(struct served *sv, int z, int x, int y, int mvt, struct sbuf *out) {
+    struct conv *cv = sv->cv;
+    struct sheet *sh = cv->sh;
+    double scale = ldexp(MVT_EXTENT, z);
+    double ox = (double)x * MVT_EXTENT, oy = (double)y * MVT_EXTENT;
+    double buf = mvt ? MVT_BUFFER : 0;
+    double bb[4] = {(ox - buf) / scale, (oy - buf) / scale, (ox + MVT_EXTENT + buf) / scale, (oy + MVT_EXTENT + buf) / scale};
+    struct arc_filter af = {sh->sig, sh->sig_start, 1 / (scale * scale)};
+    struct poly_coords pc;
+    struct tile_scratch ts;
+    int *hits;
+    int n = serve_query(sv, bb, &hits);
+    int num_features = 0;
+
+    bzero(&pc, sizeof(pc));
+    tile_scratch_init(&ts, cv);
+    if (!mvt) {
+        sbuf_adds(out, "{\"type\":\"FeatureCollection\",\"features\":[\n");
+    }
+    for (int k = 0; k < n; k++) {
+        int i = sv->polys[hits[k]];
+
+        poly_reset(&pc);
+        poly_assemble(&pc, sh, i, &af);
+        poly_drop_small_rings(&pc, 0);
+        if (pc.num_rings == 0) {
+            continue;
+        }
+        if (mvt) {
+            tile_add_feature(&ts, cv, &pc, 0, pc.num_rings, i, sv->bbox + 4 * hits[k], scale, ox, oy);
+            continue;
+        }
+        if (num_features++ > 0) {
+            sbuf_adds(out, ",\n");
+        }
+        mvt_unmercator(pc.xy, pc.num_points);
+        enc_feature_head(out, cv, i, ts.icv);
+        enc_poly_coords(out, &pc, 0, pc.num_rings);
+        sbuf_adds(out, "}}");
+    }
+    if (mvt) {
+        mvt_tile_encode(&ts.l, out);
+    } else {
+        sbuf_adds(out, "\n]}\n");
+    }
+    tile_scratch_free(&ts);
+    free(pc.xy);
+    free(pc.ring_end);
+    free(hits);
+}
+
+/*
+ * /stats：请求数、用时的百分位数、缓存命中情况和各文件
+ */
+static void
+serve_stats(struct server *srv, struct sbuf *out) {
+    struct httpd_stats hs;
+    struct lru_stats ls;
+    char num[64];
+
+    httpd_get_stats(srv->httpd, &hs);
+    lru_get_stats(srv->cache, &ls);
+    snprintf(num, sizeof(num), "%ld", hs.requests);
+    sbuf_adds(out, "{\"requests\":");
+    sbuf_adds(out, num);
+    sbuf_adds(out, ",\"latency_ms\":{\"samples\":");
+    sbuf_add_long(out, hs.samples);
+    sbuf_adds(out, ",\"p50\":");
+    sbuf_add_double(out, hs.p50, 3);
+    sbuf_adds(out, ",\"p90\":");
+    sbuf_add_double(out, hs.p90, 3);
+    sbuf_adds(out, ",\"p99\":");
+    sbuf_add_double(out, hs.p99, 3);
+    sbuf_adds(out, ",\"max\":");
+    sbuf_add_double(out, hs.max, 3);
+    sbuf_adds(out, "},\"cache\":{\"hits\":");
+    sbuf_add_long(out, ls.hits);
+    sbuf_adds(out, ",\"misses\":");
+    sbuf_add_long(out, ls.misses);
+    sbuf_adds(out, ",\"evictions\":");
+    sbuf_add_long(out, ls.evictions);
+    sbuf_adds(out, ",\"entries\":");
+    sbuf_add_long(out, ls.entries);
+    sbuf_adds(out, ",\"bytes\":");
+    sbuf_add_long(out, ls.bytes);
+    sbuf_adds(out, ",\"max_bytes\":");
+    sbuf_add_long(out, srv->cache_size);
+    sbuf_adds(out, "},\"sheets\":[");
+    for (int s = 0; s < srv->num_sheets; s++) {
+        struct served *sv = srv->sheets + s;
+        double b[4] = {sv->x0, sv->y1, sv->x1, sv->y0};  // 单位坐标的 y 向下
+
+        mvt_unmercator(b, 2);
+        sbuf_adds(out, s > 0 ? ",\n{\"name\":" : "\n{\"name\":");
+        json_add_string(out, sv->cv->tile_layer, strlen(sv->cv->tile_layer));
+        sbuf_adds(out, ",\"features\":");
+        sbuf_add_long(out, sv->num_polys);
+        sbuf_adds(out, ",\"bounds\":[");
+        for (int k = 0; k < 4; k++) {
+            if (k > 0) {
+                sbuf_addc(out, ',');
+            }
+            sbuf_add_double(out, sv->num_polys ? b[k] : 0, 7);
+        }
+        sbuf_adds(out, "]}");
+    }
+    sbuf_adds(out, "]}\n");
+}
+
+/*
+ * 处理一个请求：/<文件名>/<z>/<x>/<y>.pbf（或 .mvt）、/<文件名>/<z>/<x>/<y>.geojson、/stats
+ */
+static void
+serve_request(struct http_req *req, void *arg) {
+    struct server *srv = arg;
+    struct sbuf out;
+    char name[256], ext[16];
+    int z, x, y, mvt;
+    char *data;
+    size_t len;
+
+    bzero(&out, sizeof(out));
+    if (strcmp(req->path, "/stats") == 0 || strcmp(req->path, "/") == 0) {
+        serve_stats(srv, &out);
+        httpd_respond(req, 200, "application/json", out.data, out.len);
+        sbuf_free(&out);
+        return;
+    }
+    if (sscanf(req->path, "/%255[^/]/%d/%d/%d.%15s", name, &z, &x, &y, ext) != 5 ||
+            z < 0 || z > 24 || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) {
+        httpd_respond(req, 404, "text/plain", "not found\n", 10);
+        return;
+    }
+    if (strcmp(ext, "pbf") == 0 || strcmp(ext, "mvt") == 0) {
+        mvt = 1;
+    } else if (strcmp(ext, "geojson") == 0 || strcmp(ext, "json") == 0) {
+        mvt = 0;
+    } else {
+        httpd_respond(req, 404, "text/plain", "not found\n", 10);
+        return;
+    }
+
+    struct served *sv = NULL;
+
+    for (int s = 0; s < srv->num_sheets; s++) {
+        if (strcmp(srv->sheets[s].cv->tile_layer, name) == 0) {
+            sv = srv->sheets + s;
+            break;
+        }
+    }
+    if (!sv) {
+        httpd_respond(req, 404, "text/plain", "no such sheet\n", 14);
+        return;
+    }
+    const char *type = mvt ? "application/vnd.mapbox-vector-tile" : "application/geo+json";
+
+    if (lru_get(srv->cache, req->path, &data, &len)) {
+        httpd_respond(req, len ? 200 : 204, type, data, len);
+        free(data);
+        return;
+    }
+    serve_render(sv, z, x, y, mvt, &out);
+    lru_put(srv->cache, req->path, out.data, out.len);
+    httpd_respond(req, out.len ? 200 : 204, type, out.data, out.len);
+    sbuf_free(&out);
+}
+
+/*
+ * --serve：打开所有文件，准备好索引，然后在本机的 port 端口上按请求生成瓦片，不会返回
+ */
+static void
+serve(struct conv_list *inputs, struct options *opt, struct pool *pool, int port) {
+    struct server srv;
+
+    bzero(&srv, sizeof(srv));
+    srv.sheets = calloc(inputs->n, sizeof(*srv.sheets));
+    for (int i = 0; i < inputs->n; i++) {
+        struct conv *cv = inputs->v[i];
+        struct served *sv = srv.sheets + srv.num_sheets;
+
+        cv->opt = opt;
+        cv->pool = pool;
+        cv->sh = sheet_open(cv->name, g_verbose, opt->native_cache);
+        if (cv->sh && !conv_proj_init(cv)) {
+            sheet_free(cv->sh);
+            cv->sh = NULL;
+        }
+        if (!cv->sh) {
+            continue;
+        }
+        conv_setup(cv);
+        for (int s = 0; s < srv.num_sheets; s++) {
+            if (strcmp(srv.sheets[s].cv->tile_layer, cv->tile_layer) == 0) {
+                warnx("%s: 与 %s 同名，不提供", cv->name, srv.sheets[s].cv->name);
+                conv_finish(cv);
+                cv = NULL;
+                break;
+            }
+        }
+        if (!cv) {
+            continue;
+        }
+        prepare_arcs(cv);
+        sv->cv = cv;
+        serve_index(sv);
+        srv.num_sheets++;
+        fprintf(stderr, "%s: /%s/{z}/{x}/{y}.pbf，%d 个要素\n", cv->name, cv->tile_layer, sv->num_polys);
+    }
+    if (srv.num_sheets == 0) {
+        errx(1, "没有可以提供的文件");
+    }
+    srv.cache_size = opt->cache_size;
+    srv.cache = lru_create(opt->cache_size);
+    srv.httpd = httpd_create(port, pool, serve_request, &srv);
+    fprintf(stderr, "在 http://127.0.0.1:%d/ 上提供瓦片，/stats 查看统计\n", port);
+    httpd_run(srv.httpd);
+}
+
+#define WATCH_DEBOUNCE 0.5  // --watch 时文件最后一次写入后这么多秒没有再写才转换，免得读到写了一半的文件
+#define WATCH_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+/*
+ * --watch 时监视的一个目录
+ */
+struct watch_dir {
+    int wd;  // inotify_add_watch() 的返回值
+    char *prefix;  // 目录中的文件名前加上它就是输入文件名，与 add_input() 得到的一样
+    int all;  // 目录是输入或在输入的目录下，其中所有的 .WP 文件都要转换；否则只管已经在跟踪的文件
+};
+
+/*
+ * --watch 时跟踪的一个输入文件
+ */
+struct watch_file {
+    char *name;
+    uint64_t hash;  // 上次转换的内容的散列
+    int converted;  // hash 有效
+    double due;  // 到这个时间还没有再写入就看要不要转换，0 表示没有待办
+};
+
+struct watcher {
+    int fd;  // inotify
+    struct watch_dir *dirs;
+    int num_dirs;
+    int cap_dirs;
+    struct watch_file *files;
+    int num_files;
+    int cap_files;
+};
+
+/*
+ * 监视目录 path，prefix 归 w 所有
+ * 同一个目录（inotify 按 inode 认）再加一次时只合并 all
+ */
+static void
+watch_add_dir(struct watcher *w, const char *path, char *prefix, int all) {
+    int wd = inotify_add_watch(w->fd, path, WATCH_EVENTS | IN_ONLYDIR);
+
+    if (wd == -1) {
+        warn("监视目录 %s 失败", path);
+        free(prefix);
+        return;
+    }
+    for (int k = 0; k < w->num_dirs; k++) {
+        if (w->dirs[k].wd == wd) {
+            w->dirs[k].all |= all;
+            free(prefix);
+            return;
+        }
+    }
+    if (w->num_dirs == w->cap_dirs) {
+        w->cap_dirs = w->cap_dirs ? w->cap_dirs * 2 : 16;
+        w->dirs = realloc(w->dirs, w->cap_dirs * sizeof(*w->dirs));
+        if (!w->dirs) {
+            err(1, "realloc");
+        }
+    }
+    w->dirs[w->num_dirs].wd = wd;
+    w->dirs[w->num_dirs].prefix = prefix;
+    w->dirs[w->num_dirs].all = all;
+    w->num_dirs++;
+}
+
+/*
+ * 找跟踪的文件 name，没有时 create 为真就加上，否则返回 NULL
+ */
+static struct watch_file *
+watch_find(struct watcher *w, const char *name, int create) {
+    struct watch_file *f;
+
+    for (int k = 0; k < w->num_files; k++) {
+        if (strcmp(w->files[k].name, name) == 0) {
+            return w->files + k;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (w->num_files == w->cap_files) {
+        w->cap_files = w->cap_files ? w->cap_files * 2 : 64;
+        w->files = realloc(w->files, w->cap_files * sizeof(*w->files));
+        if (!w->files) {
+            err(1, "realloc");
+        }
+    }
+    f = w->files + w->num_files++;
+    bzero(f, sizeof(*f));
+    f->name = strdup(name);
+    return f;
+}
+
+/*
+ * 开始监视：输入的目录中所有的 .WP 文件，和单独给出的文件（监视它所在的目录）
+ * 在第一次转换之前调用，记下各文件现在的内容散列，转换时再写入的，之后会再转换
+ */
+static void
+watch_init(struct watcher *w, struct conv_list *inputs) {
+    bzero(w, sizeof(*w));
+    w->fd = inotify_init1(IN_CLOEXEC);
+    if (w->fd == -1) {
+        err(1, "inotify_init1");
+    }
+    for (int i = 0; i < inputs->num_dirs; i++) {
+        char *prefix;
+
+        if (asprintf(&prefix, "%s/", inputs->dirs[i]) == -1) {
+            err(1, "asprintf");
+        }
+        watch_add_dir(w, inputs->dirs[i], prefix, 1);
+    }
+    for (int i = 0; i < inputs->n; i++) {
+        const char *name = inputs->v[i]->name;
+        const char *slash = strrchr(name, '/');
+        struct watch_file *f = watch_find(w, name, 1);
+        char *dir = slash == name ? strdup("/") : slash ? strndup(name, slash - name) : strdup(".");
+
+        watch_add_dir(w, dir, slash ? strndup(name, slash - name + 1) : strdup(""), 0);
+        free(dir);
+        f->converted = hash_file(name, 0, &f->hash);
+    }
+}
+
+/*
+ * 读入并处理 inotify 的事件：有写入的文件推迟 WATCH_DEBOUNCE 秒再看，删掉或移走的忘掉它的散列
+ */
+static void
+watch_read(struct watcher *w) {
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n = read(w->fd, buf, sizeof(buf));
+
+    if (n <= 0) {
+        if (n < 0 && errno != EINTR && errno != EAGAIN) {
+            err(1, "读 inotify 事件失败");
+        }
+        return;
+    }
+    for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+        struct inotify_event *ev = (struct inotify_event *)p;
+        struct watch_dir *d = NULL;
+        struct watch_file *f;
+        char *name;
+
+        if (ev->mask & IN_Q_OVERFLOW) {  // 丢了事件，不知道哪些文件改了，都看一遍，内容没变的不会转换
+            warnx("inotify 事件太多，丢了一些，检查所有文件");
+            for (int k = 0; k < w->num_files; k++) {
+                w->files[k].due = now() + WATCH_DEBOUNCE;
+            }
+            continue;
+        }
+        for (int k = 0; k < w->num_dirs; k++) {
+            if (w->dirs[k].wd == ev->wd) {
+                d = w->dirs + k;
+                break;
+            }
+        }
+        if (!d || ev->len == 0) {
+            continue;
+        }
+        if (asprintf(&name, "%s%s", d->prefix, ev->name) == -1) {
+            err(1, "asprintf");
+        }
+        if (ev->mask & IN_ISDIR) {
+            if (d->all && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {  // 新建的子目录也要监视
+                char *prefix;
+
+                if (asprintf(&prefix, "%s/", name) == -1) {
+                    err(1, "asprintf");
+                }
+                watch_add_dir(w, name, prefix, 1);
+            }
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            f = watch_find(w, name, 0);
+            if (f) {
+                f->converted = 0;  // 再出现时总是转换
+                f->due = 0;
+            }
+        } else {
+            f = watch_find(w, name, d->all && is_wp_name(ev->name));
+            if (f) {
+                f->due = now() + WATCH_DEBOUNCE;
+            }
+        }
+        free(name);
+    }
+}
+
+/*
+ * 转换到时间的文件中内容变了的，同时转换的几个文件也由线程池一起转换
+ */
+static void
+watch_convert(struct watcher *w, struct options *opt, struct pool *pool, struct convcache *cache) {
+    struct conv_list round;
+    double t = now();
+
+    bzero(&round, sizeof(round));
+    for (int k = 0; k < w->num_files; k++) {
+        struct watch_file *f = w->files + k;
+        struct stat st;
+        uint64_t h;
+
+        if (f->due == 0 || f->due > t) {
+            continue;
+        }
+        f->due = 0;
+        if (stat(f->name, &st) != 0 || !hash_file(f->name, 0, &h)) {  // 又删掉了
+            continue;
+        }
+        if (f->converted && f->hash == h) {
+            if (g_verbose) {
+                fprintf(stderr, "%s: 内容没变，不用转换\n", f->name);
+            }
+            continue;
+        }
+        f->hash = h;
+        f->converted = 1;
+        add_conv(&round, f->name, st.st_size);
+    }
+    if (round.n == 0) {
+        return;
+    }
+    qsort(round.v, round.n, sizeof(*round.v), cmp_conv_size);
+    for (int i = 0; i < round.n; i++) {
+        struct conv *cv = round.v[i];
+
+        cv->opt = opt;
+        cv->pool = pool;
+        cv->cache = cache;
+        set_outputs(cv, opt);
+        pool_submit(pool, convert_file, cv);
+    }
+    pool_wait_all(pool);
+    for (int i = 0; i < round.n; i++) {
+        struct conv *cv = round.v[i];
+
+        free(cv->name);
+        free(cv->output);
+        free(cv->out_name);
+        free(cv);
+    }
+    free(round.v);
+}
+
+/*
+ * --watch：等着输入的文件改了就重新转换，进程一直在，色号定义、线程池和缓存都不用重新准备
+ */
+static void
+watch_loop(struct watcher *w, struct options *opt, struct pool *pool, struct convcache *cache) {
+    struct pollfd pfd = {.fd = w->fd, .events = POLLIN};
+
+    fprintf(stderr, "监视 %d 个目录中的 %d 个文件，改了就重新转换\n", w->num_dirs, w->num_files);
+    for (;;) {
+        double next = 0, t = now();
+        int timeout, r;
+
+        for (int k = 0; k < w->num_files; k++) {
+            if (w->files[k].due && (next == 0 || w->files[k].due < next)) {
+                next = w->files[k].due;
+            }
+        }
+        timeout = next == 0 ? -1 : next <= t ? 0 : (int)ceil((next - t) * 1000);
+        r = poll(&pfd, 1, timeout);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "poll");
+        }
+        if (r > 0) {
+            watch_read(w);
+        }
+        watch_convert(w, opt, pool, cache);
+    }
+}
+
+static void
+usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <file>\n", prog);
+    fprintf(stderr, "       %s [options] <file|dir>... | --batch-list LIST\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -o FILE                   write to FILE instead of stdout; with --split-by or sharding\n");
+    fprintf(stderr, "                            FILE without its extension is the prefix of the output files\n");
+    fprintf(stderr, "  --gzip[=LEVEL]            gzip the output, compressing blocks in parallel\n");
+    fprintf(stderr, "  -j N                      number of worker threads, default: number of CPUs\n");
+    fprintf(stderr, "  -v                        print details of every polygon and line to stderr\n");
+    fprintf(stderr, "  --select NAME[,NAME...]   only output these attributes (UTF-8 names, FillRGB included)\n");
+    fprintf(stderr, "  --exclude NAME[,NAME...]  do not output these attributes\n");
+    fprintf(stderr, "  --where EXPR              only output polygons whose attributes match EXPR, e.g.\n");
+    fprintf(stderr, "                            \"代号 IN ('D1', 'D2') AND 面积 > 1000\"\n");
+    fprintf(stderr, "  --layer N[,N...]          only output polygons on these layers\n");
+    fprintf(stderr, "  --get N[,N...]            only output these polygons (numbered from 1, as -v prints them), in\n");
+    fprintf(stderr, "                            this order; reads just their records, lines and attribute rows, so it\n");
+    fprintf(stderr, "                            takes milliseconds however large the file is\n");
+    fprintf(stderr, "  --split-by layer          write each layer to <file>.layer<N>.geojson in one pass\n");
+    fprintf(stderr, "  --shard-size BYTES[K|M|G] start a new numbered output file before exceeding this size\n");
+    fprintf(stderr, "  --shard-features N        start a new numbered output file every N features\n");
+    fprintf(stderr, "  --to-epsg 4326|4490       reproject from Beijing 1954 to WGS84 or CGCS2000 longitude/latitude;\n");
+    fprintf(stderr, "                            Gauss-Kruger coordinates are projected back first\n");
+    fprintf(stderr, "  --zone N                  Gauss-Kruger zone, when x has no zone number in front\n");
+    fprintf(stderr, "  --zone-width 3|6          zone width, default: 3 for zones above 23, otherwise 6\n");
+    fprintf(stderr, "  --central-meridian DEG    central meridian, overrides the zone\n");
+    fprintf(stderr, "  --towgs84 DX,DY,DZ[,RX,RY,RZ,DS]  datum shift to the target datum (m, arc-seconds, ppm),\n");
+    fprintf(stderr, "                            default: " BJ54_TOWGS84_STR "\n");
+    fprintf(stderr, "  --simplify TOLERANCE      simplify every arc once (Douglas-Peucker, endpoints fixed) before\n");
+    fprintf(stderr, "                            assembling polygons, so neighbours stay gap-free; TOLERANCE is in\n");
+    fprintf(stderr, "                            output units (degrees with --to-epsg)\n");
+    fprintf(stderr, "  --lod TOL[,TOL...]        write several simplification levels in one pass, level N (from 0)\n");
+    fprintf(stderr, "                            to <file>.lod<N>.geojson; a TOL of 0 keeps every point\n");
+    fprintf(stderr, "  --format FORMAT           geojson (default), mvt: Mapbox vector tiles in DIR/z/x/y.pbf, where DIR\n");
+    fprintf(stderr, "                            is -o or the input name without extension, fgb: FlatGeobuf with a\n");
+    fprintf(stderr, "                            packed Hilbert R-tree index, shp: ESRI Shapefile (.shp/.shx/.dbf/.cpg,\n");
+    fprintf(stderr, "                            .prj with --to-epsg; strings stay GB18030), arrow: Arrow IPC file\n");
+    fprintf(stderr, "                            with typed attribute columns and GeoArrow polygon geometry, pgcopy:\n");
+    fprintf(stderr, "                            PostgreSQL binary COPY stream with EWKB geometry for\n");
+    fprintf(stderr, "                            COPY ... FROM STDIN (FORMAT binary); CREATE TABLE goes to <file>.sql,\n");
+    fprintf(stderr, "                            csv: one row per polygon, WKT geometry in the first column\n");
+    fprintf(stderr, "  --zoom MIN-MAX            zoom levels to tile, default: 0-14\n");
+    fprintf(stderr, "  --serve PORT              serve tiles on http://127.0.0.1:PORT/ instead of converting: sheets\n");
+    fprintf(stderr, "                            stay mapped and indexed, tiles are rendered on demand at\n");
+    fprintf(stderr, "                            /<name>/z/x/y.pbf or .geojson, statistics at /stats\n");
+    fprintf(stderr, "  --cache-size BYTES[K|M|G] memory for recently served tiles, default: 256M\n");
+    fprintf(stderr, "  --native-cache            keep a native cache of each decoded sheet in <file>.mgc (arc and ring\n");
+    fprintf(stderr, "                            tables, UTF-8 attributes, fill colours) and map it on later runs;\n");
+    fprintf(stderr, "                            it is rebuilt when the sheet or Pcolor.lib changes\n");
+    fprintf(stderr, "  --cache-dir DIR           keep the outputs of each conversion in DIR, keyed by a hash of the input,\n");
+    fprintf(stderr, "                            Pcolor.lib, the program and the options, and copy them from there when\n");
+    fprintf(stderr, "                            the same conversion is run again (not for mvt, --split-by, sharding\n");
+    fprintf(stderr, "                            or stdout)\n");
+    fprintf(stderr, "  --cache-max BYTES[K|M|G]  size limit of --cache-dir, least recently used entries are evicted\n");
+    fprintf(stderr, "                            beyond it, default: 1G\n");
+    fprintf(stderr, "Batch mode (several inputs, a directory, --batch-list or --out-dir):\n");
+    fprintf(stderr, "  each <file>.WP is written to <file>.geojson (.fgb, .shp, .arrow, .pgcopy, .csv); directories are searched for .WP files\n");
+    fprintf(stderr, "  --batch-list LIST         read input files or directories from LIST, one per line (- for stdin)\n");
+    fprintf(stderr, "  --out-dir DIR             write the outputs into DIR instead of next to the inputs\n");
+    fprintf(stderr, "  --watch                   after converting, keep watching the inputs (inotify) and reconvert a\n");
+    fprintf(stderr, "                            .WP file once writes to it have been quiet for 0.5 s and its content\n");
+    fprintf(stderr, "                            hash changed; new .WP files in watched directories are converted too\n");
+}
+
+int
+main(int argc, char **argv) {
+    struct options opt;
+    struct conv_list inputs;
+    struct pool *pool;
+    char *batch_list = NULL;
+    int c;
+
+    enum {
+        OPT_SELECT = 256,
+        OPT_EXCLUDE,
+        OPT_WHERE,
+        OPT_LAYER,
+        OPT_SPLIT_BY,
+        OPT_SHARD_SIZE,
+        OPT_SHARD_FEATURES,
+        OPT_GZIP,
+        OPT_BATCH_LIST,
+        OPT_OUT_DIR,
+        OPT_TO_EPSG,
+        OPT_ZONE,
+        OPT_ZONE_WIDTH,
+        OPT_CENTRAL_MERIDIAN,
+        OPT_TOWGS84,
+        OPT_SIMPLIFY,
+        OPT_LOD,
+        OPT_FORMAT,
+        OPT_ZOOM,
+        OPT_SERVE,
+        OPT_CACHE_SIZE,
+        OPT_NATIVE_CACHE,
+        OPT_CACHE_DIR,
+        OPT_CACHE_MAX,
+        OPT_WATCH,
+        OPT_GET,
+    };
+    static struct option long_opts[] = {
+        {"select", required_argument, NULL, OPT_SELECT},
+        {"exclude", required_argument, NULL, OPT_EXCLUDE},
+        {"where", required_argument, NULL, OPT_WHERE},
+        {"layer", required_argument, NULL, OPT_LAYER},
+        {"split-by", required_argument, NULL, OPT_SPLIT_BY},
+        {"shard-size", required_argument, NULL, OPT_SHARD_SIZE},
+        {"shard-features", required_argument, NULL, OPT_SHARD_FEATURES},
+        {"output", required_argument, NULL, 'o'},
+        {"gzip", optional_argument, NULL, OPT_GZIP},
+        {"threads", required_argument, NULL, 'j'},
+        {"batch-list", required_argument, NULL, OPT_BATCH_LIST},
+        {"out-dir", required_argument, NULL, OPT_OUT_DIR},
+        {"to-epsg", required_argument, NULL, OPT_TO_EPSG},
+        {"zone", required_argument, NULL, OPT_ZONE},
+        {"zone-width", required_argument, NULL, OPT_ZONE_WIDTH},
+        {"central-meridian", required_argument, NULL, OPT_CENTRAL_MERIDIAN},
+        {"towgs84", required_argument, NULL, OPT_TOWGS84},
+        {"simplify", required_argument, NULL, OPT_SIMPLIFY},
+        {"lod", required_argument, NULL, OPT_LOD},
+        {"format", required_argument, NULL, OPT_FORMAT},
+        {"zoom", required_argument, NULL, OPT_ZOOM},
+        {"serve", required_argument, NULL, OPT_SERVE},
+        {"cache-size", required_argument, NULL, OPT_CACHE_SIZE},
+        {"native-cache", no_argument, NULL, OPT_NATIVE_CACHE},
+        {"cache-dir", required_argument, NULL, OPT_CACHE_DIR},
+        {"cache-max", required_argument, NULL, OPT_CACHE_MAX},
+        {"watch", no_argument, NULL, OPT_WATCH},
+        {"get", required_argument, NULL, OPT_GET},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    bzero(&opt, sizeof(opt));
+    opt.central_meridian = NAN;
+    opt.num_lods = 1;
+    opt.max_zoom = 14;
+    opt.cache_size = 256 << 20;
+    opt.cache_max = (size_t)1 << 30;
+    parse_towgs84(BJ54_TOWGS84_STR, opt.towgs84);
+    while ((c = getopt_long(argc, argv, "hj:o:v", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'j':
+            opt.threads = atoi(optarg);
+            if (opt.threads <= 0) {
+                errx(1, "-j: 线程数应该大于 0");
+            }
+            break;
+        case OPT_GZIP:
+            opt.gzip = optarg ? atoi(optarg) : 6;
+            if (opt.gzip < 1 || opt.gzip > 9) {
+                errx(1, "--gzip: 压缩级别应该在 1 到 9 之间");
+            }
+            break;
+        case 'o':
+            opt.output = optarg;
+            break;
+        case 'v':
+            g_verbose = 1;
+            break;
+        case OPT_SELECT:
+            opt.select = optarg;
+            break;
+        case OPT_EXCLUDE:
+            opt.exclude = optarg;
+            break;
+        case OPT_WHERE:
+            opt.where = optarg;
+            break;
+        case OPT_LAYER:
+            opt.layers = parse_layers(optarg);
+            break;
+        case OPT_SPLIT_BY:
+            if (strcmp(optarg, "layer") != 0) {
+                errx(1, "--split-by: 目前只支持 layer");
+            }
+            opt.split_by_layer = 1;
+            break;
+        case OPT_SHARD_SIZE:
+            opt.shard_size = parse_size("--shard-size", optarg);
+            break;
+        case OPT_SHARD_FEATURES:
+            opt.shard_features = atol(optarg);
+            if (opt.shard_features <= 0) {
+                errx(1, "--shard-features: 要素数应该大于 0");
+            }
+            break;
+        case OPT_BATCH_LIST:
+            batch_list = optarg;
+            break;
+        case OPT_OUT_DIR:
+            opt.out_dir = optarg;
+            break;
+        case OPT_TO_EPSG:
+            opt.to_epsg = atoi(optarg);
+            if (opt.to_epsg != 4326 && opt.to_epsg != 4490) {
+                errx(1, "--to-epsg: 目前只支持 4326 和 4490");
+            }
+            break;
+        case OPT_ZONE:
+            opt.zone = atoi(optarg);
+            if (opt.zone <= 0 || opt.zone > 120) {
+                errx(1, "--zone: 带号不对: %s", optarg);
+            }
+            break;
+        case OPT_ZONE_WIDTH:
+            opt.zone_width = atoi(optarg);
+            if (opt.zone_width != 3 && opt.zone_width != 6) {
+                errx(1, "--zone-width: 只能是 3 或 6");
+            }
+            break;
+        case OPT_CENTRAL_MERIDIAN:
+            opt.central_meridian = atof(optarg);
+            break;
+        case OPT_TOWGS84:
+            parse_towgs84(optarg, opt.towgs84);
+            break;
+        case OPT_SIMPLIFY:
+            if (opt.lod_files) {
+                errx(1, "--simplify 和 --lod 只能用一个");
+            }
+            opt.lod[0] = atof(optarg);
+            if (!(opt.lod[0] > 0)) {
+                errx(1, "--simplify: 容差应该大于 0");
+            }
+            opt.simplify = 1;
+            break;
+        case OPT_LOD:
+            if (opt.simplify) {
+                errx(1, "--simplify 和 --lod 只能用一个");
+            }
+            parse_lods(optarg, &opt);
+            break;
+        case OPT_FORMAT:
+            if (strcmp(optarg, "geojson") == 0) {
+                opt.format = FORMAT_GEOJSON;
+            } else if (strcmp(optarg, "mvt") == 0) {
+                opt.format = FORMAT_MVT;
+            } else if (strcmp(optarg, "fgb") == 0) {
+                opt.format = FORMAT_FGB;
+            } else if (strcmp(optarg, "shp") == 0) {
+                opt.format = FORMAT_SHP;
+            } else if (strcmp(optarg, "arrow") == 0) {
+                opt.format = FORMAT_ARROW;
+            } else if (strcmp(optarg, "pgcopy") == 0) {
+                opt.format = FORMAT_PGCOPY;
+            } else if (strcmp(optarg, "csv") == 0) {
+                opt.format = FORMAT_CSV;
+            } else {
+                errx(1, "--format: 目前只支持 geojson、mvt、fgb、shp、arrow、pgcopy 和 csv");
+            }
+            break;
+        case OPT_ZOOM:
+            if (sscanf(optarg, "%d-%d", &opt.min_zoom, &opt.max_zoom) != 2) {
+                opt.min_zoom = opt.max_zoom = atoi(optarg);
+            }
+            if (opt.min_zoom < 0 || opt.max_zoom > 24 || opt.min_zoom > opt.max_zoom) {
+                errx(1, "--zoom: 应该是 0 到 24 之间的 MIN-MAX: %s", optarg);
+            }
+            break;
+        case OPT_SERVE:
+            opt.serve_port = atoi(optarg);
+            if (opt.serve_port <= 0 || opt.serve_port > 65535) {
+                errx(1, "--serve: 端口不对: %s", optarg);
+            }
+            break;
+        case OPT_CACHE_SIZE:
+            opt.cache_size = parse_size("--cache-size", optarg);
+            break;
+        case OPT_NATIVE_CACHE:
+            opt.native_cache = 1;
+            break;
+        case OPT_CACHE_DIR:
+            opt.cache_dir = optarg;
+            break;
+        case OPT_CACHE_MAX:
+            opt.cache_max = parse_size("--cache-max", optarg);
+            break;
+        case OPT_WATCH:
+            opt.watch = 1;
+            break;
+        case OPT_GET:
+            parse_get_ids(optarg, &opt);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    bzero(&inputs, sizeof(inputs));
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            opt.batch = 1;
+        }
+        add_input(&inputs, argv[i]);
+    }
+    if (batch_list) {
+        add_batch_list(&inputs, batch_list);
+    }
+    if (batch_list || opt.out_dir || opt.watch || argc - optind > 1) {
+        opt.batch = 1;
+    }
+    if (inputs.n == 0 && !(opt.watch && inputs.num_dirs > 0)) {  // 监视空目录可以，以后放进来的会转换
+        if (opt.batch) {
+            errx(1, "没有找到要转换的 .WP 文件");
+        }
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.batch && opt.output && !opt.serve_port) {
+        errx(1, "-o 不能用于批量转换，请用 --out-dir");
+    }
+    if (opt.get_ids && (opt.batch || opt.serve_port)) {
+        errx(1, "--get 只能用于转换一个文件");
+    }
+    if (opt.serve_port) {
+        if (opt.output || opt.out_dir || opt.cache_dir || opt.watch || opt.format != FORMAT_GEOJSON) {
+            errx(1, "--serve 不写文件，不能与 -o、--out-dir、--cache-dir、--watch 或 --format 一起用");
+        }
+        opt.format = FORMAT_MVT;  // 按切瓦片准备：Web Mercator 坐标，按像素化简，GeoJSON 瓦片输出时再转回经纬度
+    }
+    if ((opt.format == FORMAT_FGB || opt.format == FORMAT_SHP || opt.format == FORMAT_ARROW) &&
+            (opt.split_by_layer || opt.shard_size || opt.shard_features || opt.gzip)) {
+        errx(1, "--format fgb、shp 和 arrow 不能与 --split-by、分片或 --gzip 一起用");  // 文件头中有总数和范围，fgb 压缩了就不能按范围读
+    }
+    if ((opt.format == FORMAT_PGCOPY || opt.format == FORMAT_CSV) && (opt.split_by_layer || opt.shard_size || opt.shard_features)) {
+        errx(1, "--format pgcopy 和 csv 不能与 --split-by 或分片一起用");
+    }
+    if (opt.format == FORMAT_MVT) {
+        if (opt.split_by_layer || opt.shard_size || opt.shard_features || opt.gzip || opt.simplify || opt.lod_files) {
+            errx(1, "--format mvt 和 --serve 不能与 --split-by、分片、--gzip、--simplify 或 --lod 一起用");
+        }
+        if (!opt.to_epsg) {  // 瓦片总是 WGS84 下的 Web Mercator
+            opt.to_epsg = 4326;
+        }
+        opt.simplify = 1;  // 每级化简到一个像素
+    }
+    qsort(inputs.v, inputs.n, sizeof(*inputs.v), cmp_conv_size);
+
+    pgz_setup(opt.threads, opt.gzip);
+    pool = pool_create(opt.threads);
+    if (opt.serve_port) {
+        serve(&inputs, &opt, pool, opt.serve_port);  // 不会返回
+    }
+
+    // 文件和文件内的多边形块都由同一个线程池执行，空闲的线程会去帮正在转换大文件的线程
+    double t0 = now();
+    struct convcache *cache = NULL;
+    struct watcher w;
+
+    if (opt.cache_dir) {
+        cache = convcache_open(opt.cache_dir, opt.cache_max);
+        opt.cache_salt = conv_cache_salt(&opt);
+    }
+    if (opt.watch) {
+        watch_init(&w, &inputs);  // 在转换之前开始监视，转换时写入的不会漏掉
+    }
+
+    for (int i = 0; i < inputs.n; i++) {
+        struct conv *cv = inputs.v[i];
+
+        cv->opt = &opt;
+        cv->pool = pool;
+        cv->cache = cache;
+        set_outputs(cv, &opt);
+        pool_submit(pool, convert_file, cv);
+    }
+    pool_wait_all(pool);
+
+    double wall = now() - t0, busy = 0;
+    long num_features = 0;
+    int failed = 0;
+
+    for (int i = 0; i < inputs.n; i++) {
+        struct conv *cv = inputs.v[i];
+
+        failed += cv->failed;
+        busy += cv->seconds;
+        num_features += cv->num_features;
+        free(cv->name);
+        free(cv->output);
+        free(cv->out_name);
+        free(cv);
+    }
+    if (opt.batch) {
+        fprintf(stderr, "共 %d 个文件（失败 %d 个），%ld 个要素，各文件用时合计 %.3f 秒，总用时 %.3f 秒，%d 个线程\n",
+                inputs.n, failed, num_features, busy, wall, pool_threads(pool));
+    }
+    if (cache) {
+        struct convcache_stats st;
+
+        convcache_get_stats(cache, &st);
+        if (opt.batch || g_verbose) {
+            fprintf(stderr, "转换结果缓存：命中 %ld 个，未命中 %ld 个，淘汰 %ld 个，现有 %d 个条目共 %.1f MB\n",
+                    st.hits, st.misses, st.evictions, st.entries, st.bytes / 1048576.0);
+        }
+    }
+    if (opt.watch) {
+        watch_loop(&w, &opt, pool, cache);  // 不会返回
+    }
+    if (cache) {
+        convcache_close(cache);
+    }
+    pool_destroy(pool);
+    pgz_shutdown();
+    free(inputs.v);
+    for (int i = 0; i < inputs.num_dirs; i++) {
+        free(inputs.dirs[i]);
+    }
+    free(inputs.dirs);
+    if (g_pal) {
+        free(g_pal->table);
+        free(g_pal->fill_strs);
+        free(g_pal);
+    }
+    free(opt.layers);
+    free(opt.get_ids);
+    return failed ? 1 : 0;
+}
@@ -1,3 +1,6 @@
+#ifndef MAPGISF_H
+#define MAPGISF_H
+
 /*
  * 整个文件的头部
  */
@@ -20,12 +23,8 @@ struct __attribute__((packed)) file_header {
     double ymax;
 };
 
-// 文件类型 ftype_id 到 名字的映射
-const char *file_type_names[] = {
-    "Line",
-    "Point",
-    "Polygon"
-};
+// 文件类型 ftype_id 到 名字的映射，定义在 mapgisf.c 中
+extern const char *file_type_names[];
 
 #define MAPGIS_F_TYPE_LINE     0
 #define MAPGIS_F_TYPE_POINT    1
@@ -194,3 +193,4 @@ struct __attribute__ ((packed)) pcolor_header {
     char pad[32];  // 未知
 };
 
+#endif
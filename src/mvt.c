@@ -0,0 +1,438 @@
+/*
+ * Mapbox Vector Tile 编码，见 mvt.h
+ *
+ * 用到的 protobuf 消息（vector_tile.proto）：
+ *   Tile    { repeated Layer layers = 3; }
+ *   Layer   { required uint32 version = 15; required string name = 1; repeated Feature features = 2;
+ *             repeated string keys = 3; repeated Value values = 4; optional uint32 extent = 5; }
+ *   Feature { optional uint64 id = 1; repeated uint32 tags = 2 [packed]; optional GeomType type = 3;
+ *             repeated uint32 geometry = 4 [packed]; }
+ *   Value   { string_value = 1; float_value = 2; double_value = 3; int_value = 4; ... }
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <math.h>
+#include <err.h>
+
+#include "mvt.h"
+
+// protobuf 的线上类型
+#define PB_VARINT 0
+#define PB_64BIT 1
+#define PB_LEN 2
+#define PB_32BIT 5
+
+#define GEOM_POLYGON 3
+#define CMD_MOVE_TO 1
+#define CMD_LINE_TO 2
+#define CMD_CLOSE_PATH 7
+
+#define MERCATOR_MAX_LAT 85.0511287798066  // Web Mercator 的纬度范围，正好是正方形
+
+static void
+pb_varint(struct sbuf *sb, uint64_t v) {
+    sbuf_reserve(sb, 10);
+    char *o = sb->data + sb->len;
+
+    while (v >= 0x80) {
+        *o++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+    *o++ = (char)v;
+    sb->len = o - sb->data;
+}
+
+static void
+pb_key(struct sbuf *sb, int field, int wire_type) {
+    pb_varint(sb, (uint64_t)(field << 3 | wire_type));
+}
+
+static void
+pb_bytes(struct sbuf *sb, int field, const void *p, size_t n) {
+    pb_key(sb, field, PB_LEN);
+    pb_varint(sb, n);
+    sbuf_add(sb, p, n);
+}
+
+/*
+ * packed 的 uint32 数组
+ */
+static void
+pb_packed(struct sbuf *sb, int field, const uint32_t *v, int n) {
+    size_t len = 0;
+
+    for (int i = 0; i < n; i++) {  // 先算出长度
+        uint32_t x = v[i];
+
+        do {
+            len++;
+            x >>= 7;
+        } while (x);
+    }
+    pb_key(sb, field, PB_LEN);
+    pb_varint(sb, len);
+    for (int i = 0; i < n; i++) {
+        pb_varint(sb, v[i]);
+    }
+}
+
+static uint32_t
+zigzag(int v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void *
+grow(void *p, int *cap, int need, size_t size) {
+    if (need > *cap) {
+        int c = *cap ? *cap : 64;
+
+        while (c < need) {
+            c *= 2;
+        }
+        p = realloc(p, c * size);
+        if (!p) {
+            err(1, "realloc");
+        }
+        *cap = c;
+    }
+    return p;
+}
+
+void
+mvt_mercator(double *xy, size_t n) {
+    for (size_t i = 0; i < n; i++, xy += 2) {
+        double lat = xy[1];
+
+        if (lat > MERCATOR_MAX_LAT) {
+            lat = MERCATOR_MAX_LAT;
+        } else if (lat < -MERCATOR_MAX_LAT) {
+            lat = -MERCATOR_MAX_LAT;
+        }
+        xy[0] = (xy[0] + 180) / 360;
+        xy[1] = 0.5 - log(tan(M_PI / 4 + lat * (M_PI / 360))) / (2 * M_PI);
+    }
+}
+
+void
+mvt_unmercator(double *xy, size_t n) {
+    for (size_t i = 0; i < n; i++, xy += 2) {
+        xy[0] = xy[0] * 360 - 180;
+        xy[1] = atan(sinh(M_PI * (1 - 2 * xy[1]))) * (180 / M_PI);
+    }
+}
+
+void
+mvt_layer_init(struct mvt_layer *l, const char *name, const char **keys, int num_keys) {
+    bzero(l, sizeof(*l));
+    l->name = name;
+    l->keys = keys;
+    l->num_keys = num_keys;
+    l->hash_cap = 1024;
+    l->hash = calloc(l->hash_cap, sizeof(*l->hash));
+    if (!l->hash) {
+        err(1, "calloc");
+    }
+}
+
+void
+mvt_layer_reset(struct mvt_layer *l) {
+    l->features.len = 0;
+    l->num_features = 0;
+    l->values.len = 0;
+    l->num_vals = 0;
+    memset(l->hash, 0, l->hash_cap * sizeof(*l->hash));
+}
+
+void
+mvt_layer_free(struct mvt_layer *l) {
+    sbuf_free(&l->features);
+    sbuf_free(&l->values);
+    free(l->vals);
+    free(l->hash);
+    free(l->tags);
+    free(l->geom);
+    free(l->q);
+}
+
+void
+mvt_feature_begin(struct mvt_layer *l, uint64_t id) {
+    l->id = id;
+    l->num_tags = 0;
+    l->num_geom = 0;
+    l->has_exterior = 0;
+    l->cx = l->cy = 0;
+}
+
+static uint32_t
+hash_bytes(const char *p, int n) {
+    uint32_t h = 2166136261u;  // FNV-1a
+
+    for (int i = 0; i < n; i++) {
+        h = (h ^ (unsigned char)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/*
+ * 散列表满了一半就扩大一倍，重新放一遍
+ */
+static void
+rehash(struct mvt_layer *l) {
+    free(l->hash);
+    l->hash_cap *= 2;
+    l->hash = calloc(l->hash_cap, sizeof(*l->hash));
+    if (!l->hash) {
+        err(1, "calloc");
+    }
+    for (int v = 0; v < l->num_vals; v++) {
+        uint32_t i = hash_bytes(l->values.data + l->vals[v].off, l->vals[v].len) & (l->hash_cap - 1);
+
+        while (l->hash[i]) {
+            i = (i + 1) & (l->hash_cap - 1);
+        }
+        l->hash[i] = v + 1;
+    }
+}
+
+/*
+ * 加一个标签，属性值是 values 末尾刚编码好的 Value 消息内容，已有相同的就用已有的
+ */
+static void
+add_tag(struct mvt_layer *l, int key, size_t off) {
+    const char *p = l->values.data + off;
+    int len = l->values.len - off;
+    uint32_t i = hash_bytes(p, len) & (l->hash_cap - 1);
+    int v;
+
+    while ((v = l->hash[i]) != 0) {
+        struct mvt_value *mv = l->vals + v - 1;
+
+        if (mv->len == len && memcmp(l->values.data + mv->off, p, len) == 0) {
+            l->values.len = off;  // 重复的，去掉刚编码的
+            break;
+        }
+        i = (i + 1) & (l->hash_cap - 1);
+    }
+    if (!v) {
+        l->vals = grow(l->vals, &l->cap_vals, l->num_vals + 1, sizeof(*l->vals));
+        l->vals[l->num_vals] = (struct mvt_value){off, len};
+        v = l->hash[i] = ++l->num_vals;
+        if (l->num_vals * 2 > l->hash_cap) {
+            rehash(l);
+        }
+    }
+    l->tags = grow(l->tags, &l->cap_tags, l->num_tags + 2, sizeof(*l->tags));
+    l->tags[l->num_tags++] = key;
+    l->tags[l->num_tags++] = v - 1;
+}
+
+void
+mvt_tag_string(struct mvt_layer *l, int key, const char *s, size_t n) {
+    size_t off = l->values.len;
+
+    pb_bytes(&l->values, 1, s, n);
+    add_tag(l, key, off);
+}
+
+void
+mvt_tag_int(struct mvt_layer *l, int key, int64_t v) {
+    size_t off = l->values.len;
+
+    pb_key(&l->values, 4, PB_VARINT);
+    pb_varint(&l->values, (uint64_t)v);  // int64 的负数也是按 64 位补码编码
+    add_tag(l, key, off);
+}
+
+void
+mvt_tag_float(struct mvt_layer *l, int key, float v) {
+    size_t off = l->values.len;
+
+    pb_key(&l->values, 2, PB_32BIT);
+    sbuf_add(&l->values, &v, sizeof(v));  // protobuf 是小端的，与 x86 相同
+    add_tag(l, key, off);
+}
+
+void
+mvt_tag_double(struct mvt_layer *l, int key, double v) {
+    size_t off = l->values.len;
+
+    pb_key(&l->values, 3, PB_64BIT);
+    sbuf_add(&l->values, &v, sizeof(v));
+    add_tag(l, key, off);
+}
+
+void
+mvt_ring(struct mvt_layer *l, const double *xy, int n, int exterior) {
+    int m = 0;
+    int64_t area2 = 0;
+
+    if (exterior) {
+        l->has_exterior = 0;
+    } else if (!l->has_exterior) {  // 外环没了，洞也就没有意义了
+        return;
+    }
+    l->q = grow(l->q, &l->cap_q, 2 * n, sizeof(*l->q));
+    for (int i = 0; i < n; i++) {  // 取整，去掉相邻的重复点
+        int x = (int)lround(xy[2 * i]), y = (int)lround(xy[2 * i + 1]);
+
+        if (m > 0 && x == l->q[2 * m - 2] && y == l->q[2 * m - 1]) {
+            continue;
+        }
+        l->q[2 * m] = x;
+        l->q[2 * m + 1] = y;
+        m++;
+    }
+    if (m > 1 && l->q[0] == l->q[2 * m - 2] && l->q[1] == l->q[2 * m - 1]) {  // 闭合点由 ClosePath 表示
+        m--;
+    }
+    if (m < 3) {
+        return;
+    }
+    for (int i = 0; i < m; i++) {
+        int j = i + 1 < m ? i + 1 : 0;
+
+        area2 += (int64_t)l->q[2 * i] * l->q[2 * j + 1] - (int64_t)l->q[2 * j] * l->q[2 * i + 1];
+    }
+    if (area2 == 0) {
+        return;
+    }
+
+    // 瓦片坐标 y 轴向下，外环的面积（按上面的公式）为正，洞为负，不对就倒过来
+    int rev = (area2 > 0) != (exterior != 0);
+
+    l->geom = grow(l->geom, &l->cap_geom, l->num_geom + 2 * m + 4, sizeof(*l->geom));
+    for (int k = 0; k < m; k++) {
+        int i = rev ? (m - k) % m : k;  // 倒过来时第一点不变
+        int x = l->q[2 * i], y = l->q[2 * i + 1];
+
+        if (k == 0) {
+            l->geom[l->num_geom++] = CMD_MOVE_TO | 1 << 3;
+        } else if (k == 1) {
+            l->geom[l->num_geom++] = CMD_LINE_TO | (m - 1) << 3;
+        }
+        l->geom[l->num_geom++] = zigzag(x - l->cx);
+        l->geom[l->num_geom++] = zigzag(y - l->cy);
+        l->cx = x;
+        l->cy = y;
+    }
+    l->geom[l->num_geom++] = CMD_CLOSE_PATH | 1 << 3;
+    if (exterior) {
+        l->has_exterior = 1;
+    }
+}
+
+void
+mvt_feature_end(struct mvt_layer *l) {
+    struct sbuf *sb = &l->features;
+    size_t start;
+
+    if (l->num_geom == 0) {
+        return;
+    }
+    // Feature 消息的长度要在前面，先留出 5 个字节（长度最多 5 字节的 varint），编码完再移过来
+    pb_key(sb, 2, PB_LEN);
+    start = sb->len;
+    sbuf_reserve(sb, 5);
+    sb->len += 5;
+    pb_key(sb, 1, PB_VARINT);
+    pb_varint(sb, l->id);
+    if (l->num_tags > 0) {
+        pb_packed(sb, 2, l->tags, l->num_tags);
+    }
+    pb_key(sb, 3, PB_VARINT);
+    pb_varint(sb, GEOM_POLYGON);
+    pb_packed(sb, 4, l->geom, l->num_geom);
+
+    size_t len = sb->len - start - 5;
+    struct sbuf hdr = {0};
+
+    pb_varint(&hdr, len);
+    memmove(sb->data + start + hdr.len, sb->data + start + 5, len);
+    memcpy(sb->data + start, hdr.data, hdr.len);
+    sb->len = start + hdr.len + len;
+    sbuf_free(&hdr);
+    l->num_features++;
+}
+
+void
+mvt_tile_encode(struct mvt_layer *l, struct sbuf *out) {
+    struct sbuf layer = {0};
+
+    if (l->num_features == 0) {
+        return;
+    }
+    pb_key(&layer, 15, PB_VARINT);
+    pb_varint(&layer, 2);
+    pb_bytes(&layer, 1, l->name, strlen(l->name));
+    sbuf_add(&layer, l->features.data, l->features.len);
+    for (int k = 0; k < l->num_keys; k++) {
+        pb_bytes(&layer, 3, l->keys[k], strlen(l->keys[k]));
+    }
+    for (int v = 0; v < l->num_vals; v++) {
+        pb_bytes(&layer, 4, l->values.data + l->vals[v].off, l->vals[v].len);
+    }
+    pb_key(&layer, 5, PB_VARINT);
+    pb_varint(&layer, MVT_EXTENT);
+    pb_bytes(out, 3, layer.data, layer.len);
+    sbuf_free(&layer);
+}
+
+/*
+ * 裁剪的一步：保留直线 coord[axis] = v 的一侧，keep_less 表示保留小于 v 的一侧
+ */
+static int
+clip_edge(const double *in, int n, double *out, int axis, double v, int keep_less) {
+    int m = 0;
+
+    for (int i = 0; i < n; i++) {
+        const double *p = in + 2 * (i > 0 ? i - 1 : n - 1), *c = in + 2 * i;
+        int pin = keep_less ? p[axis] <= v : p[axis] >= v;
+        int cin = keep_less ? c[axis] <= v : c[axis] >= v;
+
+        if (pin != cin) {  // 穿过了裁剪线，加上交点
+            double t = (v - p[axis]) / (c[axis] - p[axis]);
+
+            out[2 * m + axis] = v;
+            out[2 * m + 1 - axis] = p[1 - axis] + t * (c[1 - axis] - p[1 - axis]);
+            m++;
+        }
+        if (cin) {
+            out[2 * m] = c[0];
+            out[2 * m + 1] = c[1];
+            m++;
+        }
+    }
+    return m;
+}
+
+int
+mvt_clip_ring(const double *xy, int n, double x0, double y0, double x1, double y1, struct mvt_clip *c, double **out) {
+    static const int axis[4] = {0, 0, 1, 1};
+    static const int keep_less[4] = {0, 1, 0, 1};
+    const double bound[4] = {x0, x1, y0, y1};
+    const double *src = xy;
+    int cur = 0;
+
+    if (n > 1 && xy[0] == xy[2 * n - 2] && xy[1] == xy[2 * n - 1]) {  // 按多边形的顶点处理，不要闭合点
+        n--;
+    }
+    for (int e = 0; e < 4 && n > 0; e++) {
+        c->buf[cur] = grow(c->buf[cur], &c->cap[cur], 2 * n, 2 * sizeof(double));  // 每条边最多多出一个交点
+        n = clip_edge(src, n, c->buf[cur], axis[e], bound[e], keep_less[e]);
+        src = c->buf[cur];
+        cur = 1 - cur;
+    }
+    *out = (double *)src;
+    return n;
+}
+
+void
+mvt_clip_free(struct mvt_clip *c) {
+    for (int i = 0; i < 2; i++) {
+        free(c->buf[i]);
+        c->buf[i] = NULL;
+        c->cap[i] = 0;
+    }
+}
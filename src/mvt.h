@@ -0,0 +1,116 @@
+/*
+ * Mapbox Vector Tile（MVT 2.1）编码，不依赖 protobuf 库
+ *
+ * 一个瓦片只有一层，每个多边形一个要素。坐标先用 mvt_mercator() 转成 Web Mercator 的单位坐标（0 到 1），
+ * 各级按 2^z * MVT_EXTENT 放大后按瓦片裁剪（mvt_clip_ring()），再在 mvt_ring() 中取整、去掉重复点、
+ * 按规范调整环的方向
+ */
+#ifndef MAPGIS_MVT_H
+#define MAPGIS_MVT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#define MVT_EXTENT 4096  // 瓦片内的坐标范围
+#define MVT_BUFFER 64  // 瓦片四周多裁出来的宽度，免得渲染时边上出现接缝
+
+/*
+ * 一个已编码的属性值在 values 中的位置
+ */
+struct mvt_value {
+    size_t off;
+    int len;
+};
+
+/*
+ * 正在编码的一个瓦片（一层），各线程一个，每个瓦片开始时 mvt_layer_reset()
+ */
+struct mvt_layer {
+    const char *name;  // 层名，UTF-8
+    const char **keys;  // 各属性名，UTF-8，标签中的属性号就是在这里的序号
+    int num_keys;
+    struct sbuf features;  // 已编码的要素
+    int num_features;
+    struct sbuf values;  // 已编码的各属性值，去重后的
+    struct mvt_value *vals;  // 各属性值在 values 中的位置
+    int num_vals;
+    int cap_vals;
+    int *hash;  // 属性值的散列表，存 vals 的序号 + 1，0 表示空
+    int hash_cap;
+    // 当前要素
+    uint64_t id;
+    uint32_t *tags;  // 属性号、属性值号，一对一对的
+    int num_tags;
+    int cap_tags;
+    uint32_t *geom;  // 绘图命令
+    int num_geom;
+    int cap_geom;
+    int has_exterior;  // 外环没被裁掉或退化掉
+    int cx, cy;  // 绘图命令的当前点
+    int *q;  // 取整后的环
+    int cap_q;
+};
+
+/*
+ * 裁剪用的临时空间，各线程一个
+ */
+struct mvt_clip {
+    double *buf[2];  // 各步交替使用
+    int cap[2];  // 点数
+};
+
+/*
+ * 原地把 n 个交错存放的经度、纬度（度）转成 Web Mercator 的单位坐标，左上角为 (0, 0)，右下角为 (1, 1)
+ */
+void mvt_mercator(double *xy, size_t n);
+
+/*
+ * mvt_mercator() 的逆，单位坐标转回经度、纬度（度）
+ */
+void mvt_unmercator(double *xy, size_t n);
+
+void mvt_layer_init(struct mvt_layer *l, const char *name, const char **keys, int num_keys);
+void mvt_layer_reset(struct mvt_layer *l);
+void mvt_layer_free(struct mvt_layer *l);
+
+/*
+ * 开始一个要素，之后加属性和环，最后 mvt_feature_end()
+ */
+void mvt_feature_begin(struct mvt_layer *l, uint64_t id);
+
+/*
+ * 要素的属性，key 是属性名在 keys 中的序号
+ */
+void mvt_tag_string(struct mvt_layer *l, int key, const char *s, size_t n);
+void mvt_tag_int(struct mvt_layer *l, int key, int64_t v);
+void mvt_tag_float(struct mvt_layer *l, int key, float v);
+void mvt_tag_double(struct mvt_layer *l, int key, double v);
+
+/*
+ * 要素的一个环，n 个交错存放的瓦片内坐标，首尾可以相同，也可以不同
+ * 取整后退化了（少于 3 个点或面积为 0）就丢掉，外环丢掉后后面的洞也都丢掉
+ *   - exterior 是否为外环
+ */
+void mvt_ring(struct mvt_layer *l, const double *xy, int n, int exterior);
+
+/*
+ * 结束当前要素，没有一个环留下来时整个要素都不要
+ */
+void mvt_feature_end(struct mvt_layer *l);
+
+/*
+ * 编码整个瓦片，追加到 out 中，没有要素时什么也不加
+ */
+void mvt_tile_encode(struct mvt_layer *l, struct sbuf *out);
+
+/*
+ * 用 Sutherland-Hodgman 算法把环裁剪到矩形 [x0, x1] x [y0, y1] 中
+ * 返回裁剪后的点数，*out 指向结果（在 c 中），结果不闭合
+ */
+int mvt_clip_ring(const double *xy, int n, double x0, double y0, double x1, double y1, struct mvt_clip *c, double **out);
+
+void mvt_clip_free(struct mvt_clip *c);
+
+#endif
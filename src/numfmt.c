@@ -0,0 +1,164 @@
+/*
+ * 数字格式化，见 numfmt.h
+ */
+
+#include <stdio.h>  // snprintf()
+#include <stdlib.h>  // strtod()
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "numfmt.h"
+
+// 10 的整数次幂，到 1e22 都是精确的 double
+static const double pow10_tab[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const char digits2[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*
+ * 无符号整数的十进制数字，写到 end 之前，返回第一个数字的位置
+ */
+static char *
+utoa_rev(char *end, unsigned long u) {
+    while (u >= 100) {
+        unsigned long q = u / 100;
+        int r = (int)(u - q * 100);
+
+        end -= 2;
+        memcpy(end, digits2 + r * 2, 2);
+        u = q;
+    }
+    if (u >= 10) {
+        end -= 2;
+        memcpy(end, digits2 + u * 2, 2);
+    } else {
+        *--end = '0' + (char)u;
+    }
+    return end;
+}
+
+int
+fmt_long(char *p, long v) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+    char *s = utoa_rev(end, u);
+    int n = 0;
+
+    if (v < 0) {
+        p[n++] = '-';
+    }
+    memcpy(p + n, s, end - s);
+    return n + (int)(end - s);
+}
+
+/*
+ * 把 m * 10^-k 写成小数，去掉小数部分末尾的 0
+ */
+static int
+fmt_scaled(char *p, int neg, unsigned long m, int k) {
+    char tmp[48];
+    char *end = tmp + sizeof(tmp);
+    char *s;
+    int n = 0;
+
+    // 去掉末尾的 0
+    while (k > 0 && m % 10 == 0) {
+        m /= 10;
+        k--;
+    }
+    if (neg && m != 0) {
+        p[n++] = '-';
+    }
+    s = utoa_rev(end, m);
+    int nd = (int)(end - s);
+
+    if (k == 0) {
+        memcpy(p + n, s, nd);
+        return n + nd;
+    }
+    if (nd <= k) {  // 整数部分是 0
+        p[n++] = '0';
+        p[n++] = '.';
+        memset(p + n, '0', k - nd);
+        n += k - nd;
+        memcpy(p + n, s, nd);
+        return n + nd;
+    }
+    memcpy(p + n, s, nd - k);
+    n += nd - k;
+    p[n++] = '.';
+    memcpy(p + n, s + nd - k, k);
+    return n + k;
+}
+
+/*
+ * 与 cJSON 的 compare_double() 一样：相差不超过较大者的 DBL_EPSILON 倍就算相等
+ */
+static int
+close_enough(double a, double b) {
+    return fabs(a - b) <= fmax(fabs(a), fabs(b)) * DBL_EPSILON;
+}
+
+/*
+ * 与 cJSON 一样的做法：先试 15 位有效数字，读回来不够接近再用 17 位
+ */
+static int
+fmt_double_printf(char *p, double d) {
+    int n = snprintf(p, NUMFMT_MAX, "%1.15g", d);
+
+    if (!close_enough(strtod(p, NULL), d)) {
+        n = snprintf(p, NUMFMT_MAX, "%1.17g", d);
+    }
+    return n;
+}
+
+int
+fmt_double(char *p, double d, int prec) {
+    double a = fabs(d);
+
+    if (!isfinite(d)) {
+        memcpy(p, "null", 4);
+        return 4;
+    }
+    if (prec >= 0) {
+        if (prec <= 15 && a * pow10_tab[prec] < 9e15) {
+            return fmt_scaled(p, d < 0, (unsigned long)llround(a * pow10_tab[prec]), prec);
+        }
+        return snprintf(p, NUMFMT_MAX, "%.*f", prec > 17 ? 17 : prec, d);
+    }
+    if (a < 1e15 && d == (double)(long)d) {  // 整数
+        return fmt_long(p, (long)d);
+    }
+    if (a >= 1e-4 && a < 1e15) {  // %g 在这个范围内不用指数形式
+        // 15 位有效数字的整数 m 和小数位数 k，m 在 2^53 以内，10^k 是精确的，
+        // 所以 m / 10^k 就是这个十进制数正确舍入后的 double，也就是 cJSON 读回来的值；
+        // a * 10^k 小于 1e15，乘法的误差不到 1/16，小数部分离 0.5 太近时舍入可能与 printf 不同，交给 printf
+        int e = (int)floor(log10(a));
+        int k = 14 - e;
+
+        if (k >= 0 && k <= 22) {
+            double scale = pow10_tab[k];
+            double r = a * scale;
+            unsigned long m = (unsigned long)llround(r);
+
+            if (m < (1UL << 53) && fabs(r - floor(r) - 0.5) > 0.1 && close_enough((double)m / scale, a)) {
+                return fmt_scaled(p, d < 0, m, k);
+            }
+        }
+    }
+    return fmt_double_printf(p, d);
+}
@@ -0,0 +1,23 @@
+/*
+ * 数字格式化，不用 printf，主要用于坐标输出
+ */
+#ifndef MAPGIS_NUMFMT_H
+#define MAPGIS_NUMFMT_H
+
+#define NUMFMT_MAX 32  // 格式化一个数最多需要的字节数
+
+/*
+ * 把整数格式化到 p，返回字节数，不加结尾的 0
+ */
+int fmt_long(char *p, long v);
+
+/*
+ * 把浮点数格式化到 p，返回字节数，不加结尾的 0
+ *   - prec  小于 0 时与 cJSON 的输出一致：15 位有效数字读回来与原值相差不超过 DBL_EPSILON 倍的就用 15 位，
+ *           否则用 17 位（所以 15 位的写法不一定能精确读回原值）；
+ *           否则按 prec 位小数四舍五入，去掉末尾的 0
+ * 非有限值输出为 null
+ */
+int fmt_double(char *p, double d, int prec);
+
+#endif
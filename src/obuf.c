@@ -0,0 +1,248 @@
+/*
+ * 输出缓冲区，见 obuf.h
+ */
+
+#define _GNU_SOURCE  // fallocate()
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <unistd.h>  // write()
+#include <fcntl.h>  // open(), fallocate()
+#include <errno.h>
+#include <err.h>  // err()
+#include <sys/uio.h>  // writev()
+#include <sys/stat.h>  // fstat()
+
+#include "obuf.h"
+#include "pgz.h"
+
+void
+obuf_open(struct obuf *b, const char *path, int gzip) {
+    bzero(b, sizeof(*b));
+    if (path) {
+        b->path = strdup(path);
+        b->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (b->fd == -1) {
+            err(1, "创建输出文件 %s 失败", path);
+        }
+    } else {
+        b->fd = STDOUT_FILENO;
+    }
+    if (posix_memalign((void **)&b->buf, OBUF_ALIGN, OBUF_SIZE) != 0) {
+        err(1, "分配输出缓冲区失败");
+    }
+    if (gzip) {  // 压缩后的大小不知道，也就不预留空间了
+        b->gz = pgz_open(b->fd, b->path, OBUF_SIZE);
+        b->no_prealloc = 1;
+    }
+    b->gzip = gzip;
+}
+
+void
+obuf_prealloc(struct obuf *b, off_t size) {
+    if (!b->path || b->no_prealloc || size <= b->reserved) {
+        return;
+    }
+    // KEEP_SIZE: 只预留空间，文件大小还是按实际写出的算，文件尾后面多预留的在 obuf_close() 中释放
+    if (fallocate(b->fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0) {
+        b->reserved = size;
+    } else {  // 文件系统不支持或空间不够，以后就不再试了，真写不下去时 write() 会报错
+        b->no_prealloc = 1;
+    }
+}
+
+/*
+ * 把 iov 中的内容全部写出，处理被信号打断和部分写出的情况
+ */
+static void
+write_all(struct obuf *b, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t r = writev(b->fd, iov, iovcnt);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "写输出文件 %s 失败", b->path ? b->path : "(stdout)");
+        }
+        b->written += r;
+        while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+}
+
+/*
+ * 写出 n 个字节之前，如果超出了预留的空间，就再多预留一大块，减少文件碎片
+ */
+static void
+grow_reserve(struct obuf *b, size_t n) {
+    off_t need = b->written + n;
+
+    if (b->path && !b->no_prealloc && need > b->reserved) {
+        off_t size = b->reserved * 2;
+
+        if (size < need + OBUF_PREALLOC_STEP) {
+            size = need + OBUF_PREALLOC_STEP;
+        }
+        obuf_prealloc(b, size);
+    }
+}
+
+void
+obuf_flush(struct obuf *b) {
+    struct iovec iov;
+
+    if (b->len == 0) {
+        return;
+    }
+    if (b->gz) {
+        b->buf = pgz_submit(b->gz, b->buf, b->len);
+        b->written += b->len;
+        b->len = 0;
+        return;
+    }
+    grow_reserve(b, b->len);
+    iov.iov_base = b->buf;
+    iov.iov_len = b->len;
+    write_all(b, &iov, 1);
+    b->len = 0;
+}
+
+void
+obuf_write(struct obuf *b, const void *p, size_t n) {
+    if (b->len + n <= OBUF_SIZE) {
+        memcpy(b->buf + b->len, p, n);
+        b->len += n;
+        if (b->len == OBUF_SIZE) {
+            obuf_flush(b);
+        }
+        return;
+    }
+    if (n >= OBUF_SIZE / 2 && !b->gz) {  // 大块数据，与缓冲区中已有的一起直接写出
+        struct iovec iov[2];
+
+        grow_reserve(b, b->len + n);
+        iov[0].iov_base = b->buf;
+        iov[0].iov_len = b->len;
+        iov[1].iov_base = (void *)p;
+        iov[1].iov_len = n;
+        write_all(b, iov, 2);
+        b->len = 0;
+        return;
+    }
+    // 一次次填满缓冲区写出，剩下的放进空缓冲区
+    while (b->len + n > OBUF_SIZE) {
+        size_t k = OBUF_SIZE - b->len;
+
+        memcpy(b->buf + b->len, p, k);
+        b->len = OBUF_SIZE;
+        obuf_flush(b);
+        p = (const char *)p + k;
+        n -= k;
+    }
+    memcpy(b->buf, p, n);
+    b->len = n;
+}
+
+int
+obuf_can_pwrite(struct obuf *b) {
+    struct stat st;
+
+    return b->path && !b->gz && fstat(b->fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+off_t
+obuf_claim(struct obuf *b, size_t n) {
+    off_t off;
+
+    obuf_flush(b);
+    grow_reserve(b, n);
+    off = b->written;
+    b->written += n;
+    if (lseek(b->fd, b->written, SEEK_SET) == -1) {  // 以后 write() 的接在占用的后面
+        err(1, "lseek %s", b->path);
+    }
+    return off;
+}
+
+void
+obuf_pwrite(struct obuf *b, const void *p, size_t n, off_t off) {
+    while (n > 0) {
+        ssize_t r = pwrite(b->fd, p, n, off);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "写输出文件 %s 失败", b->path);
+        }
+        p = (const char *)p + r;
+        n -= r;
+        off += r;
+    }
+}
+
+/*
+ * 写出剩下的内容，结束压缩，释放多预留的空间，关闭文件（标准输出不关闭）
+ */
+static void
+close_fd(struct obuf *b) {
+    obuf_flush(b);
+    if (b->gz) {
+        pgz_close(b->gz);
+        b->gz = NULL;
+    }
+    if (b->path) {
+        if (b->reserved > b->written) {  // 释放文件尾后面多预留的空间
+            if (ftruncate(b->fd, b->written) != 0) {
+                err(1, "截断输出文件 %s 失败", b->path);
+            }
+        }
+        if (close(b->fd) != 0) {
+            err(1, "关闭输出文件 %s 失败", b->path);
+        }
+    }
+    free(b->buf);
+    b->buf = NULL;
+}
+
+void
+obuf_suspend(struct obuf *b) {
+    close_fd(b);
+    b->reserved = 0;
+    b->no_prealloc = 1;  // 会反复开关的文件就不预留空间了
+    b->suspended = 1;
+}
+
+void
+obuf_resume(struct obuf *b) {
+    b->fd = open(b->path, O_WRONLY | O_APPEND);
+    if (b->fd == -1) {
+        err(1, "打开输出文件 %s 失败", b->path);
+    }
+    if (posix_memalign((void **)&b->buf, OBUF_ALIGN, OBUF_SIZE) != 0) {
+        err(1, "分配输出缓冲区失败");
+    }
+    if (b->gzip) {
+        b->gz = pgz_open(b->fd, b->path, OBUF_SIZE);
+    }
+    b->suspended = 0;
+}
+
+void
+obuf_close(struct obuf *b) {
+    if (b->suspended) {
+        obuf_resume(b);
+    }
+    close_fd(b);
+    free(b->path);
+    b->path = NULL;
+}
@@ -0,0 +1,102 @@
+/*
+ * 输出缓冲区
+ *
+ * 用一块对齐的大缓冲区攒数据，满了直接 write() 到文件描述符，大块数据用 writev() 与缓冲区中
+ * 剩下的内容一起写出，不经过 stdio。能估计出输出大小时先 fallocate() 预留磁盘空间
+ * gzip 输出时，缓冲区满了就整块交给 pgz 并行压缩，换一块空的接着用
+ * 输出到普通文件时也可以先按顺序占好位置，再由多个线程用 pwrite() 同时写进去，见 obuf_claim()
+ */
+#ifndef MAPGIS_OBUF_H
+#define MAPGIS_OBUF_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define OBUF_SIZE (4 << 20)  // 缓冲区大小
+#define OBUF_ALIGN 4096  // 缓冲区按页对齐
+#define OBUF_PREALLOC_STEP (64 << 20)  // 预留空间不够时，至少再预留这么多
+
+struct pgz_stream;
+
+struct obuf {
+    int fd;
+    char *path;  // 输出文件名，NULL 表示标准输出
+    char *buf;
+    size_t len;  // 缓冲区中待写出的字节数
+    off_t written;  // 已写出的字节数，gzip 输出时是压缩前的字节数
+    struct pgz_stream *gz;  // gzip 输出，NULL 表示不压缩
+    off_t reserved;  // fallocate() 预留的大小
+    int no_prealloc;  // fallocate() 失败过，不再预留
+    int gzip;  // 压缩输出，obuf_resume() 时用
+    int suspended;  // 被 obuf_suspend() 暂时关闭了
+};
+
+/*
+ * 打开输出，path 为 NULL 时输出到标准输出，gzip 不为 0 时压缩输出。出错时直接退出
+ */
+void obuf_open(struct obuf *b, const char *path, int gzip);
+
+/*
+ * 预计输出 size 字节，预留磁盘空间（不改变文件大小），不支持时什么也不做
+ * 写出时超出了预留的空间会自动再预留一块
+ */
+void obuf_prealloc(struct obuf *b, off_t size);
+
+/*
+ * 写出缓冲区中的内容
+ */
+void obuf_flush(struct obuf *b);
+
+/*
+ * 追加 n 字节，大块数据不经过缓冲区复制
+ */
+void obuf_write(struct obuf *b, const void *p, size_t n);
+
+/*
+ * 能否定位写出：不压缩，输出是普通文件（管道等不能 pwrite()）
+ */
+int obuf_can_pwrite(struct obuf *b);
+
+/*
+ * 定位写出：占用输出中接下来的 n 个字节，返回它们在文件中的偏移量，之后的 obuf_write() 接着写在它们后面
+ * 这 n 个字节由调用者用 obuf_pwrite() 写进去，可以交给别的线程，但要在 obuf_close() 之前写完
+ */
+off_t obuf_claim(struct obuf *b, size_t n);
+
+/*
+ * 把 n 个字节写到 obuf_claim() 得到的位置 off，多个线程可以同时写各自占用的部分
+ */
+void obuf_pwrite(struct obuf *b, const void *p, size_t n, off_t off);
+
+/*
+ * 暂时关闭输出文件：写出缓冲区中的内容，释放缓冲区和多预留的空间，以后用 obuf_resume() 接着写
+ * 用来限制同时打开的文件数。gzip 输出时结束当前的 gzip 成员，接着写时另起一个，连起来仍是合法的 gzip 文件
+ * 只能用于输出到文件
+ */
+void obuf_suspend(struct obuf *b);
+
+/*
+ * 以追加方式重新打开 obuf_suspend() 关闭的输出文件，obuf_size() 接着算
+ */
+void obuf_resume(struct obuf *b);
+
+/*
+ * 写出剩下的内容，释放多预留的空间，关闭文件（标准输出不关闭）
+ */
+void obuf_close(struct obuf *b);
+
+/*
+ * 总共输出的字节数（包括还在缓冲区中的），gzip 输出时是压缩前的字节数
+ */
+static inline off_t
+obuf_size(const struct obuf *b) {
+    return b->written + b->len;
+}
+
+static inline void
+obuf_puts(struct obuf *b, const char *s) {
+    obuf_write(b, s, strlen(s));
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * PostgreSQL 二进制 COPY 输出，见 pgcopy.h
+ */
+
+#define _GNU_SOURCE  // asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+#include <endian.h>
+
+#include "pgcopy.h"
+#include "obuf.h"
+
+#define WKB_POLYGON 3
+#define EWKB_SRID 0x20000000  // 类型中的标志：后面跟着 SRID
+
+struct pgcopy_writer {
+    struct obuf ob;
+};
+
+static void
+add_be16(struct sbuf *sb, int16_t v) {
+    uint16_t be = htobe16((uint16_t)v);
+
+    sbuf_add(sb, &be, sizeof(be));
+}
+
+static void
+add_be32(struct sbuf *sb, int32_t v) {
+    uint32_t be = htobe32((uint32_t)v);
+
+    sbuf_add(sb, &be, sizeof(be));
+}
+
+static void
+add_u32(struct sbuf *sb, uint32_t v) {
+    sbuf_add(sb, &v, sizeof(v));
+}
+
+struct pgcopy_writer *
+pgcopy_open(const char *path, int gzip, const char *ddl) {
+    struct pgcopy_writer *w = calloc(1, sizeof(*w));
+    static const char header[19] = "PGCOPY\n\377\r\n";  // 11 字节的签名（最后一个是 0），32 位的标志和头扩展长度，都是 0
+
+    if (path && ddl) {
+        size_t n = strlen(path);
+        char *sql;
+        FILE *f;
+
+        if (n > 3 && strcmp(path + n - 3, ".gz") == 0) {
+            n -= 3;
+        }
+        if (asprintf(&sql, "%.*s.sql", (int)n, path) == -1) {
+            err(1, "asprintf");
+        }
+        f = fopen(sql, "w");
+        if (!f || fputs(ddl, f) == EOF || fclose(f) != 0) {
+            err(1, "写 %s 失败", sql);
+        }
+        free(sql);
+    }
+    obuf_open(&w->ob, path, gzip);
+    obuf_write(&w->ob, header, sizeof(header));
+    return w;
+}
+
+void
+pgcopy_write(struct pgcopy_writer *w, const void *tuples, size_t len) {
+    obuf_write(&w->ob, tuples, len);
+}
+
+void
+pgcopy_close(struct pgcopy_writer *w) {
+    static const char trailer[2] = {-1, -1};
+
+    obuf_write(&w->ob, trailer, sizeof(trailer));
+    obuf_close(&w->ob);
+    free(w);
+}
+
+void
+pgcopy_tuple(struct sbuf *sb, int num_fields) {
+    add_be16(sb, (int16_t)num_fields);
+}
+
+void
+pgcopy_null(struct sbuf *sb) {
+    add_be32(sb, -1);
+}
+
+void
+pgcopy_int4(struct sbuf *sb, int32_t v) {
+    add_be32(sb, 4);
+    add_be32(sb, v);
+}
+
+void
+pgcopy_float4(struct sbuf *sb, float v) {
+    int32_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    add_be32(sb, 4);
+    add_be32(sb, bits);
+}
+
+void
+pgcopy_float8(struct sbuf *sb, double v) {
+    uint64_t be;
+
+    memcpy(&be, &v, sizeof(be));
+    be = htobe64(be);
+    add_be32(sb, 8);
+    sbuf_add(sb, &be, sizeof(be));
+}
+
+void
+pgcopy_text(struct sbuf *sb, const char *s, size_t n) {
+    add_be32(sb, (int32_t)n);
+    sbuf_add(sb, s, n);
+}
+
+void
+pgcopy_polygon(struct sbuf *sb, const double *xy, const int *ring_end, int num_rings, int first, int srid) {
+    int last = num_rings > 0 ? ring_end[num_rings - 1] : first;
+    size_t len = 1 + 4 + (srid ? 4 : 0) + 4 + 4 * (size_t)num_rings + (size_t)(last - first) * 2 * sizeof(double);
+
+    add_be32(sb, (int32_t)len);
+    sbuf_reserve(sb, len);
+    sbuf_addc(sb, 1);  // 小端
+    add_u32(sb, WKB_POLYGON | (srid ? EWKB_SRID : 0));
+    if (srid) {
+        add_u32(sb, (uint32_t)srid);
+    }
+    add_u32(sb, (uint32_t)num_rings);
+    for (int r = 0; r < num_rings; r++) {
+        int s = r > 0 ? ring_end[r - 1] : first;
+
+        add_u32(sb, (uint32_t)(ring_end[r] - s));
+        sbuf_add(sb, xy + 2 * s, (size_t)(ring_end[r] - s) * 2 * sizeof(double));
+    }
+}
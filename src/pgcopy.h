@@ -0,0 +1,57 @@
+/*
+ * PostgreSQL 二进制 COPY 输出，几何是 PostGIS 的 EWKB，可以直接 COPY ... FROM STDIN (FORMAT binary) 导入
+ *
+ * 流的开头是 11 字节的签名、标志和头扩展长度，然后一行一个元组，最后是 -1
+ * 元组是字段数和各字段，字段是长度（-1 表示 NULL）和值，都是网络字节序（大端）；
+ * EWKB 自带字节序，用小端，坐标可以整段复制
+ * 元组各自独立，可以并行编码，按顺序追加到输出中
+ */
+#ifndef MAPGIS_PGCOPY_H
+#define MAPGIS_PGCOPY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sbuf.h"
+
+struct pgcopy_writer;
+
+/*
+ * 开始输出
+ *   - path  输出文件名，NULL 表示标准输出
+ *   - gzip  压缩输出
+ *   - ddl   建表语句，写到 <path 去掉 .gz>.sql 中，NULL 或输出到标准输出时不写
+ * 出错时直接退出
+ */
+struct pgcopy_writer *pgcopy_open(const char *path, int gzip, const char *ddl);
+
+/*
+ * 写出编码好的若干个元组
+ */
+void pgcopy_write(struct pgcopy_writer *w, const void *tuples, size_t len);
+
+/*
+ * 写出结尾，关闭输出
+ */
+void pgcopy_close(struct pgcopy_writer *w);
+
+/*
+ * 编码一个元组：先 pgcopy_tuple() 给出字段数，再按顺序追加各字段的值
+ */
+void pgcopy_tuple(struct sbuf *sb, int num_fields);
+void pgcopy_null(struct sbuf *sb);
+void pgcopy_int4(struct sbuf *sb, int32_t v);
+void pgcopy_float4(struct sbuf *sb, float v);
+void pgcopy_float8(struct sbuf *sb, double v);
+void pgcopy_text(struct sbuf *sb, const char *s, size_t n);  // UTF-8
+
+/*
+ * 多边形字段，EWKB。没有环时是空多边形
+ *   - xy        交错存放的坐标，各环首尾相同
+ *   - ring_end  各环最后一点的下一个点在 xy 中的序号
+ *   - first     第一个环的第一点在 xy 中的序号
+ *   - srid      坐标系，0 表示不知道，不写进 EWKB
+ */
+void pgcopy_polygon(struct sbuf *sb, const double *xy, const int *ring_end, int num_rings, int first, int srid);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * 并行 gzip 压缩输出，见 pgz.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // write(), sysconf()
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "pgz.h"
+
+#define PGZ_MAX_INFLIGHT 32  // 每个流最多有多少块在途
+#define PGZ_BUF_ALIGN 4096
+
+// 块的状态
+enum {
+    JOB_EMPTY,
+    JOB_QUEUED,  // 等待或正在压缩
+    JOB_DONE,  // 压缩好了，等待按顺序写出
+};
+
+struct pgz_job {
+    struct pgz_stream *s;
+    struct pgz_job *next;  // 工作队列
+    int state;
+    char *in;
+    size_t in_len;
+    unsigned char *out;
+    size_t out_cap;
+    size_t out_len;
+};
+
+struct pgz_stream {
+    int fd;
+    const char *path;
+    size_t bufsize;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct pgz_job jobs[PGZ_MAX_INFLIGHT];  // 第 n 块放在 jobs[n % PGZ_MAX_INFLIGHT]
+    long next_seq;  // 下一块的序号
+    long next_write;  // 下一块要写出的序号
+    int max_inflight;  // 在途块数的上限，与线程数相当就够了
+    int writing;  // 有线程正在写出
+    char **free_bufs;  // 空闲的输入缓冲区
+    int num_free;
+    off_t written;  // 写出的压缩后字节数
+};
+
+/*
+ * 所有流共用的压缩线程
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct pgz_job *head, *tail;  // 等待压缩的块
+    pthread_t *threads;
+    int num_threads;
+    int level;
+    int started;
+    int quit;
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, NULL, 0, Z_DEFAULT_COMPRESSION, 0, 0
+};
+
+static void
+write_full(struct pgz_stream *s, const void *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = write(s->fd, p, n);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(1, "写输出文件 %s 失败", s->path ? s->path : "(stdout)");
+        }
+        p = (const char *)p + r;
+        n -= r;
+        s->written += r;
+    }
+}
+
+/*
+ * 压缩一块，结果是一个完整的 gzip member
+ */
+static void
+compress_job(z_stream *zs, struct pgz_job *j) {
+    size_t bound;
+
+    deflateReset(zs);  // 上一块结束后的状态下 deflateBound() 不算 gzip 头，小块会放不下
+    bound = deflateBound(zs, j->in_len);
+    if (j->out_cap < bound) {
+        free(j->out);
+        j->out = malloc(bound);
+        if (!j->out) {
+            err(1, "malloc");
+        }
+        j->out_cap = bound;
+    }
+    zs->next_in = (unsigned char *)j->in;
+    zs->avail_in = j->in_len;
+    zs->next_out = j->out;
+    zs->avail_out = j->out_cap;
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+        errx(1, "gzip 压缩失败");
+    }
+    j->out_len = j->out_cap - zs->avail_out;
+}
+
+/*
+ * 压缩完一块后，把该流中已经按顺序压缩好的块都写出去，同一时间只有一个线程在写
+ * 调用时持有 s->lock
+ */
+static void
+write_done_jobs(struct pgz_stream *s) {
+    if (s->writing) {  // 正在写的线程会接着写这一块
+        return;
+    }
+    s->writing = 1;
+    while (s->next_write < s->next_seq) {
+        struct pgz_job *j = s->jobs + s->next_write % PGZ_MAX_INFLIGHT;
+
+        if (j->state != JOB_DONE) {
+            break;
+        }
+        pthread_mutex_unlock(&s->lock);
+        write_full(s, j->out, j->out_len);
+        pthread_mutex_lock(&s->lock);
+        j->state = JOB_EMPTY;
+        s->next_write++;
+        pthread_cond_broadcast(&s->cond);
+    }
+    s->writing = 0;
+}
+
+static void *
+worker(void *arg) {
+    z_stream zs;
+
+    (void)arg;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 加 16 表示带 gzip 头和尾
+    if (deflateInit2(&zs, pool.level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        errx(1, "gzip 初始化失败");
+    }
+    for (;;) {
+        struct pgz_job *j;
+
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.head && !pool.quit) {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        }
+        if (!pool.head) {
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+        j = pool.head;
+        pool.head = j->next;
+        if (!pool.head) {
+            pool.tail = NULL;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        compress_job(&zs, j);
+
+        struct pgz_stream *s = j->s;
+
+        pthread_mutex_lock(&s->lock);
+        s->free_bufs[s->num_free++] = j->in;  // 输入缓冲区马上就可以再用了
+        j->in = NULL;
+        j->state = JOB_DONE;
+        pthread_cond_broadcast(&s->cond);
+        write_done_jobs(s);
+        pthread_mutex_unlock(&s->lock);
+    }
+    deflateEnd(&zs);
+    return NULL;
+}
+
+void
+pgz_setup(int threads, int level) {
+    pool.num_threads = threads;
+    pool.level = level;
+}
+
+static void
+start_pool(void) {
+    if (pool.num_threads <= 0) {
+        pool.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (pool.num_threads <= 0) {
+            pool.num_threads = 1;
+        }
+    }
+    pool.threads = calloc(pool.num_threads, sizeof(*pool.threads));
+    for (int i = 0; i < pool.num_threads; i++) {
+        if (pthread_create(pool.threads + i, NULL, worker, NULL) != 0) {
+            errx(1, "创建压缩线程失败");
+        }
+    }
+    pool.started = 1;
+}
+
+struct pgz_stream *
+pgz_open(int fd, const char *path, size_t bufsize) {
+    struct pgz_stream *s = calloc(1, sizeof(*s));
+
+    if (!s) {
+        err(1, "calloc");
+    }
+    pthread_mutex_lock(&pool.lock);
+    if (!pool.started) {
+        start_pool();
+    }
+    pthread_mutex_unlock(&pool.lock);
+    s->fd = fd;
+    s->path = path;
+    s->bufsize = bufsize;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->max_inflight = pool.num_threads * 2 + 2;
+    if (s->max_inflight > PGZ_MAX_INFLIGHT) {
+        s->max_inflight = PGZ_MAX_INFLIGHT;
+    }
+    s->free_bufs = calloc(PGZ_MAX_INFLIGHT + 1, sizeof(*s->free_bufs));
+    return s;
+}
+
+char *
+pgz_submit(struct pgz_stream *s, char *buf, size_t len) {
+    struct pgz_job *j;
+    char *nbuf = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    j = s->jobs + s->next_seq % PGZ_MAX_INFLIGHT;
+    while (j->state != JOB_EMPTY || s->next_seq - s->next_write >= s->max_inflight) {  // 在途的块太多了，等一等
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    j->s = s;
+    j->in = buf;
+    j->in_len = len;
+    j->state = JOB_QUEUED;
+    j->next = NULL;
+    s->next_seq++;
+    if (s->num_free > 0) {
+        nbuf = s->free_bufs[--s->num_free];
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.tail) {
+        pool.tail->next = j;
+    } else {
+        pool.head = j;
+    }
+    pool.tail = j;
+    pthread_cond_signal(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    if (!nbuf && posix_memalign((void **)&nbuf, PGZ_BUF_ALIGN, s->bufsize) != 0) {
+        err(1, "分配压缩缓冲区失败");
+    }
+    return nbuf;
+}
+
+off_t
+pgz_close(struct pgz_stream *s) {
+    off_t written;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->next_write < s->next_seq) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    for (int i = 0; i < s->num_free; i++) {
+        free(s->free_bufs[i]);
+    }
+    for (int i = 0; i < PGZ_MAX_INFLIGHT; i++) {
+        free(s->jobs[i].out);
+    }
+    free(s->free_bufs);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    written = s->written;
+    free(s);
+    return written;
+}
+
+void
+pgz_shutdown(void) {
+    if (!pool.started) {
+        return;
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < pool.num_threads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    free(pool.threads);
+    pool.started = 0;
+    pool.quit = 0;
+}
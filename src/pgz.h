@@ -0,0 +1,45 @@
+/*
+ * 并行 gzip 压缩输出
+ *
+ * 输出按块交给一组工作线程，每块独立压缩成一个完整的 gzip member，再按原来的顺序写出，
+ * 多个 member 连在一起仍是合法的 gzip 文件（与 pigz 的做法类似，gzip -d 可以直接解开）
+ * 所有输出流共用一组线程，每个流在途的块数有上限，所以内存占用是有界的
+ */
+#ifndef MAPGIS_PGZ_H
+#define MAPGIS_PGZ_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct pgz_stream;
+
+/*
+ * 设置压缩线程数和压缩级别，要在第一次 pgz_open() 之前调用，threads 为 0 表示用 CPU 个数
+ */
+void pgz_setup(int threads, int level);
+
+/*
+ * 开始一个压缩输出流
+ *   - fd       输出文件描述符
+ *   - path     输出文件名，只用于报错
+ *   - bufsize  每块的大小，pgz_submit() 交进来和换回去的缓冲区都是这个大小
+ */
+struct pgz_stream *pgz_open(int fd, const char *path, size_t bufsize);
+
+/*
+ * 交出一块数据去压缩，换回一个空的缓冲区。在途的块太多时会等待
+ * 缓冲区用 posix_memalign() 分配，由 pgz 负责释放
+ */
+char *pgz_submit(struct pgz_stream *s, char *buf, size_t len);
+
+/*
+ * 等所有块都压缩并写出，返回写出的压缩后的总字节数
+ */
+off_t pgz_close(struct pgz_stream *s);
+
+/*
+ * 停掉压缩线程
+ */
+void pgz_shutdown(void);
+
+#endif
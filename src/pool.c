@@ -0,0 +1,278 @@
+/*
+ * 工作窃取线程池，见 pool.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // sysconf()
+#include <err.h>
+#include <pthread.h>
+#include <sched.h>  // sched_yield()
+
+#include "pool.h"
+
+struct task {
+    pool_fn fn;
+    void *arg;
+};
+
+/*
+ * 任务队列，环形数组，满了就扩大。各线程的队列由主人从队尾存取，别人从队头偷
+ */
+struct deque {
+    pthread_mutex_t lock;
+    struct task *tasks;
+    int cap;
+    int head;  // 队头序号
+    int len;
+};
+
+struct pool {
+    int nthreads;
+    pthread_t *threads;
+    struct deque *deques;  // 各工作线程的队列
+    struct deque global;  // 公共队列
+    pthread_mutex_t lock;
+    pthread_cond_t cond;  // 有新任务或有任务完成
+    int queued;  // 各工作线程队列中的任务数，由 lock 保护
+    int global_queued;  // 公共队列中的任务数，由 lock 保护
+    int running;  // 正在执行的任务数，由 lock 保护
+    int quit;
+};
+
+static __thread struct pool *t_pool;  // 当前线程所属的线程池
+static __thread int t_id = -1;  // 当前工作线程的序号
+
+static void
+deque_init(struct deque *d) {
+    pthread_mutex_init(&d->lock, NULL);
+    d->cap = 64;
+    d->tasks = malloc(d->cap * sizeof(*d->tasks));
+    d->head = 0;
+    d->len = 0;
+}
+
+static void
+deque_push(struct deque *d, pool_fn fn, void *arg) {
+    pthread_mutex_lock(&d->lock);
+    if (d->len == d->cap) {
+        struct task *t = malloc(d->cap * 2 * sizeof(*t));
+
+        if (!t) {
+            err(1, "malloc");
+        }
+        for (int i = 0; i < d->len; i++) {
+            t[i] = d->tasks[(d->head + i) % d->cap];
+        }
+        free(d->tasks);
+        d->tasks = t;
+        d->head = 0;
+        d->cap *= 2;
+    }
+    d->tasks[(d->head + d->len) % d->cap] = (struct task){fn, arg};
+    d->len++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/*
+ * 从队尾（from_tail）或队头取一个任务，没有返回 0
+ */
+static int
+deque_take(struct deque *d, int from_tail, struct task *t) {
+    int r = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->len > 0) {
+        if (from_tail) {
+            *t = d->tasks[(d->head + d->len - 1) % d->cap];
+        } else {
+            *t = d->tasks[d->head];
+            d->head = (d->head + 1) % d->cap;
+        }
+        d->len--;
+        r = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return r;
+}
+
+/*
+ * 找一个任务：先自己的队列，再偷别人的，with_global 时最后看公共队列
+ * 没找到返回 0，从工作线程队列中找到返回 1，从公共队列中找到返回 2
+ */
+static int
+find_task(struct pool *p, int with_global, struct task *t) {
+    int self = t_pool == p ? t_id : -1;
+
+    if (self >= 0 && deque_take(p->deques + self, 1, t)) {
+        return 1;
+    }
+    for (int i = 1; i <= p->nthreads; i++) {
+        int v = (self + i + p->nthreads) % p->nthreads;
+
+        if (v != self && deque_take(p->deques + v, 0, t)) {
+            return 1;
+        }
+    }
+    return with_global && deque_take(&p->global, 0, t) ? 2 : 0;
+}
+
+/*
+ * 执行一个已取出的任务，from 是 find_task() 的返回值
+ */
+static void
+run_task(struct pool *p, struct task *t, int from) {
+    pthread_mutex_lock(&p->lock);
+    if (from == 2) {
+        p->global_queued--;
+    } else {
+        p->queued--;
+    }
+    p->running++;
+    pthread_mutex_unlock(&p->lock);
+
+    t->fn(t->arg);
+
+    pthread_mutex_lock(&p->lock);
+    p->running--;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *
+worker(void *arg) {
+    struct pool *p = arg;
+    struct task t;
+    int from;
+
+    t_pool = p;
+    pthread_mutex_lock(&p->lock);
+    t_id = p->nthreads;  // 先借用 nthreads 计数给自己编号
+    p->nthreads++;
+    pthread_mutex_unlock(&p->lock);
+
+    for (;;) {
+        if ((from = find_task(p, 1, &t)) != 0) {
+            run_task(p, &t, from);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        if (p->queued == 0 && p->global_queued == 0) {
+            if (p->quit) {
+                pthread_mutex_unlock(&p->lock);
+                break;
+            }
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+struct pool *
+pool_create(int nthreads) {
+    struct pool *p = calloc(1, sizeof(*p));
+    int n = nthreads;
+
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0) {
+            n = 1;
+        }
+    }
+    p->deques = calloc(n, sizeof(*p->deques));
+    p->threads = calloc(n, sizeof(*p->threads));
+    for (int i = 0; i < n; i++) {
+        deque_init(p->deques + i);
+    }
+    deque_init(&p->global);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(p->threads + i, NULL, worker, p) != 0) {
+            errx(1, "创建工作线程失败");
+        }
+    }
+    // 等所有线程都编好号
+    pthread_mutex_lock(&p->lock);
+    while (p->nthreads < n) {
+        pthread_mutex_unlock(&p->lock);
+        sched_yield();
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return p;
+}
+
+int
+pool_threads(struct pool *p) {
+    return p->nthreads;
+}
+
+void
+pool_submit(struct pool *p, pool_fn fn, void *arg) {
+    // 先计数再放进队列，都在 lock 中：放进去马上就可能被别的线程取走并减计数，
+    // 后计数的话 pool_wait_all() 可能看到计数为 0 而队列中还有任务
+    pthread_mutex_lock(&p->lock);
+    if (t_pool == p) {
+        p->queued++;
+        deque_push(p->deques + t_id, fn, arg);
+    } else {
+        p->global_queued++;
+        deque_push(&p->global, fn, arg);
+    }
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void
+pool_notify(struct pool *p) {
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void
+pool_wait_flag(struct pool *p, int *flag) {
+    struct task t;
+    int from;
+
+    while (!__atomic_load_n(flag, __ATOMIC_ACQUIRE)) {
+        if ((from = find_task(p, 0, &t)) != 0) {
+            run_task(p, &t, from);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        // 持锁再看一下，免得错过检查之后才来的通知
+        if (!__atomic_load_n(flag, __ATOMIC_ACQUIRE) && p->queued == 0) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+void
+pool_wait_all(struct pool *p) {
+    pthread_mutex_lock(&p->lock);
+    while (p->queued > 0 || p->global_queued > 0 || p->running > 0) {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void
+pool_destroy(struct pool *p) {
+    pool_wait_all(p);
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nthreads; i++) {
+        pthread_join(p->threads[i], NULL);
+        free(p->deques[i].tasks);
+    }
+    free(p->global.tasks);
+    free(p->deques);
+    free(p->threads);
+    free(p);
+}
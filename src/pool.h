@@ -0,0 +1,53 @@
+/*
+ * 工作窃取（work-stealing）线程池
+ *
+ * 每个工作线程有自己的任务队列，工作线程中提交的任务放进自己的队列，自己从队尾取（后进先出），
+ * 闲着的线程从别人的队头偷（先进先出）。不在工作线程中提交的任务放进公共队列，
+ * 只有闲着的线程才会去公共队列中取，等待中顺便干活的线程不取，免得一个大任务嵌套在另一个里面
+ *
+ * 批量转换时公共队列里是文件，文件任务再把多边形分块提交到自己的队列中
+ */
+#ifndef MAPGIS_POOL_H
+#define MAPGIS_POOL_H
+
+struct pool;
+
+typedef void (*pool_fn)(void *arg);
+
+/*
+ * 创建线程池，nthreads 为 0 时用 CPU 个数
+ */
+struct pool *pool_create(int nthreads);
+
+/*
+ * 线程池的线程数
+ */
+int pool_threads(struct pool *p);
+
+/*
+ * 提交一个任务
+ */
+void pool_submit(struct pool *p, pool_fn fn, void *arg);
+
+/*
+ * 等 *flag 变成非 0，等的时候帮着执行各线程队列中的任务
+ * 设置 flag 的一方在设置后要调用 pool_notify()
+ */
+void pool_wait_flag(struct pool *p, int *flag);
+
+/*
+ * 唤醒在 pool_wait_flag() 中等待的线程
+ */
+void pool_notify(struct pool *p);
+
+/*
+ * 等所有提交的任务都执行完
+ */
+void pool_wait_all(struct pool *p);
+
+/*
+ * 等所有任务执行完后停掉线程，释放线程池
+ */
+void pool_destroy(struct pool *p);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * 坐标转换，见 proj.h
+ */
+
+#define _GNU_SOURCE  // sincos()
+
+#include <math.h>
+#include <string.h>
+
+#include "proj.h"
+
+#define KRASS_A 6378245.0  // 克拉索夫斯基椭球
+#define KRASS_F (1 / 298.3)
+#define WGS84_A 6378137.0
+#define WGS84_F (1 / 298.257223563)
+#define CGCS2000_A 6378137.0
+#define CGCS2000_F (1 / 298.257222101)
+
+#define DEG (M_PI / 180)
+#define ARCSEC (DEG / 3600)
+
+void
+proj_init(struct proj *p, int gk, double lon0_deg, double false_easting, int to_epsg, const double towgs84[7]) {
+    double n = KRASS_F / (2 - KRASS_F);  // 第三扁率
+    double n2 = n * n, n3 = n2 * n;
+    double f2 = to_epsg == 4490 ? CGCS2000_F : WGS84_F;
+
+    memset(p, 0, sizeof(*p));
+    p->gk = gk;
+    p->lon0 = lon0_deg * DEG;
+    sincos(p->lon0, &p->sin_lon0, &p->cos_lon0);
+    p->false_easting = false_easting;
+    // 高斯-克吕格投影的比例因子为 1，级数取到 n 的三次方，在一个投影带内误差为毫米级
+    p->k0A = KRASS_A / (1 + n) * (1 + n2 / 4 + n2 * n2 / 64);
+    p->beta[0] = n / 2 - 2.0 / 3 * n2 + 37.0 / 96 * n3;
+    p->beta[1] = n2 / 48 + n3 / 15;
+    p->beta[2] = 17.0 / 480 * n3;
+    p->delta[0] = 2 * n - 2.0 / 3 * n2 - 2 * n3;
+    p->delta[1] = 7.0 / 3 * n2 - 8.0 / 5 * n3;
+    p->delta[2] = 56.0 / 15 * n3;
+
+    p->a1 = KRASS_A;
+    p->e2_1 = KRASS_F * (2 - KRASS_F);
+    p->a2 = to_epsg == 4490 ? CGCS2000_A : WGS84_A;
+    p->b2 = p->a2 * (1 - f2);
+    p->e2_2 = f2 * (2 - f2);
+    p->ep2_2 = p->e2_2 / (1 - p->e2_2);
+    for (int i = 0; i < 3; i++) {
+        p->t[i] = towgs84[i];
+        p->r[i] = towgs84[3 + i] * ARCSEC;
+    }
+    p->s = 1 + towgs84[6] * 1e-6;
+}
+
+/*
+ * 高斯-克吕格投影反算，x 为东坐标，y 为北坐标，结果为纬度、经度的正弦和余弦，正好是下一步 helmert() 要用的
+ * 级数各项的 sin(2jξ)、cosh(2jη) 等由倍角公式递推；共形纬度 χ 到大地纬度 φ 的改正量 d 很小（千分之几弧度），
+ * sin φ、cos φ 由 sin χ、cos χ 和 d 的泰勒展开算出，这样每点只调用两次 exp() 和 sincos()
+ */
+static void
+gk_inverse(const struct proj *p, const double *x, const double *y, double *sp, double *cp, double *sl, double *cl, int n) {
+    for (int i = 0; i < n; i++) {
+        double xi = y[i] / p->k0A;
+        double eta = (x[i] - p->false_easting) / p->k0A;
+        double s2, c2, e2 = exp(2 * eta);
+        double ch2 = (e2 + 1 / e2) / 2, sh2 = (e2 - 1 / e2) / 2;
+
+        sincos(2 * xi, &s2, &c2);
+
+        double s = s2, c = c2, sh = sh2, ch = ch2;  // 第 j 项的 sin(2jξ), cos(2jξ), sinh(2jη), cosh(2jη)
+        double xi1 = xi, eta1 = eta;
+
+        for (int j = 0; j < 3; j++) {
+            double t;
+
+            xi1 -= p->beta[j] * s * ch;
+            eta1 -= p->beta[j] * c * sh;
+            t = s * c2 + c * s2;
+            c = c * c2 - s * s2;
+            s = t;
+            t = sh * ch2 + ch * sh2;
+            ch = ch * ch2 + sh * sh2;
+            sh = t;
+        }
+
+        double e1 = exp(eta1), sx, cx;
+
+        sincos(xi1, &sx, &cx);
+        sh = (e1 - 1 / e1) / 2;
+        ch = (e1 + 1 / e1) / 2;
+
+        // 共形纬度 χ
+        double schi = sx / ch, cchi = sqrt(1 - schi * schi);
+        double d = 0;
+
+        s2 = 2 * schi * cchi;
+        c2 = 1 - 2 * schi * schi;
+        s = s2;
+        c = c2;
+        for (int j = 0; j < 3; j++) {
+            double t;
+
+            d += p->delta[j] * s;
+            t = s * c2 + c * s2;
+            c = c * c2 - s * s2;
+            s = t;
+        }
+
+        double d2 = d * d;
+        double sd = d * (1 - d2 / 6 * (1 - d2 / 20));
+        double cd = 1 - d2 / 2 * (1 - d2 / 12 * (1 - d2 / 30));
+
+        sp[i] = schi * cd + cchi * sd;
+        cp[i] = cchi * cd - schi * sd;
+
+        // 经差 Δλ = atan2(sinh η', cos ξ')，λ = λ0 + Δλ
+        double r = sqrt(sh * sh + cx * cx), sdl = sh / r, cdl = cx / r;
+
+        sl[i] = p->sin_lon0 * cdl + p->cos_lon0 * sdl;
+        cl[i] = p->cos_lon0 * cdl - p->sin_lon0 * sdl;
+    }
+}
+
+/*
+ * 七参数转换：源椭球经纬度 -> 地心直角坐标 -> 平移、旋转、缩放 -> 目标椭球经纬度（度），高程按 0 算
+ */
+static void
+helmert(const struct proj *p, const double *sp, const double *cp, const double *sl, const double *cl, double *lon, double *lat, int n) {
+    for (int i = 0; i < n; i++) {
+        double N = p->a1 / sqrt(1 - p->e2_1 * sp[i] * sp[i]);
+        double X = N * cp[i] * cl[i];
+        double Y = N * cp[i] * sl[i];
+        double Z = N * (1 - p->e2_1) * sp[i];
+        // 位置矢量约定的小角度旋转
+        double X2 = p->t[0] + p->s * (X - p->r[2] * Y + p->r[1] * Z);
+        double Y2 = p->t[1] + p->s * (p->r[2] * X + Y - p->r[0] * Z);
+        double Z2 = p->t[2] + p->s * (-p->r[1] * X + p->r[0] * Y + Z);
+        // Bowring 公式，地面附近的点不用迭代，其中的 sin θ、cos θ 直接由 tan θ 算
+        double q = sqrt(X2 * X2 + Y2 * Y2);
+        double tt = Z2 * p->a2 / (q * p->b2);
+        double ct = 1 / sqrt(1 + tt * tt), st = tt * ct;
+
+        lat[i] = atan((Z2 + p->ep2_2 * p->b2 * st * st * st) / (q - p->e2_2 * p->a2 * ct * ct * ct)) / DEG;
+        lon[i] = atan2(Y2, X2) / DEG;
+    }
+}
+
+void
+proj_apply(const struct proj *p, double *xy, size_t n) {
+    double x[PROJ_BLOCK], y[PROJ_BLOCK];
+    double sp[PROJ_BLOCK], cp[PROJ_BLOCK], sl[PROJ_BLOCK], cl[PROJ_BLOCK];  // 纬度、经度的正弦和余弦
+
+    while (n > 0) {
+        int m = n < PROJ_BLOCK ? n : PROJ_BLOCK;
+
+        for (int i = 0; i < m; i++) {  // 拆成两个数组
+            x[i] = xy[2 * i];
+            y[i] = xy[2 * i + 1];
+        }
+        if (p->gk) {
+            gk_inverse(p, x, y, sp, cp, sl, cl, m);
+        } else {
+            for (int i = 0; i < m; i++) {
+                sincos(y[i] * DEG, sp + i, cp + i);
+                sincos(x[i] * DEG, sl + i, cl + i);
+            }
+        }
+        helmert(p, sp, cp, sl, cl, x, y, m);
+        for (int i = 0; i < m; i++) {
+            xy[2 * i] = x[i];
+            xy[2 * i + 1] = y[i];
+        }
+        xy += 2 * m;
+        n -= m;
+    }
+}
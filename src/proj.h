@@ -0,0 +1,50 @@
+/*
+ * 坐标转换：高斯-克吕格投影反算和七参数（Helmert）基准转换
+ *
+ * 源坐标是北京1954（克拉索夫斯基椭球）下的高斯-克吕格投影坐标（米）或经纬度（度），
+ * 转成 WGS84（EPSG:4326）或 CGCS2000（EPSG:4490）的经纬度（度）
+ *
+ * 转换按批进行：交错存放的 x, y 先拆成两个数组（SoA），各步都是对数组的简单循环，
+ * 系数在 proj_init() 中算好，循环中没有分支
+ */
+#ifndef MAPGIS_PROJ_H
+#define MAPGIS_PROJ_H
+
+#include <stddef.h>
+
+#define PROJ_BLOCK 256  // 每次转换的点数
+
+/*
+ * 转换参数，proj_init() 之后只读，多线程可以共用
+ */
+struct proj {
+    int gk;  // 源坐标是高斯-克吕格投影坐标，否则是经纬度
+    double lon0;  // 中央经线，弧度
+    double sin_lon0, cos_lon0;
+    double false_easting;  // 东偏，米，带号在 x 中时包括带号 * 1000000
+    double k0A;  // 比例因子 * 子午线弧长的 A
+    double beta[3];  // 投影反算的 Krüger 级数系数
+    double delta[3];  // 共形纬度转大地纬度的级数系数
+    double a1, e2_1;  // 源椭球长半轴、第一偏心率平方
+    double a2, b2, e2_2, ep2_2;  // 目标椭球长半轴、短半轴、第一和第二偏心率平方
+    double t[3];  // 平移，米
+    double r[3];  // 旋转，弧度（位置矢量约定，与 PROJ 的 +towgs84 相同）
+    double s;  // 尺度变化，已加 1
+};
+
+/*
+ * 准备转换参数
+ *   - gk             源坐标是否为高斯-克吕格投影坐标
+ *   - lon0_deg       中央经线，度
+ *   - false_easting  东偏，米
+ *   - to_epsg        4326 或 4490
+ *   - towgs84        北京1954 到目标基准的七参数：dx, dy, dz（米），rx, ry, rz（秒），ds（ppm）
+ */
+void proj_init(struct proj *p, int gk, double lon0_deg, double false_easting, int to_epsg, const double towgs84[7]);
+
+/*
+ * 原地转换 n 个交错存放的点 x0, y0, x1, y1, ...，结果为经度、纬度（度）
+ */
+void proj_apply(const struct proj *p, double *xy, size_t n);
+
+#endif
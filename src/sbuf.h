@@ -0,0 +1,78 @@
+/*
+ * 可增长的字节缓冲区，编码要素时先写到这里
+ */
+#ifndef MAPGIS_SBUF_H
+#define MAPGIS_SBUF_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "numfmt.h"
+
+struct sbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/*
+ * 保证还能再放 n 个字节
+ */
+static inline void
+sbuf_reserve(struct sbuf *s, size_t n) {
+    if (s->len + n > s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 4096;
+
+        while (cap < s->len + n) {
+            cap *= 2;
+        }
+        s->data = realloc(s->data, cap);
+        if (!s->data) {
+            err(1, "realloc");
+        }
+        s->cap = cap;
+    }
+}
+
+static inline void
+sbuf_add(struct sbuf *s, const void *p, size_t n) {
+    sbuf_reserve(s, n);
+    memcpy(s->data + s->len, p, n);
+    s->len += n;
+}
+
+static inline void
+sbuf_addc(struct sbuf *s, char c) {
+    sbuf_reserve(s, 1);
+    s->data[s->len++] = c;
+}
+
+static inline void
+sbuf_adds(struct sbuf *s, const char *str) {
+    sbuf_add(s, str, strlen(str));
+}
+
+/*
+ * 追加一个数，prec 见 fmt_double()
+ */
+static inline void
+sbuf_add_double(struct sbuf *s, double d, int prec) {
+    sbuf_reserve(s, NUMFMT_MAX);
+    s->len += fmt_double(s->data + s->len, d, prec);
+}
+
+static inline void
+sbuf_add_long(struct sbuf *s, long v) {
+    sbuf_reserve(s, NUMFMT_MAX);
+    s->len += fmt_long(s->data + s->len, v);
+}
+
+static inline void
+sbuf_free(struct sbuf *s) {
+    free(s->data);
+    s->data = NULL;
+    s->len = s->cap = 0;
+}
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * ESRI Shapefile 输出，见 shp.h
+ *
+ * .shp、.shx 的文件头都是 100 字节，记录头和文件头的前 7 个整数是大端，其它都是小端；长度以 16 位字为单位
+ * .dbf 是 dBASE III：32 字节的文件头，每个字段 32 字节的描述，0x0D，然后是定长的记录，最后是 0x1A
+ */
+
+#define _GNU_SOURCE  // asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>  // bzero()
+#include <math.h>
+#include <time.h>
+#include <err.h>
+#include <unistd.h>
+
+#include "shp.h"
+#include "obuf.h"
+
+#define SHP_HEADER 100
+#define SHP_NULL 0
+#define SHP_POLYGON 5
+#define DBF_LDID_GBK 0x4D  // 代码页 936 的语言驱动号，不认识 .cpg 的软件用它
+
+struct shp_writer {
+    char *stem;  // 去掉 .shp 的文件名
+    struct obuf shp;
+    struct obuf shx;
+    struct obuf dbf;
+    int row_len;
+    long num_records;
+    double bbox[4];  // 所有记录的范围，还没有时 minx > maxx
+};
+
+/*
+ * GB18030 中从 s 开始的一个字符的字节数
+ */
+static int
+gb_char_len(const unsigned char *s, size_t n) {
+    if (s[0] < 0x80 || n < 2) {
+        return 1;
+    }
+    return s[1] >= 0x30 && s[1] <= 0x39 && n >= 4 ? 4 : 2;
+}
+
+/*
+ * s 的前 n 个字节中不超过 max 个字节的完整字符的字节数
+ */
+static size_t
+gb_prefix(const char *s, size_t n, size_t max) {
+    size_t k = 0;
+
+    while (k < n) {
+        int c = gb_char_len((const unsigned char *)s + k, n - k);
+
+        if (k + c > max) {
+            break;
+        }
+        k += c;
+    }
+    return k;
+}
+
+void
+dbf_set_name(struct dbf_field *fields, int k, const char *name) {
+    char *dst = fields[k].name;
+    size_t n = gb_prefix(name, strlen(name), DBF_NAME_LEN);
+
+    memcpy(dst, name, n);
+    dst[n] = 0;
+    for (int seq = 1;; seq++) {
+        int dup = 0;
+
+        for (int i = 0; i < k; i++) {
+            if (strcmp(fields[i].name, dst) == 0) {
+                dup = 1;
+                break;
+            }
+        }
+        if (!dup) {
+            return;
+        }
+
+        char suffix[16];
+        int m = snprintf(suffix, sizeof(suffix), "_%d", seq);
+
+        n = gb_prefix(name, strlen(name), DBF_NAME_LEN - m);
+        memcpy(dst, name, n);
+        memcpy(dst + n, suffix, m + 1);
+    }
+}
+
+int
+dbf_row_len(const struct dbf_field *fields, int n) {
+    int len = 1;  // 删除标志
+
+    for (int i = 0; i < n; i++) {
+        len += fields[i].width;
+    }
+    return len;
+}
+
+void
+dbf_string(char *dst, int width, const char *s, size_t n) {
+    size_t k = n > (size_t)width ? gb_prefix(s, n, width) : n;
+
+    memcpy(dst, s, k);
+    memset(dst + k, ' ', width - k);
+}
+
+void
+dbf_number(char *dst, int width, int decimals, double v) {
+    char buf[400];
+    int n = 0;
+
+    if (!isfinite(v)) {
+        memset(dst, ' ', width);
+        return;
+    }
+    for (int d = decimals; d >= 0; d--) {
+        n = snprintf(buf, sizeof(buf), "%.*f", d, v);
+        if (n <= width) {
+            break;
+        }
+    }
+    if (n > width) {
+        memset(dst, '*', width);
+        return;
+    }
+    memset(dst, ' ', width - n);
+    memcpy(dst + width - n, buf, n);
+}
+
+static void
+put_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+ * .shp、.shx 的文件头
+ *   - words  文件长度，16 位字
+ */
+static void
+shp_header(unsigned char *h, long words, const double *bbox) {
+    int32_t version = 1000, type = SHP_POLYGON;
+
+    bzero(h, SHP_HEADER);
+    put_be32(h, 9994);
+    put_be32(h + 24, (uint32_t)words);
+    memcpy(h + 28, &version, 4);
+    memcpy(h + 32, &type, 4);
+    memcpy(h + 36, bbox, 4 * sizeof(double));  // Z、M 的范围都是 0
+}
+
+/*
+ * 写一个小文件，写不了就退出
+ */
+static void
+write_small(const char *stem, const char *ext, const char *content) {
+    char *path;
+    FILE *f;
+
+    if (asprintf(&path, "%s.%s", stem, ext) == -1) {
+        err(1, "asprintf");
+    }
+    f = fopen(path, "w");
+    if (!f || fputs(content, f) == EOF || fclose(f) != 0) {
+        err(1, "写 %s 失败", path);
+    }
+    free(path);
+}
+
+static void
+open_part(struct obuf *b, const char *stem, const char *ext) {
+    char *path;
+
+    if (asprintf(&path, "%s.%s", stem, ext) == -1) {
+        err(1, "asprintf");
+    }
+    obuf_open(b, path, 0);
+    free(path);
+}
+
+struct shp_writer *
+shp_open(const char *path, const struct dbf_field *fields, int num_fields, const char *prj) {
+    struct shp_writer *w = calloc(1, sizeof(*w));
+    size_t n = strlen(path);
+    unsigned char h[SHP_HEADER];
+
+    w->stem = n > 4 && strcasecmp(path + n - 4, ".shp") == 0 ? strndup(path, n - 4) : strdup(path);
+    w->bbox[0] = w->bbox[1] = INFINITY;
+    w->bbox[2] = w->bbox[3] = -INFINITY;
+    open_part(&w->shp, w->stem, "shp");
+    open_part(&w->shx, w->stem, "shx");
+    open_part(&w->dbf, w->stem, "dbf");
+    write_small(w->stem, "cpg", "GB18030\n");
+    if (prj) {
+        write_small(w->stem, "prj", prj);
+    }
+
+    // 文件头先占位，关闭时改写
+    bzero(h, sizeof(h));
+    obuf_write(&w->shp, h, sizeof(h));
+    obuf_write(&w->shx, h, sizeof(h));
+
+    // .dbf 的文件头和字段描述，记录数关闭时改写
+    unsigned char dh[32], fd[32];
+    int header_len = 32 + 32 * num_fields + 1;
+    time_t t = time(NULL);
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    w->row_len = dbf_row_len(fields, num_fields);
+    bzero(dh, sizeof(dh));
+    dh[0] = 0x03;  // dBASE III，没有备注文件
+    dh[1] = tm.tm_year;
+    dh[2] = tm.tm_mon + 1;
+    dh[3] = tm.tm_mday;
+    dh[8] = header_len & 0xff;
+    dh[9] = header_len >> 8;
+    dh[10] = w->row_len & 0xff;
+    dh[11] = w->row_len >> 8;
+    dh[29] = DBF_LDID_GBK;
+    obuf_write(&w->dbf, dh, sizeof(dh));
+    for (int i = 0; i < num_fields; i++) {
+        bzero(fd, sizeof(fd));
+        memcpy(fd, fields[i].name, strlen(fields[i].name));
+        fd[11] = fields[i].type;
+        fd[16] = fields[i].width;
+        fd[17] = fields[i].decimals;
+        obuf_write(&w->dbf, fd, sizeof(fd));
+    }
+    obuf_write(&w->dbf, "\r", 1);
+    return w;
+}
+
+/*
+ * 环的有向面积的两倍，逆时针为正
+ */
+static double
+ring_area2(const double *xy, int n) {
+    double a = 0;
+
+    for (int k = 0; k < n; k++) {
+        int j = k + 1 < n ? k + 1 : 0;
+
+        a += xy[2 * k] * xy[2 * j + 1] - xy[2 * j] * xy[2 * k + 1];
+    }
+    return a;
+}
+
+void
+shp_polygon(struct sbuf *out, const double *xy, const int *ring_end, int num_rings, int first) {
+    int last = num_rings > 0 ? ring_end[num_rings - 1] : first;
+    int32_t v;
+
+    if (num_rings == 0) {
+        v = SHP_NULL;
+        sbuf_add(out, &v, sizeof(v));
+        return;
+    }
+
+    double bbox[4] = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+
+    for (int k = first; k < last; k++) {
+        bbox[0] = fmin(bbox[0], xy[2 * k]);
+        bbox[1] = fmin(bbox[1], xy[2 * k + 1]);
+        bbox[2] = fmax(bbox[2], xy[2 * k]);
+        bbox[3] = fmax(bbox[3], xy[2 * k + 1]);
+    }
+    v = SHP_POLYGON;
+    sbuf_add(out, &v, sizeof(v));
+    sbuf_add(out, bbox, sizeof(bbox));
+    v = num_rings;
+    sbuf_add(out, &v, sizeof(v));
+    v = last - first;
+    sbuf_add(out, &v, sizeof(v));
+    for (int r = 0; r < num_rings; r++) {
+        v = (r > 0 ? ring_end[r - 1] : first) - first;
+        sbuf_add(out, &v, sizeof(v));
+    }
+    for (int r = 0; r < num_rings; r++) {
+        int s = r > 0 ? ring_end[r - 1] : first, n = ring_end[r] - s;
+        double a = ring_area2(xy + 2 * s, n);
+
+        if ((r == 0) == (a > 0)) {  // 外环逆时针或洞顺时针，倒过来写
+            sbuf_reserve(out, (size_t)n * 2 * sizeof(double));
+            for (int k = s + n - 1; k >= s; k--) {
+                sbuf_add(out, xy + 2 * k, 2 * sizeof(double));
+            }
+        } else {
+            sbuf_add(out, xy + 2 * s, (size_t)n * 2 * sizeof(double));
+        }
+    }
+}
+
+void
+shp_write(struct shp_writer *w, const void *shape, size_t len, const char *row) {
+    unsigned char rh[8];
+    int32_t type;
+    long offset = obuf_size(&w->shp) / 2;
+
+    w->num_records++;
+    put_be32(rh, (uint32_t)w->num_records);
+    put_be32(rh + 4, (uint32_t)(len / 2));
+    obuf_write(&w->shp, rh, sizeof(rh));
+    obuf_write(&w->shp, shape, len);
+    put_be32(rh, (uint32_t)offset);
+    obuf_write(&w->shx, rh, sizeof(rh));
+    obuf_write(&w->dbf, row, w->row_len);
+
+    memcpy(&type, shape, sizeof(type));
+    if (type == SHP_POLYGON) {
+        double b[4];
+
+        memcpy(b, (const char *)shape + 4, sizeof(b));
+        w->bbox[0] = fmin(w->bbox[0], b[0]);
+        w->bbox[1] = fmin(w->bbox[1], b[1]);
+        w->bbox[2] = fmax(w->bbox[2], b[2]);
+        w->bbox[3] = fmax(w->bbox[3], b[3]);
+    }
+}
+
+/*
+ * 写出缓冲区后改写文件头中从 off 开始的 n 个字节，再关闭
+ */
+static void
+rewrite_close(struct obuf *b, off_t off, const void *p, size_t n) {
+    obuf_flush(b);
+    if (pwrite(b->fd, p, n, off) != (ssize_t)n) {
+        err(1, "改写 %s 的文件头失败", b->path);
+    }
+    obuf_close(b);
+}
+
+void
+shp_close(struct shp_writer *w) {
+    unsigned char h[SHP_HEADER];
+
+    if (w->num_records == 0 || !(w->bbox[0] <= w->bbox[2])) {  // 没有记录或全是空记录
+        bzero(w->bbox, sizeof(w->bbox));
+    }
+    shp_header(h, obuf_size(&w->shp) / 2, w->bbox);
+    rewrite_close(&w->shp, 0, h, sizeof(h));
+    shp_header(h, obuf_size(&w->shx) / 2, w->bbox);
+    rewrite_close(&w->shx, 0, h, sizeof(h));
+
+    unsigned char count[4];
+    uint32_t n = (uint32_t)w->num_records;
+
+    obuf_write(&w->dbf, "\x1a", 1);
+    memcpy(count, &n, sizeof(count));
+    rewrite_close(&w->dbf, 4, count, sizeof(count));
+    free(w->stem);
+    free(w);
+}
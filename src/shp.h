@@ -0,0 +1,73 @@
+/*
+ * ESRI Shapefile 输出：.shp、.shx、.dbf，以及说明字符串编码的 .cpg 和可选的 .prj
+ *
+ * 要素边来边写：.shp 的记录和 .shx 的索引项按顺序追加，.dbf 的记录是定长的，
+ * 文件头中的总长度、范围和记录数到关闭时才知道，那时再回头改写文件头
+ * 字符串属性不转换编码，原样写出 GB18030，.cpg 中写明
+ */
+#ifndef MAPGIS_SHP_H
+#define MAPGIS_SHP_H
+
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#define DBF_NAME_LEN 10  // dBASE 字段名最多 10 个字节
+
+/*
+ * .dbf 的一个字段
+ */
+struct dbf_field {
+    char name[DBF_NAME_LEN + 1];  // GB18030，以 0 结尾
+    char type;  // 'C' 字符串，'N' 数值
+    int width;  // 字节数，1 到 254
+    int decimals;  // 'N' 的小数位数
+};
+
+struct shp_writer;
+
+/*
+ * 给第 k 个字段起名：name（GB18030）太长时在字符边界上截断，与前面的字段重名时在后面加序号
+ */
+void dbf_set_name(struct dbf_field *fields, int k, const char *name);
+
+/*
+ * 各字段加上删除标志的总长度，即 .dbf 每个记录的字节数
+ */
+int dbf_row_len(const struct dbf_field *fields, int n);
+
+/*
+ * 把一个值写进记录中的字段位置 dst，占 width 个字节
+ * 字符串左对齐，太长时在字符边界上截断；数值右对齐，放不下时先减少小数位数，还放不下就填 *，不是有限数时为空
+ */
+void dbf_string(char *dst, int width, const char *s, size_t n);
+void dbf_number(char *dst, int width, int decimals, double v);
+
+/*
+ * 开始输出
+ *   - path    .shp 的文件名，其它文件把扩展名换掉，没有 .shp 扩展名时直接加上
+ *   - fields  .dbf 的字段，只在打开时用到
+ *   - prj     .prj 的内容（ESRI WKT），NULL 表示不写 .prj
+ * 出错时直接退出
+ */
+struct shp_writer *shp_open(const char *path, const struct dbf_field *fields, int num_fields, const char *prj);
+
+/*
+ * 编码一个多边形的 .shp 记录内容（不包括记录头），追加到 out 中。外环改成顺时针，洞改成逆时针，没有环时是空记录
+ *   - xy        交错存放的坐标
+ *   - ring_end  各环最后一点的下一个点在 xy 中的序号
+ *   - first     第一个环的第一点在 xy 中的序号
+ */
+void shp_polygon(struct sbuf *out, const double *xy, const int *ring_end, int num_rings, int first);
+
+/*
+ * 写出一个要素：shp_polygon() 编码好的记录内容和 dbf_row_len() 个字节的 .dbf 记录
+ */
+void shp_write(struct shp_writer *w, const void *shape, size_t len, const char *row);
+
+/*
+ * 改写各文件头，关闭输出
+ */
+void shp_close(struct shp_writer *w);
+
+#endif
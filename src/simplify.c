@@ -0,0 +1,134 @@
+/*
+ * 线的化简，见 simplify.h
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <err.h>
+
+#include "simplify.h"
+
+/*
+ * 点 p 到线段 ab 的距离的平方
+ */
+static double
+seg_dist2(const double *p, const double *a, const double *b) {
+    double dx = b[0] - a[0], dy = b[1] - a[1];
+    double ex = p[0] - a[0], ey = p[1] - a[1];
+    double len2 = dx * dx + dy * dy;
+
+    if (len2 > 0) {
+        double t = (ex * dx + ey * dy) / len2;
+
+        if (t >= 1) {
+            ex = p[0] - b[0];
+            ey = p[1] - b[1];
+        } else if (t > 0) {
+            ex -= t * dx;
+            ey -= t * dy;
+        }
+    }
+    return ex * ex + ey * ey;
+}
+
+/*
+ * (first, last) 之间离线段 first-last 最远的点，*d2 为距离的平方，没有中间点时返回 -1
+ */
+static int
+farthest(const double *xy, int first, int last, double *d2) {
+    int k = -1;
+
+    *d2 = -1;
+    for (int i = first + 1; i < last; i++) {
+        double d = seg_dist2(xy + 2 * i, xy + 2 * first, xy + 2 * last);
+
+        if (d > *d2) {
+            *d2 = d;
+            k = i;
+        }
+    }
+    return k;
+}
+
+/*
+ * 对区间 [first, last] 做容差为 0 的 Douglas-Peucker，记下各分点的重要性，用栈代替递归，很长的线也不会栈溢出
+ *   - cap 区间两端点的重要性中较小的那个，即分出本区间的那个点的重要性
+ * 栈中每项三个数：两端点和 cap 所在点的序号（-1 表示无穷大）
+ */
+static void
+dp_range(const double *xy, int first, int last, double *sig, struct simplify_scratch *s) {
+    int top = 0;
+
+    s->stack[top++] = first;
+    s->stack[top++] = last;
+    while (top > 0) {
+        int b = s->stack[--top], a = s->stack[--top];
+        double d2;
+        int k = farthest(xy, a, b, &d2);
+
+        if (k < 0) {
+            continue;
+        }
+        // 两端点中后分出来的那个的重要性较小，子区间中的点不能比它更重要
+        sig[k] = fmin(d2, fmin(sig[a], sig[b]));
+        s->stack[top++] = a;
+        s->stack[top++] = k;
+        s->stack[top++] = k;
+        s->stack[top++] = b;
+    }
+}
+
+void
+simplify_significance(const double *xy, int n, double *sig, struct simplify_scratch *s) {
+    if (n <= 0) {
+        return;
+    }
+    if (n > s->cap) {
+        free(s->stack);
+        s->cap = n;
+        s->stack = malloc(2 * n * sizeof(*s->stack));  // 栈中的区间互不重叠，不会超过 n 个
+        if (!s->stack) {
+            err(1, "malloc");
+        }
+    }
+    sig[0] = sig[n - 1] = INFINITY;
+    if (n <= 2) {
+        return;
+    }
+
+    const double *last = xy + 2 * (n - 1);
+
+    if (xy[0] == last[0] && xy[1] == last[1]) {  // 闭合线，两个端点重合，先从离端点最远的点分成两半
+        double d2, d2b, best = -1;
+        int f = -1;
+
+        for (int i = 1; i < n - 1; i++) {
+            double dx = xy[2 * i] - xy[0], dy = xy[2 * i + 1] - xy[1];
+
+            d2 = dx * dx + dy * dy;
+            if (d2 > best) {
+                best = d2;
+                f = i;
+            }
+        }
+        sig[f] = INFINITY;
+        // 两半中离线段最远的点中较远的那个也总要保留，免得只剩 3 个点成了退化的环
+        int k1 = farthest(xy, 0, f, &d2);
+        int k2 = farthest(xy, f, n - 1, &d2b);
+
+        dp_range(xy, 0, f, sig, s);
+        dp_range(xy, f, n - 1, sig, s);
+        if (k1 >= 0 || k2 >= 0) {
+            sig[k2 < 0 || (k1 >= 0 && d2 >= d2b) ? k1 : k2] = INFINITY;
+        }
+    } else {
+        dp_range(xy, 0, n - 1, sig, s);
+    }
+}
+
+void
+simplify_free(struct simplify_scratch *s) {
+    free(s->stack);
+    s->stack = NULL;
+    s->cap = 0;
+}
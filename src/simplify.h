@@ -0,0 +1,30 @@
+/*
+ * 线的化简（Douglas-Peucker）
+ *
+ * 在组装多边形之前对每条线（弧段）处理一次，线的两个端点不动，
+ * 相邻多边形共用的线化简结果是同一个，所以化简后多边形之间不会出现缝隙
+ *
+ * 不直接按容差化简，而是算出每个点的“重要性”：用容差 tol 做 Douglas-Peucker 时，
+ * 点被保留当且仅当它的重要性大于 tol 的平方。这样一遍就能得到任意多个容差的化简结果
+ */
+#ifndef MAPGIS_SIMPLIFY_H
+#define MAPGIS_SIMPLIFY_H
+
+/*
+ * 化简用的临时空间，每个线程一个，用完 simplify_free()
+ */
+struct simplify_scratch {
+    int *stack;  // 待处理的区间
+    int cap;
+};
+
+/*
+ * 算出 n 个交错存放的点 x0, y0, x1, y1, ... 的重要性，即被分出来时到所在线段的距离的平方，
+ * 再与上一级分点的重要性取小，两个端点为无穷大
+ * 首尾相同的闭合线另有两个点为无穷大，至少保留 4 个点，不会化简成退化的环
+ */
+void simplify_significance(const double *xy, int n, double *sig, struct simplify_scratch *s);
+
+void simplify_free(struct simplify_scratch *s);
+
+#endif
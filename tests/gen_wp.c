@@ -0,0 +1,285 @@
+/*
+ * 生成测试用的 MapGIS .WP 面文件：nx * ny 个网格多边形，相邻的共用弧段，部分带洞，
+ * 属性有整数、双精度、单精度和两个字符串（GB18030）
+ *
+ * 用法：gen_wp NX NY 输出文件
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+#include <iconv.h>
+
+#define NPTS 4  // 每条网格边的点数
+#define X0 37500000.0
+#define Y0 3300000.0
+#define CELL 1000.0
+#define ROW_SIZE 47  // 属性行：1 字节开头，4 + 8 + 4 + 20 + 10
+
+struct buf {
+    unsigned char *p;
+    size_t len, cap;
+};
+
+static void
+put(struct buf *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->p = realloc(b->p, b->cap);
+        if (!b->p) {
+            err(1, "realloc");
+        }
+    }
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+}
+
+static void
+put_zero(struct buf *b, size_t n) {
+    static const char zero[512];
+
+    while (n > 0) {
+        size_t k = n < sizeof(zero) ? n : sizeof(zero);
+
+        put(b, zero, k);
+        n -= k;
+    }
+}
+
+// 下面都按小端写，测试只在小端机器上跑
+static void
+put_u8(struct buf *b, uint8_t v) {
+    put(b, &v, 1);
+}
+
+static void
+put_i16(struct buf *b, int16_t v) {
+    put(b, &v, 2);
+}
+
+static void
+put_i32(struct buf *b, int32_t v) {
+    put(b, &v, 4);
+}
+
+static void
+put_f32(struct buf *b, float v) {
+    put(b, &v, 4);
+}
+
+static void
+put_f64(struct buf *b, double v) {
+    put(b, &v, 8);
+}
+
+/*
+ * UTF-8 转成 GB18030，补 0 到 n 字节
+ */
+static void
+put_gb(struct buf *b, const char *s, size_t n) {
+    char out[64] = {0};
+    char *in = (char *)s, *o = out;
+    size_t il = strlen(s), ol = sizeof(out) - 1;
+    iconv_t icv = iconv_open("GB18030", "UTF-8");
+
+    if (icv == (iconv_t)-1 || iconv(icv, &in, &il, &o, &ol) == (size_t)-1) {
+        err(1, "iconv");
+    }
+    iconv_close(icv);
+    if ((size_t)(o - out) >= n) {
+        errx(1, "%s 太长", s);
+    }
+    put(b, out, n);
+}
+
+static struct buf coords;  // 区 1：线坐标和多边形的线号表
+static struct buf linfo;  // 区 0：线信息
+static int num_lines;
+
+/*
+ * 加一条线，中间的点左右摆动，返回线号（从 1 开始）
+ */
+static int
+add_line(const double (*pts)[2], int n) {
+    put_i32(&linfo, 0);
+    put_i32(&linfo, 0);
+    put_i32(&linfo, n);
+    put_i32(&linfo, coords.len);
+    put_i32(&linfo, 0);
+    put_i16(&linfo, 1);
+    put_u8(&linfo, 0);
+    put_u8(&linfo, 0);
+    put_i32(&linfo, 3);
+    put_f32(&linfo, 0.1);
+    put_u8(&linfo, 0);
+    put_f32(&linfo, 1);
+    put_f32(&linfo, 1);
+    put_i32(&linfo, 0);
+    put_i32(&linfo, num_lines % 3);
+    put_i32(&linfo, 0);
+    put_i32(&linfo, 0);  // 共 57 字节
+    for (int i = 0; i < n; i++) {
+        put_f64(&coords, pts[i][0]);
+        put_f64(&coords, pts[i][1]);
+    }
+    return ++num_lines;
+}
+
+static int
+add_edge(int i0, int j0, int i1, int j1) {
+    double pts[NPTS][2];
+
+    for (int k = 0; k < NPTS; k++) {
+        double t = (double)k / (NPTS - 1);
+        double w = k == 0 || k == NPTS - 1 ? 0 : sin(t * M_PI * 3) * CELL * 0.02;
+
+        pts[k][0] = X0 + (i0 + (i1 - i0) * t) * CELL + (i0 == i1 ? w : 0);
+        pts[k][1] = Y0 + (j0 + (j1 - j0) * t) * CELL + (i0 == i1 ? 0 : w);
+    }
+    return add_line(pts, NPTS);
+}
+
+int
+main(int argc, char **argv) {
+    static const char *names[] = {"林地", "草地", "水域", "耕地", "建设用地"};
+    static const char *attr_names[] = {"ID", "面积", "周长", "名称", "代号"};
+    static const int attr_types[] = {3, 5, 4, 0, 0}, attr_sizes[] = {4, 8, 4, 20, 10};
+    struct buf pinfo = {0}, pattr = {0}, out = {0};
+    struct buf *regions[16] = {0};
+    int nx, ny, np, *h, *v, (*ents)[7], *num_ents;
+    FILE *f;
+
+    if (argc != 4 || (nx = atoi(argv[1])) <= 0 || (ny = atoi(argv[2])) <= 0) {
+        errx(1, "用法：gen_wp NX NY 输出文件");
+    }
+    np = nx * ny;
+    h = malloc((nx + 1) * (ny + 1) * sizeof(*h));
+    v = malloc((nx + 1) * (ny + 1) * sizeof(*v));
+    ents = malloc(np * sizeof(*ents));
+    num_ents = malloc(np * sizeof(*num_ents));
+    if (!h || !v || !ents || !num_ents) {
+        err(1, "malloc");
+    }
+    put_zero(&linfo, 59);
+    for (int j = 0; j <= ny; j++) {  // 横边
+        for (int i = 0; i < nx; i++) {
+            h[j * (nx + 1) + i] = add_edge(i, j, i + 1, j);
+        }
+    }
+    for (int j = 0; j < ny; j++) {  // 竖边
+        for (int i = 0; i <= nx; i++) {
+            v[j * (nx + 1) + i] = add_edge(i, j, i, j + 1);
+        }
+    }
+    for (int j = 0, k = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++, k++) {
+            int *e = ents[k], n = 0;
+
+            e[n++] = h[j * (nx + 1) + i];
+            e[n++] = v[j * (nx + 1) + i + 1];
+            e[n++] = -h[(j + 1) * (nx + 1) + i];
+            e[n++] = -v[j * (nx + 1) + i];
+            if ((i + j) % 5 == 0) {  // 带个洞
+                double x = X0 + i * CELL, y = Y0 + j * CELL;
+                double hole[5][2] = {{x + 300, y + 300}, {x + 300, y + 600}, {x + 600, y + 600}, {x + 600, y + 300},
+                        {x + 300, y + 300}};
+
+                e[n++] = 0;
+                e[n++] = add_line(hole, 5);
+            }
+            num_ents[k] = n;
+        }
+    }
+    put_zero(&linfo, 8);
+
+    put_zero(&pinfo, 40);  // 第一个是哑元
+    for (int k = 0; k < np; k++) {
+        put_u8(&pinfo, 1);
+        put_i32(&pinfo, num_ents[k] + 1);
+        put_i32(&pinfo, coords.len);
+        put_i32(&pinfo, 1 + k * 7 % 500);
+        put_i16(&pinfo, 0);
+        put_f32(&pinfo, 1);
+        put_f32(&pinfo, 1);
+        put_i16(&pinfo, 1);
+        put_i32(&pinfo, 0);
+        put_u8(&pinfo, 0);
+        put_i16(&pinfo, k % 4);
+        put_i32(&pinfo, 0);
+        put_i32(&pinfo, 0);  // 共 40 字节
+        put_i32(&coords, 0);
+        for (int i = 0; i < num_ents[k]; i++) {
+            put_i32(&coords, ents[k][i]);
+        }
+    }
+
+    put_zero(&pattr, 12);  // 属性头 348 字节，然后各属性定义 39 字节，然后缺省值行和各行
+    put_i32(&pattr, 348 + 5 * 39);
+    put_zero(&pattr, 306);
+    put_i16(&pattr, 5);
+    put_i32(&pattr, 0);
+    put_i32(&pattr, ROW_SIZE);
+    put_zero(&pattr, 16);
+    for (int a = 0, off = 1; a < 5; off += attr_sizes[a], a++) {
+        put_gb(&pattr, attr_names[a], 20);
+        put_u8(&pattr, attr_types[a]);
+        put_i32(&pattr, off);
+        put_i16(&pattr, attr_sizes[a]);
+        put_i16(&pattr, 10);
+        put_u8(&pattr, attr_types[a] == 4 || attr_types[a] == 5 ? 3 : 0);
+        put(&pattr, "\1\0\0", 3);
+        put_i32(&pattr, a);
+        put_i16(&pattr, 0);
+    }
+    put_zero(&pattr, ROW_SIZE);
+    for (int k = 0; k < np; k++) {
+        char name[32], code[16];
+
+        snprintf(name, sizeof(name), "%s%d", names[k % 5], k);
+        snprintf(code, sizeof(code), "D%d", k % 13);
+        put_u8(&pattr, 0);
+        put_i32(&pattr, k % 3 == 2 ? -(k + 1) : k + 1);
+        put_f64(&pattr, CELL * CELL * (1 + (k % 10) / 10.0) + 0.1);
+        put_f32(&pattr, 4 * CELL + k % 7 + 0.3);
+        put_gb(&pattr, name, 20);
+        put_gb(&pattr, code, 10);
+    }
+
+    regions[0] = &linfo;
+    regions[1] = &coords;
+    regions[8] = &pinfo;
+    regions[9] = &pattr;
+    put(&out, "WMAP`D23", 8);  // 文件头 336 字节
+    put_i32(&out, 2);
+    put_i32(&out, 336);
+    put_i32(&out, 16);
+    put_zero(&out, 240);
+    put_i32(&out, num_lines);
+    put_zero(&out, 12);
+    put_i32(&out, np);
+    put_zero(&out, 24);
+    put_f64(&out, X0);
+    put_f64(&out, Y0);
+    put_f64(&out, X0 + nx * CELL);
+    put_f64(&out, Y0 + ny * CELL);
+    for (int i = 0, pos = 336 + 16 * 10; i < 16; i++) {  // 数据区头，各区依次紧接着放
+        put_i32(&out, regions[i] ? pos : 0);
+        put_i32(&out, regions[i] ? (int)regions[i]->len : 0);
+        put_i16(&out, -1);
+        pos += regions[i] ? regions[i]->len : 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        if (regions[i]) {
+            put(&out, regions[i]->p, regions[i]->len);
+        }
+    }
+
+    f = fopen(argv[3], "wb");
+    if (!f || fwrite(out.p, 1, out.len, f) != out.len || fclose(f) != 0) {
+        err(1, "写 %s 失败", argv[3]);
+    }
+    return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * 读回 --format pgcopy 的输出，与同一文件的 GeoJSON 输出逐项对照：
+ * 文件头和结尾、元组数、按 .sql 建表语句中的类型解出的各字段值、EWKB 中的 SRID 和各环坐标
+ * 有不符的就报出第几个元组并返回 1
+ *
+ * 用法：pgcopy_read 输出.pgcopy 建表语句.sql 输出.geojson
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <err.h>
+#include <endian.h>
+
+#include "cJSON.h"
+
+#define MAX_COLS 256
+
+enum col_type { COL_INT4, COL_FLOAT4, COL_FLOAT8, COL_TEXT, COL_GEOM };
+
+struct col {
+    char name[128];
+    enum col_type type;
+};
+
+static struct col cols[MAX_COLS];
+static int num_cols;
+static int srid;  // geometry(Polygon, N) 中的 N，0 表示没写
+static int tuple_no;  // 正在对照的元组，从 1 开始，报错用
+
+static char *
+read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    char *p;
+    long n;
+
+    if (!f || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        err(1, "打开 %s 失败", path);
+    }
+    p = malloc(n + 1);
+    if (!p || fread(p, 1, n, f) != (size_t)n) {
+        err(1, "读 %s 失败", path);
+    }
+    fclose(f);
+    p[n] = 0;
+    *len = n;
+    return p;
+}
+
+/*
+ * 从建表语句中取出各列的名字和类型，每列一行：    "名字" 类型,
+ */
+static void
+parse_ddl(const char *ddl) {
+    for (const char *line = strchr(ddl, '\n'); line; line = strchr(line, '\n')) {
+        const char *p = ++line, *q;
+        struct col *c;
+
+        while (*p == ' ') {
+            p++;
+        }
+        if (*p == ')' || *p == '-' || !*p) {
+            continue;
+        }
+        if (num_cols == MAX_COLS) {
+            errx(1, "列太多");
+        }
+        c = cols + num_cols++;
+        if (*p == '"') {
+            q = strchr(++p, '"');
+        } else {
+            q = strchr(p, ' ');
+        }
+        if (!q || (size_t)(q - p) >= sizeof(c->name)) {
+            errx(1, "建表语句格式不对：%.40s", line);
+        }
+        memcpy(c->name, p, q - p);
+        c->name[q - p] = 0;
+        p = q + (*q == '"') + 1;
+        if (strncmp(p, "integer", 7) == 0) {
+            c->type = COL_INT4;
+        } else if (strncmp(p, "real", 4) == 0) {
+            c->type = COL_FLOAT4;
+        } else if (strncmp(p, "double precision", 16) == 0) {
+            c->type = COL_FLOAT8;
+        } else if (strncmp(p, "text", 4) == 0) {
+            c->type = COL_TEXT;
+        } else if (strncmp(p, "geometry(Polygon", 16) == 0) {
+            c->type = COL_GEOM;
+            srid = p[16] == ',' ? atoi(p + 17) : 0;
+        } else {
+            errx(1, "不认识列 %s 的类型：%.20s", c->name, p);
+        }
+    }
+    if (num_cols == 0 || cols[num_cols - 1].type != COL_GEOM) {
+        errx(1, "建表语句中最后一列应当是几何");
+    }
+}
+
+/*
+ * 按顺序从输出中取字节，越界就报错
+ */
+struct reader {
+    const unsigned char *p, *end;
+};
+
+static const unsigned char *
+take(struct reader *r, size_t n) {
+    const unsigned char *p = r->p;
+
+    if ((size_t)(r->end - r->p) < n) {
+        errx(1, "元组 %d：数据不完整", tuple_no);
+    }
+    r->p += n;
+    return p;
+}
+
+static int16_t
+be16(struct reader *r) {
+    uint16_t v;
+
+    memcpy(&v, take(r, 2), 2);
+    return (int16_t)be16toh(v);
+}
+
+static int32_t
+be32(struct reader *r) {
+    uint32_t v;
+
+    memcpy(&v, take(r, 4), 4);
+    return (int32_t)be32toh(v);
+}
+
+static uint32_t
+le32(struct reader *r) {
+    uint32_t v;
+
+    memcpy(&v, take(r, 4), 4);
+    return le32toh(v);
+}
+
+static double
+le_double(struct reader *r) {
+    double v;
+
+    memcpy(&v, take(r, 8), 8);  // 测试只在小端机器上跑
+    return v;
+}
+
+/*
+ * GeoJSON 中的数可能是在 DBL_EPSILON 之内的较短写法，不要求完全相等
+ */
+static int
+same_double(double a, double b) {
+    return a == b || fabs(a - b) <= 2 * DBL_EPSILON * fabs(b);
+}
+
+static void
+check_value(struct reader *r, const struct col *c, int len, const cJSON *v) {
+    if (len == -1) {
+        if (!cJSON_IsNull(v)) {
+            errx(1, "元组 %d：%s 是 NULL，GeoJSON 中不是", tuple_no, c->name);
+        }
+        return;
+    }
+    switch (c->type) {
+    case COL_INT4:
+        if (len != 4 || !cJSON_IsNumber(v) || be32(r) != v->valuedouble) {
+            errx(1, "元组 %d：整数 %s 不符", tuple_no, c->name);
+        }
+        break;
+    case COL_FLOAT4: {
+        int32_t bits;
+        float f;
+
+        if (len != 4 || !cJSON_IsNumber(v)) {
+            errx(1, "元组 %d：单精度 %s 不符", tuple_no, c->name);
+        }
+        bits = be32(r);
+        memcpy(&f, &bits, sizeof(f));
+        if (f != (float)v->valuedouble) {
+            errx(1, "元组 %d：单精度 %s 是 %.9g，GeoJSON 中是 %.17g", tuple_no, c->name, f, v->valuedouble);
+        }
+        break;
+    }
+    case COL_FLOAT8: {
+        uint64_t bits;
+        double d;
+
+        if (len != 8 || !cJSON_IsNumber(v)) {
+            errx(1, "元组 %d：双精度 %s 不符", tuple_no, c->name);
+        }
+        memcpy(&bits, take(r, 8), 8);
+        bits = be64toh(bits);
+        memcpy(&d, &bits, sizeof(d));
+        if (!same_double(d, v->valuedouble)) {
+            errx(1, "元组 %d：双精度 %s 是 %.17g，GeoJSON 中是 %.17g", tuple_no, c->name, d, v->valuedouble);
+        }
+        break;
+    }
+    case COL_TEXT:
+        if (!cJSON_IsString(v) || strlen(v->valuestring) != (size_t)len ||
+                memcmp(take(r, len), v->valuestring, len) != 0) {
+            errx(1, "元组 %d：文本 %s 不符", tuple_no, c->name);
+        }
+        break;
+    case COL_GEOM:
+        break;
+    }
+}
+
+/*
+ * 对照 EWKB 多边形和 GeoJSON 的 coordinates
+ */
+static void
+check_polygon(struct reader *r, int len, const cJSON *geom) {
+    const unsigned char *end = r->p + len;
+    const cJSON *coords = cJSON_GetObjectItemCaseSensitive(geom, "coordinates");
+    const cJSON *ring;
+    uint32_t type, num_rings;
+
+    if (len < 9 || !cJSON_IsArray(coords)) {
+        errx(1, "元组 %d：几何不符", tuple_no);
+    }
+    if (*take(r, 1) != 1) {
+        errx(1, "元组 %d：EWKB 不是小端", tuple_no);
+    }
+    type = le32(r);
+    if ((type & 0xff) != 3 || !(type & 0x20000000) != !srid || (srid && (int)le32(r) != srid)) {
+        errx(1, "元组 %d：EWKB 类型或 SRID 不符", tuple_no);
+    }
+    num_rings = le32(r);
+    if (num_rings != (uint32_t)cJSON_GetArraySize(coords)) {
+        errx(1, "元组 %d：环数 %u，GeoJSON 中 %d 个", tuple_no, num_rings, cJSON_GetArraySize(coords));
+    }
+    ring = coords->child;
+    for (uint32_t k = 0; k < num_rings; k++, ring = ring->next) {
+        uint32_t n = le32(r);
+        const cJSON *pt = ring->child;
+
+        if (n != (uint32_t)cJSON_GetArraySize(ring)) {
+            errx(1, "元组 %d：第 %u 个环 %u 点，GeoJSON 中 %d 点", tuple_no, k, n, cJSON_GetArraySize(ring));
+        }
+        for (uint32_t i = 0; i < n; i++, pt = pt->next) {
+            double x = le_double(r), y = le_double(r);
+
+            if (cJSON_GetArraySize(pt) != 2 || !same_double(x, pt->child->valuedouble) ||
+                    !same_double(y, pt->child->next->valuedouble)) {
+                errx(1, "元组 %d：第 %u 个环第 %u 点不符", tuple_no, k, i);
+            }
+        }
+    }
+    if (r->p != end) {
+        errx(1, "元组 %d：EWKB 长度不符", tuple_no);
+    }
+}
+
+int
+main(int argc, char **argv) {
+    static const unsigned char sig[11] = "PGCOPY\n\377\r\n";
+    size_t len, ddl_len, json_len;
+    char *data, *ddl, *json;
+    const cJSON *features, *f;
+    cJSON *root;
+    struct reader r;
+
+    if (argc != 4) {
+        errx(1, "用法：pgcopy_read 输出.pgcopy 建表语句.sql 输出.geojson");
+    }
+    data = read_file(argv[1], &len);
+    ddl = read_file(argv[2], &ddl_len);
+    json = read_file(argv[3], &json_len);
+    parse_ddl(ddl);
+    root = cJSON_Parse(json);
+    features = cJSON_GetObjectItemCaseSensitive(root, "features");
+    if (!cJSON_IsArray(features)) {
+        errx(1, "%s 不是 GeoJSON", argv[3]);
+    }
+
+    r.p = (const unsigned char *)data;
+    r.end = r.p + len;
+    if (memcmp(take(&r, sizeof(sig)), sig, sizeof(sig)) != 0 || be32(&r) != 0 || be32(&r) != 0) {
+        errx(1, "%s 的文件头不对", argv[1]);
+    }
+    f = features->child;
+    for (;;) {
+        int n = be16(&r);
+        const cJSON *props, *v;
+
+        if (n == -1) {
+            break;
+        }
+        tuple_no++;
+        if (!f) {
+            errx(1, "元组比 GeoJSON 中的要素多");
+        }
+        if (n != num_cols) {
+            errx(1, "元组 %d：%d 个字段，建表语句中 %d 列", tuple_no, n, num_cols);
+        }
+        props = cJSON_GetObjectItemCaseSensitive(f, "properties");
+        v = props ? props->child : NULL;
+        for (int i = 0; i < num_cols - 1; i++, v = v->next) {
+            if (!v || strcmp(v->string, cols[i].name) != 0) {
+                errx(1, "元组 %d：第 %d 列 %s 在 GeoJSON 中没有", tuple_no, i, cols[i].name);
+            }
+            check_value(&r, cols + i, be32(&r), v);
+        }
+        if (v) {
+            errx(1, "元组 %d：GeoJSON 中的属性比建表语句多", tuple_no);
+        }
+        check_polygon(&r, be32(&r), cJSON_GetObjectItemCaseSensitive(f, "geometry"));
+        f = f->next;
+    }
+    if (f) {
+        errx(1, "元组只有 %d 个，比 GeoJSON 中的要素少", tuple_no);
+    }
+    if (r.p != r.end) {
+        errx(1, "结尾后还有 %zu 字节", (size_t)(r.end - r.p));
+    }
+    printf("%s: %d 个元组与 %s 相符\n", argv[1], tuple_no, argv[3]);
+    cJSON_Delete(root);
+    free(data);
+    free(ddl);
+    free(json);
+    return 0;
+}